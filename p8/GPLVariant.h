@@ -40,6 +40,10 @@ public:
 
 	bool is_initialized() const;
 
+	// where an int or a double is kept (they share it), for code that
+	// reads and writes it directly (see jit.h)
+	void* get_address() { return &_val_int; };
+
 private:
 	bool _binit; 
 	Gpl_type _type;
@@ -36,6 +36,7 @@ void Animation_block::execute(const std::shared_ptr<Game_object>& argument)
 	//std::lock_guard<std::mutex> lock(_mutex);	
 	//std::cout << "Animation_block::execute - There are " << get_count() << " statements.\n";
 	m_parameter_symbol->set_game_object(argument);
+	Random_scope random_scope(argument->random_stream());
 
 	/*if(_pExecuteThread)
 	{
@@ -53,10 +54,15 @@ void Animation_block::execute()
 	try
 	{
 		_bRunning = true;
-		int count = get_count();
-		for(int i = 0; i < count; i++)
+		if(!run_native(false))
 		{
-			get_statement(i)->execute();
+			begin_run();
+			int count = get_count();
+			for(int i = 0; i < count; i++)
+			{
+				Error::set_runtime_line(get_statement(i)->get_line());
+				get_statement(i)->execute();
+			}
 		}
 	}
 	catch(...)
@@ -0,0 +1,203 @@
+#include "batch_renderer.h"
+#include "geometry_cache.h"
+#include "gpl_assert.h"
+#include "interpreter_context.h"
+using namespace std;
+
+/* static */ Batch_renderer *Batch_renderer::instance()
+{
+  return &Interpreter_context::current()->get_batch_renderer();
+}
+
+Batch_renderer::Batch_renderer()
+{
+  m_enabled = false;
+  set_color(1, 1, 1);
+  m_atlas_texture = 0;
+  m_shelf_x = 0;
+  m_shelf_y = 0;
+  m_shelf_height = 0;
+}
+
+void Batch_renderer::set_color(double red, double green, double blue)
+{
+  m_color[0] = (GLubyte) (red * 255 + 0.5);
+  m_color[1] = (GLubyte) (green * 255 + 0.5);
+  m_color[2] = (GLubyte) (blue * 255 + 0.5);
+  m_color[3] = 255;
+}
+
+void Batch_renderer::add_vertex(double x, double y)
+{
+  Colored_vertex vertex;
+  vertex.x = (GLfloat) x;
+  vertex.y = (GLfloat) y;
+  for (int i = 0; i < 4; i++)
+    vertex.color[i] = m_color[i];
+  m_colored.push_back(vertex);
+}
+
+void Batch_renderer::add_textured_vertex(double x, double y,
+                                         GLfloat u, GLfloat v)
+{
+  Textured_vertex vertex;
+  vertex.x = (GLfloat) x;
+  vertex.y = (GLfloat) y;
+  vertex.u = u;
+  vertex.v = v;
+  m_textured.push_back(vertex);
+}
+
+void Batch_renderer::add_polygon(int count, const double *xs, const double *ys)
+{
+  assert(count == 3 || count == 4);
+
+  // keep the drawing order: the images before this go first
+  if (!m_textured.empty())
+    flush_textured();
+
+  // a fan of triangles around the first vertex
+  for (int i = 1; i + 1 < count; i++)
+  {
+    add_vertex(xs[0], ys[0]);
+    add_vertex(xs[i], ys[i]);
+    add_vertex(xs[i + 1], ys[i + 1]);
+  }
+}
+
+void Batch_renderer::add_disk(double center_x, double center_y,
+                              double radius, int lod)
+{
+  if (!m_textured.empty())
+    flush_textured();
+
+  int slices = Geometry_cache::disk_slices(lod);
+  const double *points = Geometry_cache::disk_points(lod);
+  for (int i = 0; i < slices; i++)
+  {
+    add_vertex(center_x, center_y);
+    add_vertex(center_x + radius * points[2*i],
+               center_y + radius * points[2*i + 1]);
+    add_vertex(center_x + radius * points[2*i + 2],
+               center_y + radius * points[2*i + 3]);
+  }
+}
+
+bool Batch_renderer::add_image(const void *key, int width, int height,
+                               const unsigned char *data, int x, int y)
+{
+  const Atlas_entry *entry = find_in_atlas(key, width, height, data);
+  if (!entry)
+    return false;
+
+  if (!m_colored.empty())
+    flush_colored();
+
+  add_textured_vertex(x, y, entry->u0, entry->v0);
+  add_textured_vertex(x + width, y, entry->u1, entry->v0);
+  add_textured_vertex(x + width, y + height, entry->u1, entry->v1);
+  add_textured_vertex(x, y + height, entry->u0, entry->v1);
+  return true;
+}
+
+const Batch_renderer::Atlas_entry *
+Batch_renderer::find_in_atlas(const void *key, int width, int height,
+                              const unsigned char *data)
+{
+  map<const void *, Atlas_entry>::const_iterator iter;
+  iter = m_atlas_entries.find(key);
+  if (iter != m_atlas_entries.end())
+    return &(*iter).second;
+
+  // leave a pixel between images so they don't bleed into each other
+  int padded_width = width + 1;
+  int padded_height = height + 1;
+  if (padded_width > ATLAS_SIZE || padded_height > ATLAS_SIZE)
+    return 0;
+
+  // start a new shelf if the image does not fit on this one
+  if (m_shelf_x + padded_width > ATLAS_SIZE)
+  {
+    m_shelf_y += m_shelf_height;
+    m_shelf_x = 0;
+    m_shelf_height = 0;
+  }
+  if (m_shelf_y + padded_height > ATLAS_SIZE)
+    return 0;
+
+  if (!m_atlas_texture)
+  {
+    glGenTextures(1, &m_atlas_texture);
+    glBindTexture(GL_TEXTURE_2D, m_atlas_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_SIZE, ATLAS_SIZE, 0,
+                 GL_BGRA, GL_UNSIGNED_BYTE, 0);
+  }
+
+  // rows of 4 byte pixels are always 4 byte aligned
+  glBindTexture(GL_TEXTURE_2D, m_atlas_texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, (GLint) 4);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, m_shelf_x, m_shelf_y, width, height,
+                  GL_BGRA, GL_UNSIGNED_BYTE, data);
+
+  Atlas_entry entry;
+  entry.u0 = (GLfloat) m_shelf_x / ATLAS_SIZE;
+  entry.v0 = (GLfloat) m_shelf_y / ATLAS_SIZE;
+  entry.u1 = (GLfloat) (m_shelf_x + width) / ATLAS_SIZE;
+  entry.v1 = (GLfloat) (m_shelf_y + height) / ATLAS_SIZE;
+
+  m_shelf_x += padded_width;
+  if (padded_height > m_shelf_height)
+    m_shelf_height = padded_height;
+
+  return &(m_atlas_entries[key] = entry);
+}
+
+void Batch_renderer::flush()
+{
+  if (!m_colored.empty())
+    flush_colored();
+  if (!m_textured.empty())
+    flush_textured();
+}
+
+void Batch_renderer::flush_colored()
+{
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(Colored_vertex), &m_colored[0].x);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Colored_vertex),
+                 m_colored[0].color);
+
+  glDrawArrays(GL_TRIANGLES, 0, (GLsizei) m_colored.size());
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  m_colored.clear();
+}
+
+void Batch_renderer::flush_textured()
+{
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, m_atlas_texture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  // the transparent pixels have an alpha of 0
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(Textured_vertex), &m_textured[0].x);
+  glTexCoordPointer(2, GL_FLOAT, sizeof(Textured_vertex), &m_textured[0].u);
+
+  glDrawArrays(GL_QUADS, 0, (GLsizei) m_textured.size());
+
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisable(GL_TEXTURE_2D);
+  m_textured.clear();
+}
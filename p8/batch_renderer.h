@@ -0,0 +1,122 @@
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+/****
+
+  Batch_renderer draws many objects with a few OpenGL calls
+  (gpl -batch_draw).
+
+  Normally each object is drawn by calling its display list inside its
+  own glPushMatrix()/glPopMatrix().  With thousands of small objects the
+  cost of those calls is larger than the cost of the drawing.  In batched
+  mode, Game_object::draw_all_game_objects() asks each object to add
+  itself to the batch instead (Game_object::append_to_batch()):
+
+    Rectangle, Triangle, Circle   colored triangles, in world coordinates,
+                                  appended to one vertex array
+    Pixmap                        a textured quad; the image is copied
+                                  once into a shared texture (the atlas)
+
+  The vertices are sent with glDrawArrays() when the kind of vertex
+  changes (colored <-> textured), when an object that can't be batched
+  (e.g. a Textbox) has to be drawn the old way, and at the end of the
+  frame.  Objects are still drawn in drawing order.
+
+  An image that does not fit into what is left of the atlas is drawn the
+  old way.
+
+****/
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+#include <map>
+#include <vector>
+
+class Batch_renderer
+{
+  public:
+    // the batch renderer of the current Interpreter_context
+    static Batch_renderer *instance();
+
+    static const int ATLAS_SIZE = 1024;
+
+    void set_enabled(bool enabled) {m_enabled = enabled;}
+    bool enabled() const {return m_enabled;}
+
+    // the color of the shapes added after this
+    void set_color(double red, double green, double blue);
+
+    // a convex polygon of 3 or 4 vertices
+    void add_polygon(int count, const double *xs, const double *ys);
+
+    // a disk with the tessellation of Geometry_cache::disk(lod)
+    void add_disk(double center_x, double center_y, double radius, int lod);
+
+    // an image of width * height BGRA pixels (bottom row first) with its
+    // lower left corner at (x, y).  key identifies the image, it is only
+    // copied into the atlas the first time.  Returns false if the image
+    // does not fit into the atlas (nothing is added)
+    bool add_image(const void *key, int width, int height,
+                   const unsigned char *data, int x, int y);
+
+    // draws everything added since the last flush()
+    void flush();
+
+  private:
+    Batch_renderer();
+
+    struct Colored_vertex
+    {
+      GLfloat x, y;
+      GLubyte color[4];
+    };
+
+    struct Textured_vertex
+    {
+      GLfloat x, y;
+      GLfloat u, v;
+    };
+
+    // where an image is in the atlas, in texture coordinates
+    struct Atlas_entry
+    {
+      GLfloat u0, v0, u1, v1;
+    };
+
+    void add_vertex(double x, double y);
+    void add_textured_vertex(double x, double y, GLfloat u, GLfloat v);
+    void flush_colored();
+    void flush_textured();
+
+    // returns 0 if the image does not fit
+    const Atlas_entry *find_in_atlas(const void *key, int width, int height,
+                                     const unsigned char *data);
+
+    bool m_enabled;
+    GLubyte m_color[4];
+
+    std::vector<Colored_vertex> m_colored;
+    std::vector<Textured_vertex> m_textured;
+
+    // the atlas is filled in shelves (rows of images) from the bottom up
+    GLuint m_atlas_texture;
+    int m_shelf_x;
+    int m_shelf_y;
+    int m_shelf_height;
+    std::map<const void *, Atlas_entry> m_atlas_entries;
+
+    // one per Interpreter_context
+    friend class Interpreter_context;
+
+    // disable default copy constructor and default assignment
+    // done as a precaution, they should never be called
+    Batch_renderer(const Batch_renderer &);
+    const Batch_renderer &operator=(const Batch_renderer &);
+};
+
+#endif // #ifndef BATCH_RENDERER_H
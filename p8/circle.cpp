@@ -1,5 +1,8 @@
 #include "circle.h"
 #include "gpl_assert.h"
+#include "geometry_cache.h"
+#include "batch_renderer.h"
+#include "software_renderer.h"
 using namespace std;
 
 std::shared_ptr<Game_object> Circle::Create()
@@ -14,56 +17,89 @@ Circle::Circle() :  Game_object(/* red = */ 0.0,
                                )
 {
     m_radius = 10;
-    register_member_variable("radius", &m_radius);
     m_object_type_name = "Circle";
 
     // the width and height are derived from the radius
-    m_w = 2*m_radius;
-    m_h = 2*m_radius;
+    w() = 2*m_radius;
+    h() = 2*m_radius;
 
-    // width and height are derived --> user cannot change them
-    Status status;
-    status = mark_member_variable_as_derived("w");
-    assert(status == OK);
-    status = mark_member_variable_as_derived("h");
-    assert(status == OK);
+    if (begin_member_schema(m_object_type_name))
+    {
+      register_member_variable("radius", &m_radius);
 
-    m_quadric = 0;
+      // width and height are derived --> user cannot change them
+      Status status;
+      status = mark_member_variable_as_derived("w");
+      assert(status == OK);
+      status = mark_member_variable_as_derived("h");
+      assert(status == OK);
+    }
+
+    m_lod = -1;
 }
 
 void Circle::updated(string name)
 {
   if (name == "radius")
   {
-    m_w = 2*m_radius;
-    m_h = 2*m_radius;
+    w() = 2*m_radius;
+    h() = 2*m_radius;
   }
   m_display_list_dirty = true;
 }
 
+/* virtual */ void Circle::get_collision_shape(Collision_shape &shape) const
+{
+  shape.set_circle(x() + m_radius, y() + m_radius, m_radius);
+}
+
 void Circle::build_display_list()
 {
   assert(m_display_list);
-  if (m_quadric == 0)
-  {
-    m_quadric = gluNewQuadric();
-    gluQuadricDrawStyle(m_quadric, GLU_FILL);
-  }
+
+  // must be fetched before glNewList(), the cache may have to compile it
+  m_lod = Geometry_cache::disk_lod(m_radius * Geometry_cache::pixel_scale());
+  GLuint disk = Geometry_cache::disk(m_lod);
+
   glNewList(m_display_list, GL_COMPILE);
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
-  glTranslated(m_x + m_radius, m_y + m_radius, 0);
+  glTranslated(m_radius, m_radius, 0);
+  glScaled(m_radius, m_radius, 1);
   glColor3f(m_red, m_green, m_blue);
-  gluDisk(m_quadric,
-          /* innerRadius = */ 0,    // creates a hole in center
-          /* outerRadius = */ m_radius,
-          /* slices = */ 200, // use to be 20
-          /* rings = */ 1
-         );
+  glCallList(disk);
   glPopMatrix();
   glEndList();
 
   // width and height are derived from the radius
-  m_w = 2*m_radius;
-  m_h = 2*m_radius;
+  w() = 2*m_radius;
+  h() = 2*m_radius;
+}
+
+/* virtual */ void Circle::draw_in_view(int left, int bottom,
+                                       int right, int top)
+{
+  // zooming in (or out) far enough needs a different disk
+  if (Geometry_cache::disk_lod(m_radius * Geometry_cache::pixel_scale())
+      != m_lod)
+    m_display_list_dirty = true;
+
+  Game_object::draw_in_view(left, bottom, right, top);
+}
+
+/* virtual */ bool Circle::append_to_batch(Batch_renderer &batch)
+{
+  int lod = Geometry_cache::disk_lod(m_radius * Geometry_cache::pixel_scale());
+
+  batch.set_color(m_red, m_green, m_blue);
+  batch.add_disk(x() + m_radius, y() + m_radius, m_radius, lod);
+  return true;
+}
+
+/* virtual */ void Circle::draw_software(Software_renderer &renderer,
+                                        int left, int bottom,
+                                        int right, int top)
+{
+  renderer.set_color(m_red, m_green, m_blue);
+  renderer.add_disk(x() + m_radius, y() + m_radius, m_radius);
 }
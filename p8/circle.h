@@ -24,9 +24,16 @@ class Circle : public Game_object
 	Circle();
     virtual void updated(std::string name);
     virtual void build_display_list();
+    virtual void draw_in_view(int left, int bottom, int right, int top);
+    virtual void get_collision_shape(Collision_shape &shape) const;
+    virtual bool append_to_batch(Batch_renderer &batch);
+    virtual void draw_software(Software_renderer &renderer,
+                               int left, int bottom, int right, int top);
 
     int m_radius;
-    GLUquadricObj *m_quadric;
+
+    // the level of detail of the disk in the display list
+    int m_lod;
 
     // disable default copy constructor and default assignment
     // done as a precaution, they should never be called
@@ -0,0 +1,311 @@
+#include "collision.h"
+#include "gpl_assert.h"
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+Collision_mask::Collision_mask(int width, int height, const unsigned char *data)
+{
+  m_width = width;
+  m_height = height;
+  m_words_per_row = (width + 63) / 64;
+  m_bits.assign(m_words_per_row * height, 0);
+
+  for (int y = 0; y < height; y++)
+  {
+    uint64_t *row = &m_bits[y * m_words_per_row];
+    for (int x = 0; x < width; x++)
+    {
+      if (data[(y * width + x) * 4 + 3])
+        row[x >> 6] |= (uint64_t) 1 << (x & 63);
+    }
+  }
+}
+
+uint64_t Collision_mask::bits_at(int x, int y) const
+{
+  if (y < 0 || y >= m_height || x >= m_width || x <= -64)
+    return 0;
+
+  const uint64_t *row = &m_bits[y * m_words_per_row];
+
+  // starting left of the mask: the first bits are outside of it
+  if (x < 0)
+    return row[0] << -x;
+
+  int word = x >> 6;
+  int shift = x & 63;
+  uint64_t result = row[word] >> shift;
+  if (shift && word + 1 < m_words_per_row)
+    result |= row[word + 1] << (64 - shift);
+  return result;
+}
+
+void Collision_shape::set_box(double x, double y, double w, double h)
+{
+  double xs[4] = {x, x + w, x + w, x};
+  double ys[4] = {y, y, y + h, y + h};
+  set_polygon(4, xs, ys);
+}
+
+void Collision_shape::set_circle(double center_x, double center_y, double radius)
+{
+  m_kind = CIRCLE;
+  m_cx = center_x;
+  m_cy = center_y;
+  m_radius = radius;
+  m_left = center_x - radius;
+  m_bottom = center_y - radius;
+  m_right = center_x + radius;
+  m_top = center_y + radius;
+}
+
+void Collision_shape::set_polygon(int count, const double *xs, const double *ys)
+{
+  assert(count >= 3 && count <= 4);
+  m_kind = POLYGON;
+  m_count = count;
+  for (int i = 0; i < count; i++)
+  {
+    m_xs[i] = xs[i];
+    m_ys[i] = ys[i];
+  }
+  update_polygon_bounds();
+}
+
+void Collision_shape::set_mask(const Collision_mask *mask, int x, int y)
+{
+  m_kind = MASK;
+  m_mask = mask;
+  m_mask_x = x;
+  m_mask_y = y;
+  m_left = x;
+  m_bottom = y;
+  m_right = x + mask->width();
+  m_top = y + mask->height();
+}
+
+void Collision_shape::rotate(double degrees, double cx, double cy)
+{
+  assert(m_kind == POLYGON);
+  if (degrees == 0)
+    return;
+
+  double radians = degrees * M_PI / 180.0;
+  double c = cos(radians);
+  double s = sin(radians);
+  for (int i = 0; i < m_count; i++)
+  {
+    double dx = m_xs[i] - cx;
+    double dy = m_ys[i] - cy;
+    m_xs[i] = cx + dx * c - dy * s;
+    m_ys[i] = cy + dx * s + dy * c;
+  }
+  update_polygon_bounds();
+}
+
+void Collision_shape::update_polygon_bounds()
+{
+  m_left = m_right = m_xs[0];
+  m_bottom = m_top = m_ys[0];
+  for (int i = 1; i < m_count; i++)
+  {
+    m_left = min(m_left, m_xs[i]);
+    m_right = max(m_right, m_xs[i]);
+    m_bottom = min(m_bottom, m_ys[i]);
+    m_top = max(m_top, m_ys[i]);
+  }
+}
+
+bool Collision_shape::contains(double x, double y) const
+{
+  switch (m_kind)
+  {
+    case CIRCLE:
+    {
+      double dx = x - m_cx;
+      double dy = y - m_cy;
+      return dx * dx + dy * dy <= m_radius * m_radius;
+    }
+    case POLYGON:
+    {
+      // inside a convex polygon: on the same side of every edge
+      // (either winding)
+      bool positive = false;
+      bool negative = false;
+      for (int i = 0; i < m_count; i++)
+      {
+        int j = (i + 1) % m_count;
+        double cross = (m_xs[j] - m_xs[i]) * (y - m_ys[i])
+                       - (m_ys[j] - m_ys[i]) * (x - m_xs[i]);
+        if (cross > 0) positive = true;
+        if (cross < 0) negative = true;
+      }
+      return !(positive && negative);
+    }
+    case MASK:
+    {
+      int px = (int) floor(x) - m_mask_x;
+      int py = (int) floor(y) - m_mask_y;
+      if (px < 0 || py < 0 || px >= m_mask->width() || py >= m_mask->height())
+        return false;
+      return m_mask->test(px, py);
+    }
+  }
+  return false;
+}
+
+static double distance_squared_to_segment(double px, double py,
+                                          double ax, double ay,
+                                          double bx, double by)
+{
+  double dx = bx - ax;
+  double dy = by - ay;
+  double length_squared = dx * dx + dy * dy;
+  double t = 0;
+  if (length_squared > 0)
+    t = max(0.0, min(1.0, ((px - ax) * dx + (py - ay) * dy) / length_squared));
+  double cx = ax + t * dx - px;
+  double cy = ay + t * dy - py;
+  return cx * cx + cy * cy;
+}
+
+static bool circle_circle(const Collision_shape &a, const Collision_shape &b)
+{
+  double dx = a.m_cx - b.m_cx;
+  double dy = a.m_cy - b.m_cy;
+  double r = a.m_radius + b.m_radius;
+  return dx * dx + dy * dy <= r * r;
+}
+
+static bool circle_polygon(const Collision_shape &circle,
+                           const Collision_shape &polygon)
+{
+  if (polygon.contains(circle.m_cx, circle.m_cy))
+    return true;
+
+  double r2 = circle.m_radius * circle.m_radius;
+  for (int i = 0; i < polygon.m_count; i++)
+  {
+    int j = (i + 1) % polygon.m_count;
+    if (distance_squared_to_segment(circle.m_cx, circle.m_cy,
+                                    polygon.m_xs[i], polygon.m_ys[i],
+                                    polygon.m_xs[j], polygon.m_ys[j]) <= r2)
+      return true;
+  }
+  return false;
+}
+
+// true if one of the edge normals of a separates a and b
+static bool separated_by_edge_of(const Collision_shape &a,
+                                 const Collision_shape &b)
+{
+  for (int i = 0; i < a.m_count; i++)
+  {
+    int j = (i + 1) % a.m_count;
+    double nx = a.m_ys[j] - a.m_ys[i];
+    double ny = a.m_xs[i] - a.m_xs[j];
+
+    double a_min, a_max, b_min, b_max;
+    a_min = a_max = a.m_xs[0] * nx + a.m_ys[0] * ny;
+    for (int k = 1; k < a.m_count; k++)
+    {
+      double p = a.m_xs[k] * nx + a.m_ys[k] * ny;
+      a_min = min(a_min, p);
+      a_max = max(a_max, p);
+    }
+    b_min = b_max = b.m_xs[0] * nx + b.m_ys[0] * ny;
+    for (int k = 1; k < b.m_count; k++)
+    {
+      double p = b.m_xs[k] * nx + b.m_ys[k] * ny;
+      b_min = min(b_min, p);
+      b_max = max(b_max, p);
+    }
+
+    if (a_max < b_min || b_max < a_min)
+      return true;
+  }
+  return false;
+}
+
+static bool polygon_polygon(const Collision_shape &a, const Collision_shape &b)
+{
+  return !separated_by_edge_of(a, b) && !separated_by_edge_of(b, a);
+}
+
+static bool mask_mask(const Collision_shape &a, const Collision_shape &b)
+{
+  const Collision_mask *ma = a.m_mask;
+  const Collision_mask *mb = b.m_mask;
+
+  // the overlap, in world coordinates
+  int left = max(a.m_mask_x, b.m_mask_x);
+  int right = min(a.m_mask_x + ma->width(), b.m_mask_x + mb->width());
+  int bottom = max(a.m_mask_y, b.m_mask_y);
+  int top = min(a.m_mask_y + ma->height(), b.m_mask_y + mb->height());
+
+  for (int y = bottom; y < top; y++)
+  {
+    for (int x = left; x < right; x += 64)
+    {
+      uint64_t bits = ma->bits_at(x - a.m_mask_x, y - a.m_mask_y)
+                      & mb->bits_at(x - b.m_mask_x, y - b.m_mask_y);
+
+      // don't count pixels past the end of the overlap
+      if (right - x < 64)
+        bits &= ((uint64_t) 1 << (right - x)) - 1;
+      if (bits)
+        return true;
+    }
+  }
+  return false;
+}
+
+static bool mask_other(const Collision_shape &mask, const Collision_shape &other)
+{
+  const Collision_mask *m = mask.m_mask;
+
+  int left = max(mask.m_mask_x, (int) floor(other.m_left));
+  int right = min(mask.m_mask_x + m->width(), (int) ceil(other.m_right));
+  int bottom = max(mask.m_mask_y, (int) floor(other.m_bottom));
+  int top = min(mask.m_mask_y + m->height(), (int) ceil(other.m_top));
+
+  for (int y = bottom; y < top; y++)
+  {
+    for (int x = left; x < right; x++)
+    {
+      // test the center of each set pixel
+      if (m->test(x - mask.m_mask_x, y - mask.m_mask_y)
+          && other.contains(x + 0.5, y + 0.5))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool shapes_overlap(const Collision_shape &a, const Collision_shape &b)
+{
+  if (a.m_right < b.m_left || a.m_left > b.m_right
+      || a.m_top < b.m_bottom || a.m_bottom > b.m_top)
+    return false;
+
+  if (a.m_kind == Collision_shape::MASK)
+  {
+    if (b.m_kind == Collision_shape::MASK)
+      return mask_mask(a, b);
+    return mask_other(a, b);
+  }
+  if (b.m_kind == Collision_shape::MASK)
+    return mask_other(b, a);
+
+  if (a.m_kind == Collision_shape::CIRCLE)
+  {
+    if (b.m_kind == Collision_shape::CIRCLE)
+      return circle_circle(a, b);
+    return circle_polygon(a, b);
+  }
+  if (b.m_kind == Collision_shape::CIRCLE)
+    return circle_polygon(b, a);
+
+  return polygon_polygon(a, b);
+}
@@ -0,0 +1,102 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+/****
+
+  Exact collision tests (the narrowphase behind Game_object::touches())
+
+  Each object describes its outline as a Collision_shape:
+
+    CIRCLE    center and radius (Circle)
+    POLYGON   up to four vertices of a convex polygon
+              (a bounding box, a rotated Rectangle, a Triangle)
+    MASK      one bit per pixel (a Pixmap, from its transparent pixels)
+
+  shapes_overlap() picks the test for the pair:
+
+    circle - circle     distance between the centers
+    circle - polygon    center inside, or closest edge within the radius
+    polygon - polygon   separating axis theorem
+    mask - mask         the rows of both masks are ANDed 64 pixels at a time
+    mask - other        every set pixel in the overlap is tested against
+                        the other shape
+
+  Shapes that merely touch (share an edge or a point) overlap, the same
+  as the bounding box test.
+
+****/
+
+#include <vector>
+#include <cstdint>
+
+class Collision_mask
+{
+  public:
+    // data is width * height pixels of 4 bytes (BGRA), bottom row first;
+    // a pixel is set if its alpha is not 0
+    Collision_mask(int width, int height, const unsigned char *data);
+
+    int width() const {return m_width;}
+    int height() const {return m_height;}
+
+    bool test(int x, int y) const
+     { return (m_bits[y * m_words_per_row + (x >> 6)] >> (x & 63)) & 1; }
+
+    // the 64 pixels of row y starting at x (may start anywhere, even
+    // outside of the mask; pixels outside of the mask are 0)
+    uint64_t bits_at(int x, int y) const;
+
+  private:
+    int m_width;
+    int m_height;
+    int m_words_per_row;
+    std::vector<uint64_t> m_bits;
+};
+
+class Collision_shape
+{
+  public:
+    enum Kind {CIRCLE, POLYGON, MASK};
+
+    Collision_shape() {m_kind = POLYGON; m_count = 0; m_mask = 0;}
+
+    void set_box(double x, double y, double w, double h);
+    void set_circle(double center_x, double center_y, double radius);
+    void set_polygon(int count, const double *xs, const double *ys);
+    void set_mask(const Collision_mask *mask, int x, int y);
+
+    // rotate the polygon by degrees (counter clockwise) around (cx, cy)
+    void rotate(double degrees, double cx, double cy);
+
+    bool contains(double x, double y) const;
+
+    Kind m_kind;
+
+    // POLYGON
+    int m_count;
+    double m_xs[4];
+    double m_ys[4];
+
+    // CIRCLE
+    double m_cx;
+    double m_cy;
+    double m_radius;
+
+    // MASK, m_mask_x and m_mask_y are the lower left corner
+    const Collision_mask *m_mask;
+    int m_mask_x;
+    int m_mask_y;
+
+    // bounding box
+    double m_left;
+    double m_bottom;
+    double m_right;
+    double m_top;
+
+  private:
+    void update_polygon_bounds();
+};
+
+bool shapes_overlap(const Collision_shape &a, const Collision_shape &b);
+
+#endif // #ifndef COLLISION_H
@@ -1,282 +1,401 @@
 #include "error.h"
+#include "interpreter_context.h"
 
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <stdlib.h>
 using namespace std;
 
-// The following is a global variable defined by the scanner (the lex .l file)
-extern int line_count; // the line number of current token
+/* static */ int Error::m_max_reports = Error::DEFAULT_MAX_REPORTS;
+/* static */ bool Error::m_fatal = false;
 
-/* static */ bool Error::m_runtime = false;
-/* static */ int Error::m_num_errors = 0;
+// The line the scanner is on (see Parse_state)
+static int line_count()
+{
+  return Interpreter_context::current()->get_parse_state().line_count;
+}
+
+/* static */ Error::State &Error::state()
+{
+  return Interpreter_context::current()->get_error_state();
+}
+
+/* static */ void Error::starting_execution()
+{
+  state().m_runtime = true;
+}
+
+/* static */ int Error::num_errors()
+{
+  return state().m_num_errors;
+}
+
+/* static */ bool Error::runtime()
+{
+  return state().m_runtime;
+}
 
-/* static */ void Error::error_header(int line)
+/* static */ void Error::set_runtime_line(int line)
 {
-  if(line == -1) line = line_count;
+  state().m_runtime_line = line;
+}
 
-  if (m_runtime)
-    cerr << "Runtime error: ";
-  else cerr << "Semantic error on line " << line  << ": ";
+/* static */ int *Error::runtime_line_address()
+{
+  return &state().m_runtime_line;
 }
 
+// A bad index in an animation block fails on every frame; printing each
+// one to the unbuffered cerr costs more than the frame itself, so only
+// the first few of each site are printed.
 /* static */ void Error::error(Error_type type,
                                string s1 /* = "" */,
                                string s2 /* = "" */,
                                string s3 /* = "" */,
-			       int line  /* = -1 */
+                               int line  /* = -1 */
                                )
+{
+  Interpreter_context *context = Interpreter_context::current();
+  State &errors = context->get_error_state();
+  ostream &err = context->err();
+
+  errors.m_num_errors++;
+
+  if (!errors.m_runtime)
+  {
+    write_message(err, type, s1, s2, s3, line);
+    return;
+  }
+
+  Runtime_error_site &site =
+    errors.m_sites[make_pair(errors.m_runtime_line, (int) type)];
+  site.count++;
+
+  if (site.count == 1)
+  {
+    ostringstream message;
+    write_message(message, type, s1, s2, s3, line);
+    site.message = message.str();
+  }
+
+  if (m_max_reports <= 0 || site.count <= m_max_reports)
+  {
+    write_message(err, type, s1, s2, s3, line);
+    if (site.count == m_max_reports && !m_fatal)
+      err << "  (Not printing this error on line " << errors.m_runtime_line
+          << " again, it is counted and reported when gpl exits.)"
+          << endl;
+  }
+
+  if (m_fatal)
+  {
+    err << "Runtime error on line " << errors.m_runtime_line
+        << " is fatal (-fatal_errors).  Exiting." << endl;
+    context->end(1);
+  }
+}
+
+/* static */ void Error::report(ostream &os)
+{
+  const State &errors = state();
+  bool header = false;
+  for (Runtime_error_sites::const_iterator it = errors.m_sites.begin();
+       it != errors.m_sites.end(); it++)
+  {
+    const Runtime_error_site &site = it->second;
+
+    // the ones that were all printed need no summary
+    if (m_max_reports <= 0 || site.count <= m_max_reports)
+      continue;
+
+    if (!header)
+    {
+      os << "Runtime errors that were not all printed:" << endl;
+      header = true;
+    }
+    os << "  line " << it->first.first << ", " << site.count
+       << " times (" << site.count - m_max_reports << " not printed): "
+       << site.message;
+  }
+}
+
+/* static */ void Error::error_header(ostream &os, int line)
+{
+  if(line == -1) line = line_count();
+
+  if (state().m_runtime)
+    os << "Runtime error: ";
+  else os << "Semantic error on line " << line  << ": ";
+}
+
+/* static */ void Error::write_message(ostream &os,
+                                       Error_type type,
+                                       string s1,
+                                       string s2,
+                                       string s3,
+                                       int line
+                                      )
 {
   switch (type)
   {
     case ANIMATION_PARAM_DOES_NOT_MATCH_FORWARD:
-      error_header(line);
-      cerr << "The animation block's parameter does not match "
+      error_header(os, line);
+      os << "The animation block's parameter does not match "
            << "the parameter specified in the forward statement."
            << endl;
       break;
     case ANIMATION_PARAMETER_NAME_NOT_UNIQUE:
-      error_header(line);
-      cerr << "The animation parameter '" << s1
+      error_header(os, line);
+      os << "The animation parameter '" << s1
            << "' is not a unique name.  Animation parameters must have"
            << " names that are unique in the global name space."
            << endl;
       break;
     case ARRAY_INDEX_MUST_BE_AN_INTEGER:
-      error_header(line);
+      error_header(os, line);
         // s2 is expected to be one of the following strings
         //     "A double expression"
         //     "A string expression"
         //     "A animation_block expression"
-        cerr << s2
+        os << s2
              << " is not a legal array index.  The array is '"
              << s1 << "'.";
-        if (m_runtime)
-          cerr << "  Element '" << s1 <<"[0]' will be used instead.";
-        cerr << endl;
+        if (state().m_runtime)
+          os << "  Element '" << s1 <<"[0]' will be used instead.";
+        os << endl;
       break;
     case ARRAY_INDEX_OUT_OF_BOUNDS:
-      error_header(line);
-        cerr << "Index value '" << s2
+      error_header(os, line);
+        os << "Index value '" << s2
              << "' is out of bounds for array '"
              << s1 << "'.";
-        if (m_runtime)
-          cerr << "  Element '" << s1 <<"[0]' will be used instead.";
-        cerr << endl;
+        if (state().m_runtime)
+          os << "  Element '" << s1 <<"[0]' will be used instead.";
+        os << endl;
       break;
     case ASSIGNMENT_TYPE_ERROR:
-      error_header(line);
-      cerr << "Cannot assign an expression of type '" << s2
+      error_header(os, line);
+      os << "Cannot assign an expression of type '" << s2
            << "' to a variable of type '" << s1 << "'."
            << endl;
       break;
 
+    // the frame scheduler's reserved variables (frame_count, ...)
+    case CANNOT_ASSIGN_TO_READ_ONLY_VARIABLE:
+      error_header(os, line);
+      os << "Variable '" << s1 << "' is reserved and read only.  "
+           << "It cannot be the LHS of an assignment."
+           << endl;
+      break;
+
     // some attributes (such as h & w in a circle) cannot be changed
     case CANNOT_CHANGE_DERIVED_ATTRIBUTE:
-      error_header(line);
-      cerr << "Cannot changed derived field '" << s1 << "' of a '" << s2
+      error_header(os, line);
+      os << "Cannot changed derived field '" << s1 << "' of a '" << s2
            << "' object.  This field is derived from other fields.  ";
-      if (m_runtime)
-        cerr << "The change will be ignored.";
-      cerr << endl;
+      if (state().m_runtime)
+        os << "The change will be ignored.";
+      os << endl;
       break;
     case EXIT_STATUS_MUST_BE_AN_INTEGER:
-      error_header(line);
-      cerr << "Value passed to exit() must be an integer.  "
+      error_header(os, line);
+      os << "Value passed to exit() must be an integer.  "
            << "Value passed was of type '" << s1  << "'."
            << endl;
       break;
 
     // this error originates from gpl.y when it finds an illegal token
     case ILLEGAL_TOKEN:
-      cerr << "Syntax error on line "
-           << line_count
+      os << "Syntax error on line "
+           << line_count()
            << " '" << s1 << "'" << " is not a legal token."
            << endl;
       break;
     case INCORRECT_CONSTRUCTOR_PARAMETER_TYPE:
-      error_header(line);
-      cerr << "Incorrect type for parameter '"
+      error_header(os, line);
+      os << "Incorrect type for parameter '"
            << s2 << "' of object " << s1  << "."
            << endl;
       break;
     case INVALID_ARRAY_SIZE:
-      error_header(line);
-      cerr << "The array '" << s1 << "' was declared with illegal size '"
+      error_header(os, line);
+      os << "The array '" << s1 << "' was declared with illegal size '"
            << s2 << "'.  Arrays sizes must be integers of 1 or larger."
            << endl;
       break;
     // everything but a game object is a legal LHS of assignment
     case INVALID_LHS_OF_ASSIGNMENT:
-      error_header(line);
-      cerr << "LHS of assignment must be "
+      error_header(os, line);
+      os << "LHS of assignment must be "
            << "(INT || DOUBLE || STRING || ANIMATION_BLOCK)."
            << "  Variable '" << s1 << "' is of type '"  << s2 << "'."
            << endl;
       break;
     case INVALID_LHS_OF_MINUS_ASSIGNMENT:
-      error_header(line);
-      cerr << "LHS of minus-assignment must be (INT || DOUBLE)."
+      error_header(os, line);
+      os << "LHS of minus-assignment must be (INT || DOUBLE)."
            << "  Variable '" << s1 << "' is of type '"  << s2 << "'."
            << endl;
       break;
     case INVALID_LHS_OF_PLUS_ASSIGNMENT:
-      error_header(line);
-      cerr << "LHS of plus-assignment must be (INT || DOUBLE || STRING)."
+      error_header(os, line);
+      os << "LHS of plus-assignment must be (INT || DOUBLE || STRING)."
            << "  Variable '" << s1 << "' is of type '"  << s2 << "'."
            << endl;
       break;
     case INVALID_LEFT_OPERAND_TYPE:
-      error_header(line);
-      cerr << "Invalid left operand for operator '" << s1 << "'."
+      error_header(os, line);
+      os << "Invalid left operand for operator '" << s1 << "'."
            << endl;
       break;
     case INVALID_RIGHT_OPERAND_TYPE:
-      error_header(line);
-      cerr << "Invalid right operand for operator '" << s1 << "'."
+      error_header(os, line);
+      os << "Invalid right operand for operator '" << s1 << "'."
            << endl;
       break;
     case INVALID_TYPE_FOR_INITIAL_VALUE:
-      error_header(line);
-      cerr << "Incorrect type for initial value of variable '"
+      error_header(os, line);
+      os << "Incorrect type for initial value of variable '"
            << s1 << "'."
            << endl;
       break;
     case INVALID_TYPE_FOR_FOR_STMT_EXPRESSION:
-      error_header(line);
-      cerr << "Incorrect type for expression in for statement."
+      error_header(os, line);
+      os << "Incorrect type for expression in for statement."
            << "  Expressions in for statements must be of type INT."
            << endl;
       break;
     case INVALID_TYPE_FOR_IF_STMT_EXPRESSION:
-      error_header(line);
-      cerr << "Incorrect type for expression in an if statement."
+      error_header(os, line);
+      os << "Incorrect type for expression in an if statement."
            << "  Expressions in if statements must be of type INT."
            << endl;
       break;
     case INVALID_TYPE_FOR_PRINT_STMT_EXPRESSION:
-      error_header(line);
-      cerr << "Incorrect type for expression in a print statement."
+      error_header(os, line);
+      os << "Incorrect type for expression in a print statement."
            << "  Expressions in print statements must be"
            << " of type INT, DOUBLE, or STRING."
            << endl;
       break;
     case INVALID_TYPE_FOR_RESERVED_VARIABLE:
-      error_header(line);
-      cerr << "Incorrect type for reserved variable '" << s1
+      error_header(os, line);
+      os << "Incorrect type for reserved variable '" << s1
            << "'  It was declared with type '" << s2
            << "'.  It must be of type '" << s3 << "'."
            << endl;
       break;
     case LHS_OF_PERIOD_MUST_BE_OBJECT:
-      error_header(line);
-      cerr << "Variable '" << s1 << "' is not an object."
+      error_header(os, line);
+      os << "Variable '" << s1 << "' is not an object."
            << "  Only objects may be on the left of a period."
            << endl;
       break;
     case MINUS_ASSIGNMENT_TYPE_ERROR:
-      error_header(line);
-      cerr << "Cannot -= an expression of type '" << s2
+      error_header(os, line);
+      os << "Cannot -= an expression of type '" << s2
            << "' from a variable of type '" << s1 << "'."
            << endl;
       break;
     case NO_BODY_PROVIDED_FOR_FORWARD:
-      error_header(line);
-      cerr << "No body was provided for animation block '" << s1
+      error_header(os, line);
+      os << "No body was provided for animation block '" << s1
            << "' which was declared in a forward statement."
            << endl;
       break;
     case NO_FORWARD_FOR_ANIMATION_BLOCK:
-      error_header(line);
-      cerr << "There is not a forward statement for animation block '"
+      error_header(os, line);
+      os << "There is not a forward statement for animation block '"
            << s1 << "'."
            << endl;
       break;
     // game objects are the only valid operands for near and touches
     case OPERAND_MUST_BE_A_GAME_OBJECT:
-      error_header(line);
-      cerr << "Operand '" << s1 << "' must be of type Game_object or "
+      error_header(os, line);
+      os << "Operand '" << s1 << "' must be of type Game_object or "
            << "inherit from Game_object."
            << endl;
       break;
     // only called in gpl.cpp when parser finds an error
     // called from yyerror()
     case PARSE_ERROR:
-      cerr << "Parse error on line "
-           << line_count
+      os << "Parse error on line "
+           << line_count()
            << " reported by parser: "
            << s1 << "."
            << endl;
       break;
     case PLUS_ASSIGNMENT_TYPE_ERROR:
-      error_header(line);
-      cerr << "Cannot += an expression of type '" << s2
+      error_header(os, line);
+      os << "Cannot += an expression of type '" << s2
            << "' to a variable of type '" << s1 << "'."
            << endl;
       break;
     case PREVIOUSLY_DECLARED_VARIABLE:
-      error_header(line);
-      cerr << "Variable '"<< s1 << "'" << " previously declared."
+      error_header(os, line);
+      os << "Variable '"<< s1 << "'" << " previously declared."
            << endl;
       break;
     case PREVIOUSLY_DEFINED_ANIMATION_BLOCK:
-      error_header(line);
-      cerr << "A statement block for the animation block '"<< s1 << "'"
+      error_header(os, line);
+      os << "A statement block for the animation block '"<< s1 << "'"
            << " has already been defined."
            << endl;
       break;
     case TYPE_MISMATCH_BETWEEN_ANIMATION_BLOCK_AND_OBJECT:
-      error_header(line);
-      cerr << "The type of object '"<< s1 << "'"
+      error_header(os, line);
+      os << "The type of object '"<< s1 << "'"
            << " does not match the type of the parameter to the "
            << "animation block '" << s2 << "'"
            << endl;
       break;
     case UNDECLARED_MEMBER:
-      error_header(line);
-      cerr << "Object '" << s1 << "'"
+      error_header(os, line);
+      os << "Object '" << s1 << "'"
            << " does not contain the member variable '"
            << s2 << "'."
            << endl;
       break;
     case UNDECLARED_VARIABLE:
-      error_header(line);
-      cerr << "Variable '" << s1 << "'"
+      error_header(os, line);
+      os << "Variable '" << s1 << "'"
            << " was not declared before it was used."
            << endl;
       break;
     case UNKNOWN_CONSTRUCTOR_PARAMETER:
-      error_header(line);
-      cerr << "Class '" << s1 << "' does not have a parameter called '"
+      error_header(os, line);
+      os << "Class '" << s1 << "' does not have a parameter called '"
            << s2 << "'."
            << endl;
       break;
     case VARIABLE_NOT_AN_ARRAY:
-      error_header(line);
-      cerr << "Variable '" << s1 << "' is not an array."
+      error_header(os, line);
+      os << "Variable '" << s1 << "' is not an array."
            << endl;
       break;
     case DIVIDE_BY_ZERO_AT_PARSE_TIME:
-      error_header(line);
-      cerr << "Arithmetic divide by zero at parse time.  "
+      error_header(os, line);
+      os << "Arithmetic divide by zero at parse time.  "
            << "Using zero as the result so parse can continue."
            << endl;
       break;
     case MOD_BY_ZERO_AT_PARSE_TIME:
-      error_header(line);
-      cerr << "Arithmetic mod by zero at parse time.  "
+      error_header(os, line);
+      os << "Arithmetic mod by zero at parse time.  "
            << "Using zero as the result so parse can continue."
            << endl;
       break;
     case UNDEFINED_ERROR:
-      error_header(line);
-      cerr << "Undefined error passed to Error::error().  "
+      error_header(os, line);
+      os << "Undefined error passed to Error::error().  "
            << "This is probably because error.cpp was not updated "
            << "when a new error was added to error.h."
            << endl;
       break;
     default:
-      cerr << "Unknown error sent to class Error::error()."
+      os << "Unknown error sent to class Error::error()."
            << endl;
       break;
   }
-  m_num_errors++;
 }
@@ -39,6 +39,9 @@
 #define ERROR_H
 
 #include <string>
+#include <ostream>
+#include <map>
+#include <utility>
 
 class Error
 {
@@ -49,6 +52,7 @@ class Error
              ARRAY_INDEX_MUST_BE_AN_INTEGER,
              ARRAY_INDEX_OUT_OF_BOUNDS,
              ASSIGNMENT_TYPE_ERROR,
+             CANNOT_ASSIGN_TO_READ_ONLY_VARIABLE,
              CANNOT_CHANGE_DERIVED_ATTRIBUTE,
              EXIT_STATUS_MUST_BE_AN_INTEGER,
              ILLEGAL_TOKEN,
@@ -89,15 +93,68 @@ class Error
                       std::string s3 = "",
 		      int line = -1);
 
-    static void starting_execution() {m_runtime = true;}
+    // Every runtime error is counted by its site: the line of the
+    // statement that was executing and the type of the error.
+    struct Runtime_error_site
+    {
+      Runtime_error_site() : count(0) {}
 
-    static int num_errors() {return m_num_errors;}
-    static bool runtime() {return m_runtime;}
+      int count;
+      std::string message; // the first one, for report()
+    };
+    typedef std::map<std::pair<int, int>, Runtime_error_site> Runtime_error_sites;
+
+    // the errors of one program, one per Interpreter_context
+    struct State
+    {
+      State() : m_runtime(false), m_num_errors(0), m_runtime_line(0) {}
+
+      bool m_runtime;
+      int m_num_errors;
+      int m_runtime_line;
+      Runtime_error_sites m_sites;
+    };
+
+    // the functions below work on the program of the current
+    // Interpreter_context
+    static void starting_execution();
+
+    static int num_errors();
+    static bool runtime();
+
+    // Once execution starts, errors are counted by site (the line of the
+    // statement that was executing and the type of the error) and only
+    // the first max_reports of each site are printed; report() lists the
+    // rest.  0 prints every one of them (gpl -error_reports N)
+    static const int DEFAULT_MAX_REPORTS = 3;
+    static void set_max_reports(int max_reports) {m_max_reports = max_reports;}
+
+    // end the program after the first runtime error (gpl -fatal_errors)
+    static void set_fatal(bool fatal) {m_fatal = fatal;}
+
+    // the statements tell Error which line is executing
+    static void set_runtime_line(int line);
+
+    // compiled code writes the line itself (see jit.h)
+    static int *runtime_line_address();
+
+    // the number of times each runtime error that was not always printed
+    // happened, with the first message of each
+    static void report(std::ostream &os);
 
   protected:
-    static bool m_runtime;
-    static int m_num_errors;
-    static void error_header(int line);
+    static State &state();
+
+    // -error_reports and -fatal_errors hold for every program
+    static int m_max_reports;
+    static bool m_fatal;
+    static void error_header(std::ostream &os, int line);
+    static void write_message(std::ostream &os,
+                              Error_type type,
+                              std::string s1,
+                              std::string s2,
+                              std::string s3,
+                              int line);
 };
 
 #endif // #ifndef ERROR_H
@@ -4,17 +4,15 @@
 #include "parser.h"
 #include "event_manager.h"
 #include "gpl_statement.h"
+#include "runtime_metrics.h"
 #include "gpl_assert.h"
+#include "interpreter_context.h"
 
 using namespace std;
 
-/* static */ Event_manager *Event_manager::m_instance = 0;
-
 /* static */ Event_manager * Event_manager::instance()
 {
-  if (!m_instance)
-    m_instance = new Event_manager();
-  return m_instance;
+  return &Interpreter_context::current()->get_event_manager();
 }
 
 Event_manager::Event_manager()
@@ -42,6 +40,7 @@ void Event_manager::execute_handlers(Window::Keystroke keystroke)
 	if(map_it == _eventMap.end()) return;
 
 	TRACE_VERBOSE("Event_manager::execute_handlers - Event Handlers Found");
+	Metrics_timer timer(&Runtime_metrics::add_event_time);
 
 	EventHandlerList* pList = map_it->second;
 	TRACE_VERBOSE("Event_manager::execute_handlers - Count: " << pList->size())
@@ -73,3 +72,16 @@ void Event_manager::add_handler(Window::Keystroke keystroke, const std::shared_p
 	}
 }
 
+void Event_manager::get_handlers(Handler_list& handlers) const
+{
+	for(EventHandlerMap::const_iterator map_it = _eventMap.begin();
+				map_it != _eventMap.end(); map_it++)
+	{
+		EventHandlerList* pList = map_it->second;
+		for(EventHandlerList::const_iterator handler_it = pList->begin();
+					handler_it != pList->end(); handler_it++)
+		{
+			handlers.push_back(std::make_pair(map_it->first, *handler_it));
+		}
+	}
+}
@@ -28,16 +28,21 @@
 class Event_manager
 {
   public:
+    // the event manager of the current Interpreter_context
     static Event_manager *instance();
     ~Event_manager();
 
     void execute_handlers(Window::Keystroke keystroke);
     void add_handler(Window::Keystroke keystroke, const std::shared_ptr<statement_block>& handler);
 
+    // every handler, those of each keystroke in the order they were added
+    typedef std::vector<std::pair<Window::Keystroke, std::shared_ptr<statement_block>>> Handler_list;
+    void get_handlers(Handler_list& handlers) const;
+
   private:
-	// hide default constructor because this is a singleton
+	// hide default constructor, there is one per Interpreter_context
 	Event_manager();
-	static Event_manager *m_instance;
+	friend class Interpreter_context;
 
 	typedef std::vector<std::shared_ptr<statement_block>> EventHandlerList;
 	typedef std::map<Window::Keystroke, EventHandlerList*> EventHandlerMap;
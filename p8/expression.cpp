@@ -1,14 +1,16 @@
 #include <cmath>
-#include <random>
-#include <chrono>
+#include <type_traits>
+#include <utility>
 #include "expression.h"
+#include "runtime_metrics.h"
+#include "random_stream.h"
+#include "gpl_math.h"
 #include "symbol_table.h"
 #include "gpl_exception.h"
 #include "parser.h"
+#include "snapshot.h"
+#include "program_cache.h"
 
-#define PI 3.14159265
-#define CONVERT_TO_RADIANS(deg) (deg)*PI/180
-#define CONVERT_TO_DEGREES(rad) (rad)*180/PI
 	
 
 IExpression::~IExpression()
@@ -40,6 +42,71 @@ void IExpression::add_child(std::shared_ptr<IExpression> child)
 	_children.push_back(child);
 }
 
+void IExpression::replace_child(int ndx, const std::shared_ptr<IExpression>& child)
+{
+	if(ndx < 0 || ndx >= (int) _children.size())
+	{
+		throw std::invalid_argument("ndx out of bounds");
+	}
+
+	if(!child || child->get_type() != _children[ndx]->get_type())
+	{
+		throw std::invalid_argument("replacement must have the same type");
+	}
+
+	_children[ndx] = child;
+}
+
+bool IExpression::is_pure() const
+{
+	for(ExpressionList::const_iterator it = _children.begin(); it != _children.end(); it++)
+	{
+		if(!(*it)->is_pure()) return false;
+	}
+	return true;
+}
+
+bool IExpression::is_repeatable() const
+{
+	for(ExpressionList::const_iterator it = _children.begin(); it != _children.end(); it++)
+	{
+		if(!(*it)->is_repeatable()) return false;
+	}
+	return true;
+}
+
+bool IExpression::is_constant() const
+{
+	// operators applied to constants are constant, as long as they are pure
+	if(_children.empty()) return false;
+	for(ExpressionList::const_iterator it = _children.begin(); it != _children.end(); it++)
+	{
+		if(!(*it)->is_constant()) return false;
+	}
+	return is_pure();
+}
+
+void IExpression::get_variables(VariableSet& vars) const
+{
+	for(ExpressionList::const_iterator it = _children.begin(); it != _children.end(); it++)
+	{
+		(*it)->get_variables(vars);
+	}
+}
+
+void IExpression::get_side_effects(VariableSet& vars) const
+{
+	for(ExpressionList::const_iterator it = _children.begin(); it != _children.end(); it++)
+	{
+		(*it)->get_side_effects(vars);
+	}
+}
+
+std::string IExpression::get_storage_name() const
+{
+	return "";
+}
+
 //================================================================
 
 IVariableExpression::IVariableExpression(const std::string& name)
@@ -76,6 +143,7 @@ ValueExpression::~ValueExpression()
 
 std::shared_ptr<IValue> ValueExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	//TRACE_VERBOSE("ValueExpression::eval()")
 	return _pVal;
 }
@@ -85,6 +153,67 @@ Gpl_type ValueExpression::get_type() const
 	return _pVal->get_type();
 }
 
+bool ValueExpression::is_constant() const
+{
+	return _pVal->is_constant();
+}
+
+void ValueExpression::get_variables(VariableSet& vars) const
+{
+	std::string name = get_storage_name();
+	if(!name.empty()) vars.insert(name);
+}
+
+std::string ValueExpression::get_storage_name() const
+{
+	// ValueExpressions also hold member references (ex. "player.x")
+	if(_pVal->is_constant()) return "";
+	return storage_name(_pVal);
+}
+
+void ValueExpression::write(Snapshot_writer& out) const
+{
+	if(_pVal->is_constant())
+	{
+		out.write_int(Program_cache::VALUE_EXPRESSION);
+		out.write_int(_pVal->get_type());
+		switch(_pVal->get_type())
+		{
+			case INT:
+			{
+				int val = 0;
+				_pVal->get_int(val);
+				out.write_int(val);
+				break;
+			}
+			case DOUBLE:
+			{
+				double val = 0;
+				_pVal->get_double(val);
+				out.write_double(val);
+				break;
+			}
+			case STRING:
+			{
+				std::string val;
+				_pVal->get_string(val);
+				out.write_string(val);
+				break;
+			}
+			default:
+				throw std::logic_error("ValueExpression::write - Unhandled Constant Type");
+		}
+		return;
+	}
+
+	std::shared_ptr<MemberReference> pMember = std::dynamic_pointer_cast<MemberReference>(_pVal);
+	if(!pMember) throw std::logic_error("ValueExpression::write - Unhandled Value");
+
+	out.write_int(Program_cache::MEMBER_EXPRESSION);
+	out.write_string(pMember->get_symbol_name());
+	out.write_string(pMember->get_member_name());
+}
+
 //============================================================
 
 ArrayReferenceExpression::ArrayReferenceExpression
@@ -116,6 +245,7 @@ ArrayReferenceExpression::~ArrayReferenceExpression()
 
 std::shared_ptr<IValue> ArrayReferenceExpression::eval() const
 {	
+	Runtime_metrics::count_eval();
 	TRACE_VERBOSE("ArrayReferenceExpression::eval()")
 	std::shared_ptr<IExpression> ndx_expr = get_child(0);
 	const std::shared_ptr<IValue>& ndx_val = ndx_expr->eval();
@@ -151,6 +281,24 @@ Gpl_type ArrayReferenceExpression::get_type() const
 	return _type;
 }
 
+void ArrayReferenceExpression::get_variables(VariableSet& vars) const
+{
+	vars.insert(get_storage_name());
+	IExpression::get_variables(vars);
+}
+
+std::string ArrayReferenceExpression::get_storage_name() const
+{
+	return get_name() + "[]";
+}
+
+void ArrayReferenceExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::ARRAY_REFERENCE_EXPRESSION);
+	out.write_string(get_name());
+	get_child(0)->write(out);
+}
+
 ArrayMemberReferenceExpression::ArrayMemberReferenceExpression(std::string array_name, 
 			std::string member_name, std::shared_ptr<IExpression> ndx_expr)
 	: IVariableExpression(array_name + "." + member_name)
@@ -202,8 +350,28 @@ const std::string& ArrayMemberReferenceExpression::get_array_name() const
 const std::string& ArrayMemberReferenceExpression::get_member_name() const
 { return _member_name; }
 
+void ArrayMemberReferenceExpression::get_variables(VariableSet& vars) const
+{
+	vars.insert(get_storage_name());
+	IExpression::get_variables(vars);
+}
+
+std::string ArrayMemberReferenceExpression::get_storage_name() const
+{
+	return "." + _member_name;
+}
+
+void ArrayMemberReferenceExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::ARRAY_MEMBER_REFERENCE_EXPRESSION);
+	out.write_string(_array_name);
+	out.write_string(_member_name);
+	get_child(0)->write(out);
+}
+
 std::shared_ptr<IValue> ArrayMemberReferenceExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	TRACE_VERBOSE("ArrayMemberReferenceExpression::eval - Array: '" + _array_name + "', "
 				+ "Member: '" + _member_name + "'")
 
@@ -284,6 +452,101 @@ std::shared_ptr<IValue> ArrayMemberReferenceExpression::eval() const
 	return pret;
 }
 
+//============================================================
+
+IndexedMemberReferenceExpression::IndexedMemberReferenceExpression(std::string object_name,
+			std::string member_name, std::shared_ptr<IExpression> ndx_expr)
+	: IVariableExpression(object_name + "." + member_name)
+{
+	TRACE_VERBOSE("IndexedMemberReferenceExpression - Object: '" + object_name + "', "
+				+ "MemberName: '" + member_name + "'")
+	if(!ndx_expr) throw std::invalid_argument("IndexedMemberReferenceExpression - Index Expression NULL");
+
+	_pSymbol = Symbol_table::instance()->find_symbol(object_name);
+	if(!_pSymbol)
+	{
+		throw undeclared_variable(object_name);
+	}
+
+	std::shared_ptr<Game_object> pObj;
+	if(_pSymbol->get_game_object(pObj) == CONVERSION_ERROR)
+	{
+		throw object_expected_lhs(object_name);
+	}
+
+	if(pObj->indexed_member_variable_size(member_name) < 0)
+	{
+		throw undeclared_member(object_name, member_name);
+	}
+
+	if(ndx_expr->get_type() != INT)
+	{
+		throw invalid_index_type(object_name + "." + member_name, ndx_expr->get_type());
+	}
+
+	_object_name = object_name;
+	_member_name = member_name;
+	add_child(ndx_expr);
+}
+
+Gpl_type IndexedMemberReferenceExpression::get_type() const
+{ return INT; }
+
+void IndexedMemberReferenceExpression::get_variables(VariableSet& vars) const
+{
+	vars.insert(get_storage_name());
+	IExpression::get_variables(vars);
+}
+
+std::string IndexedMemberReferenceExpression::get_storage_name() const
+{
+	return "." + _member_name;
+}
+
+void IndexedMemberReferenceExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::INDEXED_MEMBER_REFERENCE_EXPRESSION);
+	out.write_string(_object_name);
+	out.write_string(_member_name);
+	get_child(0)->write(out);
+}
+
+std::shared_ptr<IValue> IndexedMemberReferenceExpression::eval() const
+{
+	Runtime_metrics::count_eval();
+	std::shared_ptr<IValue> ndx_val = get_child(0)->eval();
+
+	int ndx;
+	if(ndx_val->get_int(ndx) == CONVERSION_ERROR)
+	{
+		throw invalid_index_type(_object_name + "." + _member_name, ndx_val->get_type());
+	}
+
+	// the size can change (e.g. when a Tilemap is resized)
+	std::shared_ptr<Game_object> pObj;
+	_pSymbol->get_game_object(pObj);
+	if(ndx < 0 || ndx >= pObj->indexed_member_variable_size(_member_name))
+	{
+		index_out_of_bounds(_object_name + "." + _member_name, ndx).write_exception();
+		ndx = 0;
+	}
+
+	std::shared_ptr<IValue> pret(new MemberReference(_pSymbol,
+		_member_name + "[" + std::to_string(ndx) + "]"));
+	return pret;
+}
+
+void IOperationalExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::OPERATIONAL_EXPRESSION);
+	out.write_int(_operator);
+	out.write_int(get_child_count());
+	for(int i = 0; i < get_child_count(); i++)
+	{
+		get_child(i)->write(out);
+	}
+}
+
 AddExpression::AddExpression(std::shared_ptr<IExpression> pArg1, std::shared_ptr<IExpression> pArg2)
 	: IOperationalExpression(PLUS)
 {
@@ -321,6 +584,7 @@ AddExpression::~AddExpression()
 
 std::shared_ptr<IValue> AddExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> val1 = get_child(0)->eval();
 	std::shared_ptr<IValue> val2 = get_child(1)->eval();
 	std::shared_ptr<IValue> ret = nullptr;
@@ -406,6 +670,7 @@ MinusExpression::~MinusExpression()
 
 std::shared_ptr<IValue> MinusExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -470,6 +735,7 @@ MultiplyExpression::~MultiplyExpression()
 
 std::shared_ptr<IValue> MultiplyExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -536,6 +802,7 @@ DivideExpression::~DivideExpression()
 
 std::shared_ptr<IValue> DivideExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -558,7 +825,7 @@ std::shared_ptr<IValue> DivideExpression::eval() const
 		pval1->get_double(num1);
 		pval2->get_double(num2);
 
-		double result;
+		double result = 0;
 		if(num2 == 0) Error::error(Error::DIVIDE_BY_ZERO_AT_PARSE_TIME);
 		else result = num1 / num2;
 
@@ -573,6 +840,16 @@ Gpl_type DivideExpression::get_type() const
 	return _type;
 }
 
+bool DivideExpression::is_pure() const
+{
+	// dividing by zero reports an error, so only a known divisor is pure
+	if(!get_child(1)->is_constant()) return false;
+
+	double divisor;
+	get_child(1)->eval()->get_double(divisor);
+	return divisor != 0 && IExpression::is_pure();
+}
+
 ModExpression::ModExpression(std::shared_ptr<IExpression> pArg1, std::shared_ptr<IExpression> pArg2)
 	:  IOperationalExpression(MOD)
 {
@@ -595,6 +872,7 @@ ModExpression::~ModExpression()
 
 std::shared_ptr<IValue> ModExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -621,6 +899,15 @@ Gpl_type ModExpression::get_type() const
 	return _type;
 }
 
+bool ModExpression::is_pure() const
+{
+	if(!get_child(1)->is_constant()) return false;
+
+	int divisor;
+	get_child(1)->eval()->get_int(divisor);
+	return divisor != 0 && IExpression::is_pure();
+}
+
 
 SinExpression::SinExpression(std::shared_ptr<IExpression> pArg1)
 	: IOperationalExpression(SIN)
@@ -639,14 +926,14 @@ SinExpression::~SinExpression()
 
 std::shared_ptr<IValue> SinExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
 
 	double result;
 	pval1->get_double(result);
 
-	result = CONVERT_TO_RADIANS(result);
-	result = sin(result);
+	result = Gpl_math::sin_deg(result);
 
 	pret.reset(new GPLVariant(result, true));
 	return pret;
@@ -669,12 +956,12 @@ CosExpression::~CosExpression()
 
 std::shared_ptr<IValue> CosExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 	
 	double result;
 	pval->get_double(result);
-	result = CONVERT_TO_RADIANS(result);
-	result = cos(result);
+	result = Gpl_math::cos_deg(result);
 
 	std::shared_ptr<IValue>pret(new GPLVariant(result, true));
 	return pret;
@@ -698,12 +985,12 @@ TanExpression::~TanExpression()
 
 std::shared_ptr<IValue> TanExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 	
 	double result;
 	pval->get_double(result);
-	result = CONVERT_TO_RADIANS(result);
-	result = tan(result);
+	result = Gpl_math::tan_deg(result);
 
 	return std::shared_ptr<IValue>(new GPLVariant(result, true));
 }
@@ -725,12 +1012,12 @@ AsinExpression::~AsinExpression()
 
 std::shared_ptr<IValue> AsinExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 
 	double result;
 	pval->get_double(result);
-	result = asin(result);
-	result = CONVERT_TO_DEGREES(result);
+	result = Gpl_math::asin_deg(result);
 	return std::shared_ptr<IValue>(new GPLVariant(result, true));
 }
 
@@ -751,12 +1038,12 @@ AcosExpression::~AcosExpression()
 
 std::shared_ptr<IValue> AcosExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 
 	double result;
 	pval->get_double(result);
-	result = acos(result);
-	result = CONVERT_TO_DEGREES(result);
+	result = Gpl_math::acos_deg(result);
 
 	return std::shared_ptr<IValue>(new GPLVariant(result, true));
 }
@@ -778,12 +1065,12 @@ AtanExpression::~AtanExpression()
 
 std::shared_ptr<IValue> AtanExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 
 	double result;
 	pval->get_double(result);
-	result = atan(result);
-	result = CONVERT_TO_DEGREES(result);
+	result = Gpl_math::atan_deg(result);
 
 	return std::shared_ptr<IValue>(new GPLVariant(result, true));
 }
@@ -805,6 +1092,7 @@ SqrtExpression::~SqrtExpression()
 
 std::shared_ptr<IValue> SqrtExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 
 	double result;
@@ -832,6 +1120,7 @@ FloorExpression::~FloorExpression()
 
 std::shared_ptr<IValue> FloorExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 
 	double orig;
@@ -860,6 +1149,7 @@ AbsoluteExpression::~AbsoluteExpression()
 
 std::shared_ptr<IValue> AbsoluteExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 	std::shared_ptr<IValue> pret = nullptr;	
 
@@ -902,19 +1192,15 @@ RandomExpression::~RandomExpression()
 
 std::shared_ptr<IValue> RandomExpression::eval() const
 {
-	static unsigned seed = 
-		std::chrono::system_clock::now().time_since_epoch().count();
-
-	static std::default_random_engine generator(seed);
-
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval = get_child(0)->eval();
 
 	double orig;
 	pval->get_double(orig);
 
-	int result = abs(floor(orig));
-	std::uniform_int_distribution<int> distribution(0, result? result - 1 : 0);
-	result = distribution(generator);
+	// random(n) is in [0, |n| - 1], random(0) is 0
+	int bound = abs(floor(orig));
+	int result = bound? Random_stream::current().uniform(bound) : 0;
 
 	return std::shared_ptr<IValue>(new GPLVariant(result, true));
 }
@@ -937,6 +1223,7 @@ EqualExpression::EqualExpression(std::shared_ptr<IExpression> pArg1, std::shared
 
 std::shared_ptr<IValue> EqualExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -986,6 +1273,7 @@ NotEqualExpression::NotEqualExpression(std::shared_ptr<IExpression> pArg1, std::
 
 std::shared_ptr<IValue> NotEqualExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -1031,6 +1319,7 @@ LessThanExpression::LessThanExpression(std::shared_ptr<IExpression> pArg1, std::
 
 std::shared_ptr<IValue> LessThanExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -1076,6 +1365,7 @@ LessThanEqualExpression::LessThanEqualExpression(std::shared_ptr<IExpression> pA
 
 std::shared_ptr<IValue> LessThanEqualExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -1121,6 +1411,7 @@ GreaterThanExpression::GreaterThanExpression(std::shared_ptr<IExpression> pArg1,
 
 std::shared_ptr<IValue> GreaterThanExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -1166,6 +1457,7 @@ GreaterThanEqualExpression::GreaterThanEqualExpression(std::shared_ptr<IExpressi
 
 std::shared_ptr<IValue> GreaterThanEqualExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 	std::shared_ptr<IValue> pret = nullptr;
@@ -1211,6 +1503,7 @@ AndExpression::AndExpression(std::shared_ptr<IExpression> pArg1, std::shared_ptr
 
 std::shared_ptr<IValue> AndExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 
@@ -1241,6 +1534,7 @@ OrExpression::OrExpression(std::shared_ptr<IExpression> pArg1, std::shared_ptr<I
 
 std::shared_ptr<IValue> OrExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pval2 = get_child(1)->eval();
 
@@ -1267,6 +1561,7 @@ NotExpression::NotExpression(std::shared_ptr<IExpression> pArg)
 
 std::shared_ptr<IValue> NotExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pval1 = get_child(0)->eval();
 	
 	double dbl1;
@@ -1279,6 +1574,274 @@ std::shared_ptr<IValue> NotExpression::eval() const
 
 //================================================================
 
+// What TypedBinaryExpression<OP, T1, T2> computes: apply() takes the
+// operands as their own types, and its return type is the type of the
+// expression (a comparison's bool is an int)
+template <Operator_type OP> struct Binary_op;
+
+template <> struct Binary_op<PLUS>
+{
+	template <typename T1, typename T2>
+	static auto apply(const T1& a, const T2& b) -> decltype(a + b) { return a + b; }
+};
+
+template <> struct Binary_op<MINUS>
+{
+	template <typename T1, typename T2>
+	static auto apply(T1 a, T2 b) -> decltype(a - b) { return a - b; }
+};
+
+template <> struct Binary_op<MULTIPLY>
+{
+	template <typename T1, typename T2>
+	static auto apply(T1 a, T2 b) -> decltype(a * b) { return a * b; }
+};
+
+template <> struct Binary_op<DIVIDE>
+{
+	template <typename T1, typename T2>
+	static auto apply(T1 a, T2 b) -> decltype(a / b)
+	{
+		if(b == 0)
+		{
+			Error::error(Error::DIVIDE_BY_ZERO_AT_PARSE_TIME);
+			return 0;
+		}
+		return a / b;
+	}
+};
+
+template <> struct Binary_op<MOD>
+{
+	static int apply(int a, int b)
+	{
+		if(b == 0)
+		{
+			Error::error(Error::MOD_BY_ZERO_AT_PARSE_TIME);
+			return 0;
+		}
+		return a % b;
+	}
+};
+
+// the generic classes evaluate both operands too
+template <> struct Binary_op<AND>
+{
+	template <typename T1, typename T2>
+	static bool apply(T1 a, T2 b) { return a && b; }
+};
+
+template <> struct Binary_op<OR>
+{
+	template <typename T1, typename T2>
+	static bool apply(T1 a, T2 b) { return a || b; }
+};
+
+template <> struct Binary_op<EQUAL>
+{
+	template <typename T1, typename T2>
+	static bool apply(const T1& a, const T2& b) { return a == b; }
+};
+
+template <> struct Binary_op<NOT_EQUAL>
+{
+	template <typename T1, typename T2>
+	static bool apply(const T1& a, const T2& b) { return a != b; }
+};
+
+template <> struct Binary_op<LESS_THAN>
+{
+	template <typename T1, typename T2>
+	static bool apply(const T1& a, const T2& b) { return a < b; }
+};
+
+template <> struct Binary_op<LESS_THAN_EQUAL>
+{
+	template <typename T1, typename T2>
+	static bool apply(const T1& a, const T2& b) { return a <= b; }
+};
+
+template <> struct Binary_op<GREATER_THAN>
+{
+	template <typename T1, typename T2>
+	static bool apply(const T1& a, const T2& b) { return a > b; }
+};
+
+template <> struct Binary_op<GREATER_THAN_EQUAL>
+{
+	template <typename T1, typename T2>
+	static bool apply(const T1& a, const T2& b) { return a >= b; }
+};
+
+// reads an operand as the type the parser found for it
+static void get_operand(const std::shared_ptr<IValue>& pVal, int& val) { pVal->get_int(val); }
+static void get_operand(const std::shared_ptr<IValue>& pVal, double& val) { pVal->get_double(val); }
+static void get_operand(const std::shared_ptr<IValue>& pVal, std::string& val) { pVal->get_string(val); }
+
+// the gpl type of an operand or a result
+template <typename T> struct Gpl_type_of;
+template <> struct Gpl_type_of<int> { static const Gpl_type type = INT; };
+template <> struct Gpl_type_of<bool> { static const Gpl_type type = INT; };
+template <> struct Gpl_type_of<double> { static const Gpl_type type = DOUBLE; };
+template <> struct Gpl_type_of<std::string> { static const Gpl_type type = STRING; };
+
+static IValue* new_result(int val) { return new GPLVariant(val, true); }
+static IValue* new_result(bool val) { return new GPLVariant((int) val, true); }
+static IValue* new_result(double val) { return new GPLVariant(val, true); }
+static IValue* new_result(const std::string& val) { return new GPLVariant(val, true); }
+
+template <Operator_type OP, typename T1, typename T2>
+TypedBinaryExpression<OP, T1, T2>::TypedBinaryExpression(std::shared_ptr<IExpression> pArg1, 
+							std::shared_ptr<IExpression> pArg2)
+	: IOperationalExpression(OP)
+{
+	if(!pArg1 || !pArg2) throw std::invalid_argument("Argument cannot be NULL");
+
+	if(pArg1->get_type() != Gpl_type_of<T1>::type || pArg2->get_type() != Gpl_type_of<T2>::type)
+		throw std::invalid_argument("Operand types do not match the expression");
+
+	add_child(pArg1);
+	add_child(pArg2);
+}
+
+template <Operator_type OP, typename T1, typename T2>
+std::shared_ptr<IValue> TypedBinaryExpression<OP, T1, T2>::eval() const
+{
+	Runtime_metrics::count_eval();
+	T1 val1;
+	T2 val2;
+	get_operand(get_child(0)->eval(), val1);
+	get_operand(get_child(1)->eval(), val2);
+
+	return std::shared_ptr<IValue>(new_result(Binary_op<OP>::apply(val1, val2)));
+}
+
+template <Operator_type OP, typename T1, typename T2>
+Gpl_type TypedBinaryExpression<OP, T1, T2>::get_type() const
+{
+	typedef decltype(Binary_op<OP>::apply(std::declval<T1>(), std::declval<T2>())) Result;
+	return Gpl_type_of<typename std::decay<Result>::type>::type;
+}
+
+template <Operator_type OP, typename T1, typename T2>
+bool TypedBinaryExpression<OP, T1, T2>::is_pure() const
+{
+	// dividing by zero reports an error, so only a known divisor is pure
+	if(OP == DIVIDE || OP == MOD)
+	{
+		if(!get_child(1)->is_constant()) return false;
+
+		T2 divisor;
+		get_operand(get_child(1)->eval(), divisor);
+		if(divisor == T2()) return false;
+	}
+	return IExpression::is_pure();
+}
+
+// The string x string specialization, for the operators that have one
+template <Operator_type OP, bool bStrings>
+struct Typed_strings
+{
+	static IExpression* make(const std::shared_ptr<IExpression>&,
+				const std::shared_ptr<IExpression>&) { return nullptr; }
+};
+
+template <Operator_type OP>
+struct Typed_strings<OP, true>
+{
+	static IExpression* make(const std::shared_ptr<IExpression>& pArg1,
+				const std::shared_ptr<IExpression>& pArg2)
+	{
+		return new TypedBinaryExpression<OP, std::string, std::string>(pArg1, pArg2);
+	}
+};
+
+// The specialization for the types of the operands, or nullptr if they
+// are not both numbers (or, with bStrings, both strings)
+template <Operator_type OP, bool bStrings>
+static IExpression* make_typed(const std::shared_ptr<IExpression>& pArg1,
+				const std::shared_ptr<IExpression>& pArg2)
+{
+	Gpl_type t1 = pArg1->get_type();
+	Gpl_type t2 = pArg2->get_type();
+
+	if(t1 == STRING && t2 == STRING)
+		return Typed_strings<OP, bStrings>::make(pArg1, pArg2);
+
+	if(t1 == INT && t2 == INT)
+		return new TypedBinaryExpression<OP, int, int>(pArg1, pArg2);
+	if(t1 == INT && t2 == DOUBLE)
+		return new TypedBinaryExpression<OP, int, double>(pArg1, pArg2);
+	if(t1 == DOUBLE && t2 == INT)
+		return new TypedBinaryExpression<OP, double, int>(pArg1, pArg2);
+	if(t1 == DOUBLE && t2 == DOUBLE)
+		return new TypedBinaryExpression<OP, double, double>(pArg1, pArg2);
+	return nullptr;
+}
+
+static bool _bTyped_binary_expressions = true;
+
+void set_typed_binary_expressions(bool bTyped)
+{
+	_bTyped_binary_expressions = bTyped;
+}
+
+IExpression* make_binary_expression(Operator_type op,
+	std::shared_ptr<IExpression> pArg1, std::shared_ptr<IExpression> pArg2)
+{
+	if(!pArg1 || !pArg2) throw std::invalid_argument("Argument cannot be NULL");
+
+	IExpression* pExpr = nullptr;
+	bool bTyped = _bTyped_binary_expressions;
+	switch(op)
+	{
+		case PLUS:
+			if(bTyped && (pExpr = make_typed<PLUS, true>(pArg1, pArg2))) return pExpr;
+			return new AddExpression(pArg1, pArg2);
+		case MINUS:
+			if(bTyped && (pExpr = make_typed<MINUS, false>(pArg1, pArg2))) return pExpr;
+			return new MinusExpression(pArg1, pArg2);
+		case MULTIPLY:
+			if(bTyped && (pExpr = make_typed<MULTIPLY, false>(pArg1, pArg2))) return pExpr;
+			return new MultiplyExpression(pArg1, pArg2);
+		case DIVIDE:
+			if(bTyped && (pExpr = make_typed<DIVIDE, false>(pArg1, pArg2))) return pExpr;
+			return new DivideExpression(pArg1, pArg2);
+		case MOD:
+			if(bTyped && pArg1->get_type() == INT && pArg2->get_type() == INT)
+				return new TypedBinaryExpression<MOD, int, int>(pArg1, pArg2);
+			return new ModExpression(pArg1, pArg2);
+		case AND:
+			if(bTyped && (pExpr = make_typed<AND, false>(pArg1, pArg2))) return pExpr;
+			return new AndExpression(pArg1, pArg2);
+		case OR:
+			if(bTyped && (pExpr = make_typed<OR, false>(pArg1, pArg2))) return pExpr;
+			return new OrExpression(pArg1, pArg2);
+		case EQUAL:
+			if(bTyped && (pExpr = make_typed<EQUAL, true>(pArg1, pArg2))) return pExpr;
+			return new EqualExpression(pArg1, pArg2);
+		case NOT_EQUAL:
+			if(bTyped && (pExpr = make_typed<NOT_EQUAL, true>(pArg1, pArg2))) return pExpr;
+			return new NotEqualExpression(pArg1, pArg2);
+		case LESS_THAN:
+			if(bTyped && (pExpr = make_typed<LESS_THAN, true>(pArg1, pArg2))) return pExpr;
+			return new LessThanExpression(pArg1, pArg2);
+		case LESS_THAN_EQUAL:
+			if(bTyped && (pExpr = make_typed<LESS_THAN_EQUAL, true>(pArg1, pArg2))) return pExpr;
+			return new LessThanEqualExpression(pArg1, pArg2);
+		case GREATER_THAN:
+			if(bTyped && (pExpr = make_typed<GREATER_THAN, true>(pArg1, pArg2))) return pExpr;
+			return new GreaterThanExpression(pArg1, pArg2);
+		case GREATER_THAN_EQUAL:
+			if(bTyped && (pExpr = make_typed<GREATER_THAN_EQUAL, true>(pArg1, pArg2))) return pExpr;
+			return new GreaterThanEqualExpression(pArg1, pArg2);
+		default:
+			throw std::invalid_argument("Not a binary operator: " + operator_to_string(op));
+	}
+}
+
+//================================================================
+
 TouchesExpression::TouchesExpression(std::shared_ptr<IVariableExpression> pArg1, 
 				std::shared_ptr<IVariableExpression> pArg2)
 		: IExpression()
@@ -1303,6 +1866,7 @@ TouchesExpression::TouchesExpression(std::shared_ptr<IVariableExpression> pArg1,
 
 std::shared_ptr<IValue> TouchesExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pVal1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pVal2 = get_child(1)->eval();
 
@@ -1322,6 +1886,23 @@ std::shared_ptr<IValue> TouchesExpression::eval() const
 	return pret;
 }
 
+void TouchesExpression::get_variables(VariableSet& vars) const
+{
+	IExpression::get_variables(vars);
+	vars.insert(".x");
+	vars.insert(".y");
+	vars.insert(".w");
+	vars.insert(".h");
+	vars.insert(".active");
+}
+
+void TouchesExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::TOUCHES_EXPRESSION);
+	get_child(0)->write(out);
+	get_child(1)->write(out);
+}
+
 //============================================================
 
 NearExpression::NearExpression(std::shared_ptr<IVariableExpression> pArg1, 
@@ -1346,6 +1927,7 @@ NearExpression::NearExpression(std::shared_ptr<IVariableExpression> pArg1,
 
 std::shared_ptr<IValue> NearExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pVal1 = get_child(0)->eval();
 	std::shared_ptr<IValue> pVal2 = get_child(1)->eval();
 
@@ -1363,3 +1945,156 @@ std::shared_ptr<IValue> NearExpression::eval() const
 	return pret;
 }
 
+void NearExpression::get_variables(VariableSet& vars) const
+{
+	IExpression::get_variables(vars);
+	vars.insert(".x");
+	vars.insert(".y");
+	vars.insert(".w");
+	vars.insert(".h");
+	vars.insert(".proximity");
+	vars.insert(".active");
+}
+
+void NearExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::NEAR_EXPRESSION);
+	get_child(0)->write(out);
+	get_child(1)->write(out);
+}
+
+//============================================================
+
+SpawnExpression::SpawnExpression(const std::string& pool_name)
+	: IExpression()
+{
+	Symbol_table* pTable = Symbol_table::instance();
+	_pool_name = pool_name;
+
+	if(pTable->find_symbol(pool_name))
+		throw not_an_array(pool_name);
+
+	// the pool is every element of the array, in order
+	std::shared_ptr<Symbol> pSymbol;
+	for(int i = 0; (pSymbol = pTable->find_symbol(pool_name + "[" + std::to_string(i) + "]")); i++)
+	{
+		std::shared_ptr<Game_object> pObj;
+		if(pSymbol->get_type() != GAME_OBJECT 
+			|| pSymbol->get_game_object(pObj) == CONVERSION_ERROR || !pObj)
+		{
+			throw object_operand_expected(pool_name);
+		}
+		_pool.push_back(pObj);
+	}
+
+	if(_pool.empty()) throw undeclared_variable(pool_name);
+}
+
+std::shared_ptr<IValue> SpawnExpression::eval() const
+{
+	Runtime_metrics::count_eval();
+
+	int result = -1;
+	for(size_t i = 0; i < _pool.size(); i++)
+	{
+		if(!_pool[i]->active())
+		{
+			_pool[i]->spawn();
+			result = i;
+			break;
+		}
+	}
+
+	return std::shared_ptr<IValue>(new GPLVariant(result, true));
+}
+
+void SpawnExpression::get_variables(VariableSet& vars) const
+{
+	vars.insert(".active");
+}
+
+void SpawnExpression::get_side_effects(VariableSet& vars) const
+{
+	vars.insert(".active");
+}
+
+void SpawnExpression::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::SPAWN_EXPRESSION);
+	out.write_string(_pool_name);
+}
+
+//============================================================
+
+LoopInvariantExpression::LoopInvariantExpression(std::shared_ptr<IExpression> pExpr, 
+						const unsigned* pLoopRun)
+	: IExpression()
+{
+	if(!pExpr) throw std::invalid_argument("Expression is NULL");
+	if(!pLoopRun) throw std::invalid_argument("Loop Run Counter is NULL");
+
+	_pLoopRun = pLoopRun;
+	_cached_run = *pLoopRun - 1;
+	add_child(pExpr);
+}
+
+std::shared_ptr<IValue> LoopInvariantExpression::eval() const
+{
+	Runtime_metrics::count_eval();
+	if(_cached_run != *_pLoopRun || !_pCached)
+	{
+		_pCached = get_child(0)->eval();
+		_cached_run = *_pLoopRun;
+	}
+
+	return _pCached;
+}
+
+Gpl_type LoopInvariantExpression::get_type() const
+{
+	return get_child(0)->get_type();
+}
+
+void LoopInvariantExpression::write(Snapshot_writer& out) const
+{
+	// the loop wraps the expression again when it is read
+	get_child(0)->write(out);
+}
+
+//================================================================
+
+CommonExpression::CommonExpression(std::shared_ptr<IExpression> pExpr,
+		std::shared_ptr<Common_value> pValue, const unsigned* pBlockRun)
+	: IExpression()
+{
+	if(!pExpr) throw std::invalid_argument("Expression is NULL");
+	if(!pValue) throw std::invalid_argument("Common Value is NULL");
+	if(!pBlockRun) throw std::invalid_argument("Block Run Counter is NULL");
+
+	_pValue = pValue;
+	_pBlockRun = pBlockRun;
+	add_child(pExpr);
+}
+
+std::shared_ptr<IValue> CommonExpression::eval() const
+{
+	Runtime_metrics::count_eval();
+	if(_pValue->run != *_pBlockRun || !_pValue->pValue)
+	{
+		_pValue->pValue = get_child(0)->eval();
+		_pValue->run = *_pBlockRun;
+	}
+
+	return _pValue->pValue;
+}
+
+Gpl_type CommonExpression::get_type() const
+{
+	return get_child(0)->get_type();
+}
+
+void CommonExpression::write(Snapshot_writer& out) const
+{
+	// the block shares its sub-expressions again when it is read
+	get_child(0)->write(out);
+}
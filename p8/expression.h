@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <memory>
+#include <set>
+#include <string>
 
 #include "GPLVariant.h"
 #include "value.h"
@@ -10,11 +12,14 @@
 //==================================================================
 //	F O R W A R D  D E F I N I T I O N S 
 //==================================================================
+class Symbol;
+class Snapshot_writer;
 class IExpression;
 class IVariableExpression;
 class ValueExpression;
 class ArrayReferenceExpression;
 class ArrayMemberReferenceExpression; //Implement later
+class IndexedMemberReferenceExpression;
 
 // Math Expressions
 class IOperationalExpression;
@@ -33,6 +38,7 @@ class SqrtExpression;
 class FloorExpression;
 class AbsoluteExpression;
 class RandomExpression;
+class SpawnExpression;
 
 // Comparison Expressions
 class EqualExpression;
@@ -53,6 +59,12 @@ class NearExpression;
 
 typedef std::vector<std::shared_ptr<IExpression>> ExpressionList;
 
+// The storage names of a set of variables. Plain variables use their name,
+// array elements use "name[]" (any element of the array) and game object
+// members use ".member" (that member of any object). Used by the statement
+// optimizers to decide whether an expression can change while a loop runs.
+typedef std::set<std::string> VariableSet;
+
 // An expression is a statement that can be evaluated to produce a value.
 // Values are produced by taking constants & variables and applying operators
 // to them. These values maybe a direct reference to a variable or a constant.
@@ -65,7 +77,8 @@ typedef std::vector<std::shared_ptr<IExpression>> ExpressionList;
 // operators for acting upon its children, once they have been evaluated.
 
 // NOTE: Expressions do not chnage after construction. So there are no methods
-// to add/remove child Expressions.
+// to add/remove child Expressions. The one exception is replace_child(), which
+// the optimizers use to swap a child for an equivalent Expression of the same type.
 
 class IExpression
 {
@@ -77,6 +90,32 @@ public:
 
 	virtual int get_child_count() const;
 	virtual std::shared_ptr<IExpression> get_child(int ndx) const;
+	void replace_child(int ndx, const std::shared_ptr<IExpression>& child);
+
+	// An expression is pure if evaluating it has no side effects (including
+	// runtime error messages) and it always produces the same value given the
+	// same variable values. Constant expressions are pure and read no variables.
+	virtual bool is_pure() const;
+	virtual bool is_constant() const;
+
+	// An expression is repeatable if evaluating it again, with no variable
+	// changed in between, produces the same value and nothing new: a runtime
+	// error message would only be repeated. Pure expressions and array
+	// references are repeatable, random() and spawn() are not.
+	virtual bool is_repeatable() const;
+
+	// Adds the storage names of every variable read while evaluating
+	virtual void get_variables(VariableSet& vars) const;
+
+	// Adds the storage names of every variable written while evaluating
+	// (only spawn() has side effects)
+	virtual void get_side_effects(VariableSet& vars) const;
+
+	// The storage name of the variable this expression refers to, or ""
+	virtual std::string get_storage_name() const;
+
+	// Writes the expression to the program cache (see program_cache.h)
+	virtual void write(Snapshot_writer& out) const = 0;
 
 protected:
 	virtual ExpressionList& get_children();
@@ -110,6 +149,11 @@ public:
 
 	Gpl_type get_type() const;
 	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+
+	bool is_constant() const;
+	void get_variables(VariableSet& vars) const;
+	std::string get_storage_name() const;
 	
 private:
 	std::shared_ptr<IValue> _pVal;	
@@ -127,6 +171,12 @@ public:
 
 	Gpl_type get_type() const;
 	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+
+	bool is_pure() const { return false; };
+	bool is_constant() const { return false; };
+	void get_variables(VariableSet& vars) const;
+	std::string get_storage_name() const;
 
 private:
 	std::shared_ptr<IValue> _pVal;
@@ -142,14 +192,42 @@ public:
 	Gpl_type get_type() const;
 
 	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
 	const std::string& get_array_name() const;
 	const std::string& get_member_name() const;
+
+	bool is_pure() const { return false; };
+	bool is_constant() const { return false; };
+	void get_variables(VariableSet& vars) const;
+	std::string get_storage_name() const;
 private:
 	std::shared_ptr<IValue> _pVal;
 	std::string _array_name, _member_name;
 	Gpl_type _type;
 };
 
+// An element of an indexed member of an object. For example: map.tile[i]
+// Indexed members are always int.
+class IndexedMemberReferenceExpression : public IVariableExpression
+{
+public:
+	IndexedMemberReferenceExpression(std::string object_name, std::string member_name,
+					std::shared_ptr<IExpression> ndx_expr);
+	virtual ~IndexedMemberReferenceExpression() {};
+	Gpl_type get_type() const;
+
+	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+
+	bool is_pure() const { return false; };
+	bool is_constant() const { return false; };
+	void get_variables(VariableSet& vars) const;
+	std::string get_storage_name() const;
+private:
+	std::shared_ptr<Symbol> _pSymbol;
+	std::string _object_name, _member_name;
+};
+
 
 
 class IOperationalExpression : public IExpression
@@ -160,7 +238,8 @@ public:
 
 	virtual ~IOperationalExpression() {};
 
-	Operator_type get_operator() { return _operator; };
+	Operator_type get_operator() const { return _operator; };
+	void write(Snapshot_writer& out) const;
 private:
 	Operator_type _operator;
 };
@@ -206,6 +285,7 @@ public:
 	virtual ~DivideExpression();
 	std::shared_ptr<IValue> eval() const;
 	Gpl_type get_type() const;
+	bool is_pure() const;
 private:
 	Gpl_type _type;
 };
@@ -217,6 +297,7 @@ public:
 	virtual ~ModExpression();
 	std::shared_ptr<IValue> eval() const;
 	Gpl_type get_type() const;
+	bool is_pure() const;
 private:
 	Gpl_type _type;
 };
@@ -317,6 +398,8 @@ public:
 	virtual ~RandomExpression();
 	std::shared_ptr<IValue> eval() const;
 	Gpl_type get_type() const { return INT; };
+	bool is_pure() const { return false; };
+	bool is_repeatable() const { return false; };
 };
 
 class EqualExpression : public IOperationalExpression
@@ -406,13 +489,47 @@ public:
 	Gpl_type get_type() const { return INT; };
 };
 
+// A binary operator specialized at compile time for the C++ types of its
+// operands (int, double or std::string). eval() reads each operand as its
+// own type and applies the operator, without the type switch and the
+// conversions of the generic classes above. The operator is kept in
+// IOperationalExpression, so the jit, the optimizers and the program cache
+// treat it like the generic one. Only make_binary_expression() creates
+// them (the members are defined in expression.cpp).
+template <Operator_type OP, typename T1, typename T2>
+class TypedBinaryExpression : public IOperationalExpression
+{
+public:
+	TypedBinaryExpression(std::shared_ptr<IExpression> pArg1, std::shared_ptr<IExpression> pArg2);
+	virtual ~TypedBinaryExpression() {};
+	std::shared_ptr<IValue> eval() const;
+	Gpl_type get_type() const;
+	bool is_pure() const;
+};
+
+// Creates the expression for pArg1 op pArg2. The parser and the program
+// cache use it instead of the classes above: a TypedBinaryExpression for
+// int x int, int x double, double x int and double x double operands (the
+// arithmetic, comparison and logical operators) and string x string
+// operands (+ and the comparisons). Anything else, a string and a number
+// or an operand of the wrong type, gets the generic class, whose
+// constructor reports the errors.
+IExpression* make_binary_expression(Operator_type op,
+	std::shared_ptr<IExpression> pArg1, std::shared_ptr<IExpression> pArg2);
+
+// gpl -typed_nodes off makes make_binary_expression() create only the
+// generic classes, to compare the two (see expression_bench.gpl)
+void set_typed_binary_expressions(bool bTyped);
+
 class TouchesExpression : public IExpression
 {
 public:
 	TouchesExpression(std::shared_ptr<IVariableExpression> pArg1, std::shared_ptr<IVariableExpression> pArg2);
 	virtual ~TouchesExpression() {};
 	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
 	Gpl_type get_type() const { return INT; };
+	void get_variables(VariableSet& vars) const;
 };
 
 class NearExpression : public IExpression
@@ -421,7 +538,78 @@ public:
 	NearExpression(std::shared_ptr<IVariableExpression> pArg1, std::shared_ptr<IVariableExpression> pArg2);
 	virtual ~NearExpression() {};
 	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
 	Gpl_type get_type() const { return INT; };
+	void get_variables(VariableSet& vars) const;
+};
+
+// spawn(pool): activates the first despawned object in the array pool
+// and evaluates to its index, or -1 if every object is already active
+class SpawnExpression : public IExpression
+{
+public:
+	SpawnExpression(const std::string& pool_name);
+	virtual ~SpawnExpression() {};
+	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+	Gpl_type get_type() const { return INT; };
+
+	bool is_pure() const { return false; };
+	bool is_repeatable() const { return false; };
+	bool is_constant() const { return false; };
+	void get_variables(VariableSet& vars) const;
+	void get_side_effects(VariableSet& vars) const;
+
+private:
+	std::string _pool_name;
+	std::vector<std::shared_ptr<Game_object>> _pool;
+};
+
+// Wraps a sub-expression that a loop has proven invariant for as long as it
+// runs. The wrapped expression is evaluated the first time it is needed during
+// each run of the loop and the result is reused for the rest of that run.
+// The loop signals a new run by incrementing the counter at pLoopRun.
+class LoopInvariantExpression : public IExpression
+{
+public:
+	LoopInvariantExpression(std::shared_ptr<IExpression> pExpr, const unsigned* pLoopRun);
+	virtual ~LoopInvariantExpression() {};
+	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+	Gpl_type get_type() const;
+
+private:
+	const unsigned* _pLoopRun;
+	mutable unsigned _cached_run;
+	mutable std::shared_ptr<IValue> _pCached;
+};
+
+// The value of a sub-expression that a statement block evaluates more than
+// once, shared by all the CommonExpressions that wrap an occurrence of it
+// (see Common_subexpressions)
+struct Common_value
+{
+	unsigned run;
+	std::shared_ptr<IValue> pValue;
+};
+
+// Wraps one occurrence of a common sub-expression. The first occurrence
+// evaluated during a run of the block computes the shared value, the others
+// reuse it. The block signals a new run by incrementing the counter at
+// pBlockRun.
+class CommonExpression : public IExpression
+{
+public:
+	CommonExpression(std::shared_ptr<IExpression> pExpr,
+		std::shared_ptr<Common_value> pValue, const unsigned* pBlockRun);
+	virtual ~CommonExpression() {};
+	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+	Gpl_type get_type() const;
+
+private:
+	std::shared_ptr<Common_value> _pValue;
+	const unsigned* _pBlockRun;
 };
 
 #endif
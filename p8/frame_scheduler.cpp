@@ -0,0 +1,214 @@
+#include "frame_scheduler.h"
+#include "symbol_table.h"
+#include "error.h"
+#include "parser.h"
+#include "interpreter_context.h"
+
+#include <algorithm>
+#include <iomanip>
+
+const int Frame_scheduler::HISTOGRAM_BOUNDS[HISTOGRAM_SIZE - 1]
+	= { 1, 2, 4, 8, 16, 33, 66 };
+
+Frame_scheduler::Frame_scheduler()
+{
+	_policy = DEGRADE;
+	_period_ms = 16;
+	_max_catch_up = 5;
+	_bStarted = false;
+	_bFixed_step = false;
+
+	_frame_count = 0;
+	_frames_late = 0;
+	_frames_skipped = 0;
+	_skipped_in_row = 0;
+	_last_frame_ms = 0;
+	_worst_frame_ms = 0;
+	_total_frame_ms = 0;
+	for(int i = 0; i < HISTOGRAM_SIZE; i++) _histogram[i] = 0;
+}
+
+Frame_scheduler* Frame_scheduler::instance()
+{
+	return &Interpreter_context::current()->get_frame_scheduler();
+}
+
+bool Frame_scheduler::string_to_policy(const std::string& str, Policy& policy)
+{
+	if(str == "catch_up") policy = CATCH_UP;
+	else if(str == "skip_render") policy = SKIP_RENDER;
+	else if(str == "degrade") policy = DEGRADE;
+	else return false;
+	return true;
+}
+
+std::string Frame_scheduler::policy_to_string(Policy policy)
+{
+	switch(policy)
+	{
+		case CATCH_UP: return "catch_up";
+		case SKIP_RENDER: return "skip_render";
+		case DEGRADE: return "degrade";
+	}
+	return "unknown";
+}
+
+bool Frame_scheduler::is_reserved_variable(const std::string& name)
+{
+	return name == "frame_count" || name == "frames_late"
+		|| name == "frames_skipped" || name == "frame_period"
+		|| name == "frame_time" || name == "worst_frame_time";
+}
+
+void Frame_scheduler::set_policy(Policy policy)
+{
+	_policy = policy;
+}
+
+void Frame_scheduler::set_period(int ms)
+{
+	if(ms < 1) ms = 1;
+	_period_ms = ms;
+}
+
+void Frame_scheduler::set_max_catch_up(int steps)
+{
+	if(steps < 1) steps = 1;
+	_max_catch_up = steps;
+}
+
+std::shared_ptr<Symbol> Frame_scheduler::find_reserved(const std::string& name, bool bDouble) const
+{
+	std::shared_ptr<Symbol> pSymbol = Symbol_table::instance()->find_symbol(name);
+	if(!pSymbol) return NULL;
+
+	Gpl_type expected = bDouble ? DOUBLE : INT;
+	if(pSymbol->get_type() != expected)
+	{
+		Error::error(Error::INVALID_TYPE_FOR_RESERVED_VARIABLE, name,
+			gpl_type_to_string(pSymbol->get_type()), gpl_type_to_string(expected));
+		return NULL;
+	}
+	return pSymbol;
+}
+
+void Frame_scheduler::start()
+{
+	_pFrameCount = find_reserved("frame_count", false);
+	_pFramesLate = find_reserved("frames_late", false);
+	_pFramesSkipped = find_reserved("frames_skipped", false);
+	_pFramePeriod = find_reserved("frame_period", false);
+	_pFrameTime = find_reserved("frame_time", true);
+	_pWorstFrameTime = find_reserved("worst_frame_time", true);
+
+	publish();
+
+	_deadline = Clock::now() + std::chrono::milliseconds(_period_ms);
+	_bStarted = true;
+}
+
+int Frame_scheduler::tick(void (*simulate)(), void (*render)())
+{
+	if(!_bStarted) start();
+
+	const Clock::duration period = std::chrono::milliseconds(_period_ms);
+	Clock::time_point begin = Clock::now();
+
+	// how many whole periods the tick started behind its deadline
+	int behind = 0;
+	if(begin > _deadline) behind = (begin - _deadline) / period;
+
+	int steps = 1;
+	bool bRender = true;
+	if(!_bFixed_step) switch(_policy)
+	{
+		case CATCH_UP:
+			steps = std::min(behind + 1, _max_catch_up);
+			break;
+		case SKIP_RENDER:
+			// never starve the window completely
+			bRender = (behind == 0 || _skipped_in_row >= _max_catch_up);
+			break;
+		case DEGRADE:
+			break;
+	}
+
+	for(int i = 0; i < steps; i++) simulate();
+
+	if(bRender)
+	{
+		render();
+		_skipped_in_row = 0;
+	}
+	else
+	{
+		_frames_skipped++;
+		_skipped_in_row++;
+	}
+
+	Clock::time_point end = Clock::now();
+	double frame_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+	record_frame(frame_ms, end > _deadline + period);
+
+	_deadline += steps * period;
+
+	// too far behind to ever catch up (or not trying to): start over from now
+	if(_policy == DEGRADE || end - _deadline > _max_catch_up * period)
+	{
+		if(end > _deadline) _deadline = end + period;
+	}
+
+	publish();
+	if(_bFixed_step) return 0;
+
+	Clock::time_point now = Clock::now();
+	if(now >= _deadline) return 0;
+	return std::chrono::duration_cast<std::chrono::milliseconds>(_deadline - now).count();
+}
+
+void Frame_scheduler::record_frame(double frame_ms, bool bLate)
+{
+	_frame_count++;
+	if(bLate) _frames_late++;
+
+	_last_frame_ms = frame_ms;
+	_total_frame_ms += frame_ms;
+	if(frame_ms > _worst_frame_ms) _worst_frame_ms = frame_ms;
+
+	int bucket = 0;
+	while(bucket < HISTOGRAM_SIZE - 1 && frame_ms >= HISTOGRAM_BOUNDS[bucket]) bucket++;
+	_histogram[bucket]++;
+}
+
+void Frame_scheduler::publish()
+{
+	if(_pFrameCount) _pFrameCount->set_int(_frame_count);
+	if(_pFramesLate) _pFramesLate->set_int(_frames_late);
+	if(_pFramesSkipped) _pFramesSkipped->set_int(_frames_skipped);
+	if(_pFramePeriod) _pFramePeriod->set_int(_period_ms);
+	if(_pFrameTime) _pFrameTime->set_double(_last_frame_ms);
+	if(_pWorstFrameTime) _pWorstFrameTime->set_double(_worst_frame_ms);
+}
+
+void Frame_scheduler::report(std::ostream& os) const
+{
+	if(!_frame_count) return;
+
+	os << "frame scheduler: policy(" << policy_to_string(_policy)
+		<< "), period(" << _period_ms << " ms)" << std::endl
+		<< "  frames(" << _frame_count << "), late(" << _frames_late
+		<< "), renders skipped(" << _frames_skipped << ")" << std::endl
+		<< std::fixed << std::setprecision(3)
+		<< "  average(" << _total_frame_ms / _frame_count << " ms), worst("
+		<< _worst_frame_ms << " ms)" << std::endl;
+
+	os << "  histogram:" << std::endl;
+	for(int i = 0; i < HISTOGRAM_SIZE; i++)
+	{
+		if(i < HISTOGRAM_SIZE - 1)
+			os << "    < " << std::setw(3) << HISTOGRAM_BOUNDS[i] << " ms: ";
+		else
+			os << "   >= " << std::setw(3) << HISTOGRAM_BOUNDS[i - 1] << " ms: ";
+		os << _histogram[i] << std::endl;
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+class Symbol;
+
+/***
+ Frame_scheduler drives the animation at a fixed tick period.
+
+ Every tick has a deadline measured on a monotonic clock. If the
+ animation cannot keep up, the Policy decides what to give up:
+
+	CATCH_UP	run several simulation steps in one tick, then draw once
+	SKIP_RENDER	run one simulation step per tick, but skip drawing
+			while behind
+	DEGRADE		(the default) run one step and draw; missed
+			deadlines are dropped and the game simply runs
+			slower, as gpl always did
+
+ The scheduler keeps counters for late frames, the worst frame and a
+ frame time histogram. They are printed at exit when gpl was given
+ -frame_policy or -metrics, and copied into the following reserved
+ variables when the program declares them:
+
+	int frame_count, int frames_late, int frames_skipped,
+	int frame_period, double frame_time, double worst_frame_time
+
+ The reserved variables are read only; assigning to one is an error.
+
+ With a fixed step (gpl -frames) every tick runs one simulation step
+ and draws, whatever the clock says, and the next tick is due at once:
+ a headless run then does the same work however loaded the machine is.
+***/
+class Frame_scheduler
+{
+public:
+	enum Policy
+	{
+		CATCH_UP,
+		SKIP_RENDER,
+		DEGRADE
+	};
+
+	// upper bounds (ms) of the frame time histogram buckets
+	// the last bucket holds everything slower
+	static const int HISTOGRAM_SIZE = 8;
+	static const int HISTOGRAM_BOUNDS[HISTOGRAM_SIZE - 1];
+
+	// the scheduler of the current Interpreter_context
+	static Frame_scheduler* instance();
+
+	static bool string_to_policy(const std::string& str, Policy& policy);
+	static std::string policy_to_string(Policy policy);
+	static bool is_reserved_variable(const std::string& name);
+
+	void set_policy(Policy policy);
+	Policy get_policy() const { return _policy; };
+
+	void set_period(int ms);
+	int get_period() const { return _period_ms; };
+
+	// the most simulation steps CATCH_UP runs in one tick, and the most
+	// draws SKIP_RENDER skips in a row
+	void set_max_catch_up(int steps);
+	int get_max_catch_up() const { return _max_catch_up; };
+
+	void set_fixed_step(bool bFixed_step) { _bFixed_step = bFixed_step; };
+	bool get_fixed_step() const { return _bFixed_step; };
+
+	// looks up the reserved variables and anchors the first deadline
+	void start();
+
+	// Runs one tick. Returns the number of ms until the next one.
+	int tick(void (*simulate)(), void (*render)());
+
+	void report(std::ostream& os) const;
+
+protected:
+	Frame_scheduler();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	std::shared_ptr<Symbol> find_reserved(const std::string& name, bool bDouble) const;
+	void record_frame(double frame_ms, bool bLate);
+	void publish();
+
+	Policy _policy;
+	int _period_ms;
+	int _max_catch_up;
+
+	bool _bStarted;
+	bool _bFixed_step;
+	Clock::time_point _deadline;
+
+	// telemetry
+	int _frame_count;
+	int _frames_late;
+	int _frames_skipped;
+	int _skipped_in_row;
+	double _last_frame_ms;
+	double _worst_frame_ms;
+	double _total_frame_ms;
+	int _histogram[HISTOGRAM_SIZE];
+
+	std::shared_ptr<Symbol> _pFrameCount, _pFramesLate, _pFramesSkipped,
+		_pFramePeriod, _pFrameTime, _pWorstFrameTime;
+
+	// one per Interpreter_context
+	friend class Interpreter_context;
+};
+
+#endif
@@ -4,85 +4,250 @@
 #include "indent.h"
 #include "gpl_assert.h"
 #include "error.h"
+#include "runtime_metrics.h"
+#include "batch_renderer.h"
+#include "software_renderer.h"
+#include "snapshot.h"
+#include "interpreter_context.h"
 #include <algorithm>
+#include <cstdlib>
 using namespace std;
 
-// all game objects that have been created but not deleted
-// used for (1) error checking via valid() (2) drawing all game objects
-/* static */ vector<Game_object *> Game_object::all_game_objects;
+Game_object::World::World()
+{
+  animating = false;
+  stale_handles = 0;
+  objects_created = 0;
+  graphics_dirty = true;
+}
 
-// all game objects that have been deleted
-// used for error checking via has_been_deleted()
-/* static */ vector<Game_object *> Game_object::deleted_game_objects;
+Game_object::World::~World()
+{
+  map<string, Member_schema *>::iterator iter;
+  for (iter = member_schemas.begin(); iter != member_schemas.end(); iter++)
+    delete iter->second;
+}
 
-/* static */ bool Game_object::graphics_dirty = true;
+/* static */ Game_object::World &Game_object::world()
+{
+  return Interpreter_context::current()->get_world();
+}
 
-void Game_object::insert_into_all_game_objects_vector()
+/* static */ void Game_object::insert_by_drawing_order(World &world,
+                                                       vector<Handle> &objects,
+                                                       Game_object *obj)
 {
-  // all_game_objects is a vector sorted by drawing_order
+  // objects is a vector sorted by drawing_order
   // Sorted small to large (small drawing_order drawn first/on bottom)
+  // the stale handles of deleted objects are passed over
 
-  // find the first iter w/a larger or equal m_drawing_order compared to this
-  vector<Game_object *>::iterator iter = all_game_objects.begin();
-  while (iter != all_game_objects.end()
-     && (*iter)->m_drawing_order < m_drawing_order)
-     iter++;
+  // find the first iter w/a larger or equal drawing_order compared to obj
+  int drawing_order = obj->drawing_order();
+  vector<Handle>::iterator iter = objects.begin();
+  while (iter != objects.end())
+  {
+    Game_object *cur = world.objects.get(*iter);
+    if (cur && cur->drawing_order() >= drawing_order)
+      break;
+    iter++;
+  }
   
-  // this object has a larger drawing_order than any object in vector
-  if (iter == all_game_objects.end())
-    all_game_objects.push_back(this);
+  // obj has a larger drawing_order than any object in vector
+  if (iter == objects.end())
+    objects.push_back(obj->m_handle);
   // the game object pointed to by iter is the first one in the vector
-  // that has a drawing order larger or equal to this
+  // that has a drawing order larger or equal to obj
   // insert before this object
-  else all_game_objects.insert(iter,this);
+  else objects.insert(iter, obj->m_handle);
+}
+
+/* static */ bool Game_object::remove_from(vector<Handle> &objects,
+                                           Handle handle)
+{
+  vector<Handle>::iterator iter =
+      find(objects.begin(), objects.end(), handle);
+  if (iter == objects.end())
+    return false;
+  objects.erase(iter);
+  return true;
+}
+
+/* static */ void Game_object::remove_stale_handles(World &world)
+{
+  vector<Handle> *lists[] = {&world.active_game_objects,
+                             &world.inactive_game_objects};
+  for (int i = 0; i < 2; i++)
+  {
+    vector<Handle> &objects = *lists[i];
+    vector<Handle>::iterator last = objects.begin();
+    for (vector<Handle>::iterator iter = objects.begin();
+         iter != objects.end();
+         iter++)
+    {
+      if (world.objects.contains(*iter))
+        *last++ = *iter;
+    }
+    objects.erase(last, objects.end());
+  }
+  world.stale_handles = 0;
+}
+
+void Game_object::insert_into_all_game_objects_vector()
+{
+  m_handle = m_world->objects.insert(this);
+  m_creation_index = m_world->objects_created++;
 
+  // new objects start out active
+  insert_by_drawing_order(*m_world, m_world->active_game_objects, this);
+  m_listed_active = true;
 }
 
-// call when the drawing_order for a Game_object changes
-// removes the object from the all_game_objects vector and
-// inserts it in the correct position
+// call when the drawing_order for a Game_object changes or it is
+// spawned/despawned.  Moves the object to the list that matches
+// active, in the correct position
 void Game_object::update_order_in_game_objects_vector()
 {
-  // remove this from all_game_objects
-  vector<Game_object *>::iterator iter =
-      find(all_game_objects.begin(), all_game_objects.end(), this);
-  assert(iter != all_game_objects.end());
-  all_game_objects.erase(iter);
+  // can't change the active list while animate_all_game_objects()
+  // is walking it
+  if (m_world->animating)
+  {
+    m_world->pending_list_updates.push_back(m_handle);
+    return;
+  }
+
+  if (m_listed_active)
+    remove_from(m_world->active_game_objects, m_handle);
+  else remove_from(m_world->inactive_game_objects, m_handle);
 
   // now put it back -- it will go in the correct place this time
-  insert_into_all_game_objects_vector();
+  if (active())
+    insert_by_drawing_order(*m_world, m_world->active_game_objects, this);
+  else m_world->inactive_game_objects.push_back(m_handle);
+  m_listed_active = active();
+}
+
+/* static */ bool Game_object::created_before(const Game_object *a,
+                                             const Game_object *b)
+{
+  return a->m_creation_index < b->m_creation_index;
+}
+
+/* static */ void Game_object::get_game_objects(vector<Game_object *> &objects)
+{
+  World &world = Game_object::world();
+  objects.clear();
+  objects.reserve(world.objects.size());
+  vector<Handle> *lists[] = {&world.active_game_objects,
+                             &world.inactive_game_objects};
+  for (int i = 0; i < 2; i++)
+  {
+    vector<Handle>::iterator iter;
+    for (iter = lists[i]->begin(); iter != lists[i]->end(); iter++)
+    {
+      if (Game_object *cur = world.objects.get(*iter))
+        objects.push_back(cur);
+    }
+  }
+  sort(objects.begin(), objects.end(), created_before);
+}
+
+void Game_object::spawn()
+{
+  if (active())
+    return;
+  m_world->scene.active[m_slot] = 1;
+  m_world->graphics_dirty = true;
+  update_order_in_game_objects_vector();
+}
+
+void Game_object::despawn()
+{
+  if (!active())
+    return;
+  m_world->scene.active[m_slot] = 0;
+  m_world->graphics_dirty = true;
+  update_order_in_game_objects_vector();
 }
 
 /* static */ bool Game_object::graphics_out_of_date_with_last_rendering()
 {
-  bool result = graphics_dirty;
-  graphics_dirty = false;
+  World &world = Game_object::world();
+  bool result = world.graphics_dirty;
+  world.graphics_dirty = false;
   return result;
 }
 
 /* static */ void Game_object::animate_all_game_objects()
 {
-  vector<Game_object *>::iterator iter;
-  for (iter = all_game_objects.begin();
-    iter != all_game_objects.end();
+  World &world = Game_object::world();
+  world.animating = true;
+  vector<Handle>::iterator iter;
+  for (iter = world.active_game_objects.begin();
+    iter != world.active_game_objects.end();
     iter++)
   {
-    Game_object *cur = *iter;
-    if (cur->m_should_animate)
+    Game_object *cur = world.objects.get(*iter);
+    // an earlier animation block may have despawned (or deleted) cur
+    // this frame
+    if (cur && cur->m_should_animate && cur->active())
       cur->animate();
   }
+  world.animating = false;
+
+  // apply the spawns/despawns/reorders made by the animation blocks
+  // (an object may be in the list more than once, updating is idempotent)
+  for (iter = world.pending_list_updates.begin();
+    iter != world.pending_list_updates.end();
+    iter++)
+  {
+    if (Game_object *cur = world.objects.get(*iter))
+      cur->update_order_in_game_objects_vector();
+  }
+  world.pending_list_updates.clear();
+
+  if (world.stale_handles > 0)
+    remove_stale_handles(world);
 }
 
-/* static */ void Game_object::draw_all_game_objects()
+/* static */ void Game_object::draw_all_game_objects(int left, int bottom,
+                                                     int right, int top)
 {
-  vector<Game_object *>::iterator iter;
-  for (iter = all_game_objects.begin();
-    iter != all_game_objects.end();
+  World &world = Game_object::world();
+  // decide what to draw for all objects at once, from the scene arrays
+  world.scene.update_bounds();
+  world.scene.update_draw_mask(left, bottom, right, top);
+
+  Software_renderer *software = Software_renderer::instance();
+  Batch_renderer *batch = Batch_renderer::instance();
+  bool batched = batch->enabled() && !software->enabled();
+
+  vector<Handle>::iterator iter;
+  for (iter = world.active_game_objects.begin();
+    iter != world.active_game_objects.end();
     iter++)
   {
-    if ((*iter)->m_should_draw)
-      (*iter)->draw();
+    Game_object *cur = world.objects.get(*iter);
+    if (!cur || !world.scene.draw_mask[cur->m_slot])
+      continue;
+
+    if (software->enabled())
+    {
+      cur->draw_software(*software, left, bottom, right, top);
+      Runtime_metrics::count_drawn();
+    }
+    else if (batched && cur->append_to_batch(*batch))
+      Runtime_metrics::count_drawn();
+    else
+    {
+      // what was batched before this object is drawn under it
+      if (batched)
+        batch->flush();
+      cur->draw_in_view(left, bottom, right, top);
+    }
   }
+
+  if (batched)
+    batch->flush();
 }
 
 Game_object::Game_object(double red /* =  0.5 */,
@@ -90,17 +255,22 @@ Game_object::Game_object(double red /* =  0.5 */,
                          double blue /* =  0.5 */
                          )
 {
-  m_x = 0;
-  m_y = 0;
-  m_w = 10;
-  m_h = 10;
+  m_world = &world();
+  m_slot = m_world->scene.add(this);
+  x() = 0;
+  y() = 0;
+  w() = 10;
+  h() = 10;
   m_red = red;
   m_green = green;
   m_blue = blue;
   m_animation_block = nullptr;
-  m_visible = 1;
+  m_world->scene.visible[m_slot] = 1;
   m_proximity = 4;
-  m_drawing_order = 0;
+  m_exact_collision = 0;
+  m_world->scene.drawing_order[m_slot] = 0;
+  m_world->scene.active[m_slot] = 1;
+  m_listed_active = false;
   m_user_int = 0;
   m_user_double = 0.0;
   m_user_string = "";
@@ -127,7 +297,7 @@ Game_object::Game_object(double red /* =  0.5 */,
   // should never be drawn or animated (they are not "real" objects)
   // the functions never_draw() and never_animate() reset these
   // however, all others objects should be drawn and animated
-  m_should_draw = true;
+  m_world->scene.should_draw[m_slot] = 1;
   m_should_animate = true;
 
   // Set my type name
@@ -137,52 +307,84 @@ Game_object::Game_object(double red /* =  0.5 */,
   // register my variable that can be set/get from parser
   // --> each object that inherits me that wants to have any of
   // --> its member variables settable, must do the same for each
-  register_member_variable("x", &m_x);
-  register_member_variable("y", &m_y);
-  register_member_variable("w", &m_w);
-  register_member_variable("h", &m_h);
-  register_member_variable("red", &m_red);
-  register_member_variable("green", &m_green);
-  register_member_variable("blue", &m_blue);
-  register_member_variable("animation_block", &m_animation_block);
-  register_member_variable("visible", &m_visible);
-  register_member_variable("proximity", &m_proximity);
-  register_member_variable("drawing_order", &m_drawing_order);
-  register_member_variable("user_int", &m_user_int);
-  register_member_variable("user_double", &m_user_double);
-  register_member_variable("user_string", &m_user_string);
-  register_member_variable("user_int2", &m_user_int2);
-  register_member_variable("user_double2", &m_user_double2);
-  register_member_variable("user_string2", &m_user_string2);
-  register_member_variable("user_int3", &m_user_int3);
-  register_member_variable("user_double3", &m_user_double3);
-  register_member_variable("user_string3", &m_user_string3);
-  register_member_variable("user_int4", &m_user_int4);
-  register_member_variable("user_double4", &m_user_double4);
-  register_member_variable("user_string4", &m_user_string4);
-  register_member_variable("user_int5", &m_user_int5);
-  register_member_variable("user_double5", &m_user_double5);
-  register_member_variable("user_string5", &m_user_string5);
+  m_schema = 0;
+  if (begin_member_schema("Game_object"))
+  {
+    register_member_variable("x", &Scene::x);
+    register_member_variable("y", &Scene::y);
+    register_member_variable("w", &Scene::w);
+    register_member_variable("h", &Scene::h);
+    register_member_variable("red", &m_red);
+    register_member_variable("green", &m_green);
+    register_member_variable("blue", &m_blue);
+    register_member_variable("animation_block", &m_animation_block);
+    register_member_variable("visible", &Scene::visible);
+    register_member_variable("proximity", &m_proximity);
+    register_member_variable("exact_collision", &m_exact_collision);
+    register_member_variable("drawing_order", &Scene::drawing_order);
+    register_member_variable("user_int", &m_user_int);
+    register_member_variable("user_double", &m_user_double);
+    register_member_variable("user_string", &m_user_string);
+    register_member_variable("user_int2", &m_user_int2);
+    register_member_variable("user_double2", &m_user_double2);
+    register_member_variable("user_string2", &m_user_string2);
+    register_member_variable("user_int3", &m_user_int3);
+    register_member_variable("user_double3", &m_user_double3);
+    register_member_variable("user_string3", &m_user_string3);
+    register_member_variable("user_int4", &m_user_int4);
+    register_member_variable("user_double4", &m_user_double4);
+    register_member_variable("user_string4", &m_user_string4);
+    register_member_variable("user_int5", &m_user_int5);
+    register_member_variable("user_double5", &m_user_double5);
+    register_member_variable("user_string5", &m_user_string5);
+  }
 
   insert_into_all_game_objects_vector();
 }
 
 Game_object::~Game_object()
 {
+  // the handle goes stale in every list it is in
+  // (the lists drop it at the end of the frame)
+  m_world->objects.erase(m_handle);
+  m_world->stale_handles++;
+
+  // the last object in the scene takes over our slot
+  Game_object *moved = m_world->scene.remove(m_slot);
+  if (moved)
+    moved->m_slot = m_slot;
+}
 
-  vector<Game_object *>::iterator iter =
-      find(all_game_objects.begin(), all_game_objects.end(), this);
-  assert(iter != all_game_objects.end());
+void Game_object::draw()
+{
+  if (!visible())
+      return;
+  build_if_dirty();
+  call_display_list();
+}
 
-  deleted_game_objects.push_back(*iter);
+/* virtual */ void Game_object::draw_in_view(int left, int bottom,
+                                            int right, int top)
+{
+  build_if_dirty();
+  call_display_list();
+}
 
-  all_game_objects.erase(iter);
+// the display list is built relative to the lower left corner of the
+// object, the translation to (x, y) is done here, so moving an object
+// never rebuilds it
+void Game_object::call_display_list()
+{
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glTranslated(x(), y(), 0);
+  glCallList(m_display_list);
+  glPopMatrix();
 }
 
-void Game_object::draw()
+void Game_object::build_if_dirty()
 {
-  if (!m_visible)
-      return;
+  Runtime_metrics::count_drawn();
   if (m_display_list_dirty)
   {
     if (m_display_list == 0)
@@ -190,24 +392,22 @@ void Game_object::draw()
 
     build_display_list();
     m_display_list_dirty = false;
+    Runtime_metrics::count_rebuilt();
   }
-  //   it might be more efficient to move the translation for m_x and m_y
-  //   out of the display list
-  //   a) if most objects move, it will probably be faster to take it out of
-  //      the display list
-  //   b) if most objects don't move, it will be faster to leave it in
-  //   unclear if there is an efficiency problem...
-
-  glCallList(m_display_list);
 }
 
 Status Game_object::get_member_variable_type(string name, Gpl_type &type)
 {
-  Typed_void_ptr* typed_void_ptr = lookup_registered_member_variable(name);
+  const Member_info *member = lookup_registered_member_variable(name);
 
-  if (typed_void_ptr)
+  if (member)
+  {
+    type = member->m_type;
+    return OK;
+  }
+  else if (lookup_indexed_member_variable(name))
   {
-    type = typed_void_ptr->m_type;
+    type = INT;
     return OK;
   }
   else
@@ -218,41 +418,52 @@ Status Game_object::get_member_variable_type(string name, Gpl_type &type)
 
 Status Game_object::set_member_variable(string name, int value)
 {
-  graphics_dirty = true;
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  m_world->graphics_dirty = true;
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
+  {
+    int *element = lookup_indexed_member_variable(name);
+    if (!element)
       return MEMBER_NOT_DECLARED;
+
+    *element = value;
+    string::size_type bracket = name.find('[');
+    updated_element(name.substr(0, bracket),
+                    atoi(name.c_str() + bracket + 1));
+    return OK;
+  }
   if (variable->m_type != INT)
     return MEMBER_NOT_OF_GIVEN_TYPE;
-  assert(variable->m_value);
 
 
   if (variable->m_derived)
     Error::error(Error::CANNOT_CHANGE_DERIVED_ATTRIBUTE,
           name, m_object_type_name);
   
-  else *((int *) variable->m_value) = value;
+  else *((int *) member_address(variable)) = value;
 
   // when drawing_order is changed, need to update the drawing order
   if (name == "drawing_order")
     update_order_in_game_objects_vector();
 
-  updated(name);
+  // moving does not change the display list (see call_display_list())
+  if (name == "x" || name == "y")
+    Runtime_metrics::count_moved();
+  else updated(name);
   return OK;
 }
 
 Status Game_object::set_member_variable(string name, double value)
 {
-  graphics_dirty = true;
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  m_world->graphics_dirty = true;
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
       return MEMBER_NOT_DECLARED;
   if (variable->m_type != DOUBLE)
     return MEMBER_NOT_OF_GIVEN_TYPE;
 
-  assert(variable->m_value);
 
-  *((double *) variable->m_value) = value;
+  *((double *) member_address(variable)) = value;
 
   updated(name);
   return OK;
@@ -260,16 +471,15 @@ Status Game_object::set_member_variable(string name, double value)
 
 Status Game_object::set_member_variable(string name, string value)
 {
-  graphics_dirty = true;
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  m_world->graphics_dirty = true;
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
       return MEMBER_NOT_DECLARED;
   if (variable->m_type != STRING)
     return MEMBER_NOT_OF_GIVEN_TYPE;
 
-  assert(variable->m_value);
 
-  *((string *) variable->m_value) = value;
+  *((string *) member_address(variable)) = value;
   updated(name);
     
   return OK;
@@ -277,16 +487,15 @@ Status Game_object::set_member_variable(string name, string value)
 
 Status Game_object::set_member_variable(string name, const std::shared_ptr<Animation_block>& value)
 {
-  graphics_dirty = true;
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  m_world->graphics_dirty = true;
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
     return MEMBER_NOT_DECLARED;
   if (variable->m_type != ANIMATION_BLOCK)
     return MEMBER_NOT_OF_GIVEN_TYPE;
 
-  assert(variable->m_value);
 
-  // note, we don't dereference m_value as above because
+  // note, we don't dereference the member address as above because
   // we store Animation_blocks as pointers
   m_animation_block = value;
 
@@ -296,25 +505,31 @@ Status Game_object::set_member_variable(string name, const std::shared_ptr<Anima
 
 Status Game_object::get_member_variable(string name, int &value)
 {
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
-    return MEMBER_NOT_DECLARED;
+  {
+    int *element = lookup_indexed_member_variable(name);
+    if (!element)
+      return MEMBER_NOT_DECLARED;
+    value = *element;
+    return OK;
+  }
   if (variable->m_type != INT)
     return MEMBER_NOT_OF_GIVEN_TYPE;
 
-  value = *((int *) variable->m_value);
+  value = *((int *) member_address(variable));
   return OK;
 }
 
 Status Game_object::get_member_variable(string name, double &value)
 {
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
     return MEMBER_NOT_DECLARED;
 
   if (variable->m_type == DOUBLE)
   {
-    value = *((double *) variable->m_value);
+    value = *((double *) member_address(variable));
     return OK;
   }
   else return MEMBER_NOT_OF_GIVEN_TYPE;
@@ -322,25 +537,25 @@ Status Game_object::get_member_variable(string name, double &value)
 
 Status Game_object::get_member_variable(string name, string &value)
 {
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
     return MEMBER_NOT_DECLARED;
   if (variable->m_type != STRING)
     return MEMBER_NOT_OF_GIVEN_TYPE;
 
-  value = *((string *) variable->m_value);
+  value = *((string *) member_address(variable));
   return OK;
 }
 
 Status Game_object::get_member_variable(string name, std::shared_ptr<Animation_block>& value)
 {
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
+  const Member_info *variable = lookup_registered_member_variable(name);
   if (!variable)
     return MEMBER_NOT_DECLARED;
   if (variable->m_type != ANIMATION_BLOCK)
     return MEMBER_NOT_OF_GIVEN_TYPE;
 
-  // note, we don't dereference m_value as above because
+  // note, we don't dereference the member address as above because
   // we store Animation_blocks as pointers
   value = m_animation_block;
   return OK;
@@ -360,57 +575,122 @@ int Game_object::touches(const std::shared_ptr<Game_object>& obj)
 {
 
 /*****
-LIMITATION
-
-touches uses the bounding box of the object which is created at object
-construction.
+By default touches uses the bounding box of each object.
 
 The bounding box is not a very good representation of triangles or circles.
 And it does not take into account the rotation of either triangles
 or rectangles.
 
-It would make the touches mechanism better if objects were represented
-with a more accurate boundary.
+An object with exact_collision set is represented by its outline instead
+(see get_collision_shape()): a circle, a rotated polygon, or for a pixmap
+the mask of its non-transparent pixels.  The bounding boxes are still
+compared first, so objects that are far apart cost the same either way.
+*****/
 
-Idea 1:  use a polygon to represent the bounding boxes.  Each type of
-object could create and update their polygon.  When line segments of the
-polygons of two objects intersect the two objects would be considered touching.
-This approach does not handle containment (when one object is completely
-inside another).
 
-Idea 2: represent each object as a set of triangles.  When segments of
-triangles of two objects intersect, the objects touch.  Could also look
-for a vertex inside of another object's triangle.
-*****/
+  // both objects are read from the scene arrays
+  Scene &scene = m_world->scene;
+  int a = m_slot;
+  int b = obj->m_slot;
 
+  // despawned objects don't touch anything
+  if (!scene.active[a] || !scene.active[b])
+    return 0;
 
-  // true if the bounding boxes of this and obj overlap
-  return overlap(m_x, m_y, m_x + m_w, m_y + m_h,
-         obj->m_x, obj->m_y, obj->m_x + obj->m_w, obj->m_y+obj->m_h);
+  if (!m_exact_collision && !obj->m_exact_collision)
+  {
+    // true if the bounding boxes of this and obj overlap
+    return overlap(scene.x[a], scene.y[a],
+                   scene.x[a] + scene.w[a], scene.y[a] + scene.h[a],
+                   scene.x[b], scene.y[b],
+                   scene.x[b] + scene.w[b], scene.y[b] + scene.h[b]);
+  }
+
+  // an object without exact_collision is still just its bounding box
+  Collision_shape shape_a, shape_b;
+  if (m_exact_collision)
+    get_collision_shape(shape_a);
+  else shape_a.set_box(scene.x[a], scene.y[a], scene.w[a], scene.h[a]);
+  if (obj->m_exact_collision)
+    obj->get_collision_shape(shape_b);
+  else shape_b.set_box(scene.x[b], scene.y[b], scene.w[b], scene.h[b]);
+
+  return shapes_overlap(shape_a, shape_b);
 }
 
 int Game_object::near(const std::shared_ptr<Game_object>& obj)
 {
 
+  Scene &scene = m_world->scene;
+  int a = m_slot;
+  int b = obj->m_slot;
+
+  if (!scene.active[a] || !scene.active[b])
+    return 0;
+
   // expand the bounding boxes of this and obj by their respective m_proximity
   // true if the expanded bounding boxes of this and obj overlap
-  return overlap(m_x - m_proximity, m_y - m_proximity,
-           m_x + m_w + m_proximity, m_y + m_h + m_proximity,
-         obj->m_x - obj->m_proximity, obj->m_y - obj->m_proximity,
-         obj->m_x + obj->m_w + obj->m_proximity,
-         obj->m_y+obj->m_h + obj->m_proximity);
+  int pa = m_proximity;
+  int pb = obj->m_proximity;
+  return overlap(scene.x[a] - pa, scene.y[a] - pa,
+                 scene.x[a] + scene.w[a] + pa, scene.y[a] + scene.h[a] + pa,
+                 scene.x[b] - pb, scene.y[b] - pb,
+                 scene.x[b] + scene.w[b] + pb, scene.y[b] + scene.h[b] + pb);
+}
+
+/* virtual */ void Game_object::get_collision_shape(Collision_shape &shape) const
+{
+  shape.set_box(x(), y(), w(), h());
 }
 
-Game_object::Typed_void_ptr* Game_object::lookup_registered_member_variable(string name)
+const Game_object::Member_info*
+Game_object::lookup_registered_member_variable(const string &name) const
 {
-    // Check if name in map of registered_member_variables
-    map<string, Typed_void_ptr *>::iterator iter;
-    iter = m_variable_registry.find(name);
-    if (iter == m_variable_registry.end())
+    // Check if name in the schema of this object's class
+    Member_schema::const_iterator iter;
+    iter = m_schema->find(name);
+    if (iter == m_schema->end())
     {
       return 0;
     }
-    return (*iter).second;
+    return &(*iter).second;
+}
+
+int *Game_object::lookup_indexed_member_variable(const string &name)
+{
+    // name must look like member[index]
+    string::size_type bracket = name.find('[');
+    if (bracket == string::npos || bracket == 0
+        || name[name.size() - 1] != ']')
+      return 0;
+
+    const char *begin = name.c_str() + bracket + 1;
+    char *end;
+    long index = strtol(begin, &end, 10);
+    if (end == begin || *end != ']')
+      return 0;
+
+    return indexed_member_variable(name.substr(0, bracket), (int) index);
+}
+
+bool Game_object::begin_member_schema(const string &class_name)
+{
+    map<string, Member_schema *>::iterator iter;
+    iter = m_world->member_schemas.find(class_name);
+    if (iter != m_world->member_schemas.end())
+    {
+      m_schema = (*iter).second;
+      return false;
+    }
+
+    // first object of this class: start from what the base classes
+    // registered
+    if (m_schema)
+      m_schema = new Member_schema(*m_schema);
+    else m_schema = new Member_schema();
+
+    m_world->member_schemas[class_name] = m_schema;
+    return true;
 }
 
 void Game_object::register_member_variable(Gpl_type type,
@@ -425,16 +705,24 @@ void Game_object::register_member_variable(Gpl_type type,
     // make sure this member variable has not already been registered
     assert(!lookup_registered_member_variable(name));
 
-    // insert this member variable into the registry as type "type"
-    m_variable_registry[name] = new Typed_void_ptr(type, (void *)value);
+    // insert this member variable into the schema as type "type"
+    std::ptrdiff_t offset = (char *) value - (char *) this;
+    m_schema->insert(make_pair(name, Member_info(type, offset)));
+}
+
+void Game_object::register_member_variable(string name,
+                                           vector<int> Scene::*field)
+{
+    assert(!lookup_registered_member_variable(name));
+    m_schema->insert(make_pair(name, Member_info(field)));
 }
 
 Status Game_object::mark_member_variable_as_derived(string name)
 {
-  Typed_void_ptr *variable = lookup_registered_member_variable(name);
-  if (!variable)
+  Member_schema::iterator iter = m_schema->find(name);
+  if (iter == m_schema->end())
     return MEMBER_NOT_DECLARED;
-  variable->m_derived = true;
+  (*iter).second.m_derived = true;
   return OK;
 }
 
@@ -463,9 +751,175 @@ void Game_object::animate()
 
 bool Game_object::valid() const
 {
-  vector<Game_object *>::iterator iter =
-      find(all_game_objects.begin(), all_game_objects.end(), this);
-  return iter != all_game_objects.end();
+  return m_world->objects.get(m_handle) == this;
+}
+
+void Game_object::write_snapshot(Snapshot_writer &out)
+{
+  out.write_string(m_object_type_name);
+  out.write_int(active());
+
+  out.write_int((int) m_schema->size());
+  Member_schema::const_iterator iter;
+  for (iter = m_schema->begin(); iter != m_schema->end(); iter++)
+  {
+    const Member_info *cur_member = &(*iter).second;
+    void *cur_value = member_address(cur_member);
+
+    out.write_string((*iter).first);
+    out.write_int(cur_member->m_type);
+    switch (cur_member->m_type)
+    {
+      case INT:
+        out.write_int(*((int *) cur_value));
+        break;
+      case DOUBLE:
+        out.write_double(*((double *) cur_value));
+        break;
+      case STRING:
+        out.write_string(*((string *) cur_value));
+        break;
+      case ANIMATION_BLOCK:
+      {
+        // bound by name, the block itself is code
+        std::shared_ptr<Animation_block> block
+          = *((std::shared_ptr<Animation_block> *) cur_value);
+        out.write_string(block ? block->name() : "");
+        break;
+      }
+      default:
+        assert(false);
+    }
+  }
+
+  vector<string> names;
+  indexed_member_names(names);
+  out.write_int((int) names.size());
+  for (unsigned int i = 0; i < names.size(); i++)
+  {
+    int size = indexed_member_variable_size(names[i]);
+    out.write_string(names[i]);
+    out.write_int(size);
+    for (int index = 0; index < size; index++)
+      out.write_int(*indexed_member_variable(names[i], index));
+  }
+}
+
+bool Game_object::read_snapshot(Snapshot_reader &in, string &error)
+{
+  string type_name;
+  int spawned;
+  int count;
+  if (!in.read_string(type_name) || !in.read_int(spawned)
+      || !in.read_int(count))
+  {
+    error = "the snapshot is truncated";
+    return false;
+  }
+  if (type_name != m_object_type_name)
+  {
+    error = "the snapshot holds a " + type_name
+            + " instead of a " + m_object_type_name;
+    return false;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    string name;
+    int type;
+    if (!in.read_string(name) || !in.read_int(type))
+    {
+      error = "the snapshot is truncated";
+      return false;
+    }
+
+    const Member_info *member = lookup_registered_member_variable(name);
+    if (!member || member->m_type != type)
+    {
+      error = m_object_type_name + " has no " + gpl_type_to_string((Gpl_type) type)
+              + " member " + name;
+      return false;
+    }
+
+    // written directly: derived members (e.g. a Circle's w) are
+    // restored too
+    void *value = member_address(member);
+    bool read = false;
+    switch (type)
+    {
+      case INT:
+        read = in.read_int(*((int *) value));
+        break;
+      case DOUBLE:
+        read = in.read_double(*((double *) value));
+        break;
+      case STRING:
+        read = in.read_string(*((string *) value));
+        break;
+      case ANIMATION_BLOCK:
+      {
+        string block_name;
+        read = in.read_string(block_name);
+        std::shared_ptr<Animation_block> block;
+        if (read && block_name != "")
+        {
+          block = in.find_animation_block(block_name);
+          if (!block)
+          {
+            error = "the program has no animation block " + block_name;
+            return false;
+          }
+        }
+        *((std::shared_ptr<Animation_block> *) value) = block;
+        break;
+      }
+    }
+    if (!read)
+    {
+      error = "the snapshot is truncated";
+      return false;
+    }
+
+    // as if the member had been set (a Tilemap resizes its grid ...)
+    if (name != "x" && name != "y")
+      updated(name);
+  }
+
+  if (!in.read_int(count))
+  {
+    error = "the snapshot is truncated";
+    return false;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    string name;
+    int size;
+    if (!in.read_string(name) || !in.read_int(size))
+    {
+      error = "the snapshot is truncated";
+      return false;
+    }
+    if (indexed_member_variable_size(name) != size)
+    {
+      error = m_object_type_name + " has no member " + name
+              + "[" + std::to_string(size) + "]";
+      return false;
+    }
+    for (int index = 0; index < size; index++)
+    {
+      if (!in.read_int(*indexed_member_variable(name, index)))
+      {
+        error = "the snapshot is truncated";
+        return false;
+      }
+    }
+  }
+
+  m_world->scene.active[m_slot] = spawned ? 1 : 0;
+  update_order_in_game_objects_vector();
+  m_display_list_dirty = true;
+  m_world->graphics_dirty = true;
+  return true;
 }
 
 ostream & Game_object::print(ostream &os) const
@@ -475,35 +929,36 @@ ostream & Game_object::print(ostream &os) const
   os.flush();
   indent++;
 
-  map<string, Typed_void_ptr *>::const_iterator iter;
-  for (iter = m_variable_registry.begin();
-    iter != m_variable_registry.end();
+  Member_schema::const_iterator iter;
+  for (iter = m_schema->begin();
+    iter != m_schema->end();
     iter++
     )
   {
-    if (iter != m_variable_registry.begin())
+    if (iter != m_schema->begin())
       os << "," << endl;
 
-    Typed_void_ptr *cur_member = (*iter).second;
+    const Member_info *cur_member = &(*iter).second;
+    void *cur_value = member_address(cur_member);
     string cur_name = (*iter).first;
 
     os << indent << cur_name << " = ";
     switch (cur_member->m_type)
     {
       case INT:
-        os << "int(" << *((int *) cur_member->m_value) << ")";
+        os << "int(" << *((int *) cur_value) << ")";
         break;
       case DOUBLE:
-        os << "double(" << *((double *) cur_member->m_value) << ")";
+        os << "double(" << *((double *) cur_value) << ")";
         break;
       case STRING:
-        os << "string(\"" << *((string *) cur_member->m_value)<< "\")";
+        os << "string(\"" << *((string *) cur_value)<< "\")";
         break;
       case ANIMATION_BLOCK:
-        if (*((std::shared_ptr<Animation_block>*) (cur_member->m_value)) == 0)
+        if (*((std::shared_ptr<Animation_block>*) (cur_value)) == 0)
           os << "NULL";
         else
-          os << (*((std::shared_ptr<Animation_block>*) (cur_member->m_value)))->name();
+          os << (*((std::shared_ptr<Animation_block>*) (cur_value)))->name();
         break;
       default:
         // there is a programming bug if this is ever executed
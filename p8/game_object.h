@@ -49,14 +49,24 @@ Member variables
     Need to map the name of the variable to its memory location
     Also keep an enumerated label of the type so we can do type checking
 
-    The class Typed_void_ptr will store the memory location (as void *)
-    and an enumerated variable (of type Gpl_type) to store the real type.
+    The layout is the same for every object of a class, so the registry
+    is a schema shared by all of them.  The class Member_info stores the
+    offset of the variable from the start of the Game_object, an
+    enumerated variable (of type Gpl_type) to store the real type, and
+    whether the variable is derived.
 
-    A map will implement the registry:
-        std::map<string, Typed_void_ptr *> m_variable_registry;
+    A map will implement the schema:
+        typedef std::map<string, Member_info> Member_schema;
+
+    and each object points at the schema for its class (m_schema).
+
+    The fields read every frame (x, y, w, h, visible, drawing_order)
+    are not stored in the object but in the scene arrays (see scene.h);
+    their Member_info names the array (m_field) instead of an offset,
+    and the object's slot is the index into it.
 
     Each object that inherits from Game_object will have to put
-    all variables it wants accessible from gpl into the registry by
+    all variables it wants accessible from gpl into the schema by
     calling
     
         void register_member_variable(string name, int *value)
@@ -64,8 +74,26 @@ Member variables
         void register_member_variable(string name, string *value)
         ...
 
-    Each of these will set the enum flag to the correct value
+    Each of these will set the enum flag to the correct value.
+    Only the first object of a class has to do this; every constructor
+    calls begin_member_schema() first and only registers its variables
+    if it returns true:
+
+        if (begin_member_schema("Circle"))
+        {
+          register_member_variable("radius", &m_radius);
+          ...
+        }
   
+  Indexed members
+
+    A class can also have members that are arrays of ints (e.g. the
+    tile[] of a Tilemap).  They are not in the schema; the class
+    overrides indexed_member_variable() and indexed_member_variable_size()
+    and they are accessed with the name "name[index]":
+
+        obj->set_member_variable("tile[3]", 7);
+
   Access:
 
       The gpl code can now set/get member variables by using the member
@@ -113,6 +141,11 @@ Graphics
     When a member variable is changed, build_display_list() is called before
     the object is redrawn.
 
+    The display list is built relative to the lower left corner of the
+    object (i.e. as if x and y were 0).  The object is moved to (x, y)
+    each time it is drawn, so changing x or y does not call updated()
+    and never rebuilds the display list.
+
     A class can redefine this behavior by providing the following function:
 
       virtual void updated(string name) {m_display_list_dirty = true;}
@@ -128,9 +161,23 @@ Graphics
     largest drawing_order number is drawn last and will thus appear on
     top of all other game objects.
 
+  Object lists
+
+    The world of a program (see World below) keeps every object in a
+    Slot_map (slot_map.h).  The active, inactive and pending lists hold
+    the objects' handles (slot index + generation), not pointers, so
+    deleting an object is O(1): the destructor frees its slot, and the
+    lists skip its stale handle until the end of the frame, when
+    animate_all_game_objects() drops it.  valid() is a single lookup
+    in the map.
+
 ****/
 
 #include "gpl_type.h"
+#include "scene.h"
+#include "slot_map.h"
+#include "collision.h"
+#include "random_stream.h"
 
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
@@ -144,8 +191,13 @@ Graphics
 #include <map>
 #include <vector>
 #include <memory>
+#include <cstddef>
 
 class Animation_block;
+class Batch_renderer;
+class Software_renderer;
+class Snapshot_writer;
+class Snapshot_reader;
 
 class Game_object : public std::enable_shared_from_this<Game_object>
 {
@@ -169,25 +221,59 @@ class Game_object : public std::enable_shared_from_this<Game_object>
     Status get_member_variable(std::string name, std::string &value);
     Status get_member_variable(std::string name, std::shared_ptr<Animation_block>& value);
 
-    bool visible() {return m_visible;}
+    // the number of elements of the indexed member name
+    // -1 if there is no such indexed member
+    virtual int indexed_member_variable_size(const std::string &name) const
+     {return -1;}
+
+    // the names of the indexed members
+    virtual void indexed_member_names(std::vector<std::string> &names) const {}
+
+    // every member variable, the elements of the indexed members and
+    // whether the object is spawned (see snapshot.h)
+    void write_snapshot(Snapshot_writer &out);
+    // returns false and sets error if the snapshot is of another kind
+    // of object
+    bool read_snapshot(Snapshot_reader &in, std::string &error);
+
+    bool visible() const {return m_world->scene.visible[m_slot] != 0;}
 
     // a game object used as a parameter should never be drawn or animated
     // it is just used as a placeholder for the actual parameter
     // thus when creating an object to be used as a parameter, set them
     // to by calling never_draw() and never_animate()
-    void never_draw() {m_should_draw = false;}
+    void never_draw() {m_world->scene.should_draw[m_slot] = 0;}
     void never_animate() {m_should_animate = false;}
+    bool should_draw() const {return m_world->scene.should_draw[m_slot] != 0;}
+    bool should_animate() const {return m_should_animate;}
 
+    // random() in this object's animation block draws from here
+    Random_stream &random_stream() {return m_random_stream;}
+
+    // pooling: a despawned object keeps its member variables, but is not
+    // animated, drawn or touched until it is spawned again
+    void spawn();
+    void despawn();
+    bool active() const {return m_world->scene.active[m_slot] != 0;}
+
+    // touches() compares bounding boxes, unless one of the objects has
+    // exact_collision set, in which case that object's real outline is
+    // used (see collision.h)
     int touches(const std::shared_ptr<Game_object>& obj);
     int near(const std::shared_ptr<Game_object>& obj);
 
     // if no objects have changed, do not draw
     static bool graphics_out_of_date_with_last_rendering();
 
-    // draw all game objects in the vector all_game_objects
-    static void draw_all_game_objects();
+    // draw the game objects in the vector active_game_objects that are
+    // visible and at least partly inside the given screen rectangle
+    static void draw_all_game_objects(int left, int bottom, int right, int top);
 
     static void animate_all_game_objects();
+
+    // every object, in the order the objects were created (the order of
+    // their declarations, see program_cache.h)
+    static void get_game_objects(std::vector<Game_object *> &objects);
     void animate();
 
     bool valid() const;
@@ -200,6 +286,12 @@ class Game_object : public std::enable_shared_from_this<Game_object>
     void insert_into_all_game_objects_vector();
     void update_order_in_game_objects_vector();
 
+    // Switches this object to the schema for class_name.  Returns true
+    // if this is the first object of the class, in which case the caller
+    // must register its member variables (they are added to a copy of
+    // the schema built so far by the base class constructors).
+    bool begin_member_schema(const std::string &class_name);
+
     void register_member_variable(std::string name, int *value)
      { register_member_variable(INT, name, (void *) value);}
     void register_member_variable(std::string name, double *value)
@@ -208,23 +300,35 @@ class Game_object : public std::enable_shared_from_this<Game_object>
      { register_member_variable(STRING, name, (void *) value);}
     void register_member_variable(std::string name, std::shared_ptr<Animation_block>*value)
      { register_member_variable(ANIMATION_BLOCK, name, (void *) value);}
+    // a field kept in the scene arrays
+    void register_member_variable(std::string name, std::vector<int> Scene::*field);
 
     Status mark_member_variable_as_derived(std::string name);
-      
-    int m_x;
-    int m_y;
-    int m_w;
-    int m_h;
+
+    // the fields the per-frame passes read live in the scene arrays,
+    // at index m_slot
+    int &x() {return m_world->scene.x[m_slot];}
+    int &y() {return m_world->scene.y[m_slot];}
+    int &w() {return m_world->scene.w[m_slot];}
+    int &h() {return m_world->scene.h[m_slot];}
+    int x() const {return m_world->scene.x[m_slot];}
+    int y() const {return m_world->scene.y[m_slot];}
+    int w() const {return m_world->scene.w[m_slot];}
+    int h() const {return m_world->scene.h[m_slot];}
+    int drawing_order() const {return m_world->scene.drawing_order[m_slot];}
+
+    // for objects whose w and h are only known after they are drawn
+    void never_cull() {m_world->scene.cullable[m_slot] = 0;}
+
     double m_red;
     double m_green;
     double m_blue;
     std::shared_ptr<Animation_block> m_animation_block;
-    int m_visible;
     int m_proximity;
-    bool m_should_draw;
+    int m_exact_collision;
     bool m_should_animate;
+    Random_stream m_random_stream;
     bool m_display_list_dirty;
-    int m_drawing_order;
     int m_user_int;
     double m_user_double;
     std::string m_user_string;
@@ -245,9 +349,41 @@ class Game_object : public std::enable_shared_from_this<Game_object>
 
     GLuint m_display_list;
 
+    // builds the display list if it is out of date
+    void build_if_dirty();
+
+    // calls the display list translated to (x, y)
+    void call_display_list();
+
     // each object that inherits us must implement build_display_list()
     virtual void build_display_list() = 0;
 
+    // the address of name[index], 0 if there is no such element
+    virtual int *indexed_member_variable(const std::string &name, int index)
+     {return 0;}
+
+    // called after name[index] is set, the default is updated(name)
+    virtual void updated_element(std::string name, int index)
+     {updated(name);}
+
+    // draws the object, the arguments are the part of the world that is
+    // visible.  The default ignores them and calls the display list
+    virtual void draw_in_view(int left, int bottom, int right, int top);
+
+    // adds the object to the batch when drawing in batched mode (see
+    // batch_renderer.h).  Returns false if the object can't be batched,
+    // it is then drawn by draw_in_view().  The default can't be batched
+    virtual bool append_to_batch(Batch_renderer &batch) {return false;}
+
+    // draws the object with the software renderer (gpl -backend software),
+    // the arguments are the same as for draw_in_view()
+    virtual void draw_software(Software_renderer &renderer,
+                               int left, int bottom, int right, int top) = 0;
+
+    // the outline of the object for exact collisions
+    // the default is the bounding box
+    virtual void get_collision_shape(Collision_shape &shape) const;
+
     // the default is to mark the display list as dirty when any member
     // variable changes.  Subclasses can redefine this behavior if the
     // display list changes only when some members fields are changed
@@ -255,26 +391,107 @@ class Game_object : public std::enable_shared_from_this<Game_object>
 
   private:
 
-    class Typed_void_ptr
+    class Member_info
     {
       public:
-        Typed_void_ptr(Gpl_type type, void *value)
-         {m_type = type; m_value = value; m_derived = false;}
-          Gpl_type m_type;
-        void *m_value;
+        Member_info(Gpl_type type, std::ptrdiff_t offset)
+         {m_type = type; m_offset = offset; m_field = 0; m_derived = false;}
+        Member_info(std::vector<int> Scene::*field)
+         {m_type = INT; m_offset = 0; m_field = field; m_derived = false;}
+        Gpl_type m_type;
+        std::ptrdiff_t m_offset; // from the start of the Game_object
+        std::vector<int> Scene::*m_field; // or the scene array it is in
         bool m_derived;
     };
+    typedef std::map<std::string, Member_info> Member_schema;
+    typedef Slot_handle Handle;
+
+    // everything the game objects of one program share: their lists,
+    // the scene arrays and the schemas (one per Interpreter_context,
+    // see interpreter_context.h)
+    struct World
+    {
+      World();
+      ~World();
+
+      // every game object that has been created but not deleted; the
+      // lists below refer to the objects by their Handle, valid() checks
+      // that the object's handle is still the one in this map
+      Slot_map<Game_object> objects;
+
+      // the live objects, sorted by drawing_order
+      // only these are animated and drawn
+      std::vector<Handle> active_game_objects;
+
+      // objects that have been despawned; they keep their member variables
+      // but cost nothing per frame until they are spawned again
+      std::vector<Handle> inactive_game_objects;
+
+      // objects whose list (or position in the list) has to be fixed once
+      // animate_all_game_objects() is done iterating over the active list
+      std::vector<Handle> pending_list_updates;
+      bool animating;
+
+      // a deleted object leaves its handle in the lists, where it is
+      // skipped; these are the handles animate_all_game_objects() drops
+      // at the end of the frame
+      int stale_handles;
+
+      // the number of objects created so far, see m_creation_index
+      int objects_created;
+
+      bool graphics_dirty;
 
-    std::map<std::string, Typed_void_ptr *> m_variable_registry;
-    Typed_void_ptr* lookup_registered_member_variable(std::string name);
+      // the per-frame fields of every game object, see scene.h
+      Scene scene;
+
+      // one schema per class, deleted with the world
+      std::map<std::string, Member_schema *> member_schemas;
+    };
+
+    // the world of the current Interpreter_context
+    static World &world();
+
+    // the world the object was created in
+    World *m_world;
+    Member_schema *m_schema;
+
+    const Member_info* lookup_registered_member_variable(const std::string &name) const;
+
+    // returns the address of an element of an indexed member
+    // (name is "member[index]"), 0 if there is no such element
+    int *lookup_indexed_member_variable(const std::string &name);
+    void *member_address(const Member_info *info) const
+     {
+       if (info->m_field)
+         return &(m_world->scene.*(info->m_field))[m_slot];
+       return (char *) this + info->m_offset;
+     }
     void register_member_variable(Gpl_type type,
                                   std::string name,
                                   void *value
                                  );
 
-    static std::vector<Game_object *> all_game_objects;
-    static std::vector<Game_object *> deleted_game_objects;
-    static bool graphics_dirty;
+    static void insert_by_drawing_order(World &world,
+                                        std::vector<Handle> &objects,
+                                        Game_object *obj);
+    static bool remove_from(std::vector<Handle> &objects, Handle handle);
+    static bool created_before(const Game_object *a, const Game_object *b);
+
+    // drops the handles of the deleted objects from the lists
+    static void remove_stale_handles(World &world);
+
+    int m_slot;
+    Handle m_handle;
+
+    // how many objects the world created before this one
+    int m_creation_index;
+
+    // which list the object is in (active can change before the
+    // lists are updated, see pending_list_updates)
+    bool m_listed_active;
+
+    friend class Interpreter_context;
 
     // disable default copy constructor and default assignment
     // done as a precaution, they should never be called
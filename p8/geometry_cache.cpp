@@ -0,0 +1,102 @@
+#include "geometry_cache.h"
+#include "gpl_assert.h"
+#include <cmath>
+using namespace std;
+
+/* static */ GLuint Geometry_cache::m_disks[DISK_LODS];
+/* static */ vector<double> Geometry_cache::m_disk_points[DISK_LODS];
+/* static */ GLuint Geometry_cache::m_square = 0;
+/* static */ GLuint Geometry_cache::m_triangle = 0;
+/* static */ thread_local double Geometry_cache::m_pixel_scale = 1.0;
+
+/* static */ int Geometry_cache::disk_slices(int lod)
+{
+  assert(lod >= 0 && lod < DISK_LODS);
+  // 8, 16, 32, 64, 128
+  return 8 << lod;
+}
+
+/* static */ int Geometry_cache::disk_lod(double pixel_radius)
+{
+  // the edge of an n sided polygon is off the circle by about
+  // r * pi^2 / (2 * n^2); keep that under half a pixel
+  double slices_needed = M_PI * sqrt(pixel_radius > 0 ? pixel_radius : 0);
+
+  int lod = 0;
+  while (lod < DISK_LODS - 1 && disk_slices(lod) < slices_needed)
+    lod++;
+  return lod;
+}
+
+/* static */ const double *Geometry_cache::disk_points(int lod)
+{
+  assert(lod >= 0 && lod < DISK_LODS);
+  vector<double> &points = m_disk_points[lod];
+  if (points.empty())
+  {
+    int slices = disk_slices(lod);
+    points.resize(2 * (slices + 1));
+    for (int i = 0; i < slices; i++)
+    {
+      double angle = 2 * M_PI * i / slices;
+      points[2*i] = cos(angle);
+      points[2*i + 1] = sin(angle);
+    }
+    // close the circle exactly
+    points[2*slices] = points[0];
+    points[2*slices + 1] = points[1];
+  }
+  return &points[0];
+}
+
+/* static */ GLuint Geometry_cache::disk(int lod)
+{
+  assert(lod >= 0 && lod < DISK_LODS);
+  if (m_disks[lod])
+    return m_disks[lod];
+
+  int slices = disk_slices(lod);
+  const double *points = disk_points(lod);
+  m_disks[lod] = glGenLists(1);
+  glNewList(m_disks[lod], GL_COMPILE);
+  glBegin(GL_TRIANGLE_FAN);
+    glVertex2d(0, 0);
+    for (int i = 0; i <= slices; i++)
+      glVertex2d(points[2*i], points[2*i + 1]);
+  glEnd();
+  glEndList();
+  return m_disks[lod];
+}
+
+/* static */ GLuint Geometry_cache::square()
+{
+  if (m_square)
+    return m_square;
+
+  m_square = glGenLists(1);
+  glNewList(m_square, GL_COMPILE);
+  glBegin(GL_QUADS);
+    glVertex2i(0, 0);
+    glVertex2i(1, 0);
+    glVertex2i(1, 1);
+    glVertex2i(0, 1);
+  glEnd();
+  glEndList();
+  return m_square;
+}
+
+/* static */ GLuint Geometry_cache::triangle()
+{
+  if (m_triangle)
+    return m_triangle;
+
+  m_triangle = glGenLists(1);
+  glNewList(m_triangle, GL_COMPILE);
+  glBegin(GL_TRIANGLES);
+    glVertex2d(0, 0);
+    glVertex2d(1, 0);
+    glVertex2d(0.5, 1);
+  glEnd();
+  glEndList();
+  return m_triangle;
+}
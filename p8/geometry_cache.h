@@ -0,0 +1,67 @@
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+/****
+
+  Geometry_cache holds the display lists of the basic shapes, compiled
+  once and shared by every object:
+
+    disk(lod)     a disk of radius 1 centered at (0, 0)
+    square()      the square (0, 0) - (1, 1)
+    triangle()    the triangle (0, 0), (1, 0), (0.5, 1)
+
+  An object's own display list just sets its color and scales one of
+  these into place, so rebuilding it is cheap and objects that look
+  alike share the same geometry.
+
+  Disks come in DISK_LODS levels of detail.  disk_lod() picks the
+  coarsest one that looks round at a given radius in pixels (a small
+  bullet doesn't need 128 slices).  The window sets pixel_scale to the
+  camera zoom before drawing, so zooming in picks finer disks.  Each
+  thread has its own pixel_scale, the one of the program it runs (see
+  interpreter_context.h); the lists are OpenGL's and there is only one
+  of those per process.
+
+  The lists are created the first time they are asked for.  Never ask
+  for one while compiling another display list (OpenGL does not allow
+  nested glNewList()).
+
+****/
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <vector>
+
+class Geometry_cache
+{
+  public:
+    static const int DISK_LODS = 5;
+
+    static int disk_lod(double pixel_radius);
+    static int disk_slices(int lod);
+
+    // the slices + 1 points around the unit circle (the last one is
+    // the first one again), x and y interleaved
+    static const double *disk_points(int lod);
+
+    static GLuint disk(int lod);
+    static GLuint square();
+    static GLuint triangle();
+
+    // screen pixels per world unit
+    static void set_pixel_scale(double scale) {m_pixel_scale = scale;}
+    static double pixel_scale() {return m_pixel_scale;}
+
+  private:
+    static GLuint m_disks[DISK_LODS];
+    static std::vector<double> m_disk_points[DISK_LODS];
+    static GLuint m_square;
+    static GLuint m_triangle;
+    static thread_local double m_pixel_scale;
+};
+
+#endif // #ifndef GEOMETRY_CACHE_H
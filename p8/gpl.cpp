@@ -29,9 +29,21 @@
 
 #include "parser.h" // substitute for y.tab.h
 #include "error.h"
+#include "runtime_metrics.h"
+#include "random_stream.h"
+#include "gpl_math.h"
+#include "jit.h"
+#include "interpreter_context.h"
 
 #ifdef GRAPHICS
 #include "window.h"
+#include "frame_scheduler.h"
+#include "batch_renderer.h"
+#include "software_renderer.h"
+#include "snapshot.h"
+#include "program_cache.h"
+#include "event_manager.h"
+#include "animation_block.h"
 #endif
 #include "gpl_assert.h"
 
@@ -44,9 +56,6 @@
 #include <stdio.h> // for fopen()
 using namespace std;
 
-extern int yylex();
-extern int yyparse();
-
 const int DEFAULT_WINDOW_X = 200;
 const int DEFAULT_WINDOW_Y = 200;
 const int DEFAULT_WINDOW_WIDTH = 500;
@@ -57,35 +66,23 @@ const double DEFAULT_WINDOW_BLUE = 1.0;
 const string DEFAULT_WINDOW_TITLE = "gpl window";
 const int DEFAULT_ANIMATION_SPEED = 88;
 
-class Window;
-Window *window = NULL;
-
-// there does not appear to be a default yywrap in OSX
-#ifdef __APPLE__
-extern "C" int yywrap ( );
 int
-yywrap(void)
-{
-  return true;
-}
-#endif
-
-
-int
-yyerror(const char *str)
+yyerror(yyscan_t scanner, Parse_state &parse_state, const char *str)
 {
   Error::error(Error::PARSE_ERROR, str);
   return 1;
 }
 
-#ifdef SYMBOL_TABLE
-static Symbol_table *symbol_table = Symbol_table::instance();
-#endif
-
 void illegal_usage(const char *qualifier = NULL)
 {
   cerr << "illegal command line argument(s)" << endl
-       << "Usage:  $ gpl [-s seed] [-stdin] [-dump_pixels filename] filename[.gpl]" << endl;
+       << "Usage:  $ gpl [-s seed] [-stdin] [-dump_pixels filename] "
+       << "[-frame_policy catch_up|skip_render|degrade] [-batch_draw] [-backend glut|software] [-pipeline] "
+       << "[-save_snapshot filename] [-restore filename] [-no_cache] "
+       << "[-error_reports N] [-fatal_errors] [-math exact|fast] [-jit on|off|verify] "
+       << "[-typed_nodes on|off] "
+       << "[-metrics filename[.csv|.jsonl]] [-frames N] [-dump_symbol_table filename] "
+       << "filename[.gpl]" << endl;
 
   if (qualifier)
       cerr << qualifier << endl;
@@ -96,31 +93,129 @@ bool dump_pixels = false;
 char *dump_pixels_filename = 0;
 bool graphics_flag = false;
 
-// This function is called from window.cpp when the user quits the program
+// -dump_symbol_table
+char *dump_symbol_table_filename = 0;
+
+// -save_snapshot, -restore (see snapshot.h)
+char *save_snapshot_filename = 0;
+char *restore_snapshot_filename = 0;
+uint64_t source_hash = 0;
+
+// -no_cache (see program_cache.h)
+bool use_program_cache = true;
+
+// -frames (the software backend quits after that many frames)
+int frame_limit = 0;
+
+// -frame_policy and -metrics print the frame statistics at exit
+bool report_frames = false;
+
+#ifdef GRAPHICS
+// registered with atexit() so the frame statistics are reported no matter
+// how the program ends (q key, exit statement, ...)
+void report_frame_scheduler()
+{
+  Frame_scheduler::instance()->report(cerr);
+}
+#endif
+
+#ifdef GRAPHICS
+// registered with atexit() so the symbol table is written no matter how
+// the program ends (gpl-batch keeps it with the results of each run)
+void dump_symbol_table()
+{
+  ofstream file(dump_symbol_table_filename);
+  if (!file)
+  {
+    cerr << "Cannot write the symbol table to <"
+         << dump_symbol_table_filename << ">." << endl;
+    return;
+  }
+  Symbol_table::instance()->print(file);
+}
+#endif
+
+// registered with atexit() so the runtime errors that were not all printed
+// are summarized (see Error::set_max_reports())
+void report_runtime_errors()
+{
+  Error::report(cerr);
+}
+
+// registered with atexit() so -jit verify reports what it checked
+void report_jit()
+{
+  Jit::report(cerr);
+}
+
+#ifdef GRAPHICS
+// shares the sub-expressions that the statements of each block evaluate
+// more than once (see Common_subexpressions in gpl_statement.h)
+void eliminate_common_subexpressions()
+{
+  const Symbol_table::SymbolMap &symbols =
+      Symbol_table::instance()->get_symbols();
+  for (Symbol_table::SymbolMap::const_iterator it = symbols.begin();
+       it != symbols.end(); it++)
+  {
+    std::shared_ptr<Animation_block> animation_block;
+    if (it->second->get_type() == ANIMATION_BLOCK
+        && it->second->get_animation_block(animation_block) != CONVERSION_ERROR
+        && animation_block)
+      animation_block->eliminate_common_subexpressions();
+  }
+
+  Event_manager::Handler_list handlers;
+  Event_manager::instance()->get_handlers(handlers);
+  for (unsigned int i = 0; i < handlers.size(); i++)
+    handlers[i].second->eliminate_common_subexpressions();
+}
+#endif
+
+// registered with atexit() so the last partial batch of frames is written
+void flush_runtime_metrics()
+{
+  Runtime_metrics::instance()->flush();
+}
+
+// Called from window.cpp when the user quits the program (the q key),
+// the context then ends the program (see Interpreter_context::quit())
 void user_quit_program()
 {
 #ifdef PRINT_SYMBOL_TABLE
   cout << endl << "User quit program.  Printing the symbol table." << endl;
-  static Symbol_table *symbol_table = Symbol_table::instance();
-  symbol_table->print(cout);
+  Symbol_table::instance()->print(cout);
 #endif
 
 #ifdef GRAPHICS
   if (dump_pixels)
   {
+    Window *window = Interpreter_context::current()->get_window();
     assert(graphics_flag);
     assert(window);
 
     window->dump_pixels(dump_pixels_filename);
   }
-#endif
-
-  exit(0);
 
+  if (save_snapshot_filename)
+  {
+    string error;
+    if (!Snapshot::save(save_snapshot_filename, source_hash, error))
+      cerr << "Cannot save snapshot <" << save_snapshot_filename << ">: "
+           << error << endl;
+  }
+#endif
 }
 
 int main(int argc, char **argv)
 {
+  // everything the program is made of belongs to this context; it is
+  // never destroyed, the program ends by exiting (the atexit() reports
+  // read it)
+  Interpreter_context context;
+  Interpreter_context::Scope scope(context);
+  context.set_quit_handler(user_quit_program);
+
   bool symbol_table_flag = false;
   bool print_symbol_table_flag = false;
 
@@ -139,7 +234,6 @@ graphics_flag = true;
 #endif
 
 
-  extern FILE *yyin;
   char *filename = 0;
   int seed = time(0);
   bool read_keypresses_from_standard_input = false;
@@ -151,12 +245,44 @@ graphics_flag = true;
   // if any argument is -s, the next one must be a number
   //    if it is a number use it as the srand seed
   // if any argument is -dump_pixels, the next one must be the filename
+  // if any argument is -frame_policy, the next one must be a policy name
+  // if any argument is -metrics, the next one must be the filename
+  // if any argument is -save_snapshot or -restore, the next one must be
+  //    the filename
+  // if any argument is -error_reports, the next one must be a number
+  // if any argument is -math, the next one must be exact or fast
+  // if any argument is -jit, the next one must be on, off or verify
+  // if any argument is -typed_nodes, the next one must be on or off
+  // if any argument is -frames, the next one must be a number
+  // if any argument is -dump_symbol_table, the next one must be the
+  //    filename
   // any other argument is assumed to be the filename
 
   for (int i = 1; i < argc; i++)
   {
     if (!strcmp(argv[i], "-stdin"))
       read_keypresses_from_standard_input = true;
+    else if (!strcmp(argv[i], "-no_cache"))
+      use_program_cache = false;
+    else if (!strcmp(argv[i], "-fatal_errors"))
+      Error::set_fatal(true);
+    else if (!strcmp(argv[i], "-error_reports"))
+    {
+      if (i+1 >= argc)
+        illegal_usage();
+      for (char *c = argv[i+1]; *c; c++)
+      {
+        if (!isdigit(*c))
+        {
+          cerr << "Illegal number of error reports: "
+               << argv[i+1]
+               << endl;
+          exit(1);
+        }
+      }
+      Error::set_max_reports(atoi(argv[i+1]));
+      i += 1; // skip the number of reports
+    }
     else if (!strcmp(argv[i], "-s"))
     {
       if (i+1 >= argc)
@@ -186,6 +312,163 @@ graphics_flag = true;
       dump_pixels = true;
       i += 1; // skip the dump filename
     }
+    else if (!strcmp(argv[i], "-frame_policy"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot set the -frame_policy unless graphics are enabled.");
+
+      if (i+1 >= argc)
+        illegal_usage();
+#ifdef GRAPHICS
+      Frame_scheduler::Policy policy;
+      if (!Frame_scheduler::string_to_policy(argv[i+1], policy))
+      {
+        cerr << "Illegal frame policy: " << argv[i+1] << endl;
+        exit(1);
+      }
+      Frame_scheduler::instance()->set_policy(policy);
+#endif
+      report_frames = true;
+      i += 1; // skip the policy name
+    }
+    else if (!strcmp(argv[i], "-batch_draw"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot use -batch_draw unless graphics are enabled.");
+#ifdef GRAPHICS
+      Batch_renderer::instance()->set_enabled(true);
+#endif
+    }
+    else if (!strcmp(argv[i], "-backend"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot set the -backend unless graphics are enabled.");
+
+      if (i+1 >= argc)
+        illegal_usage();
+#ifdef GRAPHICS
+      Window::Backend backend;
+      if (!Window::string_to_backend(argv[i+1], backend))
+      {
+        cerr << "Illegal backend: " << argv[i+1] << endl;
+        exit(1);
+      }
+      Window::set_backend(backend);
+#endif
+      i += 1; // skip the backend name
+    }
+    else if (!strcmp(argv[i], "-pipeline"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot use -pipeline unless graphics are enabled.");
+#ifdef GRAPHICS
+      Software_renderer::instance()->set_pipelined(true);
+#endif
+    }
+    else if (!strcmp(argv[i], "-math"))
+    {
+      if (i+1 >= argc)
+        illegal_usage();
+      Gpl_math::Mode mode;
+      if (!Gpl_math::string_to_mode(argv[i+1], mode))
+      {
+        cerr << "Illegal math mode: " << argv[i+1] << endl;
+        exit(1);
+      }
+      Gpl_math::set_mode(mode);
+      i += 1; // skip the mode name
+    }
+    else if (!strcmp(argv[i], "-jit"))
+    {
+      if (i+1 >= argc)
+        illegal_usage();
+      Jit::Mode mode;
+      if (!Jit::string_to_mode(argv[i+1], mode))
+      {
+        cerr << "Illegal jit mode: " << argv[i+1] << endl;
+        exit(1);
+      }
+      Jit::set_mode(mode);
+      i += 1; // skip the mode name
+    }
+    else if (!strcmp(argv[i], "-typed_nodes"))
+    {
+      if (i+1 >= argc)
+        illegal_usage();
+      if (!strcmp(argv[i+1], "on"))
+        set_typed_binary_expressions(true);
+      else if (!strcmp(argv[i+1], "off"))
+        set_typed_binary_expressions(false);
+      else
+      {
+        cerr << "Illegal typed_nodes setting: " << argv[i+1] << endl;
+        exit(1);
+      }
+      i += 1; // skip on or off
+    }
+    else if (!strcmp(argv[i], "-frames"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot use -frames unless graphics are enabled.");
+
+      if (i+1 >= argc)
+        illegal_usage();
+      for (char *c = argv[i+1]; *c; c++)
+      {
+        if (!isdigit(*c))
+        {
+          cerr << "Illegal number of frames: "
+               << argv[i+1]
+               << endl;
+          exit(1);
+        }
+      }
+      frame_limit = atoi(argv[i+1]);
+      i += 1; // skip the number of frames
+    }
+    else if (!strcmp(argv[i], "-dump_symbol_table"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot use -dump_symbol_table unless graphics are enabled.");
+
+      if (i+1 >= argc)
+        illegal_usage();
+      dump_symbol_table_filename = argv[i+1];
+      i += 1; // skip the symbol table filename
+    }
+    else if (!strcmp(argv[i], "-save_snapshot"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot use -save_snapshot unless graphics are enabled.");
+
+      if (i+1 >= argc)
+        illegal_usage();
+      save_snapshot_filename = argv[i+1];
+      i += 1; // skip the snapshot filename
+    }
+    else if (!strcmp(argv[i], "-restore"))
+    {
+      if (!graphics_flag)
+        illegal_usage("Cannot use -restore unless graphics are enabled.");
+
+      if (i+1 >= argc)
+        illegal_usage();
+      restore_snapshot_filename = argv[i+1];
+      i += 1; // skip the snapshot filename
+    }
+    else if (!strcmp(argv[i], "-metrics"))
+    {
+      if (i+1 >= argc)
+        illegal_usage();
+      if (!Runtime_metrics::instance()->open(argv[i+1]))
+      {
+        cerr << "Cannot open metrics file <" << argv[i+1] << ">." << endl;
+        exit(1);
+      }
+      atexit(flush_runtime_metrics);
+      report_frames = true;
+      i += 1; // skip the metrics filename
+    }
     else
     {
       // can only specify one filename
@@ -199,26 +482,45 @@ graphics_flag = true;
   if (!filename)
     illegal_usage();
 
+#ifdef GRAPHICS
+  // OpenGL can only be used from the thread that created the window,
+  // only the software backend can draw on another thread
+  if (Software_renderer::instance()->pipelined()
+      && Window::backend() != Window::SOFTWARE)
+  {
+    cerr << "-pipeline can only be used with -backend software" << endl;
+    exit(1);
+  }
+
+  // the GLUT backend runs until the window is closed
+  if (frame_limit && Window::backend() != Window::SOFTWARE)
+  {
+    cerr << "-frames can only be used with -backend software" << endl;
+    exit(1);
+  }
+#endif
+
   char *filename_with_extension = new char[strlen(filename) + 4];
   strcpy(filename_with_extension, filename);
 
-  yyin = fopen(filename,"r");
+  FILE *file = fopen(filename,"r");
 
   // if open failed, append .gpl to the filename and try again
-  if (!yyin)
+  if (!file)
   {
     strcat(filename_with_extension, ".gpl");
-    yyin = fopen(filename_with_extension,"r");
+    file = fopen(filename_with_extension,"r");
   }
 
   // cannot open filename or filename+.gpl
-  if (!yyin)
+  if (!file)
   {
     cerr << "Cannot open input file <" << filename << ">." << endl;
     exit(1);
   }
 
   srand(seed);
+  Random_stream::seed(seed);
 
   cout << "gpl.cpp::main()" << endl
        << "  input file(" << filename_with_extension << ")" << endl
@@ -238,22 +540,99 @@ graphics_flag = true;
        << "  graphics("
        << (graphics_flag ? "true" : "false") << ")" << endl << endl;
 
-  delete [] filename_with_extension;
+  // a snapshot can only be restored into the program it was taken from,
+  // the program cache is only used for the source it was written for
+#ifdef GRAPHICS
+  if (use_program_cache || save_snapshot_filename || restore_snapshot_filename)
+    source_hash = Snapshot::hash_file(filename_with_extension);
+  string cache_filename = Program_cache::cache_filename(filename_with_extension);
+#endif
 
-  cout << "gpl.cpp::main() Calling yyparse()" << endl << endl;
+  delete [] filename_with_extension;
 
   int parse_result = -1;
-  try
+  bool loaded_from_cache = false;
+#ifdef GRAPHICS
+  if (use_program_cache)
   {
- 	 parse_result = yyparse();
+    string error;
+    try
+    {
+      loaded_from_cache = Program_cache::load(cache_filename, source_hash, error);
+    }
+    catch (const std::exception &ex)
+    {
+      // part of the program has been built, it is too late to parse it
+      cerr << "Cannot load the program cache <" << cache_filename << ">: "
+           << ex.what() << endl
+           << "Remove it or run gpl with -no_cache." << endl;
+      exit(1);
+    }
+
+    if (loaded_from_cache)
+    {
+      cout << "gpl.cpp::main() Loaded the program from <"
+           << cache_filename << ">." << endl << endl;
+      parse_result = 0;
+    }
   }
-  catch(...)
+#endif
+
+  if (!loaded_from_cache)
   {
-  	cout << "PARSE EXCEPTION LINE " << endl;
-	throw;
+    cout << "gpl.cpp::main() Calling yyparse()" << endl << endl;
+
+    try
+    {
+      parse_result = context.parse(file);
+    }
+    catch(...)
+    {
+      cout << "PARSE EXCEPTION LINE " << endl;
+      throw;
+    }
+
+    cout << endl << "gpl.cpp::main() after call to yyparse()."<<endl<< endl;
+
+#ifdef GRAPHICS
+    // before anything runs, the cache holds the program as declared;
+    // a program whose declarations called random() is not cached, the
+    // values it declared would be the same in every run whatever the seed
+    if (use_program_cache && parse_result == 0 && Error::num_errors() == 0
+        && Random_stream::main_stream().count() == 0)
+    {
+      string error;
+      if (!Program_cache::save(cache_filename, source_hash, error))
+        cerr << "Cannot write the program cache <" << cache_filename << ">: "
+             << error << endl;
+    }
+#endif
   }
 
-  cout << endl << "gpl.cpp::main() after call to yyparse()."<<endl<< endl;
+#ifdef GRAPHICS
+  // after the program is cached, which holds the blocks as written
+  // (only the animation blocks and the event handlers run statements)
+  if (parse_result == 0 && Error::num_errors() == 0)
+    eliminate_common_subexpressions();
+#endif
+
+  // before the reserved variables (window_width, ...) are read, so the
+  // window is the one of the snapshot
+#ifdef GRAPHICS
+  bool restored = false;
+  if (restore_snapshot_filename && parse_result == 0
+      && Error::num_errors() == 0)
+  {
+    string error;
+    if (!Snapshot::restore(restore_snapshot_filename, source_hash, error))
+    {
+      cerr << "Cannot restore snapshot <" << restore_snapshot_filename
+           << ">: " << error << endl;
+      exit(1);
+    }
+    restored = true;
+  }
+#endif
 
 
 // if -DGRAPHICS was specified when compiling gpl.cpp then include this code
@@ -274,6 +653,7 @@ graphics_flag = true;
   // However, the variables must be of the correct type
   //    e.g. if there is a "window_x" in the symbol table AND it is int
   //         use its value instead of the default value
+  Symbol_table *symbol_table = Symbol_table::instance();
   Gpl_type type;
 
   // if there is a variable in the symbol table called "window_x"
@@ -369,6 +749,27 @@ graphics_flag = true;
                    );
     else symbol_table->get("animation_speed", animation_speed);
   }
+
+  // the camera variables are read by the Window every frame, but make
+  // sure they have the right type up front
+  if (symbol_table->get_type("camera_x", type) && type != INT)
+    Error::error(Error::INVALID_TYPE_FOR_RESERVED_VARIABLE,
+                 "camera_x",
+                 gpl_type_to_string(type),
+                 "int"
+                 );
+  if (symbol_table->get_type("camera_y", type) && type != INT)
+    Error::error(Error::INVALID_TYPE_FOR_RESERVED_VARIABLE,
+                 "camera_y",
+                 gpl_type_to_string(type),
+                 "int"
+                 );
+  if (symbol_table->get_type("camera_zoom", type) && type != DOUBLE)
+    Error::error(Error::INVALID_TYPE_FOR_RESERVED_VARIABLE,
+                 "camera_zoom",
+                 gpl_type_to_string(type),
+                 "double"
+                 );
 #endif
 
 
@@ -403,8 +804,7 @@ graphics_flag = true;
   if (parse_result == 0 && Error::num_errors() == 0)
   {
     cout << endl << "Printing the symbol table from main()" << endl;
-    static Symbol_table *symbol_table = Symbol_table::instance();
-    symbol_table->print(cout);
+    Symbol_table::instance()->print(cout);
   }
 #endif
 
@@ -415,18 +815,31 @@ graphics_flag = true;
 #endif
 
 #ifdef GRAPHICS
-  window = new Window(window_x, window_y, window_width,
-                      window_height, window_title, animation_speed,
-                      window_red, window_green, window_blue,
-                      read_keypresses_from_standard_input
-                     );
+  Window *window = new Window(window_x, window_y, window_width,
+                              window_height, window_title, animation_speed,
+                              window_red, window_green, window_blue,
+                              read_keypresses_from_standard_input
+                             );
+  context.set_window(window);
+  window->set_frame_limit(frame_limit);
+
+  if (report_frames)
+    atexit(report_frame_scheduler);
+  if (dump_symbol_table_filename)
+    atexit(dump_symbol_table);
 
   // tell the Error object that execution is starting
   // Error class prints different messages once execution starts
   Error::starting_execution();
+  atexit(report_runtime_errors);
+  atexit(report_jit);
 
-  cout << "gpl.cpp::main() Calling window->initialize()." << endl;
-  window->initialize();
+  // the initialization blocks already ran before the snapshot was taken
+  if (!restored)
+  {
+    cout << "gpl.cpp::main() Calling window->initialize()." << endl;
+    window->initialize();
+  }
 
   cout << "gpl.cpp::main() Passing control to window->main_loop()."
        << endl;
@@ -4,13 +4,32 @@
  ** Language (GPL). 
  **/
 
+%code requires
+{
+// the parser and the scanner are re-entrant: the scanner is passed to
+// yyparse(), and both keep their state in the Parse_state of the program's
+// Interpreter_context (see interpreter_context.h)
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+struct Parse_state;
+}
+
+%code provides
+{
+int yylex(YYSTYPE* yylval, yyscan_t scanner); // returns the next token; from gpl.l
+int yyerror(yyscan_t scanner, Parse_state& parse_state, const char* str); // used to print errors
+}
+
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {Parse_state& parse_state}
+
 %{  // bison syntax to indicate the start of the header
     // the header is copied directly into y.tab.c (the generated parser)
 
-extern int yylex();               // this lexer function returns next token
-extern int yyerror(const char *); // used to print errors
-extern int line_count;            // current line in the input; from record.l
-
 #include <iostream>
 #include <string>
 #include <vector>
@@ -34,6 +53,7 @@ extern int line_count;            // current line in the input; from record.l
 #include "window.h"
 #include "event_manager.h"
 #include "helper_functions.h"
+#include "interpreter_context.h"
 %}
 
 %union 
@@ -186,15 +206,9 @@ inline std::shared_ptr<Symbol> get_symbol(std::string name, bool* bIsArray)
 		<< Error::num_errors() << ")")
 
 
-// We need to hold onto the name of any forward statement so that we can validate them
-// after we have finished parsing the entire document. Namely, we need to
-// confirm that each animation_block has a body 
-
-typedef std::map<std::string, std::shared_ptr<Animation_block>> AnimationMap;
-AnimationMap _animMap;
-
-// used for parsing/error handling animation blocks
-int _anim_start_line;
+// The names of the forward statements are held in parse_state.animations so
+// that we can validate them after we have finished parsing the entire
+// document. Namely, we need to confirm that each animation_block has a body
 
 %} 
 
@@ -211,6 +225,7 @@ int _anim_start_line;
 %token T_CIRCLE              "Circle"
 %token T_RECTANGLE           "Rectangle"
 %token T_TEXTBOX             "Textbox"
+%token T_TILEMAP             "Tilemap"
 %token <union_int> T_FORWARD "forward" // value is line number
 %token T_INITIALIZATION      "initialization" 
 
@@ -266,6 +281,8 @@ int _anim_start_line;
 %nonassoc T_FLOOR               "floor"
 %nonassoc T_ABS                 "abs"
 %nonassoc T_RANDOM              "random"
+%nonassoc T_SPAWN               "spawn"
+%nonassoc T_DESPAWN             "despawn"
 %nonassoc <union_int> T_PRINT           "print" // value is line number
 %nonassoc <union_int> T_EXIT            "exit" // value is line number
 
@@ -401,6 +418,7 @@ int _anim_start_line;
 %type <union_statement> assign_statement
 %type <union_statement> print_statement
 %type <union_statement> exit_statement
+%type <union_statement> spawn_statement
 %type <union_statement_block> statement_list
 %type <union_statement_block> statement_block
 %type <union_statement_block> if_block
@@ -417,18 +435,18 @@ program:
 		GPL_BEGIN_BLOCK("program")
 
 		//Validate that any animation blocks have a body
-		for(AnimationMap::iterator it = _animMap.begin();
-			it != _animMap.end(); it++)
+		for(Parse_state::AnimationMap::iterator it = parse_state.animations.begin();
+			it != parse_state.animations.end(); it++)
 		{
 			if(!it->second->is_initialized())
 			{
 				// set the line # to make the error handler use the
 				// right one
-				//line_count = it->second->get_line();
+				//parse_state.line_count = it->second->get_line();
 				animation_body_expected(it->first).write_exception();
 			}
 		}		
-		_animMap.clear();
+		parse_state.animations.clear();
 
 		GPL_END_BLOCK()
 	}
@@ -628,6 +646,9 @@ object_declaration:
 			case TEXTBOX:
 				pobj = Textbox::Create();
 				break;
+			case TILEMAP:
+				pobj = Tilemap::Create();
+				break;
 			default:
 				throw std::invalid_argument("Unrecognized Game Object Type");
 		}
@@ -805,6 +826,10 @@ object_type:
 	{
 		$$ = TEXTBOX;
 	}
+    | T_TILEMAP
+	{
+		$$ = TILEMAP;
+	}
     ;
 
 //---------------------------------------------------------------------
@@ -894,7 +919,7 @@ forward_declaration:
 				
 			// Create and register the animation block
 			std::shared_ptr<Animation_block> pAnim(
-				new Animation_block(line_count, pObjSymbol, anim_name));	
+				new Animation_block(parse_state.line_count, pObjSymbol, anim_name));	
 			std::shared_ptr<IValue>pVal (new GPLVariant(pAnim));
 			InsertSymbol(anim_name, ANIMATION_BLOCK, pVal);
 
@@ -908,7 +933,7 @@ forward_declaration:
 		
 			// Hold onto this info so that we can validate it 
 			// after we have parsed the entire document
-			_animMap.insert(std::make_pair(anim_name, pAnim));
+			parse_state.animations.insert(std::make_pair(anim_name, pAnim));
 
 		GPL_END_BLOCK()
 	}
@@ -943,7 +968,7 @@ initialization_block:
 
 //---------------------------------------------------------------------
 animation_block:
-	T_ANIMATION { _anim_start_line = line_count; } 
+	T_ANIMATION { parse_state.animation_start_line = parse_state.line_count; } 
 		T_ID T_LPAREN animation_parameter T_RPAREN T_LBRACE statement_list T_RBRACE
 	{
 		GPL_BEGIN_BLOCK("animation_block")
@@ -962,7 +987,7 @@ animation_block:
 			// temporarily set the line # to the one where the animation block
 			// begins, so as to match the test output
 
-			throw animation_forward_expected(anim_name, _anim_start_line);
+			throw animation_forward_expected(anim_name, parse_state.animation_start_line);
 		}
 
 		// Confirm that this is, in fact, an animation block
@@ -974,7 +999,7 @@ animation_block:
 
 		if(pAnim->is_initialized())
 		{
-			throw animation_previously_declared(anim_name, _anim_start_line);	
+			throw animation_previously_declared(anim_name, parse_state.animation_start_line);	
 		}
 
 		// Confirm that the animation block signature matches that of the forward
@@ -996,7 +1021,7 @@ animation_block:
 				<< "' (" << gpl_type_to_string(pParam->get*/
 
 			
-			throw animation_parameter_invalid(_anim_start_line);
+			throw animation_parameter_invalid(parse_state.animation_start_line);
 		}
 	
 		// Transfer all of the statements from the generic symbol block to 
@@ -1151,7 +1176,7 @@ if_block:
 	{
 		GPL_BEGIN_BLOCK("if_block[1]")
 		std::shared_ptr<gpl_statement> statement($1);
-		$$ = new statement_block(line_count);
+		$$ = new statement_block(parse_state.line_count);
 		$$->insert_statement(statement);		
 		GPL_END_BLOCK()
 	}
@@ -1159,7 +1184,7 @@ if_block:
 /*   | empty
 	{
 		GPL_BEGIN_BLOCK("if_block[2]")
-		$$ = new statement_block(line_count);
+		$$ = new statement_block(parse_state.line_count);
 		GPL_END_BLOCK()
 	}*/
     ;
@@ -1195,7 +1220,7 @@ statement_list:
 	}
     | empty
 	{
-		$$ = new statement_block(line_count);
+		$$ = new statement_block(parse_state.line_count);
 	}
     ;
 
@@ -1211,6 +1236,8 @@ statement:
 	{ $$ = $1; }
     | exit_statement T_SEMIC
 	{ $$ = $1; }
+    | spawn_statement T_SEMIC
+	{ $$ = $1; }
     ;
 
 //---------------------------------------------------------------------
@@ -1220,7 +1247,7 @@ if_statement:
 		GPL_BEGIN_BLOCK("if_statement (no else)")
 		std::shared_ptr<IExpression> pCondition($3);
 		std::shared_ptr<gpl_statement> pThen($5);
-		$$ = new if_statement(line_count, pCondition, pThen);
+		$$ = new if_statement(parse_state.line_count, pCondition, pThen);
 		GPL_END_BLOCK()
 	}
     |
@@ -1230,7 +1257,7 @@ if_statement:
 		std::shared_ptr<IExpression> pCondition($3);
 		std::shared_ptr<gpl_statement> pThen($5);
 		std::shared_ptr<gpl_statement> pElse($7);
-		$$ = new if_statement(line_count, pCondition, pThen, pElse);
+		$$ = new if_statement(parse_state.line_count, pCondition, pThen, pElse);
 		GPL_END_BLOCK()
 	}
     ;
@@ -1246,7 +1273,7 @@ for_statement:
 		std::shared_ptr<assign_statement> incr((assign_statement*)$7);
 		std::shared_ptr<statement_block> body_block($9);
 
-		$$ = new for_statement(line_count, init, cond_expr, incr, body_block);
+		$$ = new for_statement(parse_state.line_count, init, cond_expr, incr, body_block);
 
 		GPL_END_BLOCK()
 	}
@@ -1260,7 +1287,7 @@ print_statement:
 	{
 		GPL_BEGIN_BLOCK("print_statement")
 		std::shared_ptr<IExpression> print_expr($3);
-		$$ = new print_statement(line_count, print_expr);
+		$$ = new print_statement(parse_state.line_count, print_expr);
 		GPL_END_BLOCK()
 	}
     ;
@@ -1271,7 +1298,25 @@ exit_statement:
 	{
 		GPL_BEGIN_BLOCK("exit_statement")
 		std::shared_ptr<IExpression> exit_expr($3);
-		$$ = new exit_statement(line_count, exit_expr);
+		$$ = new exit_statement(parse_state.line_count, exit_expr);
+		GPL_END_BLOCK()
+	}
+    ;
+
+//---------------------------------------------------------------------
+spawn_statement:
+    T_SPAWN T_LPAREN variable T_RPAREN
+	{
+		GPL_BEGIN_BLOCK("spawn_statement")
+		std::shared_ptr<IExpression> obj_expr($3);
+		$$ = new spawn_statement(parse_state.line_count, obj_expr, true);
+		GPL_END_BLOCK()
+	}
+    | T_DESPAWN T_LPAREN variable T_RPAREN
+	{
+		GPL_BEGIN_BLOCK("despawn_statement")
+		std::shared_ptr<IExpression> obj_expr($3);
+		$$ = new spawn_statement(parse_state.line_count, obj_expr, false);
 		GPL_END_BLOCK()
 	}
     ;
@@ -1283,7 +1328,7 @@ assign_statement:
 		GPL_BEGIN_BLOCK("assign_statement '='")
 		std::shared_ptr<IVariableExpression> var_expr((IVariableExpression*)$1);
 		std::shared_ptr<IExpression> val_expr($3);
-		$$ = new assign_statement(line_count, var_expr, ASSIGN, val_expr);
+		$$ = new assign_statement(parse_state.line_count, var_expr, ASSIGN, val_expr);
 		GPL_END_BLOCK()
 	}
     | variable T_PLUS_ASSIGN expression
@@ -1291,7 +1336,7 @@ assign_statement:
 		GPL_BEGIN_BLOCK("assign_statement '+='")
 		std::shared_ptr<IVariableExpression> var_expr((IVariableExpression*)$1);
 		std::shared_ptr<IExpression> val_expr($3);
-		$$ = new assign_statement(line_count, var_expr, ADD_ASSIGN, val_expr);
+		$$ = new assign_statement(parse_state.line_count, var_expr, ADD_ASSIGN, val_expr);
 		GPL_END_BLOCK()
 	}
     | variable T_MINUS_ASSIGN expression
@@ -1299,7 +1344,7 @@ assign_statement:
 		GPL_BEGIN_BLOCK("assign statement '-='")
 		std::shared_ptr<IVariableExpression> var_expr((IVariableExpression*)$1);
 		std::shared_ptr<IExpression> val_expr($3);
-		$$ = new assign_statement(line_count, var_expr, SUBTRACT_ASSIGN, val_expr);
+		$$ = new assign_statement(parse_state.line_count, var_expr, SUBTRACT_ASSIGN, val_expr);
 		GPL_END_BLOCK()
 	}
     ;
@@ -1402,6 +1447,19 @@ variable:
 
 		$$ = new ArrayMemberReferenceExpression(obj_name, member_name, ndx_expr);
 
+		GPL_END_EXPR_BLOCK($$)
+	}
+    | T_ID T_PERIOD T_ID T_LBRACKET expression T_RBRACKET
+	{
+		GPL_BEGIN_EXPR_BLOCK("variable[4]")
+		std::string obj_name(*$1);
+		std::string member_name(*$3);
+		delete $1; // free the ID
+		delete $3; // free the ID
+
+		std::shared_ptr<IExpression> ndx_expr($5);
+		$$ = new IndexedMemberReferenceExpression(obj_name, member_name, ndx_expr);
+
 		GPL_END_EXPR_BLOCK($$)
 	}
     ;
@@ -1415,7 +1473,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[0]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new OrExpression(pLHS, pRHS);
+		$$ = make_binary_expression(OR, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_AND expression
@@ -1423,7 +1481,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[1]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new AndExpression(pLHS, pRHS);
+		$$ = make_binary_expression(AND, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_LESS_EQUAL expression 
@@ -1431,7 +1489,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[2]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new LessThanEqualExpression(pLHS, pRHS);
+		$$ = make_binary_expression(LESS_THAN_EQUAL, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_GREATER_EQUAL  expression 
@@ -1439,7 +1497,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[3]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new GreaterThanEqualExpression(pLHS, pRHS);
+		$$ = make_binary_expression(GREATER_THAN_EQUAL, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_LESS expression 
@@ -1447,7 +1505,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[4]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new LessThanExpression(pLHS, pRHS);
+		$$ = make_binary_expression(LESS_THAN, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_GREATER  expression 
@@ -1455,7 +1513,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[5]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new GreaterThanExpression(pLHS, pRHS);
+		$$ = make_binary_expression(GREATER_THAN, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_EQUAL expression 
@@ -1463,7 +1521,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[6]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new EqualExpression(pLHS, pRHS);
+		$$ = make_binary_expression(EQUAL, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_NOT_EQUAL expression 
@@ -1471,7 +1529,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[7]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new NotEqualExpression(pLHS, pRHS);
+		$$ = make_binary_expression(NOT_EQUAL, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_PLUS expression 
@@ -1479,7 +1537,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[8]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new AddExpression(pLHS, pRHS);
+		$$ = make_binary_expression(PLUS, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_MINUS expression 
@@ -1487,7 +1545,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[9]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new MinusExpression(pLHS, pRHS);
+		$$ = make_binary_expression(MINUS, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_ASTERISK expression 
@@ -1495,7 +1553,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[10]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new MultiplyExpression(pLHS, pRHS);
+		$$ = make_binary_expression(MULTIPLY, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_DIVIDE expression
@@ -1503,7 +1561,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[11]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new DivideExpression(pLHS, pRHS);
+		$$ = make_binary_expression(DIVIDE, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | expression T_MOD expression
@@ -1511,7 +1569,7 @@ expression:
 		GPL_BEGIN_EXPR_BLOCK("expression[11]")
 		std::shared_ptr<IExpression> pLHS($1);
 		std::shared_ptr<IExpression> pRHS($3);
-		$$ = new ModExpression(pLHS, pRHS);
+		$$ = make_binary_expression(MOD, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | T_MINUS  expression %prec UNARY_OPS
@@ -1520,7 +1578,7 @@ expression:
 		std::shared_ptr<IValue> pVal(new GPLVariant(-1));
 		std::shared_ptr<IExpression> pLHS(new ValueExpression(pVal));
 		std::shared_ptr<IExpression> pRHS($2);
-		$$ = new MultiplyExpression(pLHS, pRHS);
+		$$ = make_binary_expression(MULTIPLY, pLHS, pRHS);
 		GPL_END_EXPR_BLOCK($$)
 	}
     | T_NOT  expression 
@@ -1657,6 +1715,14 @@ primary_expression:
 		$$ = new ValueExpression(pval);
 		GPL_END_EXPR_BLOCK($$)
 	}
+    | T_SPAWN T_LPAREN T_ID T_RPAREN
+	{
+		GPL_BEGIN_EXPR_BLOCK("primary_expression[7]")
+		std::string pool_name(*$3);
+		delete $3;
+		$$ = new SpawnExpression(pool_name);
+		GPL_END_EXPR_BLOCK($$)
+	}
     ;
 
 //---------------------------------------------------------------------
@@ -1,11 +1,14 @@
 #include <iostream>
 #include <stdlib.h>
+#include "interpreter_context.h"
 using namespace std;
 
-extern int line_count;  // from gpl.l
-
 void __gpl_assert(const char *filename, int line, const char *text)
 {
+  // the line the scanner is on, if a program is being run
+  Interpreter_context *context = Interpreter_context::current();
+  int line_count = context ? context->get_parse_state().line_count : 0;
+
   cerr << "assertion \"" << text << "\" failed: file \""
        << filename << "\", line " << line
        << ".  Input line " << line_count << "."
@@ -0,0 +1,536 @@
+/*
+
+  gpl-batch runs many gpl programs at once, headless, one gpl process per
+  run, on a pool of worker processes as large as the machine has cores.
+
+  Usage:  $ gpl-batch [-j workers] [-o results_dir] [-timeout seconds]
+                      [-gpl path] manifest [-- gpl arguments]
+
+  The manifest has one run (a job) per line; blank lines and everything
+  after a # are ignored:
+
+      # script            seed   input trace      frames
+      tests/pong.gpl      1      traces/pong.txt  600
+      tests/pong.gpl      2      -                600
+      tests/bounce.gpl    7
+
+  The input trace is what the run reads from standard input (see -stdin
+  in gpl.cpp), - (the default) is no input.  The run ends after the given
+  number of frames (300 by default; 0 runs until the program exits) as if
+  the q key had been pressed.  Every run is
+
+      gpl -backend software -stdin -no_cache -s seed -frames frames
+          -dump_symbol_table file [gpl arguments] script
+
+  (the program cache is not used, runs of the same script would all write
+  it at once).  For job number N the results directory gets
+
+      N_script_sSEED.out       its standard output
+      N_script_sSEED.err       its standard error
+      N_script_sSEED.symbols   the symbol table when it ended
+      summary.csv              one line per job: how it ended, its wall
+                               time, cpu time and peak memory
+
+  A run that crashes or is killed after -timeout seconds only ends that
+  job.  gpl-batch prints the throughput and the slowest jobs, and exits
+  with 1 if a job crashed, timed out or could not be started.
+
+*/
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+const int DEFAULT_FRAMES = 300;
+const char *DEFAULT_RESULTS_DIR = "batch_results";
+
+// how many of the slowest jobs are reported
+const int SLOWEST_REPORTED = 10;
+
+// how often the running jobs are checked for a timeout (ms)
+const int TIMEOUT_POLL = 5;
+
+class Job
+{
+  public:
+    Job()
+    {
+      m_number = 0;
+      m_frames = DEFAULT_FRAMES;
+      m_pid = 0;
+      m_started = false;
+      m_finished = false;
+      m_timed_out = false;
+      m_wait_status = 0;
+      m_wall_ms = 0;
+      m_cpu_ms = 0;
+      m_max_rss_kb = 0;
+    }
+
+    int m_number;
+    string m_script;
+    string m_seed;
+    string m_trace;  // "-" if there is none
+    int m_frames;
+
+    // the prefix of the result files (N_script_sSEED)
+    string m_name;
+
+    pid_t m_pid;
+    Clock::time_point m_start_time;
+    bool m_started;
+    bool m_finished;
+    bool m_timed_out;
+    string m_error;  // why the job could not be started
+    int m_wait_status;
+    double m_wall_ms;
+    double m_cpu_ms;
+    long m_max_rss_kb;
+
+    // crashed, timed out or never ran
+    bool failed() const
+    {
+      return !m_started || m_timed_out || !WIFEXITED(m_wait_status);
+    }
+
+    // "exit 0", "signal 11 (Segmentation fault)", "timeout", ...
+    string status() const
+    {
+      ostringstream os;
+      if (!m_started)
+        os << "not started: " << m_error;
+      else if (m_timed_out)
+        os << "timeout";
+      else if (WIFEXITED(m_wait_status))
+        os << "exit " << WEXITSTATUS(m_wait_status);
+      else if (WIFSIGNALED(m_wait_status))
+        os << "signal " << WTERMSIG(m_wait_status)
+           << " (" << strsignal(WTERMSIG(m_wait_status)) << ")";
+      else os << "unknown";
+      return os.str();
+    }
+};
+
+void illegal_usage(const char *qualifier = NULL)
+{
+  cerr << "illegal command line argument(s)" << endl
+       << "Usage:  $ gpl-batch [-j workers] [-o results_dir] "
+       << "[-timeout seconds] [-gpl path] manifest [-- gpl arguments]" << endl;
+
+  if (qualifier)
+      cerr << qualifier << endl;
+
+  exit(2);
+}
+
+bool is_number(const string &str)
+{
+  if (str.empty())
+    return false;
+  for (unsigned int i = 0; i < str.size(); i++)
+    if (!isdigit(str[i]))
+      return false;
+  return true;
+}
+
+// the script's file name without the directory and the .gpl
+string script_name(const string &script)
+{
+  string name = script.substr(script.find_last_of('/') + 1);
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".gpl") == 0)
+    name.erase(name.size() - 4);
+  return name;
+}
+
+// Reads the jobs in the manifest.  Returns false (after printing what is
+// wrong) if a line is not "script [seed [input_trace [frames]]]"
+bool read_manifest(const char *filename, vector<Job> &jobs)
+{
+  ifstream file(filename);
+  if (!file)
+  {
+    cerr << "Cannot open manifest <" << filename << ">." << endl;
+    return false;
+  }
+
+  bool ok = true;
+  string line;
+  for (int line_number = 1; getline(file, line); line_number++)
+  {
+    string::size_type comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+
+    istringstream fields(line);
+    vector<string> field;
+    string word;
+    while (fields >> word)
+      field.push_back(word);
+    if (field.empty())
+      continue;
+
+    Job job;
+    job.m_number = jobs.size() + 1;
+    job.m_script = field[0];
+    job.m_seed = field.size() > 1 ? field[1] : "1";
+    job.m_trace = field.size() > 2 ? field[2] : "-";
+    if (field.size() > 3)
+      job.m_frames = atoi(field[3].c_str());
+
+    if (field.size() > 4 || !is_number(job.m_seed)
+        || (field.size() > 3 && !is_number(field[3])))
+    {
+      cerr << filename << ":" << line_number << ": expected "
+           << "\"script [seed [input_trace [frames]]]\"" << endl;
+      ok = false;
+      continue;
+    }
+
+    ostringstream name;
+    name << setw(4) << setfill('0') << job.m_number << "_"
+         << script_name(job.m_script) << "_s" << job.m_seed;
+    job.m_name = name.str();
+
+    jobs.push_back(job);
+  }
+  return ok;
+}
+
+// Forks the gpl process of the job, with its standard input, output and
+// error redirected.  Returns false if it could not be started
+bool start_job(Job &job, const string &gpl, const string &results_dir,
+               const vector<string> &gpl_arguments)
+{
+  string prefix = results_dir + "/" + job.m_name;
+  string symbols_filename = prefix + ".symbols";
+
+  ostringstream frames;
+  frames << job.m_frames;
+
+  vector<string> arguments;
+  arguments.push_back(gpl);
+  arguments.push_back("-backend");
+  arguments.push_back("software");
+  arguments.push_back("-stdin");
+  arguments.push_back("-no_cache");
+  arguments.push_back("-s");
+  arguments.push_back(job.m_seed);
+  if (job.m_frames > 0)
+  {
+    arguments.push_back("-frames");
+    arguments.push_back(frames.str());
+  }
+  arguments.push_back("-dump_symbol_table");
+  arguments.push_back(symbols_filename);
+  arguments.insert(arguments.end(), gpl_arguments.begin(), gpl_arguments.end());
+  arguments.push_back(job.m_script);
+
+  // everything the child needs is ready before the fork
+  vector<char *> argv;
+  for (unsigned int i = 0; i < arguments.size(); i++)
+    argv.push_back(const_cast<char *>(arguments[i].c_str()));
+  argv.push_back(0);
+
+  const char *trace = job.m_trace == "-" ? "/dev/null" : job.m_trace.c_str();
+  int in = open(trace, O_RDONLY);
+  if (in < 0)
+  {
+    job.m_error = "cannot open input trace <" + job.m_trace + ">";
+    return false;
+  }
+  int out = open((prefix + ".out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int err = open((prefix + ".err").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0 || err < 0)
+  {
+    job.m_error = "cannot write the results of " + job.m_name;
+    close(in);
+    if (out >= 0) close(out);
+    if (err >= 0) close(err);
+    return false;
+  }
+
+  job.m_start_time = Clock::now();
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    dup2(in, STDIN_FILENO);
+    dup2(out, STDOUT_FILENO);
+    dup2(err, STDERR_FILENO);
+    close(in);
+    close(out);
+    close(err);
+    execvp(argv[0], &argv[0]);
+
+    // only returns if gpl could not be run, this ends up in the .err file
+    const char *message = "gpl-batch: cannot run gpl\n";
+    if (write(STDERR_FILENO, message, strlen(message))) {}
+    _exit(127);
+  }
+
+  close(in);
+  close(out);
+  close(err);
+  if (pid < 0)
+  {
+    job.m_error = string("fork failed: ") + strerror(errno);
+    return false;
+  }
+
+  job.m_pid = pid;
+  job.m_started = true;
+  return true;
+}
+
+void finish_job(Job &job, int wait_status, const struct rusage &usage)
+{
+  job.m_finished = true;
+  job.m_wait_status = wait_status;
+  job.m_wall_ms = chrono::duration<double, milli>(Clock::now()
+                                                   - job.m_start_time).count();
+  job.m_cpu_ms = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+                 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+  job.m_max_rss_kb = usage.ru_maxrss;
+}
+
+// a field of summary.csv, quoted if it has to be
+string csv_field(const string &str)
+{
+  if (str.find_first_of(",\"\n") == string::npos)
+    return str;
+
+  string quoted = "\"";
+  for (unsigned int i = 0; i < str.size(); i++)
+  {
+    if (str[i] == '"')
+      quoted += '"';
+    quoted += str[i];
+  }
+  return quoted + "\"";
+}
+
+bool write_summary(const string &filename, const vector<Job> &jobs)
+{
+  ofstream file(filename.c_str());
+  if (!file)
+    return false;
+
+  file << "job,script,seed,input_trace,frames,status,wall_ms,cpu_ms,max_rss_kb"
+       << endl;
+  file << fixed << setprecision(1);
+  for (unsigned int i = 0; i < jobs.size(); i++)
+  {
+    const Job &job = jobs[i];
+    file << job.m_number << "," << csv_field(job.m_script) << ","
+         << job.m_seed << "," << csv_field(job.m_trace) << ","
+         << job.m_frames << "," << csv_field(job.status()) << ","
+         << job.m_wall_ms << "," << job.m_cpu_ms << ","
+         << job.m_max_rss_kb << endl;
+  }
+  return true;
+}
+
+bool slower(const Job *a, const Job *b)
+{
+  return a->m_wall_ms > b->m_wall_ms;
+}
+
+void report(ostream &os, const vector<Job> &jobs, int workers, double wall_ms)
+{
+  int ok = 0, nonzero = 0, failed = 0;
+  double run_ms = 0;
+  vector<const Job *> ran;
+  for (unsigned int i = 0; i < jobs.size(); i++)
+  {
+    const Job &job = jobs[i];
+    if (job.failed())
+      failed++;
+    else if (WEXITSTATUS(job.m_wait_status) == 0)
+      ok++;
+    else nonzero++;
+
+    if (job.m_started)
+    {
+      run_ms += job.m_wall_ms;
+      ran.push_back(&job);
+    }
+  }
+
+  double seconds = wall_ms / 1000.0;
+  os << fixed << setprecision(2)
+     << "gpl-batch: " << jobs.size() << " jobs, " << workers
+     << " at a time, in " << seconds << " s ("
+     << (seconds > 0 ? jobs.size() / seconds : 0) << " jobs/s, "
+     << (wall_ms > 0 ? run_ms / wall_ms : 0) << " jobs running on average)"
+     << endl
+     << "  " << ok << " exited with 0, " << nonzero
+     << " with another status, " << failed
+     << " crashed, timed out or did not start" << endl;
+
+  for (unsigned int i = 0; i < jobs.size(); i++)
+    if (jobs[i].failed())
+      os << "  " << jobs[i].m_name << ": " << jobs[i].status() << endl;
+
+  sort(ran.begin(), ran.end(), slower);
+  if (ran.size() > (unsigned int) SLOWEST_REPORTED)
+    ran.resize(SLOWEST_REPORTED);
+  if (!ran.empty())
+    os << "slowest jobs:" << endl;
+  for (unsigned int i = 0; i < ran.size(); i++)
+    os << "  " << setw(8) << ran[i]->m_wall_ms / 1000.0 << " s  "
+       << ran[i]->m_name << "  " << ran[i]->status() << endl;
+}
+
+int main(int argc, char **argv)
+{
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  int timeout = 0;
+  string results_dir = DEFAULT_RESULTS_DIR;
+  string gpl;
+  char *manifest = 0;
+  vector<string> gpl_arguments;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--"))
+    {
+      gpl_arguments.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "-timeout"))
+    {
+      if (i+1 >= argc || !is_number(argv[i+1]))
+        illegal_usage();
+      if (!strcmp(argv[i], "-j"))
+        workers = atoi(argv[i+1]);
+      else timeout = atoi(argv[i+1]);
+      i += 1; // skip the number
+    }
+    else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "-gpl"))
+    {
+      if (i+1 >= argc)
+        illegal_usage();
+      if (!strcmp(argv[i], "-o"))
+        results_dir = argv[i+1];
+      else gpl = argv[i+1];
+      i += 1; // skip the path
+    }
+    else
+    {
+      // can only specify one manifest
+      if (manifest != 0)
+        illegal_usage();
+      manifest = argv[i];
+    }
+  }
+  if (!manifest)
+    illegal_usage();
+  if (workers < 1)
+    workers = 1;
+
+  // by default the gpl next to gpl-batch, or the one on the PATH
+  if (gpl.empty())
+  {
+    string self = argv[0];
+    string::size_type slash = self.find_last_of('/');
+    gpl = slash == string::npos ? "gpl" : self.substr(0, slash + 1) + "gpl";
+  }
+
+  vector<Job> jobs;
+  if (!read_manifest(manifest, jobs))
+    exit(2);
+
+  if (mkdir(results_dir.c_str(), 0755) < 0 && errno != EEXIST)
+  {
+    cerr << "Cannot create the results directory <" << results_dir << ">: "
+         << strerror(errno) << endl;
+    exit(2);
+  }
+
+  Clock::time_point batch_start = Clock::now();
+  unsigned int next = 0;
+  int running = 0;
+  while (next < jobs.size() || running > 0)
+  {
+    while (running < workers && next < jobs.size())
+    {
+      Job &job = jobs[next++];
+      if (start_job(job, gpl, results_dir, gpl_arguments))
+        running++;
+      else cerr << job.m_name << ": " << job.m_error << endl;
+    }
+    if (running == 0)
+      continue;
+
+    // without a timeout there is nothing to do but wait
+    int status;
+    struct rusage usage;
+    pid_t pid = wait4(-1, &status, timeout ? WNOHANG : 0, &usage);
+    if (pid < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      cerr << "wait4 failed: " << strerror(errno) << endl;
+      exit(2);
+    }
+
+    if (pid == 0)
+    {
+      Clock::time_point now = Clock::now();
+      for (unsigned int i = 0; i < next; i++)
+      {
+        Job &job = jobs[i];
+        if (job.m_started && !job.m_finished && !job.m_timed_out
+            && now - job.m_start_time > chrono::seconds(timeout))
+        {
+          job.m_timed_out = true;
+          kill(job.m_pid, SIGKILL);
+        }
+      }
+      usleep(TIMEOUT_POLL * 1000);
+      continue;
+    }
+
+    for (unsigned int i = 0; i < next; i++)
+    {
+      if (jobs[i].m_started && !jobs[i].m_finished && jobs[i].m_pid == pid)
+      {
+        finish_job(jobs[i], status, usage);
+        running--;
+        break;
+      }
+    }
+  }
+  double wall_ms = chrono::duration<double, milli>(Clock::now()
+                                                   - batch_start).count();
+
+  string summary = results_dir + "/summary.csv";
+  if (!write_summary(summary, jobs))
+    cerr << "Cannot write <" << summary << ">." << endl;
+
+  report(cout, jobs, workers, wall_ms);
+
+  for (unsigned int i = 0; i < jobs.size(); i++)
+    if (jobs[i].failed())
+      return 1;
+  return 0;
+}
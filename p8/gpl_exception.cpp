@@ -1,6 +1,5 @@
 #include "gpl_exception.h"
-
-extern int line_count;
+#include "interpreter_context.h"
 
 gpl_exception::gpl_exception(Error::Error_type err_type, 
 	std::string arg1, std::string arg2, std::string arg3)
@@ -9,7 +8,7 @@ gpl_exception::gpl_exception(Error::Error_type err_type,
 	_args[0] = arg1;
 	_args[1] = arg2;
 	_args[2] = arg3;
-	_line = line_count;
+	_line = Interpreter_context::current()->get_parse_state().line_count;
 }
 
 gpl_exception::~gpl_exception()
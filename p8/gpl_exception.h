@@ -290,6 +290,16 @@ public:
 	virtual ~invalid_assign_lhs() {};
 };
 
+class read_only_variable : public gpl_exception
+{
+public:
+	read_only_variable(std::string var_name)
+		: gpl_exception(Error::CANNOT_ASSIGN_TO_READ_ONLY_VARIABLE, var_name)
+		{};
+
+	virtual ~read_only_variable() {};
+};
+
 class invalid_assign_rhs : public gpl_exception
 {
 public:
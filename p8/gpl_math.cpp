@@ -0,0 +1,99 @@
+#include "gpl_math.h"
+
+#include <cmath>
+
+// the exact mode keeps the constant gpl always converted with
+#define PI 3.14159265
+#define CONVERT_TO_RADIANS(deg) (deg)*PI/180
+#define CONVERT_TO_DEGREES(rad) (rad)*180/PI
+
+static const double DEG_TO_RAD = 0.017453292519943295769;
+static const double RAD_TO_DEG = 57.295779513082320877;
+
+// past this the reduction to [-45, 45] loses precision
+static const double MAX_FAST_ANGLE = 1e9;
+
+Gpl_math::Mode Gpl_math::_mode = Gpl_math::EXACT;
+
+//==============================================================================
+
+// Splits deg into a quadrant (0 - 3) and the angle in radians from the
+// nearest multiple of 90 degrees, and evaluates sin and cos of it
+static inline int reduce(double deg, double& s, double& c)
+{
+	// round to the nearest multiple without a call to floor()
+	double t = deg * (1.0 / 90);
+	long long q = (long long) (t + std::copysign(0.5, t));
+	double x = (deg - (double) q * 90) * DEG_TO_RAD;
+	double x2 = x * x;
+
+	s = x * (1 + x2 * (-1.0 / 6 + x2 * (1.0 / 120 + x2 * (-1.0 / 5040
+		+ x2 * (1.0 / 362880 + x2 * (-1.0 / 39916800
+		+ x2 * (1.0 / 6227020800.0 + x2 * (-1.0 / 1307674368000.0))))))));
+	c = 1 + x2 * (-1.0 / 2 + x2 * (1.0 / 24 + x2 * (-1.0 / 720
+		+ x2 * (1.0 / 40320 + x2 * (-1.0 / 3628800
+		+ x2 * (1.0 / 479001600 + x2 * (-1.0 / 87178291200.0
+		+ x2 * (1.0 / 20922789888000.0))))))));
+
+	return (int) (q & 3);
+}
+
+bool Gpl_math::string_to_mode(const std::string& name, Mode& mode)
+{
+	if(name == "exact") mode = EXACT;
+	else if(name == "fast") mode = FAST;
+	else return false;
+	return true;
+}
+
+double Gpl_math::sin_deg(double deg)
+{
+	if(_mode == EXACT || !(std::fabs(deg) < MAX_FAST_ANGLE))
+		return sin(CONVERT_TO_RADIANS(deg));
+
+	double s, c;
+	int quadrant = reduce(deg, s, c);
+	double val = (quadrant & 1)? c : s;
+
+	// 0 - val rather than -val, so sin(180) is 0 and not -0
+	return (quadrant & 2)? 0.0 - val : val;
+}
+
+double Gpl_math::cos_deg(double deg)
+{
+	if(_mode == EXACT || !(std::fabs(deg) < MAX_FAST_ANGLE))
+		return cos(CONVERT_TO_RADIANS(deg));
+
+	double s, c;
+	int quadrant = reduce(deg, s, c);
+	double val = (quadrant & 1)? s : c;
+	return ((quadrant + 1) & 2)? 0.0 - val : val;
+}
+
+double Gpl_math::tan_deg(double deg)
+{
+	if(_mode == EXACT || !(std::fabs(deg) < MAX_FAST_ANGLE))
+		return tan(CONVERT_TO_RADIANS(deg));
+
+	double s, c;
+	if(reduce(deg, s, c) & 1) return -c / s;
+	return s / c;
+}
+
+double Gpl_math::asin_deg(double x)
+{
+	if(_mode == EXACT) return CONVERT_TO_DEGREES(asin(x));
+	return asin(x) * RAD_TO_DEG;
+}
+
+double Gpl_math::acos_deg(double x)
+{
+	if(_mode == EXACT) return CONVERT_TO_DEGREES(acos(x));
+	return acos(x) * RAD_TO_DEG;
+}
+
+double Gpl_math::atan_deg(double x)
+{
+	if(_mode == EXACT) return CONVERT_TO_DEGREES(atan(x));
+	return atan(x) * RAD_TO_DEG;
+}
@@ -0,0 +1,50 @@
+#ifndef GPL_MATH_H
+#define GPL_MATH_H
+
+#include <string>
+
+/***
+ Gpl_math holds the numeric built-ins of gpl that work in degrees:
+ sin, cos, tan take degrees, asin, acos, atan return them.
+
+ 	gpl -math exact		(the default) converts with PI = 3.14159265
+ 				and calls libm, as gpl always did
+ 	gpl -math fast		computes sin, cos and tan in degrees without
+ 				calling libm, and converts the results of
+ 				asin, acos and atan with one multiplication
+
+ The fast sin/cos/tan reduce the angle to [-45, 45] degrees around the
+ nearest multiple of 90 (so sin(180) is exactly 0) and evaluate the
+ Taylor polynomials of sin and cos there up to x^15 and x^16; the
+ truncation error is below 1e-16, so the results are within a few ulp
+ of the true value for angles up to 1e9 degrees (larger ones go to
+ libm). The fast mode uses the true value of pi, so it differs from
+ the exact mode by up to 4e-9 relative, the error of PI = 3.14159265.
+***/
+class Gpl_math
+{
+public:
+	enum Mode
+	{
+		EXACT,
+		FAST
+	};
+
+	static void set_mode(Mode mode) { _mode = mode; };
+	static Mode get_mode() { return _mode; };
+
+	// returns false if the name is not "exact" or "fast"
+	static bool string_to_mode(const std::string& name, Mode& mode);
+
+	static double sin_deg(double deg);
+	static double cos_deg(double deg);
+	static double tan_deg(double deg);
+	static double asin_deg(double x);
+	static double acos_deg(double x);
+	static double atan_deg(double x);
+
+private:
+	static Mode _mode;
+};
+
+#endif
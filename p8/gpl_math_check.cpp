@@ -0,0 +1,273 @@
+/*
+
+  gpl-math-check checks the fast mode of Gpl_math (gpl -math fast) against
+  the error bounds documented in gpl_math.h, then times both modes.
+
+  Usage:  $ make math-check
+          $ gpl-math-check [-iterations n]
+
+  The accuracy part compares, for every function:
+
+      fast vs the true value   sin/cos/tan on every 1/1000 degree in
+                               [-720, 720], the multiples of 15 degrees and
+                               random angles up to 1e9 degrees; asin/acos on
+                               [-1, 1] and atan on [-1e6, 1e6].  The true
+                               value is computed in long double from the
+                               angle less the nearest multiple of 90
+                               (exact in doubles).  Must be within MAX_ULP
+                               ulp.
+
+      fast vs exact            over the same inputs (sin/cos/tan on
+                               [-720, 720]); the difference must come from
+                               PI = 3.14159265 only: at most
+                               MAX_PI_ERROR relative to the angle (times
+                               the slope of the function) plus MAX_ULP ulp.
+
+  It prints the largest error of each function and exits with 1 if one
+  is out of bounds.  The timing part calls every function -iterations
+  times (1000000 by default) in each mode and prints the ns per call.
+  make math-check builds it with -O2: gpl itself is built without
+  optimization, where the polynomials of the fast mode are no faster
+  than libm.
+
+*/
+
+#include "gpl_math.h"
+
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// "within a few ulp of the true value" (gpl_math.h)
+static const double MAX_ULP = 4;
+
+// "differs from the exact mode by up to 4e-9 relative" (gpl_math.h)
+static const double MAX_PI_ERROR = 4e-9;
+
+static const long double PI_L = 3.141592653589793238462643383279502884L;
+
+typedef double (*Math_function)(double);
+
+//==============================================================================
+//	T R U E   V A L U E S
+//==============================================================================
+
+// deg less the nearest multiple of 90 is exact, the rest is in long
+// double, so sin(180) is 0 like the true value
+static long double true_sin_cos(double deg, bool sine)
+{
+	double q = nearbyint(fmod(deg, 360.0) / 90);
+	long double rad = (long double) (fmod(deg, 360.0) - q * 90) * PI_L / 180;
+	int quadrant = ((int) q + (sine? 0 : 1)) & 3;
+	switch(quadrant)
+	{
+		case 0: return sinl(rad);
+		case 1: return cosl(rad);
+		case 2: return -sinl(rad);
+		default: return -cosl(rad);
+	}
+}
+
+static double true_sin(double deg) { return (double) true_sin_cos(deg, true); }
+static double true_cos(double deg) { return (double) true_sin_cos(deg, false); }
+
+static double true_tan(double deg)
+{
+	return (double) (true_sin_cos(deg, true) / true_sin_cos(deg, false));
+}
+
+static double true_asin(double x) { return (double) (asinl(x) * 180 / PI_L); }
+static double true_acos(double x) { return (double) (acosl(x) * 180 / PI_L); }
+static double true_atan(double x) { return (double) (atanl(x) * 180 / PI_L); }
+
+//==============================================================================
+
+static double ulp(double val)
+{
+	val = fabs(val);
+	if(val < DBL_MIN) return DBL_MIN;
+	return nextafter(val, INFINITY) - val;
+}
+
+static double in_mode(Gpl_math::Mode mode, Math_function f, double x)
+{
+	Gpl_math::set_mode(mode);
+	return f(x);
+}
+
+struct Check
+{
+	const char* name;
+	Math_function function;
+	Math_function true_value;
+	bool takes_degrees;
+};
+
+static const Check checks[] =
+{
+	{ "sin", Gpl_math::sin_deg, true_sin, true },
+	{ "cos", Gpl_math::cos_deg, true_cos, true },
+	{ "tan", Gpl_math::tan_deg, true_tan, true },
+	{ "asin", Gpl_math::asin_deg, true_asin, false },
+	{ "acos", Gpl_math::acos_deg, true_acos, false },
+	{ "atan", Gpl_math::atan_deg, true_atan, false }
+};
+static const int NUM_CHECKS = sizeof(checks) / sizeof(checks[0]);
+
+static void inputs(const Check& check, vector<double>& vals, bool large)
+{
+	vals.clear();
+	if(check.takes_degrees)
+	{
+		for(int i = -720000; i <= 720000; i++)
+			vals.push_back(i / 1000.0);
+		for(int i = -48; i <= 48; i++)
+			vals.push_back(i * 15.0);
+		if(large)
+		{
+			mt19937_64 generator(1);
+			uniform_real_distribution<double> angle(-1e9, 1e9);
+			for(int i = 0; i < 100000; i++)
+				vals.push_back(angle(generator));
+		}
+	}
+	else
+	{
+		double bound = (check.true_value == true_atan)? 1e6 : 1;
+		for(int i = -1000000; i <= 1000000; i++)
+			vals.push_back(bound * i / 1000000.0);
+	}
+}
+
+// the largest error in ulp of the fast mode against the true value
+static double check_fast(const Check& check)
+{
+	vector<double> vals;
+	inputs(check, vals, true);
+
+	double worst = 0;
+	for(size_t i = 0; i < vals.size(); i++)
+	{
+		double expected = check.true_value(vals[i]);
+		double actual = in_mode(Gpl_math::FAST, check.function, vals[i]);
+
+		// tan at an odd multiple of 90 is a pole, either side will do
+		if(std::isinf(expected) || fabs(expected) > 1e15) continue;
+
+		double error = fabs(actual - expected) / ulp(expected);
+		if(!(error <= worst)) worst = error;
+	}
+	return worst;
+}
+
+// the largest difference between the modes, as a fraction of the bound
+// (> 1 is out of bounds)
+static double check_exact(const Check& check)
+{
+	vector<double> vals;
+	inputs(check, vals, false);
+
+	double worst = 0;
+	for(size_t i = 0; i < vals.size(); i++)
+	{
+		double fast = in_mode(Gpl_math::FAST, check.function, vals[i]);
+		double exact = in_mode(Gpl_math::EXACT, check.function, vals[i]);
+		if(fabs(fast) > 1e15) continue;
+
+		// the exact mode computes f(x * (1 + e)) with |e| <= MAX_PI_ERROR
+		double slope = 1;
+		double change = fabs(fast) * MAX_PI_ERROR;
+		if(check.takes_degrees)
+		{
+			if(check.function == Gpl_math::tan_deg)
+				slope = 1 + fast * fast;
+			change = fabs(vals[i]) * PI_L / 180 * MAX_PI_ERROR * slope;
+		}
+		double bound = change + MAX_ULP * ulp(fast) * slope;
+
+		double error = fabs(fast - exact) / bound;
+		if(!(error <= worst)) worst = error;
+	}
+	return worst;
+}
+
+//==============================================================================
+//	T I M I N G
+//==============================================================================
+
+// ns per call of f on angles (or values) spread over the usual range
+static double time_function(Gpl_math::Mode mode, const Check& check,
+		int iterations)
+{
+	Gpl_math::set_mode(mode);
+	double step = check.takes_degrees? 0.37 : 1.9 / iterations;
+	double start_val = check.takes_degrees? -180 : -0.95;
+
+	volatile double sink = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	double x = start_val;
+	for(int i = 0; i < iterations; i++)
+	{
+		sink = sink + check.function(x);
+		x += step;
+	}
+	chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+	return chrono::duration<double, nano>(end - start).count() / iterations;
+}
+
+//==============================================================================
+
+int main(int argc, char** argv)
+{
+	int iterations = 1000000;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-iterations") && i + 1 < argc)
+			iterations = atoi(argv[++i]);
+		else
+		{
+			cerr << "Usage:  $ gpl-math-check [-iterations n]" << endl;
+			return 1;
+		}
+	}
+	if(iterations <= 0) iterations = 1;
+
+	bool ok = true;
+	cout << "accuracy     fast vs true (ulp)   fast vs exact (of bound)" << endl;
+	for(int i = 0; i < NUM_CHECKS; i++)
+	{
+		double fast = check_fast(checks[i]);
+		double exact = check_exact(checks[i]);
+		bool passed = fast <= MAX_ULP && exact <= 1;
+		ok = ok && passed;
+		cout << "  " << left << setw(10) << checks[i].name << right
+			<< setw(12) << setprecision(3) << fast
+			<< setw(24) << setprecision(3) << exact
+			<< (passed? "" : "   FAILED") << endl;
+	}
+
+	cout << endl << "timing       exact (ns)   fast (ns)   speedup" << endl;
+	for(int i = 0; i < NUM_CHECKS; i++)
+	{
+		double exact = time_function(Gpl_math::EXACT, checks[i], iterations);
+		double fast = time_function(Gpl_math::FAST, checks[i], iterations);
+		cout << "  " << left << setw(10) << checks[i].name << right
+			<< fixed << setprecision(1)
+			<< setw(12) << exact << setw(12) << fast
+			<< setw(10) << setprecision(2) << exact / fast << endl;
+		cout.unsetf(ios::fixed);
+	}
+
+	cout << endl << (ok? "math-check passed" : "math-check FAILED") << endl;
+	return ok? 0 : 1;
+}
@@ -1,10 +1,17 @@
 #include <stdexcept>
 #include <iostream>
 #include <memory>
+#include <sstream>
 
 #include "parser.h"
 #include "gpl_statement.h"
 #include "gpl_exception.h"
+#include "symbol.h"
+#include "frame_scheduler.h"
+#include "runtime_metrics.h"
+#include "snapshot.h"
+#include "program_cache.h"
+#include "interpreter_context.h"
 
 gpl_statement::gpl_statement(int line_no)
 {
@@ -21,19 +28,90 @@ const int& gpl_statement::get_line() const
 statement_block::statement_block(int line)
 	: gpl_statement(line)
 {
+	_run = 0;
+	_shared_count = 0;
+	_executions = 0;
+	_pNative = nullptr;
 }
 
 void statement_block::execute()
 {
 	TRACE_VERBOSE("statement_block::execute - There are " << _list.size() << " Statements")
+	if(run_native(true)) return;
+
+	begin_run();
 	int i = 0;
 	for(StatementList::iterator it = _list.begin(); it != _list.end(); it++)
 	{
 		TRACE_VERBOSE("Executing Statement #" << i++)
+		Runtime_metrics::count_statement();
+		Error::set_runtime_line((*it)->get_line());
 		(*it)->execute();
 	}
 }
 
+bool statement_block::run_native(bool bCountStatements)
+{
+	if(!_pNative)
+	{
+		// a block that could not be compiled stops counting
+		if(_executions > Jit::HOT_THRESHOLD || !Jit::is_enabled()) return false;
+		if(++_executions <= Jit::HOT_THRESHOLD) return false;
+
+		_pNative = Jit::compile(*this, bCountStatements);
+		if(!_pNative) return false;
+
+		TRACE_VERBOSE("statement_block - compiled, line " << get_line())
+	}
+
+	Jit::run(_pNative);
+	return true;
+}
+
+void statement_block::get_modified_variables(VariableSet& vars) const
+{
+	for(StatementList::const_iterator it = _list.begin(); it != _list.end(); it++)
+	{
+		(*it)->get_modified_variables(vars);
+	}
+}
+
+void statement_block::hoist_invariants(Loop_invariants& loop)
+{
+	for(StatementList::iterator it = _list.begin(); it != _list.end(); it++)
+	{
+		(*it)->hoist_invariants(loop);
+	}
+}
+
+void statement_block::eliminate_common_subexpressions()
+{
+	Common_subexpressions common(&_run);
+	for(StatementList::iterator it = _list.begin(); it != _list.end(); it++)
+	{
+		(*it)->eliminate_common_subexpressions();
+		(*it)->share_subexpressions(common);
+
+		VariableSet modified;
+		(*it)->get_modified_variables(modified);
+		common.invalidate(modified);
+	}
+	_shared_count = common.get_shared_count();
+
+	TRACE_VERBOSE("statement_block - shared: " << _shared_count)
+}
+
+void statement_block::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::STATEMENT_BLOCK);
+	out.write_int(get_line());
+	out.write_int((int) _list.size());
+	for(StatementList::const_iterator it = _list.begin(); it != _list.end(); it++)
+	{
+		(*it)->write(out);
+	}
+}
+
 int statement_block::get_count() const
 {
 	return _list.size();
@@ -95,6 +173,42 @@ void if_statement::execute()
 	}
 }
 
+void if_statement::get_modified_variables(VariableSet& vars) const
+{
+	_pCondition->get_side_effects(vars);
+	_pThen->get_modified_variables(vars);
+	if(_pElse) _pElse->get_modified_variables(vars);
+}
+
+void if_statement::hoist_invariants(Loop_invariants& loop)
+{
+	loop.hoist(_pCondition);
+	_pThen->hoist_invariants(loop);
+	if(_pElse) _pElse->hoist_invariants(loop);
+}
+
+void if_statement::share_subexpressions(Common_subexpressions& common)
+{
+	// the branches are blocks of their own
+	common.share(_pCondition);
+}
+
+void if_statement::eliminate_common_subexpressions()
+{
+	_pThen->eliminate_common_subexpressions();
+	if(_pElse) _pElse->eliminate_common_subexpressions();
+}
+
+void if_statement::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::IF_STATEMENT);
+	out.write_int(get_line());
+	_pCondition->write(out);
+	_pThen->write(out);
+	out.write_int(!!_pElse);
+	if(_pElse) _pElse->write(out);
+}
+
 const std::shared_ptr<gpl_statement>& if_statement::get_then() const
 {
 	return _pThen;
@@ -128,7 +242,29 @@ void print_statement::execute()
 	std::shared_ptr<IValue> pval = _prnt_expr->eval();
 	std::string print_string = pval->to_string();
 
-	std::cout << "gpl[" << get_line() << "]: " << print_string << std::endl;	
+	Interpreter_context::current()->out() << "gpl[" << get_line() << "]: " << print_string << std::endl;	
+}
+
+void print_statement::get_modified_variables(VariableSet& vars) const
+{
+	_prnt_expr->get_side_effects(vars);
+}
+
+void print_statement::hoist_invariants(Loop_invariants& loop)
+{
+	loop.hoist(_prnt_expr);
+}
+
+void print_statement::share_subexpressions(Common_subexpressions& common)
+{
+	common.share(_prnt_expr);
+}
+
+void print_statement::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::PRINT_STATEMENT);
+	out.write_int(get_line());
+	_prnt_expr->write(out);
 }
 
 //===================================================================
@@ -156,8 +292,86 @@ void exit_statement::execute()
 		throw std::runtime_error("exit_statement::execute - CONVERSION_ERROR");
 	}
 
-	std::cout << "gpl[" << get_line() << "]: exit(" << result << ")" << std::endl;
-	exit(result);
+	Interpreter_context* pContext = Interpreter_context::current();
+	pContext->out() << "gpl[" << get_line() << "]: exit(" << result << ")" << std::endl;
+	pContext->end(result);
+}
+
+void exit_statement::get_modified_variables(VariableSet& vars) const
+{
+	_exit_expr->get_side_effects(vars);
+}
+
+void exit_statement::hoist_invariants(Loop_invariants& loop)
+{
+	loop.hoist(_exit_expr);
+}
+
+void exit_statement::share_subexpressions(Common_subexpressions& common)
+{
+	common.share(_exit_expr);
+}
+
+void exit_statement::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::EXIT_STATEMENT);
+	out.write_int(get_line());
+	_exit_expr->write(out);
+}
+
+//===================================================================
+
+spawn_statement::spawn_statement(int line, std::shared_ptr<IExpression> obj_expr, bool bSpawn)
+	: gpl_statement(line)
+{
+	if(!obj_expr) throw std::invalid_argument("Object Expression is NULL");
+
+	if(obj_expr->get_type() != GAME_OBJECT)
+	{
+		IVariableExpression* pVar = dynamic_cast<IVariableExpression*>(obj_expr.get());
+		throw object_operand_expected(pVar? pVar->get_name() : (bSpawn? "spawn" : "despawn"));
+	}
+
+	_obj_expr = obj_expr;
+	_bSpawn = bSpawn;
+}
+
+void spawn_statement::execute()
+{
+	TRACE_VERBOSE("spawn_statement::execute - " << (_bSpawn? "spawn" : "despawn"))
+
+	std::shared_ptr<Game_object> pObj;
+	if(_obj_expr->eval()->get_game_object(pObj) == CONVERSION_ERROR || !pObj)
+	{
+		throw undefined_error();
+	}
+
+	if(_bSpawn) pObj->spawn();
+	else pObj->despawn();
+}
+
+void spawn_statement::get_modified_variables(VariableSet& vars) const
+{
+	_obj_expr->get_side_effects(vars);
+	vars.insert(".active");
+}
+
+void spawn_statement::hoist_invariants(Loop_invariants& loop)
+{
+	loop.hoist_children(_obj_expr);
+}
+
+void spawn_statement::share_subexpressions(Common_subexpressions& common)
+{
+	common.share_children(_obj_expr);
+}
+
+void spawn_statement::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::SPAWN_STATEMENT);
+	out.write_int(get_line());
+	out.write_int(_bSpawn);
+	_obj_expr->write(out);
 }
 
 //===================================================================
@@ -181,6 +395,10 @@ assign_statement::assign_statement(int line, std::shared_ptr<IVariableExpression
 		throw invalid_assign_lhs(assign_oper, pLHS->get_name(), lhs_type);
 
 
+	// the frame scheduler's counters can only be read
+	if(Frame_scheduler::is_reserved_variable(pLHS->get_storage_name()))
+		throw read_only_variable(pLHS->get_name());
+
 	// Can't assign a Game Object to another one
 	if(lhs_type == GAME_OBJECT) throw invalid_assign_lhs(assign_oper, pLHS->get_name(), lhs_type);
 	if(rhs_type == GAME_OBJECT) throw invalid_assign_rhs(assign_oper, lhs_type, rhs_type);
@@ -322,6 +540,46 @@ void assign_statement::execute()
 	}
 }
 
+void assign_statement::get_modified_variables(VariableSet& vars) const
+{
+	_pLHS->get_side_effects(vars);
+	_pRHS->get_side_effects(vars);
+
+	std::string name = _pLHS->get_storage_name();
+	vars.insert(name);
+
+	// an object's width and height are derived from its other members 
+	// (radius, size, text, filename, ...), so be conservative
+	if(!name.empty() && name[0] == '.' && name != ".x" && name != ".y")
+	{
+		vars.insert(".w");
+		vars.insert(".h");
+	}
+}
+
+void assign_statement::hoist_invariants(Loop_invariants& loop)
+{
+	// the variable itself is never hoisted, but its array index may be
+	loop.hoist_children(_pLHS);
+	loop.hoist(_pRHS);
+}
+
+void assign_statement::share_subexpressions(Common_subexpressions& common)
+{
+	// the variable itself is never shared, but its array index may be
+	common.share_children(_pLHS);
+	common.share(_pRHS);
+}
+
+void assign_statement::write(Snapshot_writer& out) const
+{
+	out.write_int(Program_cache::ASSIGN_STATEMENT);
+	out.write_int(get_line());
+	_pLHS->write(out);
+	out.write_int(_operator);
+	_pRHS->write(out);
+}
+
 //===================================================================
 
 for_statement::for_statement(int line, const std::shared_ptr<assign_statement>& pInit,
@@ -341,12 +599,110 @@ for_statement::for_statement(int line, const std::shared_ptr<assign_statement>&
 	_pCondition = pCondition;
 	_pIncrement = pIncrement;
 	_pBody = pBody;
+
+	_run = 0;
+	_hoisted_count = 0;
+	_bDecrement = false;
+	_compare = LESS_THAN;
+
+	// Everything the loop may change once it is running
+	VariableSet modified;
+	_pBody->get_modified_variables(modified);
+	_pIncrement->get_modified_variables(modified);
+	_pCondition->get_side_effects(modified);
+
+	_bCounted = analyze_counted_loop(modified);
+
+	Loop_invariants loop(modified, &_run);
+	_pBody->hoist_invariants(loop);
+	if(!_bCounted)
+	{
+		loop.hoist(_pCondition);
+		_pIncrement->hoist_invariants(loop);
+	}
+	_hoisted_count = loop.get_hoisted_count();
+
+	TRACE_VERBOSE("for_statement - counted: " << _bCounted << ", hoisted: " << _hoisted_count)
+}
+
+// Recognizes loops of the form
+//	for(i = a; i < b; i += c)
+// where i is an int variable, the comparison is one of < <= > >=, the step
+// is += or -=, and neither the body nor the increment writes i or anything
+// that b or c read.
+bool for_statement::analyze_counted_loop(const VariableSet& modified)
+{
+	if(_pInit->get_operator() != ASSIGN) return false;
+
+	std::shared_ptr<ReferenceExpression> pInitVar = 
+		std::dynamic_pointer_cast<ReferenceExpression>(_pInit->get_lhs());
+	if(!pInitVar || pInitVar->get_type() != INT) return false;
+
+	std::shared_ptr<Symbol> pIndex = std::dynamic_pointer_cast<Symbol>(pInitVar->get_variable());
+	if(!pIndex) return false;
+
+	// The Condition
+	std::shared_ptr<IOperationalExpression> pCompare = 
+		std::dynamic_pointer_cast<IOperationalExpression>(_pCondition);
+	if(!pCompare) return false;
+
+	Operator_type compare = pCompare->get_operator();
+	if(compare != LESS_THAN && compare != LESS_THAN_EQUAL 
+		&& compare != GREATER_THAN && compare != GREATER_THAN_EQUAL)
+		return false;
+
+	std::shared_ptr<IExpression> pBound = pCompare->get_child(1);
+	if(pCompare->get_child(0)->get_storage_name() != pIndex->get_name()
+		|| !std::dynamic_pointer_cast<ReferenceExpression>(pCompare->get_child(0))
+		|| pBound->get_type() != INT)
+		return false;
+
+	// The Increment
+	Assignment_type step_oper = _pIncrement->get_operator();
+	if(step_oper != ADD_ASSIGN && step_oper != SUBTRACT_ASSIGN) return false;
+
+	std::shared_ptr<ReferenceExpression> pStepVar = 
+		std::dynamic_pointer_cast<ReferenceExpression>(_pIncrement->get_lhs());
+	if(!pStepVar || pStepVar->get_variable() != pInitVar->get_variable())
+		return false;
+
+	std::shared_ptr<IExpression> pStep = _pIncrement->get_rhs();
+	if(pStep->get_type() != INT) return false;
+
+	// i, b and c may only change through the loop itself
+	VariableSet body_modified;
+	_pBody->get_modified_variables(body_modified);
+	if(body_modified.count(pIndex->get_name())) return false;
+
+	Loop_invariants loop(modified, &_run);
+	if(!loop.is_invariant(pBound) || !loop.is_invariant(pStep)) return false;
+
+	VariableSet bound_vars;
+	pBound->get_variables(bound_vars);
+	pStep->get_variables(bound_vars);
+	if(bound_vars.count(pIndex->get_name())) return false;
+
+	_pIndex = pIndex;
+	_pBound = pBound;
+	_pStep = pStep;
+	_compare = compare;
+	_bDecrement = (step_oper == SUBTRACT_ASSIGN);
+	return true;
 }
 
 void for_statement::execute()
 {
 	TRACE_VERBOSE("for_statement::execute")
 
+	// invalidate the values cached by the previous run
+	_run++;
+
+	if(_bCounted)
+	{
+		execute_counted();
+		return;
+	}
+
 	// Run the Init Statement
 	_pInit->execute();
 
@@ -355,7 +711,8 @@ void for_statement::execute()
 	std::shared_ptr<IValue> pval;
 	while(true)
 	{
-		// Evaluate the Condition
+		// Evaluate the Condition (the body moved the runtime line)
+		Error::set_runtime_line(get_line());
 		pval = _pCondition->eval();
 		if(pval->get_int(bcond) == CONVERSION_ERROR)
 		{
@@ -370,3 +727,272 @@ void for_statement::execute()
 	}
 }
 
+void for_statement::execute_counted()
+{
+	_pInit->execute();
+
+	int ndx, bound, step;
+	if(_pIndex->get_int(ndx) == CONVERSION_ERROR
+		|| _pBound->eval()->get_int(bound) == CONVERSION_ERROR
+		|| _pStep->eval()->get_int(step) == CONVERSION_ERROR)
+	{
+		throw undefined_error();
+	}
+
+	if(_bDecrement) step = -step;
+
+	while(true)
+	{
+		bool bcond;
+		switch(_compare)
+		{
+			case LESS_THAN: bcond = (ndx < bound); break;
+			case LESS_THAN_EQUAL: bcond = (ndx <= bound); break;
+			case GREATER_THAN: bcond = (ndx > bound); break;
+			default: bcond = (ndx >= bound); break;
+		}
+		if(!bcond) break;
+
+		_pBody->execute();
+
+		// the body may read the index, so keep the Symbol up to date
+		ndx += step;
+		_pIndex->set_int(ndx);
+	}
+}
+
+void for_statement::get_modified_variables(VariableSet& vars) const
+{
+	_pCondition->get_side_effects(vars);
+	_pInit->get_modified_variables(vars);
+	_pIncrement->get_modified_variables(vars);
+	_pBody->get_modified_variables(vars);
+}
+
+void for_statement::hoist_invariants(Loop_invariants& loop)
+{
+	_pInit->hoist_invariants(loop);
+	_pBody->hoist_invariants(loop);
+
+	if(_bCounted)
+	{
+		loop.hoist(_pBound);
+		loop.hoist(_pStep);
+	}
+	else
+	{
+		loop.hoist(_pCondition);
+		_pIncrement->hoist_invariants(loop);
+	}
+}
+
+void for_statement::eliminate_common_subexpressions()
+{
+	// the condition and the increment are evaluated between runs of the
+	// body, so only the body is a block of its own
+	_pBody->eliminate_common_subexpressions();
+}
+
+void for_statement::write(Snapshot_writer& out) const
+{
+	// the loop is analyzed and its invariants hoisted again when it is read
+	out.write_int(Program_cache::FOR_STATEMENT);
+	out.write_int(get_line());
+	_pInit->write(out);
+	_pCondition->write(out);
+	_pIncrement->write(out);
+	_pBody->write(out);
+}
+
+//===================================================================
+
+Loop_invariants::Loop_invariants(const VariableSet& modified, const unsigned* pLoopRun)
+	: _modified(modified)
+{
+	_pLoopRun = pLoopRun;
+	_count = 0;
+}
+
+bool Loop_invariants::is_invariant(const std::shared_ptr<IExpression>& pExpr) const
+{
+	if(!pExpr->is_pure()) return false;
+
+	VariableSet vars;
+	pExpr->get_variables(vars);
+	for(VariableSet::const_iterator it = vars.begin(); it != vars.end(); it++)
+	{
+		if(_modified.count(*it)) return false;
+	}
+	return true;
+}
+
+void Loop_invariants::hoist(std::shared_ptr<IExpression>& pExpr)
+{
+	if(!pExpr) return;
+
+	// Only operators are worth caching. Variables and constants are
+	// already cheap to evaluate.
+	if(std::dynamic_pointer_cast<IOperationalExpression>(pExpr) && is_invariant(pExpr))
+	{
+		pExpr.reset(new LoopInvariantExpression(pExpr, _pLoopRun));
+		_count++;
+		return;
+	}
+
+	hoist_children(pExpr);
+}
+
+void Loop_invariants::hoist_children(const std::shared_ptr<IExpression>& pExpr)
+{
+	for(int i = 0; i < pExpr->get_child_count(); i++)
+	{
+		std::shared_ptr<IExpression> pChild = pExpr->get_child(i);
+		hoist(pChild);
+		if(pChild != pExpr->get_child(i)) pExpr->replace_child(i, pChild);
+	}
+}
+
+//===================================================================
+
+Common_subexpressions::Common_subexpressions(const unsigned* pBlockRun)
+{
+	_pBlockRun = pBlockRun;
+	_count = 0;
+}
+
+bool Common_subexpressions::is_shareable(const std::shared_ptr<IExpression>& pExpr)
+{
+	if(!pExpr->is_repeatable()) return false;
+
+	return std::dynamic_pointer_cast<IOperationalExpression>(pExpr)
+		|| std::dynamic_pointer_cast<ArrayReferenceExpression>(pExpr)
+		|| std::dynamic_pointer_cast<ArrayMemberReferenceExpression>(pExpr)
+		|| std::dynamic_pointer_cast<IndexedMemberReferenceExpression>(pExpr);
+}
+
+// Two expressions are the same if they are written to the program cache the
+// same way. Returns "" for one that cannot be written.
+std::string Common_subexpressions::get_key(const std::shared_ptr<IExpression>& pExpr)
+{
+	std::ostringstream os;
+	Snapshot_writer out(os);
+	try
+	{
+		pExpr->write(out);
+	}
+	catch(const std::exception&)
+	{
+		return "";
+	}
+	return os.str();
+}
+
+void Common_subexpressions::share(std::shared_ptr<IExpression>& pExpr)
+{
+	if(!pExpr) return;
+
+	// a spawn() may change what the other sub-expressions read
+	VariableSet effects;
+	pExpr->get_side_effects(effects);
+	if(!effects.empty())
+	{
+		invalidate(effects);
+		return;
+	}
+
+	share(pExpr, &pExpr, nullptr, 0);
+}
+
+void Common_subexpressions::share_children(const std::shared_ptr<IExpression>& pExpr)
+{
+	VariableSet effects;
+	pExpr->get_side_effects(effects);
+	if(!effects.empty())
+	{
+		invalidate(effects);
+		return;
+	}
+
+	for(int i = 0; i < pExpr->get_child_count(); i++)
+	{
+		share(pExpr->get_child(i), nullptr, pExpr, i);
+	}
+}
+
+void Common_subexpressions::share(const std::shared_ptr<IExpression>& pExpr,
+	std::shared_ptr<IExpression>* pField,
+	const std::shared_ptr<IExpression>& pParent, int child)
+{
+	// already cached by a loop, or shared
+	if(std::dynamic_pointer_cast<LoopInvariantExpression>(pExpr)
+		|| std::dynamic_pointer_cast<CommonExpression>(pExpr)) return;
+
+	if(is_shareable(pExpr))
+	{
+		std::string key = get_key(pExpr);
+		if(!key.empty())
+		{
+			Occurrence occurrence;
+			occurrence.pField = pField;
+			occurrence.pParent = pParent;
+			occurrence.child = child;
+			occurrence.pExpr = pExpr;
+
+			OccurrenceMap::iterator it = _seen.find(key);
+			if(it != _seen.end())
+			{
+				Occurrence& first = it->second;
+				if(!first.pValue)
+				{
+					first.pValue.reset(new Common_value());
+					first.pValue->run = *_pBlockRun - 1;
+					replace(first);
+				}
+				occurrence.pValue = first.pValue;
+				replace(occurrence);
+				return;
+			}
+
+			pExpr->get_variables(occurrence.vars);
+			_seen[key] = occurrence;
+		}
+	}
+
+	// copy the child, replace() may change pExpr's children under it
+	for(int i = 0; i < pExpr->get_child_count(); i++)
+	{
+		std::shared_ptr<IExpression> pChild = pExpr->get_child(i);
+		share(pChild, nullptr, pExpr, i);
+	}
+}
+
+void Common_subexpressions::replace(const Occurrence& occurrence)
+{
+	std::shared_ptr<IExpression> pCommon(new CommonExpression(occurrence.pExpr,
+		occurrence.pValue, _pBlockRun));
+
+	if(occurrence.pField) *occurrence.pField = pCommon;
+	else occurrence.pParent->replace_child(occurrence.child, pCommon);
+	_count++;
+}
+
+void Common_subexpressions::invalidate(const VariableSet& modified)
+{
+	OccurrenceMap::iterator it = _seen.begin();
+	while(it != _seen.end())
+	{
+		const VariableSet& vars = it->second.vars;
+		bool bModified = false;
+		for(VariableSet::const_iterator var = vars.begin(); var != vars.end(); var++)
+		{
+			if(modified.count(*var))
+			{
+				bModified = true;
+				break;
+			}
+		}
+
+		if(bModified) _seen.erase(it++);
+		else it++;
+	}
+}
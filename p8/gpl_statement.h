@@ -2,9 +2,17 @@
 #define GPL_STATEMENT_H
 
 #include <vector>
+#include <map>
+#include <string>
 #include "gpl_type.h"
 #include "value.h"
 #include "expression.h"
+#include "jit.h"
+
+class Symbol;
+class Snapshot_writer;
+class Loop_invariants;
+class Common_subexpressions;
 
 class gpl_statement
 {
@@ -12,6 +20,24 @@ public:
 	virtual ~gpl_statement() {};
 	virtual void execute() = 0;
 	virtual const int& get_line() const;
+
+	// Adds the storage names (see VariableSet) of every variable this
+	// statement may assign when executed
+	virtual void get_modified_variables(VariableSet& vars) const {};
+
+	// Replaces the loop invariant sub-expressions of this statement with
+	// cached ones. Called by for_statement on the statements of its body
+	virtual void hoist_invariants(Loop_invariants& loop) {};
+
+	// Offers the expressions this statement evaluates, before it modifies
+	// anything, to the block it is in (see Common_subexpressions)
+	virtual void share_subexpressions(Common_subexpressions& common) {};
+
+	// Shares the common sub-expressions of every block in this statement
+	virtual void eliminate_common_subexpressions() {};
+
+	// Writes the statement to the program cache (see program_cache.h)
+	virtual void write(Snapshot_writer& out) const = 0;
 	
 protected:
 	gpl_statement(int line_no);
@@ -27,15 +53,37 @@ public:
 	virtual ~statement_block() {};
 	virtual void execute();
 
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void eliminate_common_subexpressions();
+	virtual void write(Snapshot_writer& out) const;
+
 	int get_count() const;
 	const std::shared_ptr<gpl_statement>& get_statement(int i) const;
 	int insert_statement(const std::shared_ptr<gpl_statement>& statement);
 
+	// number of sub-expression occurrences that share a value
+	int get_shared_count() const { return _shared_count; };
+
 protected:
 	typedef std::vector<std::shared_ptr<gpl_statement>> StatementList;
+
+	// invalidates the values shared by the previous run. see CommonExpression
+	void begin_run() { _run++; };
+
+	// Runs the block natively once it is hot (see jit.h). Returns false if
+	// it has to be interpreted
+	bool run_native(bool bCountStatements);
 	
 private:
 	StatementList _list;
+	unsigned _run;
+	int _shared_count;
+
+	unsigned _executions;
+	Jit::Function _pNative;
+
+	friend class Jit_compiler;
 };
 
 class if_statement : public gpl_statement
@@ -47,7 +95,13 @@ public:
 
 	virtual ~if_statement() {};
 	virtual void execute();	
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void share_subexpressions(Common_subexpressions& common);
+	virtual void eliminate_common_subexpressions();
+	virtual void write(Snapshot_writer& out) const;
 
+	const std::shared_ptr<IExpression>& get_condition() const { return _pCondition; };
 	const std::shared_ptr<gpl_statement>& get_then() const;
 	const std::shared_ptr<gpl_statement>& get_else() const;
 
@@ -62,6 +116,10 @@ public:
 	print_statement(int line, std::shared_ptr<IExpression> prnt_expr);
 	virtual ~print_statement(){};
 	virtual void execute();
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void share_subexpressions(Common_subexpressions& common);
+	virtual void write(Snapshot_writer& out) const;
 private:
 	std::shared_ptr<IExpression> _prnt_expr;
 };
@@ -72,10 +130,31 @@ public:
 	exit_statement(int line, std::shared_ptr<IExpression> exit_expr);
 	virtual ~exit_statement() {};
 	virtual void execute();
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void share_subexpressions(Common_subexpressions& common);
+	virtual void write(Snapshot_writer& out) const;
 private:
 	std::shared_ptr<IExpression> _exit_expr;
 };
 
+// spawn(obj) and despawn(obj): moves a game object between the active
+// and inactive lists (see Game_object::spawn)
+class spawn_statement : public gpl_statement
+{
+public:
+	spawn_statement(int line, std::shared_ptr<IExpression> obj_expr, bool bSpawn);
+	virtual ~spawn_statement() {};
+	virtual void execute();
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void share_subexpressions(Common_subexpressions& common);
+	virtual void write(Snapshot_writer& out) const;
+private:
+	std::shared_ptr<IExpression> _obj_expr;
+	bool _bSpawn;
+};
+
 
 class assign_statement : public gpl_statement
 {
@@ -86,6 +165,14 @@ public:
 
 	virtual ~assign_statement() {};
 	virtual void execute();
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void share_subexpressions(Common_subexpressions& common);
+	virtual void write(Snapshot_writer& out) const;
+
+	const std::shared_ptr<IVariableExpression>& get_lhs() const { return _pLHS; };
+	const std::shared_ptr<IExpression>& get_rhs() const { return _pRHS; };
+	Assignment_type get_operator() const { return _operator; };
 private:
 	std::shared_ptr<IVariableExpression> _pLHS;
 	std::shared_ptr<IExpression> _pRHS;
@@ -102,10 +189,106 @@ public:
 		const std::shared_ptr<statement_block>& pBody);
 	virtual ~for_statement() {};
 	virtual void execute();
+	virtual void get_modified_variables(VariableSet& vars) const;
+	virtual void hoist_invariants(Loop_invariants& loop);
+	virtual void eliminate_common_subexpressions();
+	virtual void write(Snapshot_writer& out) const;
+
+	// true if the loop was recognized as "for(i = a; i < b; i += c)"
+	bool is_counted() const { return _bCounted; };
+
+	// number of sub-expressions hoisted out of the loop body
+	int get_hoisted_count() const { return _hoisted_count; };
+
 private:
+	bool analyze_counted_loop(const VariableSet& modified);
+	void execute_counted();
+
 	std::shared_ptr<IExpression> _pCondition;
-	std::shared_ptr<gpl_statement> _pInit, _pIncrement;
+	std::shared_ptr<assign_statement> _pInit, _pIncrement;
 	std::shared_ptr<statement_block>  _pBody;
+
+	// Counted loops keep the induction variable in a native int and only
+	// write it back to its Symbol. The bound and step are evaluated once.
+	bool _bCounted;
+	std::shared_ptr<Symbol> _pIndex;
+	std::shared_ptr<IExpression> _pBound, _pStep;
+	Operator_type _compare;
+	bool _bDecrement;
+
+	// incremented at the start of every run. see LoopInvariantExpression
+	unsigned _run;
+	int _hoisted_count;
+
+	friend class Jit_compiler;
+};
+
+// Finds the sub-expressions of a loop that cannot change while it runs and
+// wraps them in a LoopInvariantExpression tied to the loop's run counter.
+// An expression is invariant if it is pure and reads none of the variables
+// the loop modifies.
+class Loop_invariants
+{
+public:
+	Loop_invariants(const VariableSet& modified, const unsigned* pLoopRun);
+
+	// may replace pExpr with a LoopInvariantExpression
+	void hoist(std::shared_ptr<IExpression>& pExpr);
+	void hoist_children(const std::shared_ptr<IExpression>& pExpr);
+
+	bool is_invariant(const std::shared_ptr<IExpression>& pExpr) const;
+	int get_hoisted_count() const { return _count; };
+
+private:
+	const VariableSet& _modified;
+	const unsigned* _pLoopRun;
+	int _count;
+};
+
+// Finds the sub-expressions that the statements of a block evaluate more than
+// once with none of the variables they read modified in between, e.g.
+//	a[i].x and a[i].x + a[i].w	in	x = a[i].x; r = a[i].x + a[i].w;
+// and wraps every occurrence in a CommonExpression, so the block evaluates
+// each one once per run. The statements are offered in order, each followed
+// by invalidate() with the variables it modifies. Only repeatable operators
+// and array references are shared; variables and constants are cheap.
+class Common_subexpressions
+{
+public:
+	Common_subexpressions(const unsigned* pBlockRun);
+
+	// may replace pExpr (or its sub-expressions) with a CommonExpression
+	void share(std::shared_ptr<IExpression>& pExpr);
+	void share_children(const std::shared_ptr<IExpression>& pExpr);
+
+	// forgets the expressions that read one of the variables
+	void invalidate(const VariableSet& modified);
+
+	int get_shared_count() const { return _count; };
+
+private:
+	// where an expression was seen: a statement's field or a child
+	struct Occurrence
+	{
+		std::shared_ptr<IExpression>* pField;
+		std::shared_ptr<IExpression> pParent;
+		int child;
+		std::shared_ptr<IExpression> pExpr;
+		VariableSet vars;
+		std::shared_ptr<Common_value> pValue;
+	};
+	typedef std::map<std::string, Occurrence> OccurrenceMap;
+
+	void share(const std::shared_ptr<IExpression>& pExpr,
+		std::shared_ptr<IExpression>* pField,
+		const std::shared_ptr<IExpression>& pParent, int child);
+	void replace(const Occurrence& occurrence);
+	static bool is_shareable(const std::shared_ptr<IExpression>& pExpr);
+	static std::string get_key(const std::shared_ptr<IExpression>& pExpr);
+
+	const unsigned* _pBlockRun;
+	OccurrenceMap _seen;
+	int _count;
 };
 
 
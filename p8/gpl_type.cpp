@@ -93,6 +93,7 @@ std::string game_object_type_to_string(Game_object_type type)
 		case CIRCLE: return "Circle";
 		case PIXMAP: return "Pixmap";
 		case TEXTBOX: return "Textbox";
+		case TILEMAP: return "Tilemap";
 		default: break;
 	}
 	assert(false);
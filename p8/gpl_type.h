@@ -29,7 +29,8 @@ enum Game_object_type {	TRIANGLE = 1,
 			RECTANGLE = 2,
 			CIRCLE = 4,			
 			PIXMAP = 8,
-			TEXTBOX = 16
+			TEXTBOX = 16,
+			TILEMAP = 32
 		};
 
 std::string game_object_type_to_string(Game_object_type type);
@@ -9,6 +9,7 @@ std::shared_ptr<Game_object> create_game_object(Game_object_type type)
 		case CIRCLE: return Circle::Create();
 		case PIXMAP: return Pixmap::Create();
 		case TEXTBOX: return Textbox::Create(); 
+		case TILEMAP: return Tilemap::Create();
 		default: 
 			TRACE_ERROR("create_game_object - Unrecognized Type"); 
 			assert(false);
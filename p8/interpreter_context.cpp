@@ -0,0 +1,122 @@
+#include "interpreter_context.h"
+#include "symbol_table.h"
+#include "event_manager.h"
+#include "frame_scheduler.h"
+#include "software_renderer.h"
+#include "batch_renderer.h"
+#include "runtime_metrics.h"
+#include "window.h"
+#include "parser.h"
+
+#include <cstdlib>
+
+// the re-entrant scanner (gpl.l)
+extern int yylex_init_extra(Parse_state* pState, yyscan_t* pScanner);
+extern void yyset_in(FILE* file, yyscan_t scanner);
+extern int yylex_destroy(yyscan_t scanner);
+
+thread_local Interpreter_context* Interpreter_context::_pCurrent = nullptr;
+
+//==============================================================================
+
+Interpreter_context::Scope::Scope(Interpreter_context& context)
+{
+	_pPrevious = _pCurrent;
+	set_current(&context);
+}
+
+Interpreter_context::Scope::~Scope()
+{
+	set_current(_pPrevious);
+}
+
+void Interpreter_context::set_current(Interpreter_context* pContext)
+{
+	_pCurrent = pContext;
+	Runtime_metrics* pMetrics = pContext? pContext->_pRuntime_metrics.get() : nullptr;
+	Runtime_metrics::_pCounters = pMetrics? &pMetrics->_counters : nullptr;
+}
+
+//==============================================================================
+
+Interpreter_context::Interpreter_context()
+{
+	_bEndsProcess = true;
+	_quit_handler = nullptr;
+	_pOut = &std::cout;
+	_pErr = &std::cerr;
+	_pIn = &std::cin;
+
+	_pError_state.reset(new Error::State());
+	_pRandom_state.reset(new Random_stream::State());
+	_pRuntime_metrics.reset(new Runtime_metrics());
+	_pSoftware_renderer.reset(new Software_renderer());
+	_pBatch_renderer.reset(new Batch_renderer());
+	_pFrame_scheduler.reset(new Frame_scheduler());
+	_pPixmap_cache.reset(new Pixmap::Cache());
+	_pWorld.reset(new Game_object::World());
+	_pSymbol_table.reset(new Symbol_table());
+	_pEvent_manager.reset(new Event_manager());
+}
+
+Interpreter_context::~Interpreter_context()
+{
+	// the destructors of the program's objects may look for the context
+	Scope scope(*this);
+
+	_pWindow.reset();
+	_parse_state.animations.clear();
+	_pEvent_manager.reset();
+	_pSymbol_table.reset();
+	_pWorld.reset();
+	_pPixmap_cache.reset();
+	_pFrame_scheduler.reset();
+	_pBatch_renderer.reset();
+	_pSoftware_renderer.reset();
+	_pRuntime_metrics.reset();
+}
+
+int Interpreter_context::parse(FILE* file)
+{
+	yyscan_t scanner;
+	if(yylex_init_extra(&_parse_state, &scanner)) return -1;
+	yyset_in(file, scanner);
+
+	int result;
+	try
+	{
+		result = yyparse(scanner, _parse_state);
+	}
+	catch(...)
+	{
+		yylex_destroy(scanner);
+		throw;
+	}
+
+	yylex_destroy(scanner);
+	return result;
+}
+
+void Interpreter_context::end(int status)
+{
+	if(_bEndsProcess) std::exit(status);
+	throw Exit(status);
+}
+
+void Interpreter_context::quit()
+{
+	if(_quit_handler) _quit_handler();
+	end(0);
+}
+
+void Interpreter_context::set_streams(std::ostream& out, std::ostream& err, std::istream& in)
+{
+	_pOut = &out;
+	_pErr = &err;
+	_pIn = &in;
+}
+
+void Interpreter_context::set_window(Window* pWindow)
+{
+	_pWindow.reset(pWindow);
+}
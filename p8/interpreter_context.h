@@ -0,0 +1,175 @@
+#ifndef INTERPRETER_CONTEXT_H
+#define INTERPRETER_CONTEXT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "error.h"
+#include "game_object.h"
+#include "jit.h"
+#include "pixmap.h"
+#include "random_stream.h"
+
+class Animation_block;
+class Batch_renderer;
+class Event_manager;
+class Frame_scheduler;
+class Runtime_metrics;
+class Software_renderer;
+class Symbol_table;
+class Window;
+
+// What the parser keeps while it reads a program: the line the scanner
+// is on and the animation blocks declared with forward, which must all
+// get a body before the end of the program
+struct Parse_state
+{
+	typedef std::map<std::string, std::shared_ptr<Animation_block>> AnimationMap;
+
+	Parse_state() : line_count(1), animation_start_line(0) {};
+
+	int line_count;
+	int animation_start_line;
+	AnimationMap animations;
+};
+
+/***
+ An Interpreter_context is one gpl program: everything that was global
+ to the interpreter belongs to a context.
+
+	the symbol table and the event handlers
+	the game objects (their lists and scene arrays, see game_object.h)
+	and the pixmaps read so far
+	the parser's state (the scanner and the parser are re-entrant)
+	the window, the frame scheduler, the software renderer and the
+	runtime metrics
+	the errors, the random streams and the state of the jit
+	where the program prints (out(), err()) and reads its keypresses
+	from (in())
+
+ The interpreter works on the current context of the thread it runs on,
+ which a Scope sets; the old singletons (Symbol_table::instance(),
+ Event_manager::instance(), ...) return the ones of the current context.
+ Independent programs can run at the same time on threads of their own,
+ each with a context current:
+
+	Interpreter_context context;
+	Interpreter_context::Scope scope(context);
+	context.set_ends_process(false);
+	if(context.parse(file) == 0) ... run it ...
+
+ A program ends through end(): the exit statement, the q key and a
+ fatal runtime error. The context main() runs gpl in ends the process,
+ as gpl always did; any other one throws Exit, which unwinds to the
+ code that runs the program. The settings of the command line (-jit,
+ -math, -backend, -error_reports, -fatal_errors) are still shared by
+ the whole process, and so is OpenGL: only one context can use the
+ GLUT backend.
+***/
+class Interpreter_context
+{
+public:
+	// what end() throws unless the context ends the process
+	struct Exit
+	{
+		Exit(int status) : status(status) {};
+		int status;
+	};
+
+	Interpreter_context();
+	virtual ~Interpreter_context();
+
+	// the context of the calling thread, null if no Scope set one
+	static Interpreter_context* current() { return _pCurrent; };
+
+	// Makes a context current for the thread in the enclosing scope
+	class Scope
+	{
+	public:
+		Scope(Interpreter_context& context);
+		~Scope();
+
+	private:
+		Interpreter_context* _pPrevious;
+	};
+
+	// Parses the program in file into this context, which must be
+	// current. Returns the result of yyparse() (0 if it succeeded)
+	int parse(FILE* file);
+
+	// Ends the program with status: ends the process (the default) or
+	// throws Exit
+	void end(int status);
+	void set_ends_process(bool bEndsProcess) { _bEndsProcess = bEndsProcess; };
+	bool ends_process() const { return _bEndsProcess; };
+
+	// called by the q key before the program ends (gpl.cpp dumps the
+	// pixels and saves the snapshot there)
+	void set_quit_handler(void (*handler)()) { _quit_handler = handler; };
+	void quit();
+
+	std::ostream& out() { return *_pOut; };
+	std::ostream& err() { return *_pErr; };
+	std::istream& in() { return *_pIn; };
+	void set_streams(std::ostream& out, std::ostream& err, std::istream& in);
+
+	Symbol_table& get_symbol_table() { return *_pSymbol_table; };
+	Event_manager& get_event_manager() { return *_pEvent_manager; };
+	Game_object::World& get_world() { return *_pWorld; };
+	Pixmap::Cache& get_pixmap_cache() { return *_pPixmap_cache; };
+	Parse_state& get_parse_state() { return _parse_state; };
+
+	// null until the program creates it (gpl.cpp::main())
+	Window* get_window() { return _pWindow.get(); };
+	void set_window(Window* pWindow);
+
+	Frame_scheduler& get_frame_scheduler() { return *_pFrame_scheduler; };
+	Software_renderer& get_software_renderer() { return *_pSoftware_renderer; };
+	Batch_renderer& get_batch_renderer() { return *_pBatch_renderer; };
+	Runtime_metrics& get_runtime_metrics() { return *_pRuntime_metrics; };
+
+	Error::State& get_error_state() { return *_pError_state; };
+	Random_stream::State& get_random_state() { return *_pRandom_state; };
+	Jit::State& get_jit_state() { return _jit_state; };
+
+private:
+	// sets the current context, and the counters of its Runtime_metrics
+	// (the interpreter counts through a pointer of their own)
+	static void set_current(Interpreter_context* pContext);
+
+	static thread_local Interpreter_context* _pCurrent;
+
+	bool _bEndsProcess;
+	void (*_quit_handler)();
+
+	std::ostream* _pOut;
+	std::ostream* _pErr;
+	std::istream* _pIn;
+
+	// in the order they can be created; the destructor takes them
+	// down the other way around (the game objects leave the world's
+	// lists as the symbol table lets go of them)
+	std::unique_ptr<Error::State> _pError_state;
+	std::unique_ptr<Random_stream::State> _pRandom_state;
+	Jit::State _jit_state;
+	std::unique_ptr<Runtime_metrics> _pRuntime_metrics;
+	std::unique_ptr<Software_renderer> _pSoftware_renderer;
+	std::unique_ptr<Batch_renderer> _pBatch_renderer;
+	std::unique_ptr<Frame_scheduler> _pFrame_scheduler;
+	std::unique_ptr<Pixmap::Cache> _pPixmap_cache;
+	std::unique_ptr<Game_object::World> _pWorld;
+	std::unique_ptr<Symbol_table> _pSymbol_table;
+	std::unique_ptr<Event_manager> _pEvent_manager;
+	Parse_state _parse_state;
+	std::unique_ptr<Window> _pWindow;
+
+	// disable default copy constructor and default assignment
+	Interpreter_context(const Interpreter_context&);
+	const Interpreter_context& operator=(const Interpreter_context&);
+};
+
+#endif
@@ -0,0 +1,1162 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "jit.h"
+#include "error.h"
+#include "gpl_statement.h"
+#include "gpl_math.h"
+#include "symbol.h"
+#include "runtime_metrics.h"
+#include "interpreter_context.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+Jit::Mode Jit::_mode = Jit::OFF;
+
+// -jit verify prints this many mismatches, and only counts the others
+static const unsigned long MAX_MISMATCH_REPORTS = 10;
+
+bool Jit::string_to_mode(const std::string& name, Mode& mode)
+{
+	if(name == "on") mode = ON;
+	else if(name == "off") mode = OFF;
+	else if(name == "verify") mode = VERIFY;
+	else return false;
+	return true;
+}
+
+Jit::State& Jit::state()
+{
+	return Interpreter_context::current()->get_jit_state();
+}
+
+void Jit::rethrow()
+{
+	State& s = state();
+	std::exception_ptr pException = s.pException;
+	s.pException = nullptr;
+	s.bAbort = false;
+	std::rethrow_exception(pException);
+}
+
+void Jit::report(std::ostream& os)
+{
+	if(_mode != VERIFY) return;
+
+	const State& s = state();
+	os << "jit: " << s.compiled << " blocks compiled, " << s.checked
+		<< " expressions verified, " << s.mismatched << " mismatched" << std::endl;
+}
+
+//==============================================================================
+
+#if defined(__x86_64__)
+
+/***
+ Jit_compiler writes the code of one block to a buffer, and copies it to
+ executable pages once it is complete.
+
+ An int value is computed in eax, a double one in xmm0; the right operand
+ of a binary operator goes to ecx or xmm1. No value is kept in a register
+ while a sub-expression is computed: the left operand is pushed, so a
+ call back into the interpreter only has to preserve the stack. _depth
+ counts the bytes pushed below rbp, so the stack can be aligned to 16
+ bytes at every call. The calls that may throw are followed by a check
+ of the State's bAbort, which leaves through the epilogue (mov rsp, rbp);
+ the epilogue returns bAbort.
+***/
+class Jit_compiler
+{
+public:
+	Jit_compiler(bool bCountStatements);
+	Jit::Function compile(statement_block& block);
+
+private:
+	enum Register { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7 };
+
+	// the condition codes of jcc and setcc
+	enum Condition
+	{
+		CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+		CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+	};
+
+	// statements
+	void compile_block(statement_block& block, bool bCountStatements);
+	void compile_statement(const std::shared_ptr<gpl_statement>& pStatement);
+	void compile_if(const if_statement& statement);
+	bool compile_assign(const assign_statement& statement);
+	void compile_for(for_statement& statement);
+	void compile_counted_for(for_statement& statement);
+
+	// expressions. compile_root() adds the evals of the native nodes to
+	// Runtime_metrics, and checks the value with -jit verify
+	void compile_root(const std::shared_ptr<IExpression>& pExpr, Gpl_type type, int extra_evals = 0);
+	bool compile_expression(const std::shared_ptr<IExpression>& pExpr, Gpl_type type);
+	bool compile_leaf(const std::shared_ptr<IExpression>& pExpr, Gpl_type type);
+	bool is_native(const std::shared_ptr<IExpression>& pExpr) const;
+	void compile_native(const std::shared_ptr<IExpression>& pExpr);
+	void compile_operator(const IOperationalExpression& expr);
+	void compile_operands(const IExpression& expr, Gpl_type type);
+	void compile_compare(Operator_type oper, Gpl_type type);
+	void compile_divide(Gpl_type type, bool bMod);
+	void compile_truth(const std::shared_ptr<IExpression>& pExpr);
+
+	// instructions
+	void emit(std::initializer_list<unsigned char> bytes);
+	void emit32(int32_t value);
+	void load_address(Register reg, const void* pAddress);
+	void load_int(Register reg, int value);
+	void load_double(Register reg, double value);
+	void load_symbol(Register reg, const Symbol* pSymbol, Gpl_type type);
+	void set_line(int line);
+	void increment(const unsigned* pCounter);
+	void increment(const unsigned long* pCounter);
+	void push(Gpl_type type);
+	void pop_operands(Gpl_type type);
+	int push_slot();
+	void slot_op(unsigned char opcode, int slot);
+	void call(const void* pFunction, bool bCheck);
+
+	template<typename F>
+	void call(F* pFunction, bool bCheck)
+		{ call(reinterpret_cast<const void*>(pFunction), bCheck); }
+
+	int new_label();
+	void bind(int label);
+	void jump(int label);
+	void jump_if(Condition cc, int label);
+
+	// the calls back into the interpreter
+	static void hold();
+	static int eval_int(const IExpression* pExpr);
+	static double eval_double(const IExpression* pExpr);
+	static void execute(gpl_statement* pStatement);
+	static int get_int(const IValue* pValue);
+	static double get_double(const IValue* pValue);
+	static void assign_int(IValue* pValue, int oper, int value);
+	static void assign_double(IValue* pValue, int oper, double value);
+	static void divide_by_zero();
+	static void mod_by_zero();
+	static int floor_int(double value);
+	static int verify_int(const IExpression* pExpr, int value);
+	static double verify_double(const IExpression* pExpr, double value);
+	static void mismatch(const std::string& native, const std::string& interpreted);
+
+	struct Fixup
+	{
+		int at;
+		int label;
+	};
+
+	std::vector<unsigned char> _code;
+	std::vector<int> _labels;
+	std::vector<Fixup> _fixups;
+	int _exit;
+	int _depth;
+	int _evals;
+	bool _bCountStatements;
+
+	// the State of the program the block belongs to
+	Jit::State& _state;
+};
+
+Jit_compiler::Jit_compiler(bool bCountStatements) : _state(Jit::state())
+{
+	_bCountStatements = bCountStatements;
+	_depth = 0;
+	_evals = 0;
+	_exit = new_label();
+}
+
+Jit::Function Jit_compiler::compile(statement_block& block)
+{
+	emit({0x55, 0x48, 0x89, 0xE5});			// push rbp; mov rbp, rsp
+	compile_block(block, _bCountStatements);
+	bind(_exit);
+	load_address(RCX, &_state.bAbort);
+	emit({0x0F, 0xB6, 0x01});				// movzx eax, byte [rcx]
+	emit({0x48, 0x89, 0xEC, 0x5D, 0xC3});		// mov rsp, rbp; pop rbp; ret
+
+	for(unsigned i = 0; i < _fixups.size(); i++)
+	{
+		int32_t rel = _labels[_fixups[i].label] - (_fixups[i].at + 4);
+		memcpy(&_code[_fixups[i].at], &rel, 4);
+	}
+
+	long page = sysconf(_SC_PAGESIZE);
+	size_t size = (_code.size() + page - 1) / page * page;
+	void* pCode = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(pCode == MAP_FAILED) return nullptr;
+
+	memcpy(pCode, _code.data(), _code.size());
+	if(mprotect(pCode, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(pCode, size);
+		return nullptr;
+	}
+	return reinterpret_cast<Jit::Function>(pCode);
+}
+
+//==============================================================================
+//	S T A T E M E N T S
+//==============================================================================
+
+// what statement_block::execute() does (Animation_block::execute() does not
+// count the statements)
+void Jit_compiler::compile_block(statement_block& block, bool bCountStatements)
+{
+	increment(&block._run);
+	for(int i = 0; i < block.get_count(); i++)
+	{
+		const std::shared_ptr<gpl_statement>& pStatement = block.get_statement(i);
+		if(bCountStatements) increment(&Runtime_metrics::counters().statements);
+		set_line(pStatement->get_line());
+		compile_statement(pStatement);
+	}
+}
+
+void Jit_compiler::compile_statement(const std::shared_ptr<gpl_statement>& pStatement)
+{
+	gpl_statement* p = pStatement.get();
+
+	if(statement_block* pBlock = dynamic_cast<statement_block*>(p))
+	{
+		compile_block(*pBlock, true);
+		return;
+	}
+	if(if_statement* pIf = dynamic_cast<if_statement*>(p))
+	{
+		compile_if(*pIf);
+		return;
+	}
+	if(for_statement* pFor = dynamic_cast<for_statement*>(p))
+	{
+		compile_for(*pFor);
+		return;
+	}
+
+	assign_statement* pAssign = dynamic_cast<assign_statement*>(p);
+	if(pAssign && compile_assign(*pAssign)) return;
+
+	// print, exit, spawn, and assignments to strings and arrays
+	load_address(RDI, p);
+	call(&Jit_compiler::execute, true);
+}
+
+void Jit_compiler::compile_if(const if_statement& statement)
+{
+	int other = new_label();
+
+	compile_root(statement.get_condition(), INT);
+	emit({0x85, 0xC0});					// test eax, eax
+	jump_if(CC_E, other);
+	compile_statement(statement.get_then());
+
+	if(statement.get_else())
+	{
+		int end = new_label();
+		jump(end);
+		bind(other);
+		compile_statement(statement.get_else());
+		bind(end);
+	}
+	else bind(other);
+}
+
+// Assignments of int and double variables and members. A variable is
+// stored directly, a member through MemberReference (see assign_int())
+bool Jit_compiler::compile_assign(const assign_statement& statement)
+{
+	const std::shared_ptr<IVariableExpression>& pLHS = statement.get_lhs();
+	Gpl_type type = pLHS->get_type();
+	ReferenceExpression* pRef = dynamic_cast<ReferenceExpression*>(pLHS.get());
+	if(!pRef || (type != INT && type != DOUBLE)) return false;
+
+	IVariable* pVariable = pRef->get_variable().get();
+	Symbol* pSymbol = dynamic_cast<Symbol*>(pVariable);
+	if(!pSymbol && !dynamic_cast<MemberReference*>(pVariable)) return false;
+
+	// the interpreter evaluates the variable too
+	compile_root(statement.get_rhs(), type, 1);
+	Assignment_type oper = statement.get_operator();
+
+	if(!pSymbol)
+	{
+		if(type == INT) emit({0x89, 0xC2});		// mov edx, eax
+		emit({0xBE}); emit32(oper);			// mov esi, oper
+		load_address(RDI, pVariable);
+		if(type == INT) call(&Jit_compiler::assign_int, true);
+		else call(&Jit_compiler::assign_double, true);
+		return true;
+	}
+
+	if(oper == ASSIGN)
+	{
+		load_address(RCX, pSymbol->get_address());
+		if(type == INT) emit({0x89, 0x01});		// mov [rcx], eax
+		else emit({0xF2, 0x0F, 0x11, 0x01});		// movsd [rcx], xmm0
+	}
+	else if(type == INT)
+	{
+		emit({0x89, 0xC1});				// mov ecx, eax
+		load_address(RAX, pSymbol->get_address());
+		if(oper == ADD_ASSIGN) emit({0x01, 0x08});	// add [rax], ecx
+		else emit({0x29, 0x08});			// sub [rax], ecx
+	}
+	else
+	{
+		emit({0x66, 0x0F, 0x28, 0xC8});			// movapd xmm1, xmm0
+		load_address(RAX, pSymbol->get_address());
+		emit({0xF2, 0x0F, 0x10, 0x00});			// movsd xmm0, [rax]
+		if(oper == ADD_ASSIGN) emit({0xF2, 0x0F, 0x58, 0xC1});	// addsd xmm0, xmm1
+		else emit({0xF2, 0x0F, 0x5C, 0xC1});		// subsd xmm0, xmm1
+		emit({0xF2, 0x0F, 0x11, 0x00});			// movsd [rax], xmm0
+	}
+	return true;
+}
+
+void Jit_compiler::compile_for(for_statement& statement)
+{
+	increment(&statement._run);
+	if(statement._bCounted)
+	{
+		compile_counted_for(statement);
+		return;
+	}
+
+	int loop = new_label();
+	int end = new_label();
+
+	compile_statement(statement._pInit);
+	bind(loop);
+	set_line(statement.get_line());
+	compile_root(statement._pCondition, INT);
+	emit({0x85, 0xC0});					// test eax, eax
+	jump_if(CC_E, end);
+	compile_block(*statement._pBody, true);
+	compile_statement(statement._pIncrement);
+	jump(loop);
+	bind(end);
+}
+
+// what for_statement::execute_counted() does, with the index, the bound
+// and the step kept in slots of the stack frame
+void Jit_compiler::compile_counted_for(for_statement& statement)
+{
+	int loop = new_label();
+	int end = new_label();
+
+	compile_statement(statement._pInit);
+
+	load_symbol(RAX, statement._pIndex.get(), INT);
+	int index = push_slot();
+	compile_root(statement._pBound, INT);
+	int bound = push_slot();
+	compile_root(statement._pStep, INT);
+	if(statement._bDecrement) emit({0xF7, 0xD8});	// neg eax
+	int step = push_slot();
+
+	Condition done;
+	switch(statement._compare)
+	{
+		case LESS_THAN: done = CC_GE; break;
+		case LESS_THAN_EQUAL: done = CC_G; break;
+		case GREATER_THAN: done = CC_LE; break;
+		default: done = CC_L; break;
+	}
+
+	bind(loop);
+	slot_op(0x8B, index);					// mov eax, index
+	slot_op(0x3B, bound);					// cmp eax, bound
+	jump_if(done, end);
+
+	compile_block(*statement._pBody, true);
+
+	// the body may read the index, so keep the Symbol up to date
+	slot_op(0x8B, index);					// mov eax, index
+	slot_op(0x03, step);					// add eax, step
+	slot_op(0x89, index);					// mov index, eax
+	load_address(RCX, statement._pIndex->get_address());
+	emit({0x89, 0x01});					// mov [rcx], eax
+	jump(loop);
+
+	bind(end);
+	emit({0x48, 0x83, 0xC4, 0x18});				// add rsp, 24
+	_depth -= 24;
+}
+
+//==============================================================================
+//	E X P R E S S I O N S
+//==============================================================================
+
+void Jit_compiler::compile_root(const std::shared_ptr<IExpression>& pExpr,
+	Gpl_type type, int extra_evals)
+{
+	_evals = extra_evals;
+	bool bNative = compile_expression(pExpr, type);
+
+	if(_evals)
+	{
+		load_address(RCX, &Runtime_metrics::counters().evals);
+		emit({0x48, 0x81, 0x01}); emit32(_evals);	// add qword [rcx], evals
+	}
+
+	if(Jit::_mode != Jit::VERIFY || !bNative || pExpr->is_constant()
+		|| !pExpr->is_pure())
+		return;
+
+	if(type == INT) emit({0x89, 0xC6});			// mov esi, eax
+	load_address(RDI, pExpr.get());
+	if(type == INT) call(&Jit_compiler::verify_int, true);
+	else call(&Jit_compiler::verify_double, true);
+}
+
+// Leaves the value of the expression in eax (INT) or xmm0 (DOUBLE).
+// Returns false if it is a call back into the interpreter
+bool Jit_compiler::compile_expression(const std::shared_ptr<IExpression>& pExpr, Gpl_type type)
+{
+	Gpl_type own = pExpr->get_type();
+	if(!is_native(pExpr) || (own == DOUBLE && type == INT))
+	{
+		// get_int() or get_double(), as the parent would ask for it
+		load_address(RDI, pExpr.get());
+		if(type == INT) call(&Jit_compiler::eval_int, true);
+		else call(&Jit_compiler::eval_double, true);
+		return false;
+	}
+
+	_evals++;
+	compile_native(pExpr);
+	if(own == INT && type == DOUBLE)
+		emit({0xF2, 0x0F, 0x2A, 0xC0});			// cvtsi2sd xmm0, eax
+	return true;
+}
+
+// Puts the value of a constant or a variable straight in ecx or xmm1.
+// Returns false if the expression is neither
+bool Jit_compiler::compile_leaf(const std::shared_ptr<IExpression>& pExpr, Gpl_type type)
+{
+	Gpl_type own = pExpr->get_type();
+	if(!is_native(pExpr) || (own == DOUBLE && type == INT)) return false;
+
+	if(dynamic_cast<const ValueExpression*>(pExpr.get()))
+	{
+		std::shared_ptr<IValue> pValue = pExpr->eval();
+		if(type == INT)
+		{
+			int value = 0;
+			pValue->get_int(value);
+			load_int(RCX, value);
+		}
+		else
+		{
+			double value = 0;
+			pValue->get_double(value);
+			load_double(RCX, value);
+		}
+		_evals++;
+		return true;
+	}
+
+	const ReferenceExpression* pRef = dynamic_cast<const ReferenceExpression*>(pExpr.get());
+	const Symbol* pSymbol = pRef? dynamic_cast<const Symbol*>(pRef->get_variable().get()) : nullptr;
+	if(!pSymbol) return false;
+
+	load_symbol(RCX, pSymbol, own);
+	if(own == INT && type == DOUBLE)
+		emit({0xF2, 0x0F, 0x2A, 0xC9});			// cvtsi2sd xmm1, ecx
+	_evals++;
+	return true;
+}
+
+bool Jit_compiler::is_native(const std::shared_ptr<IExpression>& pExpr) const
+{
+	Gpl_type type = pExpr->get_type();
+	if(type != INT && type != DOUBLE) return false;
+
+	if(dynamic_cast<const ValueExpression*>(pExpr.get()))
+		return pExpr->is_constant();
+
+	const ReferenceExpression* pRef = dynamic_cast<const ReferenceExpression*>(pExpr.get());
+	if(pRef)
+	{
+		const IVariable* pVariable = pRef->get_variable().get();
+		return dynamic_cast<const Symbol*>(pVariable)
+			|| dynamic_cast<const MemberReference*>(pVariable);
+	}
+
+	const IOperationalExpression* pOper =
+		dynamic_cast<const IOperationalExpression*>(pExpr.get());
+	if(!pOper) return false;
+
+	switch(pOper->get_operator())
+	{
+		case PLUS: case MINUS: case MULTIPLY: case DIVIDE: case MOD:
+		case SIN: case COS: case TAN: case ASIN: case ACOS: case ATAN:
+		case SQRT: case FLOOR: case ABS:
+			return true;
+
+		case EQUAL: case NOT_EQUAL: case LESS_THAN: case LESS_THAN_EQUAL:
+		case GREATER_THAN: case GREATER_THAN_EQUAL:
+		case AND: case OR: case NOT:
+			// strings are compared by the interpreter
+			for(int i = 0; i < pOper->get_child_count(); i++)
+			{
+				if(!(pOper->get_child(i)->get_type() & (INT | DOUBLE)))
+					return false;
+			}
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+void Jit_compiler::compile_native(const std::shared_ptr<IExpression>& pExpr)
+{
+	Gpl_type type = pExpr->get_type();
+
+	const IOperationalExpression* pOper =
+		dynamic_cast<const IOperationalExpression*>(pExpr.get());
+	if(pOper)
+	{
+		compile_operator(*pOper);
+		return;
+	}
+
+	const ReferenceExpression* pRef = dynamic_cast<const ReferenceExpression*>(pExpr.get());
+	if(!pRef)
+	{
+		// a constant
+		std::shared_ptr<IValue> pValue = pExpr->eval();
+		if(type == INT)
+		{
+			int value = 0;
+			pValue->get_int(value);
+			load_int(RAX, value);
+		}
+		else
+		{
+			double value = 0;
+			pValue->get_double(value);
+			load_double(RAX, value);
+		}
+		return;
+	}
+
+	const IVariable* pVariable = pRef->get_variable().get();
+	const Symbol* pSymbol = dynamic_cast<const Symbol*>(pVariable);
+	if(pSymbol)
+	{
+		load_symbol(RAX, pSymbol, type);
+		return;
+	}
+
+	load_address(RDI, pVariable);
+	if(type == INT) call(&Jit_compiler::get_int, true);
+	else call(&Jit_compiler::get_double, true);
+}
+
+void Jit_compiler::compile_operator(const IOperationalExpression& expr)
+{
+	Gpl_type type = expr.get_type();
+	Operator_type oper = expr.get_operator();
+
+	switch(oper)
+	{
+		case PLUS:
+			compile_operands(expr, type);
+			if(type == INT) emit({0x01, 0xC8});		// add eax, ecx
+			else emit({0xF2, 0x0F, 0x58, 0xC1});		// addsd xmm0, xmm1
+			break;
+
+		case MINUS:
+			compile_operands(expr, type);
+			if(type == INT) emit({0x29, 0xC8});		// sub eax, ecx
+			else emit({0xF2, 0x0F, 0x5C, 0xC1});		// subsd xmm0, xmm1
+			break;
+
+		case MULTIPLY:
+			compile_operands(expr, type);
+			if(type == INT) emit({0x0F, 0xAF, 0xC1});	// imul eax, ecx
+			else emit({0xF2, 0x0F, 0x59, 0xC1});		// mulsd xmm0, xmm1
+			break;
+
+		case DIVIDE:
+		case MOD:
+			compile_operands(expr, type);
+			compile_divide(type, oper == MOD);
+			break;
+
+		case EQUAL: case NOT_EQUAL: case LESS_THAN: case LESS_THAN_EQUAL:
+		case GREATER_THAN: case GREATER_THAN_EQUAL:
+		{
+			// the interpreter compares doubles, ints compare the same
+			Gpl_type operands = (expr.get_child(0)->get_type() == INT
+				&& expr.get_child(1)->get_type() == INT)? INT : DOUBLE;
+			compile_operands(expr, operands);
+			compile_compare(oper, operands);
+			break;
+		}
+
+		case AND:
+		case OR:
+			compile_truth(expr.get_child(0));
+			emit({0x50});					// push rax
+			_depth += 8;
+			compile_truth(expr.get_child(1));
+			emit({0x89, 0xC1, 0x58});			// mov ecx, eax; pop rax
+			_depth -= 8;
+			if(oper == AND) emit({0x21, 0xC8});		// and eax, ecx
+			else emit({0x09, 0xC8});			// or eax, ecx
+			break;
+
+		case NOT:
+			compile_truth(expr.get_child(0));
+			emit({0x83, 0xF0, 0x01});			// xor eax, 1
+			break;
+
+		case SIN: case COS: case TAN: case ASIN: case ACOS: case ATAN:
+		{
+			static double (* const functions[])(double) = {
+				&Gpl_math::sin_deg, &Gpl_math::cos_deg, &Gpl_math::tan_deg,
+				&Gpl_math::asin_deg, &Gpl_math::acos_deg, &Gpl_math::atan_deg };
+
+			compile_expression(expr.get_child(0), DOUBLE);
+			call(functions[oper - SIN], false);
+			break;
+		}
+
+		case SQRT:
+			compile_expression(expr.get_child(0), DOUBLE);
+			emit({0xF2, 0x0F, 0x51, 0xC0});			// sqrtsd xmm0, xmm0
+			break;
+
+		case FLOOR:
+			compile_expression(expr.get_child(0), DOUBLE);
+			call(&Jit_compiler::floor_int, false);
+			break;
+
+		case ABS:
+			compile_expression(expr.get_child(0), type);
+			if(type == INT)
+			{
+				emit({0x89, 0xC1});			// mov ecx, eax
+				emit({0xC1, 0xF9, 0x1F});		// sar ecx, 31
+				emit({0x31, 0xC8, 0x29, 0xC8});		// xor eax, ecx; sub eax, ecx
+			}
+			else
+			{
+				emit({0x48, 0xB8}); 			// mov rax, ~sign
+				emit32(-1); emit32(0x7FFFFFFF);
+				emit({0x66, 0x48, 0x0F, 0x6E, 0xC8});	// movq xmm1, rax
+				emit({0x66, 0x0F, 0x54, 0xC1});		// andpd xmm0, xmm1
+			}
+			break;
+
+		default:
+			throw std::logic_error("Jit_compiler::compile_operator - "
+				+ operator_to_string(oper));
+	}
+}
+
+// Leaves the left operand in eax or xmm0 and the right one in ecx or xmm1
+void Jit_compiler::compile_operands(const IExpression& expr, Gpl_type type)
+{
+	compile_expression(expr.get_child(0), type);
+	if(compile_leaf(expr.get_child(1), type)) return;
+
+	push(type);
+	compile_expression(expr.get_child(1), type);
+	pop_operands(type);
+}
+
+void Jit_compiler::compile_compare(Operator_type oper, Gpl_type type)
+{
+	if(type == INT)
+	{
+		Condition cc;
+		switch(oper)
+		{
+			case EQUAL: cc = CC_E; break;
+			case NOT_EQUAL: cc = CC_NE; break;
+			case LESS_THAN: cc = CC_L; break;
+			case LESS_THAN_EQUAL: cc = CC_LE; break;
+			case GREATER_THAN: cc = CC_G; break;
+			default: cc = CC_GE; break;
+		}
+		emit({0x39, 0xC8});					// cmp eax, ecx
+		emit({0x0F, (unsigned char) (0x90 + cc), 0xC0});	// setcc al
+	}
+	else
+	{
+		// a comparison with NaN is false, except !=
+		switch(oper)
+		{
+			case EQUAL:
+				emit({0x66, 0x0F, 0x2E, 0xC1});		// ucomisd xmm0, xmm1
+				emit({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1});	// sete al; setnp cl
+				emit({0x20, 0xC8});			// and al, cl
+				break;
+			case NOT_EQUAL:
+				emit({0x66, 0x0F, 0x2E, 0xC1});		// ucomisd xmm0, xmm1
+				emit({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1});	// setne al; setp cl
+				emit({0x08, 0xC8});			// or al, cl
+				break;
+			case LESS_THAN:
+				emit({0x66, 0x0F, 0x2E, 0xC8});		// ucomisd xmm1, xmm0
+				emit({0x0F, 0x97, 0xC0});		// seta al
+				break;
+			case LESS_THAN_EQUAL:
+				emit({0x66, 0x0F, 0x2E, 0xC8});		// ucomisd xmm1, xmm0
+				emit({0x0F, 0x93, 0xC0});		// setae al
+				break;
+			case GREATER_THAN:
+				emit({0x66, 0x0F, 0x2E, 0xC1});		// ucomisd xmm0, xmm1
+				emit({0x0F, 0x97, 0xC0});		// seta al
+				break;
+			default:
+				emit({0x66, 0x0F, 0x2E, 0xC1});		// ucomisd xmm0, xmm1
+				emit({0x0F, 0x93, 0xC0});		// setae al
+				break;
+		}
+	}
+	emit({0x0F, 0xB6, 0xC0});					// movzx eax, al
+}
+
+// a zero divisor is reported like the interpreter does, and the result is 0
+void Jit_compiler::compile_divide(Gpl_type type, bool bMod)
+{
+	int divide = new_label();
+	int end = new_label();
+
+	if(type == INT)
+	{
+		emit({0x85, 0xC9});					// test ecx, ecx
+		jump_if(CC_NE, divide);
+	}
+	else
+	{
+		emit({0x66, 0x0F, 0x57, 0xD2});				// xorpd xmm2, xmm2
+		emit({0x66, 0x0F, 0x2E, 0xCA});				// ucomisd xmm1, xmm2
+		jump_if(CC_P, divide);
+		jump_if(CC_NE, divide);
+	}
+
+	if(bMod) call(&Jit_compiler::mod_by_zero, false);
+	else call(&Jit_compiler::divide_by_zero, false);
+	if(type == INT) emit({0x31, 0xC0});				// xor eax, eax
+	else emit({0x66, 0x0F, 0x57, 0xC0});				// xorpd xmm0, xmm0
+	jump(end);
+
+	bind(divide);
+	if(type == DOUBLE) emit({0xF2, 0x0F, 0x5E, 0xC1});		// divsd xmm0, xmm1
+	else
+	{
+		emit({0x99, 0xF7, 0xF9});				// cdq; idiv ecx
+		if(bMod) emit({0x89, 0xD0});				// mov eax, edx
+	}
+	bind(end);
+}
+
+// 1 or 0 in eax, as the interpreter's get_double() != 0
+void Jit_compiler::compile_truth(const std::shared_ptr<IExpression>& pExpr)
+{
+	if(pExpr->get_type() == INT)
+	{
+		compile_expression(pExpr, INT);
+		emit({0x85, 0xC0, 0x0F, 0x95, 0xC0});			// test eax, eax; setne al
+	}
+	else
+	{
+		compile_expression(pExpr, DOUBLE);
+		emit({0x66, 0x0F, 0x57, 0xC9});				// xorpd xmm1, xmm1
+		emit({0x66, 0x0F, 0x2E, 0xC1});				// ucomisd xmm0, xmm1
+		emit({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1});		// setne al; setp cl
+		emit({0x08, 0xC8});					// or al, cl
+	}
+	emit({0x0F, 0xB6, 0xC0});					// movzx eax, al
+}
+
+//==============================================================================
+//	I N S T R U C T I O N S
+//==============================================================================
+
+void Jit_compiler::emit(std::initializer_list<unsigned char> bytes)
+{
+	_code.insert(_code.end(), bytes);
+}
+
+void Jit_compiler::emit32(int32_t value)
+{
+	unsigned char bytes[4];
+	memcpy(bytes, &value, 4);
+	_code.insert(_code.end(), bytes, bytes + 4);
+}
+
+// mov reg, imm64
+void Jit_compiler::load_address(Register reg, const void* pAddress)
+{
+	uint64_t address = reinterpret_cast<uintptr_t>(pAddress);
+	emit({0x48, (unsigned char) (0xB8 + reg)});
+	emit32((int32_t) address);
+	emit32((int32_t) (address >> 32));
+}
+
+// mov eax or ecx, imm32
+void Jit_compiler::load_int(Register reg, int value)
+{
+	emit({(unsigned char) (0xB8 + reg)});
+	emit32(value);
+}
+
+// to xmm0 (from rax) or xmm1 (from rcx)
+void Jit_compiler::load_double(Register reg, double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, 8);
+	emit({0x48, (unsigned char) (0xB8 + reg)});
+	emit32((int32_t) bits);
+	emit32((int32_t) (bits >> 32));
+	emit({0x66, 0x48, 0x0F, 0x6E, (unsigned char) (0xC0 | reg << 3 | reg)});	// movq
+}
+
+// to eax or xmm0 (through rax), or ecx or xmm1 (through rcx)
+void Jit_compiler::load_symbol(Register reg, const Symbol* pSymbol, Gpl_type type)
+{
+	load_address(reg, pSymbol->get_address());
+	unsigned char modrm = (unsigned char) (reg << 3 | reg);
+	if(type == INT) emit({0x8B, modrm});				// mov r32, [r64]
+	else emit({0xF2, 0x0F, 0x10, modrm});				// movsd xmm, [r64]
+}
+
+void Jit_compiler::set_line(int line)
+{
+	load_address(RAX, Error::runtime_line_address());
+	emit({0xC7, 0x00}); emit32(line);				// mov dword [rax], line
+}
+
+void Jit_compiler::increment(const unsigned* pCounter)
+{
+	load_address(RAX, pCounter);
+	emit({0xFF, 0x00});						// inc dword [rax]
+}
+
+void Jit_compiler::increment(const unsigned long* pCounter)
+{
+	load_address(RAX, pCounter);
+	emit({0x48, 0xFF, 0x00});					// inc qword [rax]
+}
+
+void Jit_compiler::push(Gpl_type type)
+{
+	if(type == INT) emit({0x50});					// push rax
+	else
+	{
+		emit({0x48, 0x83, 0xEC, 0x08});				// sub rsp, 8
+		emit({0xF2, 0x0F, 0x11, 0x04, 0x24});			// movsd [rsp], xmm0
+	}
+	_depth += 8;
+}
+
+// the value just computed becomes the right operand, the pushed one the left
+void Jit_compiler::pop_operands(Gpl_type type)
+{
+	if(type == INT) emit({0x89, 0xC1, 0x58});			// mov ecx, eax; pop rax
+	else
+	{
+		emit({0x66, 0x0F, 0x28, 0xC8});				// movapd xmm1, xmm0
+		emit({0xF2, 0x0F, 0x10, 0x04, 0x24});			// movsd xmm0, [rsp]
+		emit({0x48, 0x83, 0xC4, 0x08});				// add rsp, 8
+	}
+	_depth -= 8;
+}
+
+// pushes eax, and returns its offset from rbp
+int Jit_compiler::push_slot()
+{
+	emit({0x50});							// push rax
+	_depth += 8;
+	return -_depth;
+}
+
+// opcode eax, [rbp + slot] (or the other way around)
+void Jit_compiler::slot_op(unsigned char opcode, int slot)
+{
+	emit({opcode, 0x85});
+	emit32(slot);
+}
+
+void Jit_compiler::call(const void* pFunction, bool bCheck)
+{
+	bool bPad = (_depth % 16) != 0;
+	if(bPad) emit({0x48, 0x83, 0xEC, 0x08});			// sub rsp, 8
+	load_address(RAX, pFunction);
+	emit({0xFF, 0xD0});						// call rax
+	if(bPad) emit({0x48, 0x83, 0xC4, 0x08});			// add rsp, 8
+
+	if(!bCheck) return;
+	load_address(RCX, &_state.bAbort);
+	emit({0x80, 0x39, 0x00});					// cmp byte [rcx], 0
+	jump_if(CC_NE, _exit);
+}
+
+int Jit_compiler::new_label()
+{
+	_labels.push_back(-1);
+	return _labels.size() - 1;
+}
+
+void Jit_compiler::bind(int label)
+{
+	_labels[label] = _code.size();
+}
+
+void Jit_compiler::jump(int label)
+{
+	emit({0xE9});
+	_fixups.push_back({(int) _code.size(), label});
+	emit32(0);
+}
+
+void Jit_compiler::jump_if(Condition cc, int label)
+{
+	emit({0x0F, (unsigned char) (0x80 + cc)});
+	_fixups.push_back({(int) _code.size(), label});
+	emit32(0);
+}
+
+//==============================================================================
+//	C A L L S  B A C K  I N T O  T H E  I N T E R P R E T E R
+//==============================================================================
+
+// the native code cannot be unwound, so the exception waits for Jit::run()
+void Jit_compiler::hold()
+{
+	Jit::State& state = Jit::state();
+	state.pException = std::current_exception();
+	state.bAbort = true;
+}
+
+int Jit_compiler::eval_int(const IExpression* pExpr)
+{
+	try
+	{
+		int value = 0;
+		pExpr->eval()->get_int(value);
+		return value;
+	}
+	catch(...)
+	{
+		hold();
+		return 0;
+	}
+}
+
+double Jit_compiler::eval_double(const IExpression* pExpr)
+{
+	try
+	{
+		double value = 0;
+		pExpr->eval()->get_double(value);
+		return value;
+	}
+	catch(...)
+	{
+		hold();
+		return 0;
+	}
+}
+
+void Jit_compiler::execute(gpl_statement* pStatement)
+{
+	try
+	{
+		pStatement->execute();
+	}
+	catch(...)
+	{
+		hold();
+	}
+}
+
+int Jit_compiler::get_int(const IValue* pValue)
+{
+	try
+	{
+		int value = 0;
+		pValue->get_int(value);
+		return value;
+	}
+	catch(...)
+	{
+		hold();
+		return 0;
+	}
+}
+
+double Jit_compiler::get_double(const IValue* pValue)
+{
+	try
+	{
+		double value = 0;
+		pValue->get_double(value);
+		return value;
+	}
+	catch(...)
+	{
+		hold();
+		return 0;
+	}
+}
+
+// what assign_statement::execute() does with an int member
+void Jit_compiler::assign_int(IValue* pValue, int oper, int value)
+{
+	try
+	{
+		int lhs_num = value;
+		if(oper != ASSIGN)
+		{
+			if(pValue->get_int(lhs_num) == CONVERSION_ERROR)
+				throw std::runtime_error("assign_statement::execute -"
+					" Failed to retrieve the INT value of the LHS Expression");
+
+			if(oper == ADD_ASSIGN) lhs_num += value;
+			else lhs_num -= value;
+		}
+
+		if(pValue->set_int(lhs_num) == CONVERSION_ERROR)
+			throw std::runtime_error("assign_statement::execute -"
+				" Failed to set the INT value of the LHS Expression");
+	}
+	catch(...)
+	{
+		hold();
+	}
+}
+
+void Jit_compiler::assign_double(IValue* pValue, int oper, double value)
+{
+	try
+	{
+		double lhs_dbl = value;
+		if(oper != ASSIGN)
+		{
+			if(pValue->get_double(lhs_dbl) == CONVERSION_ERROR)
+				throw std::runtime_error("assign_statement::execute - "
+					" Failed to get the DOUBLE value of the LHS Expression");
+
+			if(oper == ADD_ASSIGN) lhs_dbl += value;
+			else lhs_dbl -= value;
+		}
+
+		if(pValue->set_double(lhs_dbl) == CONVERSION_ERROR)
+			throw std::runtime_error("assign_statement::execute - "
+				" Failed to set the DOUBLE value of the LHS Expression");
+	}
+	catch(...)
+	{
+		hold();
+	}
+}
+
+void Jit_compiler::divide_by_zero()
+{
+	Error::error(Error::DIVIDE_BY_ZERO_AT_PARSE_TIME);
+}
+
+void Jit_compiler::mod_by_zero()
+{
+	Error::error(Error::MOD_BY_ZERO_AT_PARSE_TIME);
+}
+
+int Jit_compiler::floor_int(double value)
+{
+	return floor(value);
+}
+
+int Jit_compiler::verify_int(const IExpression* pExpr, int value)
+{
+	try
+	{
+		int interpreted = 0;
+		pExpr->eval()->get_int(interpreted);
+		Jit::state().checked++;
+
+		if(interpreted != value)
+			mismatch(std::to_string(value), std::to_string(interpreted));
+		return interpreted;
+	}
+	catch(...)
+	{
+		hold();
+		return value;
+	}
+}
+
+double Jit_compiler::verify_double(const IExpression* pExpr, double value)
+{
+	try
+	{
+		double interpreted = 0;
+		pExpr->eval()->get_double(interpreted);
+		Jit::state().checked++;
+
+		bool bSame = (interpreted == value) || (interpreted != interpreted && value != value);
+		if(!bSame)
+		{
+			std::ostringstream native, other;
+			native << std::setprecision(17) << value;
+			other << std::setprecision(17) << interpreted;
+			mismatch(native.str(), other.str());
+		}
+		return interpreted;
+	}
+	catch(...)
+	{
+		hold();
+		return value;
+	}
+}
+
+void Jit_compiler::mismatch(const std::string& native, const std::string& interpreted)
+{
+	Jit::State& state = Jit::state();
+	state.mismatched++;
+	if(state.mismatched > MAX_MISMATCH_REPORTS) return;
+
+	Interpreter_context::current()->err() << "jit: line " << *Error::runtime_line_address() << ": the native code computed "
+		<< native << ", the interpreter " << interpreted << std::endl;
+}
+
+#endif // __x86_64__
+
+//==============================================================================
+
+Jit::Function Jit::compile(statement_block& block, bool bCountStatements)
+{
+#if defined(__x86_64__)
+	// the constants evaluated by the compiler are not evals of the program
+	unsigned long evals = Runtime_metrics::counters().evals;
+	Jit_compiler compiler(bCountStatements);
+	Function function = compiler.compile(block);
+	Runtime_metrics::counters().evals = evals;
+
+	if(function) state().compiled++;
+	return function;
+#else
+	return nullptr;
+#endif
+}
@@ -0,0 +1,106 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <exception>
+#include <ostream>
+#include <string>
+
+class statement_block;
+
+/***
+ The Jit compiles the statement blocks that run most often to x86-64
+ machine code. Every statement_block (an Animation_block too) counts how
+ many times it was executed, and the HOT_THRESHOLD-th execution compiles
+ it; from then on the block runs natively:
+
+	gpl -jit off		(the default) interprets every block
+	gpl -jit on		compiles the hot blocks
+	gpl -jit verify		compiles the hot blocks, and evaluates every
+				pure expression the native code computed once
+				more in the interpreter. The values that differ
+				are reported on cerr, and the native code goes
+				on with the interpreter's value
+
+ The native code computes int and double constants, variables and the
+ arithmetic, comparison and logical operators itself, and calls floor,
+ abs and the trig built-ins directly. Member loads and stores call
+ MemberReference, if statements, for loops (a counted loop keeps its
+ index in a native int, see for_statement) and the blocks nested in them
+ are compiled inline. Anything else (strings, arrays, random(), print,
+ spawn, the values cached by the optimizers, ...) is a call back into
+ the interpreter. The native code keeps the interpreter's bookkeeping:
+ the runtime line of each statement, the statement and eval counters of
+ Runtime_metrics and the run counters of the blocks and loops.
+
+ Each block is written to pages of its own, which are made read-only and
+ executable once it is compiled. An exception thrown by a call back into
+ the interpreter is held in the State of the program while the native
+ code returns, and rethrown by run(). The native code of a block runs on
+ the thread of its program (see interpreter_context.h) and uses the
+ counters, the runtime line and the State of that program. On other
+ processors compile() always fails and every block is interpreted.
+***/
+class Jit
+{
+public:
+	enum Mode
+	{
+		OFF,
+		ON,
+		VERIFY
+	};
+
+	// returns true if a call back into the interpreter threw
+	typedef bool (*Function)();
+
+	// what the native code of a program holds for run(), and what -jit
+	// verify checked; one per Interpreter_context
+	struct State
+	{
+		State() : bAbort(false), compiled(0), checked(0), mismatched(0) {};
+
+		bool bAbort;
+		std::exception_ptr pException;
+
+		int compiled;
+		unsigned long checked, mismatched;
+	};
+
+	// executions of a block before it is compiled
+	static const unsigned HOT_THRESHOLD = 64;
+
+	static void set_mode(Mode mode) { _mode = mode; };
+	static Mode get_mode() { return _mode; };
+	static bool is_enabled() { return _mode != OFF; };
+
+	// returns false if the name is not "on", "off" or "verify"
+	static bool string_to_mode(const std::string& name, Mode& mode);
+
+	// Compiles the statements of the block, or returns nullptr if it
+	// cannot. bCountStatements is false for an Animation_block, which does
+	// not count its own statements in Runtime_metrics
+	static Function compile(statement_block& block, bool bCountStatements);
+
+	// runs compiled code, and rethrows what a call back into the
+	// interpreter threw
+	static void run(Function function)
+	{
+		if(function()) rethrow();
+	};
+
+	// with -jit verify: the blocks compiled and the expressions checked
+	// by the program of the current Interpreter_context
+	static void report(std::ostream& os);
+
+private:
+	// the State of the current Interpreter_context
+	static State& state();
+	static void rethrow();
+
+	// the mode is the same for every program
+	static Mode _mode;
+
+	friend class Jit_compiler;
+};
+
+#endif
@@ -1,14 +1,45 @@
 #include "pixmap.h"
 #include "gpl_assert.h"
+#include "runtime_metrics.h"
+#include "batch_renderer.h"
+#include "software_renderer.h"
+#include "interpreter_context.h"
 
 #include <stdio.h>      /* Header file for standard file i/o. */
 #include <stdlib.h>     /* Header file for malloc/free. */
 #include <iostream>
+#include <algorithm>
 using namespace std;
 
 #include "default_pixmap.h"
-/* static */ Pixmap::Pixmap_data *Pixmap::default_pixmap_data = 0;
-/* static */ map<string, Pixmap::Pixmap_data*> Pixmap::m_pixmap_cache;
+
+Pixmap::Cache::Cache()
+{
+  m_default_pixmap_data = new Pixmap_data(default_width,
+                                          default_height,
+                                          default_data
+                                         );
+}
+
+Pixmap::Cache::~Cache()
+{
+  // the default pixmap's data is static, the files' data was malloc'd
+  delete m_default_pixmap_data->m_mask;
+  delete m_default_pixmap_data;
+
+  map<string, Pixmap_data *>::iterator iter;
+  for (iter = m_pixmap_data.begin(); iter != m_pixmap_data.end(); iter++)
+  {
+    delete iter->second->m_mask;
+    free(iter->second->m_data);
+    delete iter->second;
+  }
+}
+
+/* static */ Pixmap::Cache &Pixmap::cache()
+{
+  return Interpreter_context::current()->get_pixmap_cache();
+}
 
 std::shared_ptr<Game_object> Pixmap::Create()
 {
@@ -18,45 +49,47 @@ std::shared_ptr<Game_object> Pixmap::Create()
 
 Pixmap::Pixmap()
 {
-  // if the default pixmap has yet to be created, create it
-  if (!default_pixmap_data)
-  {
-    default_pixmap_data = new Pixmap_data(default_width,
-                                          default_height,
-                                          default_data
-                                         );
-  }
   m_pixmap_data = 0;
 
   m_filename = "";
-  register_member_variable("filename", &m_filename);
-
   m_object_type_name = "Pixmap";
-  // width and height of a pixmap are derived --> user cannot change them
-  Status status;
-  status = mark_member_variable_as_derived("w");
-  assert(status == OK);
-  status = mark_member_variable_as_derived("h");
-  assert(status == OK);
+
+  if (begin_member_schema(m_object_type_name))
+  {
+    register_member_variable("filename", &m_filename);
+
+    // width and height of a pixmap are derived --> user cannot change them
+    Status status;
+    status = mark_member_variable_as_derived("w");
+    assert(status == OK);
+    status = mark_member_variable_as_derived("h");
+    assert(status == OK);
+  }
 
   m_tried_to_read_current_file = false;
 
-  // the filename is not specified yet, so don't try to read file yet
+  // the filename is not specified yet, so this is the default pixmap
+  // (the scene culls by w and h, they must be right before it is drawn)
+  load_if_needed();
 }
 
 void Pixmap::updated(string name)
 {
-  // called with x,y or filename changes
+  // called with filename changes (x and y don't rebuild the display list)
 
-  // if the filename changes, set flag that it hasn't been read yet
+  // if the filename changes, read it now: w and h come from the file,
+  // and a pixmap that starts off screen must still report a bad file
   if (name == "filename")
+  {
     m_tried_to_read_current_file = false;
+    load_if_needed();
+  }
 
-  // this will cause a new display list to be created that will use new (x,y)
+  // this will cause a new display list to be created
   m_display_list_dirty = true;
 }
 
-void Pixmap::build_display_list()
+void Pixmap::load_if_needed()
 {
   // if there is a pending file read, attempt to read file
   if (!m_tried_to_read_current_file)
@@ -66,40 +99,111 @@ void Pixmap::build_display_list()
   // use the default
   if (!m_pixmap_data)
   {
-    m_pixmap_data = default_pixmap_data;
-    Game_object::m_w = m_pixmap_data->m_width;
-    Game_object::m_h = m_pixmap_data->m_height;
+    m_pixmap_data = cache().m_default_pixmap_data;
+    w() = m_pixmap_data->m_width;
+    h() = m_pixmap_data->m_height;
   }
+}
+
+void Pixmap::build_display_list()
+{
+  load_if_needed();
 
   // build the display list
   assert(m_display_list);
   assert(m_pixmap_data);
+
+  // a textured quad, not glDrawPixels: the raster position is clipped
+  // as a point and pixels are not scaled, so a pixmap partly past the
+  // left or bottom of the view would vanish and ignore camera_zoom
+  // (the texture is made outside the list, glTexImage2D would be compiled)
+  GLuint texture_name = texture(m_pixmap_data);
+  int width = m_pixmap_data->m_width;
+  int height = m_pixmap_data->m_height;
+
   glNewList(m_display_list, GL_COMPILE);
-  glMatrixMode(GL_MODELVIEW);
-  glPushMatrix();
-  glRasterPos2i(m_x, m_y);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, texture_name);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
   // Enable opengl transparency
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  // the .bmp format packs pixels into rows that are a
-  // multiple of 4 bytes (adds padding if neccessary).  
-  // Tell openGL to expect the padding @ 4byte level
-  // OBSOLETE: padding is removed when .bmp is converted to include ALPHA
-  // or maybe not...  I've read the default to be 4.
-  glPixelStorei(GL_UNPACK_ALIGNMENT, (GLint) 4);
-
-  glDrawPixels(m_pixmap_data->m_width,
-               m_pixmap_data->m_height,
-               GL_BGRA, GL_UNSIGNED_BYTE,
-               m_pixmap_data->m_data
-              );
+  // the image is stored bottom row first, like the quad
+  glBegin(GL_QUADS);
+  glTexCoord2d(0, 0); glVertex2i(0, 0);
+  glTexCoord2d(1, 0); glVertex2i(width, 0);
+  glTexCoord2d(1, 1); glVertex2i(width, height);
+  glTexCoord2d(0, 1); glVertex2i(0, height);
+  glEnd();
 
-  glPopMatrix();
+  glDisable(GL_TEXTURE_2D);
   glEndList();
 }
 
+// the texture is shared by every pixmap and tilemap that uses the file
+/* static */ GLuint Pixmap::texture(Pixmap_data *data)
+{
+  if (!data->m_texture)
+  {
+    glGenTextures(1, &data->m_texture);
+    glBindTexture(GL_TEXTURE_2D, data->m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
+    // the .bmp format packs pixels into rows that are a
+    // multiple of 4 bytes (adds padding if neccessary).
+    // Tell openGL to expect the padding @ 4byte level
+    glPixelStorei(GL_UNPACK_ALIGNMENT, (GLint) 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                 data->m_width, data->m_height, 0,
+                 GL_BGRA, GL_UNSIGNED_BYTE, data->m_data);
+  }
+  return data->m_texture;
+}
+
+bool Pixmap::append_to_batch(Batch_renderer &batch)
+{
+  load_if_needed();
+
+  // the image data never moves, so it identifies the image in the atlas
+  return batch.add_image(m_pixmap_data,
+                         m_pixmap_data->m_width,
+                         m_pixmap_data->m_height,
+                         m_pixmap_data->m_data,
+                         x(), y());
+}
+
+void Pixmap::draw_software(Software_renderer &renderer,
+                           int left, int bottom, int right, int top)
+{
+  load_if_needed();
+
+  renderer.add_image(m_pixmap_data->m_data, m_pixmap_data->m_width,
+                     0, 0, m_pixmap_data->m_width, m_pixmap_data->m_height,
+                     x(), y());
+}
+
+void Pixmap::get_collision_shape(Collision_shape &shape) const
+{
+  // the image is read when the filename is set, this is just in case
+  if (!m_pixmap_data)
+  {
+    Game_object::get_collision_shape(shape);
+    return;
+  }
+
+  // the transparent pixels (see ALPHA_RED, ...) have an alpha of 0
+  if (!m_pixmap_data->m_mask)
+    m_pixmap_data->m_mask = new Collision_mask(m_pixmap_data->m_width,
+                                               m_pixmap_data->m_height,
+                                               m_pixmap_data->m_data);
+  shape.set_mask(m_pixmap_data->m_mask, x(), y());
+}
+
 void Pixmap::read_file()
 {
   // special case that no filename has been specified yet
@@ -110,21 +214,27 @@ void Pixmap::read_file()
   // to read bad files over and over
   m_tried_to_read_current_file = true;
 
-  // If the pixmap in m_filename has already been read
-  // get it out of the cache
-  map<string, Pixmap_data *>::const_iterator iter;
-  iter = m_pixmap_cache.find(m_filename);
-  if (iter != m_pixmap_cache.end())
+  // set to NULL if read fails
+  m_pixmap_data = read_pixmap_data(m_filename);
+  if (m_pixmap_data)
   {
-    m_pixmap_data = (*iter).second;
-    Game_object::m_w = m_pixmap_data->m_width;
-    Game_object::m_h = m_pixmap_data->m_height;
-    return;
+    w() = m_pixmap_data->m_width;
+    h() = m_pixmap_data->m_height;
   }
+}
 
+// returns 0 if the file can't be read
+/* static */ Pixmap::Pixmap_data *Pixmap::read_pixmap_data(const string &filename)
+{
+  // If the pixmap in filename has already been read
+  // get it out of the cache
+  Cache &cache = Pixmap::cache();
+  map<string, Pixmap_data *>::const_iterator iter;
+  iter = cache.m_pixmap_data.find(filename);
+  if (iter != cache.m_pixmap_data.end())
+    return (*iter).second;
 
-  // set to NULL in case read fails
-  m_pixmap_data = 0;
+  ostream &err = Interpreter_context::current()->err();
 
   FILE *file;
   unsigned long width=0;           // width of image
@@ -134,102 +244,102 @@ void Pixmap::read_file()
   unsigned short int bpp;          // number of bits per pixel (must be 24)
 
   // make sure the file is there
-  if ((file = fopen(m_filename.c_str(), "rb"))==NULL)
+  if ((file = fopen(filename.c_str(), "rb"))==NULL)
   {
-    cerr << "Texture filename <" << m_filename << "> not found." << endl;
-    return;
+    err << "Texture filename <" << filename << "> not found." << endl;
+    return 0;
   }
 
   unsigned long data_offset = 0;
   fseek(file, 10, SEEK_SET);
   if ((i = fread(&data_offset, 4, 1, file)) != 1)
   {
-    cerr << "Error reading data_offset size from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading data_offset size from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
 
   unsigned long header_size = 0;
   // read the size of header
   if ((i = fread(&header_size, 4, 1, file)) != 1)
   {
-    cerr << "Error reading header size from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading header size from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
 
   // read bitmap width
   if ((i = fread(&width, 4, 1, file)) != 1)
   {
-    cerr << "Error reading width from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading width from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
 
   // read bitmap height
   if ((i = fread(&height, 4, 1, file)) != 1)
   {
-    cerr << "Error reading height from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading height from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
 
   // read the planes
   if ((fread(&planes, 2, 1, file)) != 1)
   {
-    cerr << "Error reading planes from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading planes from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
 
   // LIMITATION: some day it would be nice to handle any number of planes
   // this code only works for bitmaps with 1 plane
   if (planes != 1)
   {
-    cerr << "Error reading texture filename <" << m_filename
+    err << "Error reading texture filename <" << filename
          << "> it has more than 1 plane" << endl;
-    return;
+    return 0;
   }
 
   // read the bits-per-pixel
   if ((i = fread(&bpp, 2, 1, file)) != 1)
   {
-    cerr << "Error reading bits per pixel from texture filename <" << m_filename << endl;
-    return;
+    err << "Error reading bits per pixel from texture filename <" << filename << endl;
+    return 0;
   }
   
   // LIMITATION: some day it would be nice to handle any bit/pixel
   // this code only works for bitmaps with 24 bits per pixel
   if (bpp != 24)
   {
-    cerr << "Error reading texture filename <" << m_filename
+    err << "Error reading texture filename <" << filename
          << " bits per pixel != 24 (can only handle 1 plane w/24 bits per pixel" << endl;
-    return;
+    return 0;
   }
 
   unsigned long compression = 0;
   if ((i = fread(&compression, 4, 1, file)) != 1)
   {
-    cerr << "Error reading compression from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading compression from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
 
   if (compression)
   {
-    cerr << "Error reading texture filename <" << m_filename
+    err << "Error reading texture filename <" << filename
          << "> the bitmap is compressed, gpl can't handle compressed"
          << " bitmaps"
          << endl;
-    return;
+    return 0;
   }
 
   unsigned long bitmap_data_size = 0;
   if ((i = fread(&bitmap_data_size, 4, 1, file)) != 1)
   {
-    cerr << "Error reading bitmap_data_size from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading bitmap_data_size from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
   // buffer used temporarially hold the pixel array (NOTE: this array includes padding)
   unsigned char *bitmap_data = (unsigned char *) malloc(bitmap_data_size);
@@ -240,9 +350,9 @@ void Pixmap::read_file()
   // read the padded bitmap_data
   if ((i = fread(bitmap_data, bitmap_data_size, 1, file)) != 1)
   {
-    cerr << "Error reading image from texture filename <"
-         << m_filename << ">" << endl;
-    return;
+    err << "Error reading image from texture filename <"
+         << filename << ">" << endl;
+    return 0;
   }
   // done reading .bmp file
   fclose(file);
@@ -261,7 +371,7 @@ void Pixmap::read_file()
   // the magic mathmatics of %
   unsigned long row_padding = (width * 9) % 4;
 
-  // cout << m_filename << " being parsed\n";
+  // cout << filename << " being parsed\n";
   // cout << "width = " << width << " " << width*3 << "bytes " << endl;
   // cout << "height = " << height << endl;
   // cout << "row_padding = " << row_padding << endl;
@@ -306,12 +416,10 @@ void Pixmap::read_file()
   // no longer need the temp bitmap array
   free(bitmap_data);
 
-  m_pixmap_data = new Pixmap_data(width, height, bitmap_data_with_alpha);
-  Game_object::m_w = m_pixmap_data->m_width;
-  Game_object::m_h = m_pixmap_data->m_height;
+  Pixmap_data *pixmap_data = new Pixmap_data(width, height, bitmap_data_with_alpha);
 
   // insert new pixmap into the pixmap cache
-  m_pixmap_cache[m_filename] = m_pixmap_data;
+  cache.m_pixmap_data[filename] = pixmap_data;
 
   /**
   // DO NOT DELETE, keep it around in case we want a new default
@@ -324,12 +432,12 @@ void Pixmap::read_file()
   // (3) run gpl save stdout to file
   // (4) update default_pixmap.h with the output
   cout << "dumping bitmap ******************" << endl;
-  cout << "width = " << m_w << endl;
-  cout << "height= " << m_h << endl;
-  cout << "size = " << m_w * m_h * 4 << endl;
+  cout << "width = " << w() << endl;
+  cout << "height= " << h() << endl;
+  cout << "size = " << w() * h() * 4 << endl;
   cout << "data = " << endl;
   int in_row = 0;
-  for (int i = 0; i < m_w * m_h * 4; i++)
+  for (int i = 0; i < w() * h() * 4; i++)
   {
     if (++in_row > 20)
     {
@@ -340,4 +448,286 @@ void Pixmap::read_file()
   }
   cout << "**************** end of dump" << endl;
   ***/
+
+  return pixmap_data;
+}
+
+std::shared_ptr<Game_object> Tilemap::Create()
+{
+	std::shared_ptr<Game_object> pObj(new Tilemap());
+	return pObj;
+}
+
+Tilemap::Tilemap() : Game_object(/* red = */ 1.0,
+                                 /* green = */ 1.0,
+                                 /* blue = */ 1.0
+                                )
+{
+  m_tileset = "";
+  m_tile_size = 32;
+  m_columns = 10;
+  m_rows = 10;
+  m_grid_columns = 0;
+  m_grid_rows = 0;
+  m_tileset_data = 0;
+  m_tried_to_read_current_file = false;
+  m_chunk_base = 0;
+  m_chunk_count = 0;
+  m_chunk_columns = 0;
+  m_object_type_name = "Tilemap";
+
+  if (begin_member_schema(m_object_type_name))
+  {
+    register_member_variable("tileset", &m_tileset);
+    register_member_variable("tile_size", &m_tile_size);
+    register_member_variable("columns", &m_columns);
+    register_member_variable("rows", &m_rows);
+
+    // the size of a tilemap is derived --> user cannot change it
+    Status status;
+    status = mark_member_variable_as_derived("w");
+    assert(status == OK);
+    status = mark_member_variable_as_derived("h");
+    assert(status == OK);
+  }
+
+  resize_grid();
+}
+
+int Tilemap::indexed_member_variable_size(const string &name) const
+{
+  if (name == "tile")
+    return (int) m_tiles.size();
+  return -1;
+}
+
+int *Tilemap::indexed_member_variable(const string &name, int index)
+{
+  if (name != "tile" || index < 0 || index >= (int) m_tiles.size())
+    return 0;
+  return &m_tiles[index];
+}
+
+// keeps the tiles that are in both the old and the new grid
+void Tilemap::resize_grid()
+{
+  if (m_columns < 1)
+    m_columns = 1;
+  if (m_rows < 1)
+    m_rows = 1;
+  if (m_tile_size < 1)
+    m_tile_size = 1;
+
+  if (m_columns != m_grid_columns || m_rows != m_grid_rows)
+  {
+    vector<int> tiles(m_columns * m_rows, 0);
+    for (int row = 0; row < min(m_rows, m_grid_rows); row++)
+      for (int col = 0; col < min(m_columns, m_grid_columns); col++)
+        tiles[row * m_columns + col] = m_tiles[row * m_grid_columns + col];
+    m_tiles.swap(tiles);
+    m_grid_columns = m_columns;
+    m_grid_rows = m_rows;
+  }
+
+  w() = m_columns * m_tile_size;
+  h() = m_rows * m_tile_size;
+}
+
+void Tilemap::updated(string name)
+{
+  // nothing else changes the chunks, not even moving the map
+  // (see draw_in_view())
+  if (name == "tileset")
+  {
+    m_tried_to_read_current_file = false;
+    m_display_list_dirty = true;
+  }
+  else if (name == "columns" || name == "rows" || name == "tile_size")
+  {
+    resize_grid();
+    m_display_list_dirty = true;
+  }
+}
+
+void Tilemap::updated_element(string name, int index)
+{
+  if (index < 0 || index >= (int) m_tiles.size()
+      || (int) m_chunk_dirty.size() != m_chunk_count)
+    return;
+
+  int chunk_row = (index / m_grid_columns) / CHUNK_SIZE;
+  int chunk_col = (index % m_grid_columns) / CHUNK_SIZE;
+  int chunk = chunk_row * m_chunk_columns + chunk_col;
+  if (chunk < m_chunk_count)
+    m_chunk_dirty[chunk] = true;
+}
+
+void Tilemap::read_tileset()
+{
+  m_tried_to_read_current_file = true;
+  m_tileset_data = 0;
+  if (m_tileset != "")
+    m_tileset_data = Pixmap::read_pixmap_data(m_tileset);
+}
+
+void Tilemap::mark_all_chunks_dirty()
+{
+  m_chunk_dirty.assign(m_chunk_count, true);
+}
+
+// called when anything but a tile changed
+// sets up the texture and makes room for the chunks
+/* virtual */ void Tilemap::build_display_list()
+{
+  assert(m_display_list);
+
+  if (!m_tried_to_read_current_file)
+    read_tileset();
+
+  // the texture is shared with the pixmaps that use the tileset
+  GLuint texture_name = 0;
+  if (m_tileset_data)
+    texture_name = Pixmap::texture(m_tileset_data);
+
+  int chunk_columns = (m_grid_columns + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  int chunk_rows = (m_grid_rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  if (chunk_columns * chunk_rows != m_chunk_count)
+  {
+    if (m_chunk_base)
+      glDeleteLists(m_chunk_base, m_chunk_count);
+    m_chunk_count = chunk_columns * chunk_rows;
+    m_chunk_base = glGenLists(m_chunk_count);
+  }
+  m_chunk_columns = chunk_columns;
+  mark_all_chunks_dirty();
+
+  // the state every chunk is drawn with
+  glNewList(m_display_list, GL_COMPILE);
+  if (m_tileset_data)
+  {
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture_name);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+  glEndList();
+}
+
+// the chunk is built relative to the lower left corner of the map
+void Tilemap::build_chunk(int chunk)
+{
+  int first_col = (chunk % m_chunk_columns) * CHUNK_SIZE;
+  int first_row = (chunk / m_chunk_columns) * CHUNK_SIZE;
+  int last_col = min(first_col + CHUNK_SIZE, m_grid_columns);
+  int last_row = min(first_row + CHUNK_SIZE, m_grid_rows);
+
+  glNewList(m_chunk_base + chunk, GL_COMPILE);
+  if (m_tileset_data)
+  {
+    double tileset_w = m_tileset_data->m_width;
+    double tileset_h = m_tileset_data->m_height;
+    int per_row = m_tileset_data->m_width / m_tile_size;
+    int per_column = m_tileset_data->m_height / m_tile_size;
+
+    glBegin(GL_QUADS);
+    for (int row = first_row; row < last_row; row++)
+    {
+      for (int col = first_col; col < last_col; col++)
+      {
+        int tile = m_tiles[row * m_grid_columns + col];
+        if (tile < 0 || tile >= per_row * per_column)
+          continue;
+
+        // tiles are numbered from the top of the image, the image is
+        // stored bottom row first
+        double s0 = (tile % per_row) * m_tile_size / tileset_w;
+        double s1 = s0 + m_tile_size / tileset_w;
+        double t1 = (tileset_h - (tile / per_row) * m_tile_size) / tileset_h;
+        double t0 = t1 - m_tile_size / tileset_h;
+
+        int x0 = col * m_tile_size;
+        int y0 = row * m_tile_size;
+        glTexCoord2d(s0, t0); glVertex2i(x0, y0);
+        glTexCoord2d(s1, t0); glVertex2i(x0 + m_tile_size, y0);
+        glTexCoord2d(s1, t1); glVertex2i(x0 + m_tile_size, y0 + m_tile_size);
+        glTexCoord2d(s0, t1); glVertex2i(x0, y0 + m_tile_size);
+      }
+    }
+    glEnd();
+  }
+  glEndList();
+  m_chunk_dirty[chunk] = false;
+  Runtime_metrics::count_rebuilt();
+}
+
+/* virtual */ void Tilemap::draw_in_view(int left, int bottom,
+                                        int right, int top)
+{
+  build_if_dirty();
+  if (!m_tileset_data)
+    return;
+
+  // the chunks that are at least partly in view
+  int chunk_pixels = CHUNK_SIZE * m_tile_size;
+  int chunk_rows = m_chunk_count / m_chunk_columns;
+  int first_col = max(0, (left - x()) / chunk_pixels);
+  int last_col = min(m_chunk_columns - 1, (right - x()) / chunk_pixels);
+  int first_row = max(0, (bottom - y()) / chunk_pixels);
+  int last_row = min(chunk_rows - 1, (top - y()) / chunk_pixels);
+
+  glCallList(m_display_list);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glTranslated(x(), y(), 0);
+  for (int row = first_row; row <= last_row; row++)
+  {
+    for (int col = first_col; col <= last_col; col++)
+    {
+      int chunk = row * m_chunk_columns + col;
+      if (m_chunk_dirty[chunk])
+        build_chunk(chunk);
+      glCallList(m_chunk_base + chunk);
+    }
+  }
+  glPopMatrix();
+  glDisable(GL_TEXTURE_2D);
+}
+
+// the same tiles as build_chunk(), only the cells in view
+/* virtual */ void Tilemap::draw_software(Software_renderer &renderer,
+                                         int left, int bottom,
+                                         int right, int top)
+{
+  if (!m_tried_to_read_current_file)
+    read_tileset();
+  if (!m_tileset_data)
+    return;
+
+  int per_row = m_tileset_data->m_width / m_tile_size;
+  int per_column = m_tileset_data->m_height / m_tile_size;
+
+  int first_col = max(0, (left - x()) / m_tile_size);
+  int last_col = min(m_grid_columns - 1, (right - x()) / m_tile_size);
+  int first_row = max(0, (bottom - y()) / m_tile_size);
+  int last_row = min(m_grid_rows - 1, (top - y()) / m_tile_size);
+
+  for (int row = first_row; row <= last_row; row++)
+  {
+    for (int col = first_col; col <= last_col; col++)
+    {
+      int tile = m_tiles[row * m_grid_columns + col];
+      if (tile < 0 || tile >= per_row * per_column)
+        continue;
+
+      // tiles are numbered from the top of the image, the image is
+      // stored bottom row first
+      int src_x = (tile % per_row) * m_tile_size;
+      int src_y = m_tileset_data->m_height
+                  - (tile / per_row + 1) * m_tile_size;
+      renderer.add_image(m_tileset_data->m_data, m_tileset_data->m_width,
+                         src_x, src_y, m_tile_size, m_tile_size,
+                         x() + col * m_tile_size, y() + row * m_tile_size);
+    }
+  }
 }
@@ -16,6 +16,23 @@
 
   LIMITATIONS:
     Only works for pixmaps with 1 plane and 24 bits per plane
+
+  Tilemap draws a grid of tiles cut out of a single image (the tileset).
+  The tileset is split into square tiles of tile_size pixels, numbered
+  left to right, top to bottom, starting at 0.  Each cell of the grid
+  holds the number of its tile in the indexed member tile[]:
+
+      tilemap map(tileset = "tiles.bmp", tile_size = 32,
+                  columns = 100, rows = 50);
+      map.tile[row * map.columns + column] = 3;
+
+  Row 0 is the bottom row.  A cell with a tile number that is not in the
+  tileset (e.g. -1) is empty.
+
+  The tileset is loaded into one texture and the grid is drawn in chunks
+  of CHUNK_SIZE x CHUNK_SIZE cells, each with its own display list.
+  Setting a tile only rebuilds the chunk it is in, moving the map
+  rebuilds nothing, and only the chunks in view are drawn.
 */
 
 #ifndef PIXMAP_H
@@ -34,6 +51,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 
 class Pixmap : public Game_object
@@ -58,6 +76,8 @@ class Pixmap : public Game_object
         unsigned long m_width;
         unsigned long m_height;
         unsigned char *m_data;
+        Collision_mask *m_mask; // built the first time it is needed
+        GLuint m_texture;       // 0 until it is first drawn, see texture()
         Pixmap_data(unsigned long width,
               unsigned long height,
               unsigned char *data)
@@ -65,10 +85,24 @@ class Pixmap : public Game_object
           m_width = width;
           m_height = height;
           m_data = data;
+          m_mask = 0;
+          m_texture = 0;
         }
     };
-    static Pixmap_data *default_pixmap_data;
-    static std::map<std::string, Pixmap_data*> m_pixmap_cache;
+
+    // the pixmaps one program has read, by filename, and its default
+    // pixmap (one per Interpreter_context, see interpreter_context.h)
+    class Cache
+    {
+      public:
+        Cache();
+        ~Cache();
+        Pixmap_data *m_default_pixmap_data;
+        std::map<std::string, Pixmap_data*> m_pixmap_data;
+    };
+
+    // the cache of the current Interpreter_context
+    static Cache &cache();
 
     Pixmap_data *m_pixmap_data;
     std::string m_filename;
@@ -76,14 +110,84 @@ class Pixmap : public Game_object
     bool m_tried_to_read_current_file;
 
     void read_file();
+
+    // reads the file if it changed, uses the default pixmap if it can't
+    void load_if_needed();
+    static Pixmap_data *read_pixmap_data(const std::string &filename);
     void build_display_list();
+
+    // the texture of data, made the first time it is drawn
+    static GLuint texture(Pixmap_data *data);
+
     void updated(std::string name);
+    void get_collision_shape(Collision_shape &shape) const;
+    bool append_to_batch(Batch_renderer &batch);
+    void draw_software(Software_renderer &renderer,
+                       int left, int bottom, int right, int top);
   
     // disable default copy constructor and default assignment
     // done as a precaution, they should never be called
     Pixmap(const Pixmap &);
     const Pixmap &operator=(const Pixmap &);
 
+    friend class Tilemap;
+    friend class Interpreter_context;
+};
+
+class Tilemap : public Game_object
+{
+  public:
+	static std::shared_ptr<Game_object> Create();
+	virtual ~Tilemap() {};
+
+    	virtual Game_object_type get_object_type() const
+	{ return TILEMAP; }
+
+    static const int CHUNK_SIZE = 16;
+
+    virtual int indexed_member_variable_size(const std::string &name) const;
+    virtual void indexed_member_names(std::vector<std::string> &names) const
+     {names.push_back("tile");}
+
+  private:
+	Tilemap();
+
+    std::string m_tileset;
+    int m_tile_size;
+    int m_columns;
+    int m_rows;
+
+    // row major, row 0 is the bottom row
+    std::vector<int> m_tiles;
+    int m_grid_columns;
+    int m_grid_rows;
+
+    Pixmap::Pixmap_data *m_tileset_data;
+    bool m_tried_to_read_current_file;
+
+    // display lists of the chunks, m_chunk_base + chunk number
+    GLuint m_chunk_base;
+    int m_chunk_count;
+    int m_chunk_columns;
+    std::vector<bool> m_chunk_dirty;
+
+    void resize_grid();
+    void read_tileset();
+    void mark_all_chunks_dirty();
+    void build_chunk(int chunk);
+
+    virtual int *indexed_member_variable(const std::string &name, int index);
+    virtual void updated(std::string name);
+    virtual void updated_element(std::string name, int index);
+    virtual void build_display_list();
+    virtual void draw_in_view(int left, int bottom, int right, int top);
+    virtual void draw_software(Software_renderer &renderer,
+                               int left, int bottom, int right, int top);
+
+    // disable default copy constructor and default assignment
+    // done as a precaution, they should never be called
+    Tilemap(const Tilemap &);
+    const Tilemap &operator=(const Tilemap &);
 };
 
 #endif
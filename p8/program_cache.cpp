@@ -0,0 +1,587 @@
+#include "program_cache.h"
+#include "snapshot.h"
+#include "helper_functions.h"
+#include "event_manager.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+static const int BYTE_ORDER_MARKER = 0x01020304;
+
+const char Program_cache::MAGIC[8] = { 'G', 'P', 'L', 'P', 'R', 'O', 'G', '\n' };
+
+//==============================================================================
+//	R E A D  H E L P E R S
+//==============================================================================
+
+static int read_int(Snapshot_reader& in)
+{
+	int val;
+	if(!in.read_int(val)) throw std::runtime_error("the cache is truncated");
+	return val;
+}
+
+static double read_double(Snapshot_reader& in)
+{
+	double val;
+	if(!in.read_double(val)) throw std::runtime_error("the cache is truncated");
+	return val;
+}
+
+static std::string read_string(Snapshot_reader& in)
+{
+	std::string val;
+	if(!in.read_string(val)) throw std::runtime_error("the cache is truncated");
+	return val;
+}
+
+static std::shared_ptr<Symbol> read_symbol(Snapshot_reader& in)
+{
+	std::string name = read_string(in);
+	std::shared_ptr<Symbol> pSymbol = Symbol_table::instance()->find_symbol(name);
+	if(!pSymbol) throw std::runtime_error("the cache refers to an unknown symbol " + name);
+	return pSymbol;
+}
+
+template<typename T, typename U>
+static std::shared_ptr<T> expect(const std::shared_ptr<U>& pNode)
+{
+	std::shared_ptr<T> pCast = std::dynamic_pointer_cast<T>(pNode);
+	if(!pCast) throw std::runtime_error("the cache holds a node of the wrong kind");
+	return pCast;
+}
+
+// a variable as the grammar passes it on: member variables ("obj.x")
+// are ValueExpressions, which are cast the same way (see gpl.y)
+static std::shared_ptr<IVariableExpression> read_variable(Snapshot_reader& in)
+{
+	return std::static_pointer_cast<IVariableExpression>(Program_cache::read_expression(in));
+}
+
+//==============================================================================
+//	W R I T I N G
+//==============================================================================
+
+static void write_program(Snapshot_writer& out)
+{
+	// in the order they were declared: created and read in that order,
+	// the objects end up in the lists (and in the same place among the
+	// objects with the same drawing_order) as they did in the parser
+	std::vector<Game_object*> objects;
+	Game_object::get_game_objects(objects);
+
+	std::map<const Game_object*, int> object_index;
+	out.write_int((int) objects.size());
+	for(unsigned int i = 0; i < objects.size(); i++)
+	{
+		object_index[objects[i]] = i;
+		out.write_int(objects[i]->get_object_type());
+		out.write_int(objects[i]->should_draw());
+		out.write_int(objects[i]->should_animate());
+	}
+
+	// animation blocks last: they refer to the symbols of their parameters
+	const Symbol_table::SymbolMap& symbols = Symbol_table::instance()->get_symbols();
+	std::vector<std::shared_ptr<Animation_block>> animations;
+	out.write_int((int) symbols.size());
+	for(Symbol_table::SymbolMap::const_iterator it = symbols.cbegin();
+		it != symbols.cend(); it++)
+	{
+		const std::shared_ptr<Symbol>& pSymbol = it->second;
+		Gpl_type type = pSymbol->get_type();
+		if(type == ANIMATION_BLOCK)
+		{
+			std::shared_ptr<Animation_block> pAnim;
+			pSymbol->get_animation_block(pAnim);
+			animations.push_back(pAnim);
+			continue;
+		}
+
+		out.write_string(pSymbol->get_name());
+		out.write_int(type);
+		switch(type)
+		{
+			case INT:
+			{
+				int val = 0;
+				pSymbol->get_int(val);
+				out.write_int(val);
+				break;
+			}
+			case DOUBLE:
+			{
+				double val = 0;
+				pSymbol->get_double(val);
+				out.write_double(val);
+				break;
+			}
+			case STRING:
+			{
+				std::string val;
+				pSymbol->get_string(val);
+				out.write_string(val);
+				break;
+			}
+			case GAME_OBJECT:
+			{
+				std::shared_ptr<Game_object> pObj;
+				pSymbol->get_game_object(pObj);
+				std::map<const Game_object*, int>::const_iterator found
+					= object_index.find(pObj.get());
+				if(found == object_index.end())
+					throw std::logic_error(pSymbol->get_name() + " is not in the scene");
+				out.write_int(found->second);
+				break;
+			}
+			default:
+				throw std::logic_error("unhandled type: " + gpl_type_to_string(type));
+		}
+	}
+
+	for(unsigned int i = 0; i < animations.size(); i++)
+	{
+		out.write_string(animations[i]->name());
+		out.write_int(ANIMATION_BLOCK);
+		out.write_int(animations[i]->get_line());
+		out.write_string(animations[i]->get_parameter_symbol()->get_name());
+	}
+
+	// the member values after the declarations, which may name the
+	// animation blocks
+	for(unsigned int i = 0; i < objects.size(); i++)
+	{
+		objects[i]->write_snapshot(out);
+	}
+
+	for(unsigned int i = 0; i < animations.size(); i++)
+	{
+		out.write_int(animations[i]->get_count());
+		for(int j = 0; j < animations[i]->get_count(); j++)
+		{
+			animations[i]->get_statement(j)->write(out);
+		}
+	}
+
+	Event_manager::Handler_list handlers;
+	Event_manager::instance()->get_handlers(handlers);
+	out.write_int((int) handlers.size());
+	for(unsigned int i = 0; i < handlers.size(); i++)
+	{
+		out.write_int(handlers[i].first);
+		handlers[i].second->write(out);
+	}
+}
+
+std::string Program_cache::cache_filename(const std::string& source_filename)
+{
+	return source_filename + "c";
+}
+
+bool Program_cache::save(const std::string& filename, uint64_t source_hash,
+		std::string& error)
+{
+	std::ostringstream program(std::ios::out | std::ios::binary);
+	try
+	{
+		Snapshot_writer out(program);
+		write_program(out);
+	}
+	catch(const std::exception& ex)
+	{
+		error = ex.what();
+		return false;
+	}
+	std::string bytes = program.str();
+
+	std::ofstream file(filename.c_str(),
+		std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file)
+	{
+		error = "cannot open the file";
+		return false;
+	}
+
+	file.write(MAGIC, sizeof(MAGIC));
+	Snapshot_writer out(file);
+	out.write_int(FORMAT_VERSION);
+	out.write_int(BYTE_ORDER_MARKER);
+	out.write_hash(source_hash);
+	out.write_hash(Snapshot::hash(bytes.data(), bytes.size()));
+	file.write(bytes.data(), bytes.size());
+
+	if(!file.good())
+	{
+		error = "write failed";
+		return false;
+	}
+	return true;
+}
+
+//==============================================================================
+//	R E A D I N G
+//==============================================================================
+
+static void read_program(Snapshot_reader& in)
+{
+	Symbol_table* pTable = Symbol_table::instance();
+
+	int count = read_int(in);
+	std::vector<std::shared_ptr<Game_object>> objects;
+	for(int i = 0; i < count; i++)
+	{
+		int type = read_int(in);
+		if(type != TRIANGLE && type != RECTANGLE && type != CIRCLE
+			&& type != PIXMAP && type != TEXTBOX && type != TILEMAP)
+		{
+			throw std::runtime_error("the cache holds an unknown object type");
+		}
+
+		std::shared_ptr<Game_object> pObj = create_game_object((Game_object_type) type);
+		if(!read_int(in)) pObj->never_draw();
+		if(!read_int(in)) pObj->never_animate();
+		objects.push_back(pObj);
+	}
+
+	std::vector<std::shared_ptr<Animation_block>> animations;
+	count = read_int(in);
+	for(int i = 0; i < count; i++)
+	{
+		std::string name = read_string(in);
+		int type = read_int(in);
+
+		std::shared_ptr<IValue> pVal;
+		switch(type)
+		{
+			case INT:
+				pVal.reset(new GPLVariant(read_int(in)));
+				break;
+			case DOUBLE:
+				pVal.reset(new GPLVariant(read_double(in)));
+				break;
+			case STRING:
+				pVal.reset(new GPLVariant(read_string(in)));
+				break;
+			case GAME_OBJECT:
+			{
+				int index = read_int(in);
+				if(index < 0 || index >= (int) objects.size())
+					throw std::runtime_error("the cache refers to an unknown object");
+				pVal.reset(new GPLVariant(objects[index]));
+				break;
+			}
+			case ANIMATION_BLOCK:
+			{
+				int line = read_int(in);
+				std::shared_ptr<Symbol> pParam = read_symbol(in);
+				std::shared_ptr<Animation_block> pAnim(
+					new Animation_block(line, pParam, name));
+				animations.push_back(pAnim);
+				pVal.reset(new GPLVariant(pAnim));
+				break;
+			}
+			default:
+				throw std::runtime_error("the cache holds an unknown type");
+		}
+
+		std::shared_ptr<Symbol> pSymbol(new Symbol(name, (Gpl_type) type, pVal));
+		if(!pTable->insert_symbol(pSymbol))
+			throw std::runtime_error("the cache declares " + name + " twice");
+	}
+
+	for(unsigned int i = 0; i < objects.size(); i++)
+	{
+		std::string error;
+		if(!objects[i]->read_snapshot(in, error))
+			throw std::runtime_error(error);
+	}
+
+	for(unsigned int i = 0; i < animations.size(); i++)
+	{
+		count = read_int(in);
+		for(int j = 0; j < count; j++)
+		{
+			animations[i]->insert_statement(Program_cache::read_statement(in));
+		}
+		animations[i]->set_initialized(true);
+	}
+
+	count = read_int(in);
+	for(int i = 0; i < count; i++)
+	{
+		Window::Keystroke key = (Window::Keystroke) read_int(in);
+		std::shared_ptr<statement_block> pHandler
+			= expect<statement_block>(Program_cache::read_statement(in));
+		Event_manager::instance()->add_handler(key, pHandler);
+	}
+}
+
+bool Program_cache::load(const std::string& filename, uint64_t source_hash,
+		std::string& error)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+	{
+		error = "there is no cache";
+		return false;
+	}
+
+	// one read, then everything is checked before the program is built
+	file.seekg(0, std::ios::end);
+	std::string bytes((std::size_t) file.tellg(), '\0');
+	file.seekg(0, std::ios::beg);
+	if(!bytes.empty()) file.read(&bytes[0], bytes.size());
+	std::istringstream header(bytes);
+
+	char magic[sizeof(MAGIC)];
+	header.read(magic, sizeof(magic));
+	if(!header || !std::equal(magic, magic + sizeof(magic), MAGIC))
+	{
+		error = "not a gpl program cache";
+		return false;
+	}
+
+	Snapshot_reader in(header);
+	int version, marker;
+	uint64_t hash, program_hash;
+	if(!in.read_int(version) || version != FORMAT_VERSION
+		|| !in.read_int(marker) || marker != BYTE_ORDER_MARKER)
+	{
+		error = "the cache was written by another version of gpl";
+		return false;
+	}
+	if(!in.read_hash(hash) || hash != source_hash)
+	{
+		error = "the source has changed";
+		return false;
+	}
+	if(!in.read_hash(program_hash)
+		|| Snapshot::hash(bytes.data() + header.tellg(), bytes.size() - header.tellg())
+			!= program_hash)
+	{
+		error = "the cache is damaged";
+		return false;
+	}
+
+	read_program(in);
+	return true;
+}
+
+//==============================================================================
+//	N O D E S
+//==============================================================================
+
+std::shared_ptr<IExpression> Program_cache::read_expression(Snapshot_reader& in)
+{
+	IExpression* pExpr = NULL;
+	switch(read_int(in))
+	{
+		case VALUE_EXPRESSION:
+		{
+			std::shared_ptr<IValue> pVal;
+			switch(read_int(in))
+			{
+				case INT:
+					pVal.reset(new GPLVariant(read_int(in)));
+					break;
+				case DOUBLE:
+					pVal.reset(new GPLVariant(read_double(in)));
+					break;
+				case STRING:
+					pVal.reset(new GPLVariant(read_string(in)));
+					break;
+				default:
+					throw std::runtime_error("the cache holds a constant of an unknown type");
+			}
+			pExpr = new ValueExpression(pVal);
+			break;
+		}
+
+		case MEMBER_EXPRESSION:
+		{
+			std::shared_ptr<Symbol> pSymbol = read_symbol(in);
+			std::shared_ptr<IValue> pVal(new MemberReference(pSymbol, read_string(in)));
+			pExpr = new ValueExpression(pVal);
+			break;
+		}
+
+		case REFERENCE_EXPRESSION:
+			pExpr = new ReferenceExpression(read_symbol(in));
+			break;
+
+		case ARRAY_REFERENCE_EXPRESSION:
+		{
+			std::string array_name = read_string(in);
+			pExpr = new ArrayReferenceExpression(array_name, read_expression(in));
+			break;
+		}
+
+		case ARRAY_MEMBER_REFERENCE_EXPRESSION:
+		{
+			std::string array_name = read_string(in);
+			std::string member_name = read_string(in);
+			pExpr = new ArrayMemberReferenceExpression(array_name, member_name,
+				read_expression(in));
+			break;
+		}
+
+		case INDEXED_MEMBER_REFERENCE_EXPRESSION:
+		{
+			std::string object_name = read_string(in);
+			std::string member_name = read_string(in);
+			pExpr = new IndexedMemberReferenceExpression(object_name, member_name,
+				read_expression(in));
+			break;
+		}
+
+		case OPERATIONAL_EXPRESSION:
+		{
+			Operator_type oper = (Operator_type) read_int(in);
+			int count = read_int(in);
+			if(count != 1 && count != 2)
+				throw std::runtime_error("the cache holds an operator with "
+					+ std::to_string(count) + " operands");
+
+			ExpressionList args;
+			for(int i = 0; i < count; i++)
+			{
+				args.push_back(read_expression(in));
+			}
+
+			// the same as the grammar (see gpl.y)
+			if(count == 2)
+			{
+				switch(oper)
+				{
+					case PLUS: case MINUS: case MULTIPLY: case DIVIDE: case MOD:
+					case AND: case OR:
+					case EQUAL: case NOT_EQUAL:
+					case LESS_THAN: case LESS_THAN_EQUAL:
+					case GREATER_THAN: case GREATER_THAN_EQUAL:
+						pExpr = make_binary_expression(oper, args[0], args[1]);
+						break;
+					default: break;
+				}
+			}
+			else
+			{
+				switch(oper)
+				{
+					case NOT: pExpr = new NotExpression(args[0]); break;
+					case SIN: pExpr = new SinExpression(args[0]); break;
+					case COS: pExpr = new CosExpression(args[0]); break;
+					case TAN: pExpr = new TanExpression(args[0]); break;
+					case ASIN: pExpr = new AsinExpression(args[0]); break;
+					case ACOS: pExpr = new AcosExpression(args[0]); break;
+					case ATAN: pExpr = new AtanExpression(args[0]); break;
+					case SQRT: pExpr = new SqrtExpression(args[0]); break;
+					case FLOOR: pExpr = new FloorExpression(args[0]); break;
+					case ABS: pExpr = new AbsoluteExpression(args[0]); break;
+					case RANDOM: pExpr = new RandomExpression(args[0]); break;
+					default: break;
+				}
+			}
+
+			if(!pExpr)
+				throw std::runtime_error("the cache holds an unknown operator");
+			break;
+		}
+
+		case TOUCHES_EXPRESSION:
+		{
+			std::shared_ptr<IVariableExpression> pLHS = read_variable(in);
+			pExpr = new TouchesExpression(pLHS, read_variable(in));
+			break;
+		}
+
+		case NEAR_EXPRESSION:
+		{
+			std::shared_ptr<IVariableExpression> pLHS = read_variable(in);
+			pExpr = new NearExpression(pLHS, read_variable(in));
+			break;
+		}
+
+		case SPAWN_EXPRESSION:
+			pExpr = new SpawnExpression(read_string(in));
+			break;
+
+		default:
+			throw std::runtime_error("the cache holds an unknown expression");
+	}
+
+	return std::shared_ptr<IExpression>(pExpr);
+}
+
+std::shared_ptr<gpl_statement> Program_cache::read_statement(Snapshot_reader& in)
+{
+	int kind = read_int(in);
+	int line = read_int(in);
+
+	gpl_statement* pStatement = NULL;
+	switch(kind)
+	{
+		case STATEMENT_BLOCK:
+		{
+			std::shared_ptr<statement_block> pBlock(new statement_block(line));
+			int count = read_int(in);
+			for(int i = 0; i < count; i++)
+			{
+				pBlock->insert_statement(read_statement(in));
+			}
+			return pBlock;
+		}
+
+		case IF_STATEMENT:
+		{
+			std::shared_ptr<IExpression> pCondition = read_expression(in);
+			std::shared_ptr<gpl_statement> pThen = read_statement(in);
+			std::shared_ptr<gpl_statement> pElse;
+			if(read_int(in)) pElse = read_statement(in);
+			pStatement = new if_statement(line, pCondition, pThen, pElse);
+			break;
+		}
+
+		case PRINT_STATEMENT:
+			pStatement = new print_statement(line, read_expression(in));
+			break;
+
+		case EXIT_STATEMENT:
+			pStatement = new exit_statement(line, read_expression(in));
+			break;
+
+		case SPAWN_STATEMENT:
+		{
+			bool bSpawn = read_int(in) != 0;
+			pStatement = new spawn_statement(line, read_expression(in), bSpawn);
+			break;
+		}
+
+		case ASSIGN_STATEMENT:
+		{
+			std::shared_ptr<IVariableExpression> pLHS = read_variable(in);
+			Assignment_type oper = (Assignment_type) read_int(in);
+			if(oper != ASSIGN && oper != ADD_ASSIGN && oper != SUBTRACT_ASSIGN)
+				throw std::runtime_error("the cache holds an unknown assignment");
+			pStatement = new assign_statement(line, pLHS, oper, read_expression(in));
+			break;
+		}
+
+		case FOR_STATEMENT:
+		{
+			std::shared_ptr<assign_statement> pInit
+				= expect<assign_statement>(read_statement(in));
+			std::shared_ptr<IExpression> pCondition = read_expression(in);
+			std::shared_ptr<assign_statement> pIncrement
+				= expect<assign_statement>(read_statement(in));
+			std::shared_ptr<statement_block> pBody
+				= expect<statement_block>(read_statement(in));
+			pStatement = new for_statement(line, pInit, pCondition, pIncrement, pBody);
+			break;
+		}
+
+		default:
+			throw std::runtime_error("the cache holds an unknown statement");
+	}
+
+	return std::shared_ptr<gpl_statement>(pStatement);
+}
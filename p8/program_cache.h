@@ -0,0 +1,90 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class IExpression;
+class gpl_statement;
+class Snapshot_writer;
+class Snapshot_reader;
+
+/***
+ A Program_cache is a gpl program after it has been parsed and checked,
+ in a binary file next to its source ("program.gpl" -> "program.gplc"):
+
+	every game object, in the order of the declarations, with the member
+	values its declaration gave it (the same as in a snapshot, see
+	snapshot.h)
+	every symbol in the symbol table
+	the statements of every animation block and event handler
+
+ gpl writes the cache after every successful parse and, the next time it
+ runs the same program, builds the program from the cache instead of
+ running the parser (gpl -no_cache does neither). The cache remembers a
+ hash of the program's source and is ignored once the source changes.
+ A program whose declarations call random() is never cached: its values
+ depend on the seed of the run.
+
+ Expressions and statements write themselves (IExpression::write(),
+ gpl_statement::write()) as a Node_kind followed by their operands and
+ children; read_expression() and read_statement() build them again
+ through their constructors, so the type checks and the loop
+ optimizations of the parser run as before.
+
+ The file is the MAGIC string, the FORMAT_VERSION, a marker for the byte
+ order, the source hash, a hash of the rest of the file, then the
+ program. The whole file is read and checked before anything is built,
+ so a damaged cache is ignored like a stale one.
+***/
+
+class Program_cache
+{
+public:
+	static const char MAGIC[8];
+	static const int FORMAT_VERSION = 1;
+
+	enum Node_kind
+	{
+		// expressions
+		VALUE_EXPRESSION,
+		MEMBER_EXPRESSION,
+		REFERENCE_EXPRESSION,
+		ARRAY_REFERENCE_EXPRESSION,
+		ARRAY_MEMBER_REFERENCE_EXPRESSION,
+		INDEXED_MEMBER_REFERENCE_EXPRESSION,
+		OPERATIONAL_EXPRESSION,
+		TOUCHES_EXPRESSION,
+		NEAR_EXPRESSION,
+		SPAWN_EXPRESSION,
+
+		// statements
+		STATEMENT_BLOCK,
+		IF_STATEMENT,
+		PRINT_STATEMENT,
+		EXIT_STATEMENT,
+		SPAWN_STATEMENT,
+		ASSIGN_STATEMENT,
+		FOR_STATEMENT
+	};
+
+	// the name of the cache of the given source file
+	static std::string cache_filename(const std::string& source_filename);
+
+	// returns false and sets error if the program cannot be cached
+	static bool save(const std::string& filename, uint64_t source_hash,
+			std::string& error);
+
+	// returns false and sets error if the cache is missing, stale or
+	// damaged; nothing has been built then and the program must be parsed.
+	// Throws if the program cannot be built from a cache that is intact
+	static bool load(const std::string& filename, uint64_t source_hash,
+			std::string& error);
+
+	// throw std::runtime_error if the input is not a valid node
+	static std::shared_ptr<IExpression> read_expression(Snapshot_reader& in);
+	static std::shared_ptr<gpl_statement> read_statement(Snapshot_reader& in);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "random_stream.h"
+#include "interpreter_context.h"
+#include "snapshot.h"
+
+thread_local Random_stream* Random_stream::_pCurrent = nullptr;
+
+// splitmix64, to spread the seed and the id over the state
+static uint64_t mix(uint64_t& x)
+{
+	uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+// the id of a named stream is a hash of the name
+static uint64_t name_id(const std::string& name)
+{
+	return Snapshot::hash(name.data(), name.size());
+}
+
+//==============================================================================
+
+Random_stream::Random_stream()
+{
+	start(state().seed, name_id(""));
+}
+
+Random_stream::Random_stream(const std::string& name)
+{
+	start(state().seed, name_id(name));
+}
+
+Random_stream::Random_stream(uint64_t seed, uint64_t id)
+{
+	start(seed, id);
+}
+
+void Random_stream::start(uint64_t seed, uint64_t id)
+{
+	uint64_t x = seed;
+	uint64_t y = id;
+	x ^= mix(y);
+	for(int i = 0; i < 4; i++)
+		_state[i] = mix(x);
+	_count = 0;
+}
+
+uint64_t Random_stream::next()
+{
+	_count++;
+	uint64_t result = rotl(_state[1] * 5, 7) * 9;
+	uint64_t t = _state[1] << 17;
+
+	_state[2] ^= _state[0];
+	_state[3] ^= _state[1];
+	_state[1] ^= _state[2];
+	_state[0] ^= _state[3];
+	_state[2] ^= t;
+	_state[3] = rotl(_state[3], 45);
+
+	return result;
+}
+
+// Lemire's multiply and shift; the division is only needed for the few
+// numbers that would make the result biased
+int Random_stream::uniform(int bound)
+{
+	uint32_t range = (uint32_t) bound;
+	uint64_t m = (next() >> 32) * range;
+	uint32_t low = (uint32_t) m;
+	if(low < range)
+	{
+		uint32_t threshold = -range % range;
+		while(low < threshold)
+		{
+			m = (next() >> 32) * range;
+			low = (uint32_t) m;
+		}
+	}
+	return (int) (m >> 32);
+}
+
+void Random_stream::write_snapshot(Snapshot_writer& out) const
+{
+	for(int i = 0; i < 4; i++)
+		out.write_hash(_state[i]);
+	out.write_hash(_count);
+}
+
+bool Random_stream::read_snapshot(Snapshot_reader& in)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		if(!in.read_hash(_state[i])) return false;
+	}
+	return in.read_hash(_count);
+}
+
+void Random_stream::seed(uint64_t seed)
+{
+	State& s = state();
+	s.seed = seed;
+	s.main.start(seed, 0);
+}
+
+Random_stream& Random_stream::main_stream()
+{
+	return state().main;
+}
+
+Random_stream::State& Random_stream::state()
+{
+	return Interpreter_context::current()->get_random_state();
+}
+
+Random_stream& Random_stream::current()
+{
+	return _pCurrent? *_pCurrent : main_stream();
+}
@@ -0,0 +1,102 @@
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+#include <cstdint>
+#include <string>
+
+class Snapshot_writer;
+class Snapshot_reader;
+
+/***
+ A Random_stream is a xoshiro256** generator. Every stream starts from
+ the seed of the run (gpl -s seed) and its own id, so the numbers a
+ stream returns depend only on the seed, the id and how many numbers it
+ was asked for before, never on the other streams:
+
+	stream 0		the main stream (initialization blocks, event
+				handlers)
+	every game object	a stream of its own, with an id made from the
+				name of the variable the object was declared as
+				("ship", "rocks[3]"); random() in an animation
+				block draws from the stream of the object it
+				animates
+
+ A game object's stream is named when its variable is inserted into the
+ symbol table, so the ids do not change when declarations are added,
+ moved or built from the program cache. The state of every stream is
+ part of a snapshot (see snapshot.h).
+
+ random() asks current() for its number. The main stream is current
+ unless a Random_scope made another one current for the thread. The
+ seed and the main stream belong to the program: every
+ Interpreter_context has a State of its own.
+***/
+class Random_stream
+{
+public:
+	// the stream of a game object that has no name yet
+	Random_stream();
+	// the stream of the variable with the given name
+	Random_stream(const std::string& name);
+
+	uint64_t next();
+
+	// how many numbers next() returned since the stream started
+	uint64_t count() const { return _count; };
+
+	// uniform in [0, bound), bound must be > 0
+	int uniform(int bound);
+
+	// the state of the generator; read_snapshot() returns false if the
+	// snapshot is truncated
+	void write_snapshot(Snapshot_writer& out) const;
+	bool read_snapshot(Snapshot_reader& in);
+
+	// before any stream but the main one is created (gpl.cpp::main())
+	static void seed(uint64_t seed);
+
+	static Random_stream& main_stream();
+	static Random_stream& current();
+
+	// the seed and the main stream of a program
+	struct State;
+
+private:
+	Random_stream(uint64_t seed, uint64_t id);
+	void start(uint64_t seed, uint64_t id);
+
+	// the State of the current Interpreter_context
+	static State& state();
+
+	uint64_t _state[4];
+	uint64_t _count;
+
+	static thread_local Random_stream* _pCurrent;
+
+	friend class Random_scope;
+};
+
+struct Random_stream::State
+{
+	State() : seed(0), main(0, 0) {};
+
+	uint64_t seed;
+	Random_stream main;
+};
+
+// Makes a stream current for the thread in the enclosing scope
+class Random_scope
+{
+public:
+	Random_scope(Random_stream& stream)
+	{
+		_pPrevious = Random_stream::_pCurrent;
+		Random_stream::_pCurrent = &stream;
+	};
+	~Random_scope() { Random_stream::_pCurrent = _pPrevious; };
+
+private:
+	Random_stream* _pPrevious;
+};
+
+#endif
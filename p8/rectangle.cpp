@@ -1,5 +1,8 @@
 #include "rectangle.h"
 #include "gpl_assert.h"
+#include "geometry_cache.h"
+#include "batch_renderer.h"
+#include "software_renderer.h"
 
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
@@ -19,33 +22,62 @@ Rectangle::Rectangle() : Game_object(/* red = */ 1.0,
                                     )
 {
   m_rotation = 0;
-  register_member_variable("rotation", &m_rotation);
   m_object_type_name = "Rectangle";
+  if (begin_member_schema(m_object_type_name))
+    register_member_variable("rotation", &m_rotation);
 }
 
 /* virtual */ void Rectangle::build_display_list()
 {
   assert(m_display_list);
 
+  // must be fetched before glNewList(), the cache may have to compile it
+  GLuint square = Geometry_cache::square();
+
   glNewList(m_display_list, GL_COMPILE);
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
   if (m_rotation != 0)
   {
-    double center_x = m_x + m_w/2.0;
-    double center_y = m_y + m_h/2.0;
+    double center_x = w()/2.0;
+    double center_y = h()/2.0;
     glTranslated(center_x, center_y, 0);
     glRotated(m_rotation, 0, 0, 1);
     glTranslated(-center_x, -center_y, 0);
   }
 
   glColor3f(m_red, m_green, m_blue);
-  glBegin(GL_QUADS);
-    glVertex2i(m_x, m_y);
-    glVertex2i(m_x + m_w, m_y);
-    glVertex2i(m_x + m_w, m_y + m_h);
-    glVertex2i(m_x, m_y + m_h);
-  glEnd();
+  glScaled(w(), h(), 1);
+  glCallList(square);
   glPopMatrix();
   glEndList();
 }
+
+/* virtual */ void Rectangle::get_collision_shape(Collision_shape &shape) const
+{
+  // the same rotation as build_display_list()
+  shape.set_box(x(), y(), w(), h());
+  shape.rotate(m_rotation, x() + w()/2.0, y() + h()/2.0);
+}
+
+/* virtual */ bool Rectangle::append_to_batch(Batch_renderer &batch)
+{
+  // the outline is the rotated rectangle, in world coordinates
+  Collision_shape outline;
+  get_collision_shape(outline);
+
+  batch.set_color(m_red, m_green, m_blue);
+  batch.add_polygon(outline.m_count, outline.m_xs, outline.m_ys);
+  return true;
+}
+
+/* virtual */ void Rectangle::draw_software(Software_renderer &renderer,
+                                           int left, int bottom,
+                                           int right, int top)
+{
+  Collision_shape outline;
+  get_collision_shape(outline);
+
+  renderer.set_color(m_red, m_green, m_blue);
+  renderer.add_polygon(outline.m_count, outline.m_xs, outline.m_ys);
+}
@@ -21,6 +21,10 @@ class Rectangle : public Game_object
     const Rectangle &operator=(const Rectangle &);
 
     virtual void build_display_list();
+    virtual void get_collision_shape(Collision_shape &shape) const;
+    virtual bool append_to_batch(Batch_renderer &batch);
+    virtual void draw_software(Software_renderer &renderer,
+                               int left, int bottom, int right, int top);
 
     double m_rotation;
 
@@ -0,0 +1,114 @@
+#include "runtime_metrics.h"
+#include "interpreter_context.h"
+
+#include <iomanip>
+
+thread_local Runtime_metrics::Counters* Runtime_metrics::_pCounters = nullptr;
+
+Runtime_metrics::Runtime_metrics()
+{
+	_bEnabled = false;
+	_format = CSV;
+	_frame = 0;
+	_animate_ms = _event_ms = _draw_ms = 0;
+	_counters = { 0, 0, 0, 0, 0, 0 };
+	_start = _counters;
+}
+
+Runtime_metrics::~Runtime_metrics()
+{
+	flush();
+}
+
+Runtime_metrics* Runtime_metrics::instance()
+{
+	return &Interpreter_context::current()->get_runtime_metrics();
+}
+
+bool Runtime_metrics::open(const std::string& filename)
+{
+	std::string::size_type dot = filename.rfind('.');
+	std::string ext = (dot == std::string::npos)? "" : filename.substr(dot);
+	_format = (ext == ".jsonl" || ext == ".json")? JSONL : CSV;
+
+	_file.open(filename.c_str(), std::ios::out | std::ios::trunc);
+	if(!_file) return false;
+
+	_pending.reserve(FLUSH_INTERVAL);
+	_bEnabled = true;
+	write_header();
+
+	// don't charge the setup above to the first frame
+	_start = _counters;
+	return true;
+}
+
+void Runtime_metrics::end_frame()
+{
+	if(!_bEnabled) return;
+
+	Frame_record rec;
+	rec.frame = _frame++;
+	rec.animate_ms = _animate_ms;
+	rec.event_ms = _event_ms;
+	rec.draw_ms = _draw_ms;
+	rec.statements = _counters.statements - _start.statements;
+	rec.evals = _counters.evals - _start.evals;
+	rec.allocations = _counters.allocations - _start.allocations;
+	rec.drawn = _counters.drawn - _start.drawn;
+	rec.rebuilt = _counters.rebuilt - _start.rebuilt;
+	rec.moved = _counters.moved - _start.moved;
+	_pending.push_back(rec);
+
+	_animate_ms = _event_ms = _draw_ms = 0;
+	_start = _counters;
+
+	if(_pending.size() >= (size_t)FLUSH_INTERVAL) flush();
+}
+
+void Runtime_metrics::flush()
+{
+	if(!_bEnabled) return;
+
+	for(std::vector<Frame_record>::const_iterator it = _pending.begin();
+			it != _pending.end(); it++)
+	{
+		write_record(*it);
+	}
+	_pending.clear();
+	_file.flush();
+}
+
+void Runtime_metrics::write_header()
+{
+	if(_format == CSV)
+	{
+		_file << "frame,animate_ms,event_ms,draw_ms,statements,evals,"
+			<< "allocations,drawn,rebuilt,moved" << std::endl;
+	}
+	_file << std::fixed << std::setprecision(3);
+}
+
+void Runtime_metrics::write_record(const Frame_record& rec)
+{
+	if(_format == CSV)
+	{
+		_file << rec.frame << ',' << rec.animate_ms << ',' << rec.event_ms << ','
+			<< rec.draw_ms << ',' << rec.statements << ',' << rec.evals << ','
+			<< rec.allocations << ',' << rec.drawn << ',' << rec.rebuilt << ','
+			<< rec.moved << '\n';
+	}
+	else
+	{
+		_file << "{\"frame\":" << rec.frame
+			<< ",\"animate_ms\":" << rec.animate_ms
+			<< ",\"event_ms\":" << rec.event_ms
+			<< ",\"draw_ms\":" << rec.draw_ms
+			<< ",\"statements\":" << rec.statements
+			<< ",\"evals\":" << rec.evals
+			<< ",\"allocations\":" << rec.allocations
+			<< ",\"drawn\":" << rec.drawn
+			<< ",\"rebuilt\":" << rec.rebuilt
+			<< ",\"moved\":" << rec.moved << "}\n";
+	}
+}
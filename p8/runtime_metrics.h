@@ -0,0 +1,147 @@
+#ifndef RUNTIME_METRICS_H
+#define RUNTIME_METRICS_H
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/***
+ Runtime_metrics records what the interpreter did during each frame:
+
+	animate_ms	time spent in the animation blocks
+	event_ms	time spent in the event handlers
+	draw_ms		time spent drawing
+	statements	statements executed
+	evals		expression nodes evaluated
+	allocations	values allocated by the interpreter (IValue::operator
+			new), the results of eval() among them
+	drawn		objects drawn
+	rebuilt		display lists rebuilt
+	moved		x or y changes (they move the object without a rebuild)
+
+ The counters are always on; they are plain increments in the hot path.
+ Every Interpreter_context has a Runtime_metrics of its own; the
+ counters of the current one are reached through a thread_local pointer
+ rather than through the context, since they are bumped on every eval.
+ A thread that has no current context (no Interpreter_context::Scope)
+ counts nothing; counters() may only be called with one.
+ When a metrics file is opened (gpl -metrics filename) every frame is
+ appended to it as a line of CSV, or JSON if the file name ends in
+ .jsonl or .json. Frames are buffered in memory and formatted in
+ batches, so the file is only touched every FLUSH_INTERVAL frames.
+***/
+class Runtime_metrics
+{
+public:
+	enum Format
+	{
+		CSV,
+		JSONL
+	};
+
+	struct Counters
+	{
+		unsigned long statements;
+		unsigned long evals;
+		unsigned long allocations;
+		unsigned long drawn;
+		unsigned long rebuilt;
+		unsigned long moved;
+	};
+
+	struct Frame_record
+	{
+		unsigned long frame;
+		double animate_ms, event_ms, draw_ms;
+		unsigned long statements, evals, allocations, drawn, rebuilt, moved;
+	};
+
+	static const int FLUSH_INTERVAL = 256;
+
+	// the metrics of the current Interpreter_context
+	static Runtime_metrics* instance();
+	virtual ~Runtime_metrics();
+
+	// hot path
+	static void count_statement() { if(_pCounters) _pCounters->statements++; };
+	static void count_eval() { if(_pCounters) _pCounters->evals++; };
+	static void count_drawn() { if(_pCounters) _pCounters->drawn++; };
+	static void count_rebuilt() { if(_pCounters) _pCounters->rebuilt++; };
+	static void count_moved() { if(_pCounters) _pCounters->moved++; };
+	static void count_allocation() { if(_pCounters) _pCounters->allocations++; };
+
+	// returns false if the file could not be opened
+	bool open(const std::string& filename);
+	bool is_enabled() const { return _bEnabled; };
+	Format get_format() const { return _format; };
+
+	void add_animate_time(double ms) { _animate_ms += ms; };
+	void add_event_time(double ms) { _event_ms += ms; };
+	void add_draw_time(double ms) { _draw_ms += ms; };
+
+	// takes a snapshot of the counters as the record of the frame
+	// that just finished, and starts the next one
+	void end_frame();
+
+	// writes any buffered frames out to the file
+	void flush();
+
+	// the counters of the current Interpreter_context
+	static Counters& counters() { assert(_pCounters); return *_pCounters; };
+
+protected:
+	Runtime_metrics();
+
+private:
+	void write_header();
+	void write_record(const Frame_record& rec);
+
+	static thread_local Counters* _pCounters;
+	Counters _counters;
+
+	bool _bEnabled;
+	Format _format;
+	std::ofstream _file;
+	std::vector<Frame_record> _pending;
+
+	unsigned long _frame;
+	double _animate_ms, _event_ms, _draw_ms;
+
+	// counter values at the start of the current frame
+	Counters _start;
+
+	// one per Interpreter_context, which sets _pCounters
+	friend class Interpreter_context;
+};
+
+// Adds the time spent in the enclosing scope to one of the
+// Runtime_metrics timers, but only when metrics are being written
+class Metrics_timer
+{
+public:
+	typedef void (Runtime_metrics::*Timer)(double);
+
+	Metrics_timer(Timer timer)
+	{
+		_timer = timer;
+		_bEnabled = Runtime_metrics::instance()->is_enabled();
+		if(_bEnabled) _begin = std::chrono::steady_clock::now();
+	};
+
+	~Metrics_timer()
+	{
+		if(!_bEnabled) return;
+		std::chrono::duration<double, std::milli> elapsed
+			= std::chrono::steady_clock::now() - _begin;
+		(Runtime_metrics::instance()->*_timer)(elapsed.count());
+	};
+
+private:
+	Timer _timer;
+	bool _bEnabled;
+	std::chrono::steady_clock::time_point _begin;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "scene.h"
+#include "gpl_assert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+int Scene::add(Game_object *obj)
+{
+  int slot = size();
+
+  objects.push_back(obj);
+  x.push_back(0);
+  y.push_back(0);
+  w.push_back(0);
+  h.push_back(0);
+  visible.push_back(1);
+  drawing_order.push_back(0);
+  should_draw.push_back(1);
+  active.push_back(1);
+  cullable.push_back(1);
+  right.push_back(0);
+  top.push_back(0);
+  draw_mask.push_back(0);
+
+  return slot;
+}
+
+Game_object *Scene::remove(int slot)
+{
+  assert(slot >= 0 && slot < size());
+
+  int last = size() - 1;
+  Game_object *moved = 0;
+  if (slot != last)
+  {
+    moved = objects[last];
+    objects[slot] = objects[last];
+    x[slot] = x[last];
+    y[slot] = y[last];
+    w[slot] = w[last];
+    h[slot] = h[last];
+    visible[slot] = visible[last];
+    drawing_order[slot] = drawing_order[last];
+    should_draw[slot] = should_draw[last];
+    active[slot] = active[last];
+    cullable[slot] = cullable[last];
+    right[slot] = right[last];
+    top[slot] = top[last];
+    draw_mask[slot] = draw_mask[last];
+  }
+
+  objects.pop_back();
+  x.pop_back();
+  y.pop_back();
+  w.pop_back();
+  h.pop_back();
+  visible.pop_back();
+  drawing_order.pop_back();
+  should_draw.pop_back();
+  active.pop_back();
+  cullable.pop_back();
+  right.pop_back();
+  top.pop_back();
+  draw_mask.pop_back();
+
+  return moved;
+}
+
+void Scene::update_bounds()
+{
+  int n = size();
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i vx = _mm_loadu_si128((const __m128i *) &x[i]);
+    __m128i vy = _mm_loadu_si128((const __m128i *) &y[i]);
+    __m128i vw = _mm_loadu_si128((const __m128i *) &w[i]);
+    __m128i vh = _mm_loadu_si128((const __m128i *) &h[i]);
+    _mm_storeu_si128((__m128i *) &right[i], _mm_add_epi32(vx, vw));
+    _mm_storeu_si128((__m128i *) &top[i], _mm_add_epi32(vy, vh));
+  }
+#endif
+
+  for (; i < n; i++)
+  {
+    right[i] = x[i] + w[i];
+    top[i] = y[i] + h[i];
+  }
+}
+
+void Scene::update_draw_mask(int left, int bottom, int right_edge, int top_edge)
+{
+  int n = size();
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i vleft = _mm_set1_epi32(left);
+  const __m128i vbottom = _mm_set1_epi32(bottom);
+  const __m128i vright = _mm_set1_epi32(right_edge);
+  const __m128i vtop = _mm_set1_epi32(top_edge);
+
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i vx = _mm_loadu_si128((const __m128i *) &x[i]);
+    __m128i vy = _mm_loadu_si128((const __m128i *) &y[i]);
+    __m128i vr = _mm_loadu_si128((const __m128i *) &right[i]);
+    __m128i vt = _mm_loadu_si128((const __m128i *) &top[i]);
+    __m128i margin = _mm_srai_epi32(
+        _mm_add_epi32(_mm_loadu_si128((const __m128i *) &w[i]),
+                      _mm_loadu_si128((const __m128i *) &h[i])), 1);
+
+    // all ones in the lanes that are completely off screen
+    __m128i off = _mm_or_si128(
+        _mm_or_si128(_mm_cmpgt_epi32(_mm_sub_epi32(vx, margin), vright),
+                     _mm_cmpgt_epi32(vleft, _mm_add_epi32(vr, margin))),
+        _mm_or_si128(_mm_cmpgt_epi32(_mm_sub_epi32(vy, margin), vtop),
+                     _mm_cmpgt_epi32(vbottom, _mm_add_epi32(vt, margin))));
+    __m128i cull = _mm_andnot_si128(
+        _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) &cullable[i]), zero),
+        off);
+
+    // all ones in the lanes where any of the flags is 0
+    __m128i hidden = _mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) &should_draw[i]), zero),
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) &active[i]), zero)),
+        _mm_or_si128(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) &visible[i]), zero),
+            cull));
+
+    _mm_storeu_si128((__m128i *) &draw_mask[i], _mm_andnot_si128(hidden, one));
+  }
+#endif
+
+  for (; i < n; i++)
+  {
+    int margin = (w[i] + h[i]) >> 1;
+    bool off = x[i] - margin > right_edge || right[i] + margin < left
+               || y[i] - margin > top_edge || top[i] + margin < bottom;
+    draw_mask[i] = should_draw[i] && active[i] && visible[i]
+                   && !(cullable[i] && off);
+  }
+}
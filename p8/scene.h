@@ -0,0 +1,82 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+/****
+
+  class Scene holds the fields of every Game_object that the per-frame
+  passes read, one array per field (structure of arrays):
+
+      x, y, w, h, visible, drawing_order, should_draw, active
+
+  Each Game_object owns one slot (the same index in every array).  The
+  object reads and writes its fields through that index, so a pass over
+  all objects walks a few dense arrays instead of chasing a pointer to
+  each object.
+
+  Slots are kept dense: when an object is deleted the last slot is moved
+  into the hole (remove() returns the object that moved so it can update
+  its index).
+
+  Passes
+
+    update_bounds()       right = x + w, top = y + h for every slot
+    update_draw_mask()    draw_mask[i] is 1 if slot i should be drawn:
+                          should_draw, active, visible and on screen
+
+  The passes process four slots at a time with SSE2 when it is
+  available, and fall back to plain loops otherwise.
+
+****/
+
+#include <vector>
+
+class Game_object;
+
+class Scene
+{
+  public:
+    Scene() {}
+
+    // returns the new slot
+    int add(Game_object *obj);
+
+    // moves the last slot into slot; returns the object that was moved
+    // (0 if slot was the last one)
+    Game_object *remove(int slot);
+
+    int size() const {return (int) objects.size();}
+
+    void update_bounds();
+
+    // rotated objects can extend past their w and h, so each box is
+    // grown by half of (w + h) before it is tested against the screen
+    void update_draw_mask(int left, int bottom, int right_edge, int top_edge);
+
+    // the fields, indexed by slot
+    std::vector<int> x;
+    std::vector<int> y;
+    std::vector<int> w;
+    std::vector<int> h;
+    std::vector<int> visible;
+    std::vector<int> drawing_order;
+    std::vector<int> should_draw;
+    std::vector<int> active;
+
+    // an object whose w and h are not known until it is drawn
+    // (e.g. a Textbox) is never culled
+    std::vector<int> cullable;
+
+    // written by the passes
+    std::vector<int> right;
+    std::vector<int> top;
+    std::vector<int> draw_mask;
+
+    std::vector<Game_object *> objects;
+
+  private:
+    // disable default copy constructor and default assignment
+    Scene(const Scene &);
+    const Scene &operator=(const Scene &);
+};
+
+#endif // #ifndef SCENE_H
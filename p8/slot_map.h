@@ -0,0 +1,116 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+/****
+
+  class Slot_map keeps pointers to objects that are referred to by a
+  Slot_handle instead of by pointer.  A handle is the index of the
+  object's slot plus the generation of the slot when the object was
+  inserted:
+
+      insert(obj)     O(1), reuses the slot of an erased object if there is
+                      one, returns the object's handle
+      erase(handle)   O(1), frees the slot and bumps its generation, so
+                      the handle (and every copy of it) goes stale
+      get(handle)     O(1), the object, 0 if the handle is stale
+
+  A list of handles can outlive the objects in it: a handle of an erased
+  object is simply skipped (or dropped) when the list is walked, so an
+  object does not have to be found in every list that refers to it when
+  it goes away.
+
+  Generations start at 1; the default Slot_handle (generation 0) never
+  refers to anything.  A generation wraps around after 2^32 objects have
+  used the same slot, which no gpl program lives long enough to do.
+
+****/
+
+#include <stdint.h>
+#include <vector>
+#include "gpl_assert.h"
+
+class Slot_handle
+{
+  public:
+    Slot_handle() {m_index = 0; m_generation = 0;}
+    Slot_handle(uint32_t index, uint32_t generation)
+     {m_index = index; m_generation = generation;}
+
+    bool operator==(const Slot_handle &other) const
+     {return m_index == other.m_index && m_generation == other.m_generation;}
+    bool operator!=(const Slot_handle &other) const
+     {return !(*this == other);}
+
+    uint32_t m_index;
+    uint32_t m_generation;
+};
+
+template <class T>
+class Slot_map
+{
+  public:
+    Slot_map() {m_size = 0;}
+
+    Slot_handle insert(T *obj)
+    {
+      uint32_t index;
+      if (m_free.empty())
+      {
+        index = m_slots.size();
+        m_slots.push_back(Slot());
+      }
+      else
+      {
+        index = m_free.back();
+        m_free.pop_back();
+      }
+
+      m_slots[index].m_object = obj;
+      m_size++;
+      return Slot_handle(index, m_slots[index].m_generation);
+    }
+
+    void erase(Slot_handle handle)
+    {
+      assert(get(handle));
+
+      Slot &slot = m_slots[handle.m_index];
+      slot.m_object = 0;
+      if (++slot.m_generation == 0)
+        slot.m_generation = 1;
+      m_free.push_back(handle.m_index);
+      m_size--;
+    }
+
+    T *get(Slot_handle handle) const
+    {
+      if (handle.m_index >= m_slots.size()
+          || m_slots[handle.m_index].m_generation != handle.m_generation)
+        return 0;
+      return m_slots[handle.m_index].m_object;
+    }
+
+    bool contains(Slot_handle handle) const {return get(handle) != 0;}
+
+    // the number of objects in the map
+    int size() const {return m_size;}
+
+  private:
+    class Slot
+    {
+      public:
+        Slot() {m_object = 0; m_generation = 1;}
+        T *m_object;
+        uint32_t m_generation;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;  // the indices of the empty slots
+    int m_size;
+
+    // disable default copy constructor and default assignment
+    Slot_map(const Slot_map &);
+    const Slot_map &operator=(const Slot_map &);
+};
+
+#endif // #ifndef SLOT_MAP_H
@@ -0,0 +1,140 @@
+#include "snapshot.h"
+#include "symbol_table.h"
+#include "animation_block.h"
+#include "random_stream.h"
+
+#include <algorithm>
+
+// a longer string means the file is corrupt
+static const int MAX_STRING_SIZE = 1 << 24;
+
+static const int BYTE_ORDER_MARKER = 0x01020304;
+
+const char Snapshot::MAGIC[8] = { 'G', 'P', 'L', 'S', 'N', 'A', 'P', '\n' };
+
+//==============================================================================
+
+void Snapshot_writer::write_string(const std::string& val)
+{
+	write_int((int) val.size());
+	write_raw(val.data(), val.size());
+}
+
+//==============================================================================
+
+bool Snapshot_reader::read_string(std::string& val)
+{
+	int size;
+	if(!read_int(size) || size < 0 || size > MAX_STRING_SIZE) return false;
+
+	val.resize(size);
+	if(size == 0) return true;
+	return read_raw(&val[0], size);
+}
+
+std::shared_ptr<Animation_block> Snapshot_reader::find_animation_block
+		(const std::string& name) const
+{
+	std::shared_ptr<Animation_block> pAnim;
+	std::shared_ptr<Symbol> pSymbol = Symbol_table::instance()->find_symbol(name);
+	if(pSymbol && pSymbol->get_type() == ANIMATION_BLOCK)
+		pSymbol->get_animation_block(pAnim);
+	return pAnim;
+}
+
+//==============================================================================
+
+uint64_t Snapshot::hash_file(const std::string& filename)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file) return 0;
+
+	file.seekg(0, std::ios::end);
+	std::string bytes((std::size_t) file.tellg(), '\0');
+	file.seekg(0, std::ios::beg);
+	if(!bytes.empty()) file.read(&bytes[0], bytes.size());
+	return hash(bytes.data(), bytes.size());
+}
+
+uint64_t Snapshot::hash(const char* bytes, std::size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(std::size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char) bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool Snapshot::save(const std::string& filename, uint64_t source_hash,
+		std::string& error)
+{
+	std::ofstream file(filename.c_str(),
+		std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file)
+	{
+		error = "cannot open the file";
+		return false;
+	}
+
+	file.write(MAGIC, sizeof(MAGIC));
+	Snapshot_writer out(file);
+	out.write_int(FORMAT_VERSION);
+	out.write_int(BYTE_ORDER_MARKER);
+	out.write_hash(source_hash);
+	Random_stream::main_stream().write_snapshot(out);
+	Symbol_table::instance()->write_snapshot(out);
+
+	if(!out.good())
+	{
+		error = "write failed";
+		return false;
+	}
+	return true;
+}
+
+bool Snapshot::restore(const std::string& filename, uint64_t source_hash,
+		std::string& error)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+	{
+		error = "cannot open the file";
+		return false;
+	}
+
+	char magic[sizeof(MAGIC)];
+	file.read(magic, sizeof(magic));
+	if(!file || !std::equal(magic, magic + sizeof(magic), MAGIC))
+	{
+		error = "not a gpl snapshot";
+		return false;
+	}
+
+	Snapshot_reader in(file);
+	int version, marker;
+	uint64_t hash;
+	if(!in.read_int(version) || version != FORMAT_VERSION)
+	{
+		error = "unsupported snapshot version";
+		return false;
+	}
+	if(!in.read_int(marker) || marker != BYTE_ORDER_MARKER)
+	{
+		error = "the snapshot was written on a machine with a different byte order";
+		return false;
+	}
+	if(!in.read_hash(hash) || hash != source_hash)
+	{
+		error = "the snapshot was taken from a different program";
+		return false;
+	}
+
+	if(!Random_stream::main_stream().read_snapshot(in))
+	{
+		error = "the snapshot is truncated";
+		return false;
+	}
+	return Symbol_table::instance()->read_snapshot(in, error);
+}
@@ -0,0 +1,95 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+class Animation_block;
+
+/***
+ A Snapshot is the runtime state of a gpl program in a binary file:
+
+	every symbol in the symbol table (the elements of an array are
+	symbols of their own: "a[0]", "a[1]", ...)
+	every game object: all its member variables (including
+	drawing_order and the animation_block it is bound to, by name),
+	the elements of its indexed members (e.g. a Tilemap's tile[]),
+	whether it is spawned and the state of its random stream
+	the state of the main random stream (see random_stream.h)
+
+ 	gpl -save_snapshot file program.gpl	writes it when the program quits
+ 	gpl -restore file program.gpl		starts from it
+
+ The code of the program (animation blocks, event handlers) is not in
+ the snapshot, so -restore still parses the program; it then overwrites
+ the values the declarations set up with the ones in the snapshot and
+ does not run the initialization blocks. The snapshot remembers a hash
+ of the program's source and can only be restored into the same
+ program.
+
+ The file is the MAGIC string, the FORMAT_VERSION, a marker for the byte
+ order, the source hash, the main random stream, then the symbols.
+ Numbers are written in the byte order of the machine that wrote them.
+***/
+
+class Snapshot_writer
+{
+public:
+	Snapshot_writer(std::ostream& os) : _os(os) {};
+
+	void write_int(int val) { write_raw(&val, sizeof(val)); };
+	void write_double(double val) { write_raw(&val, sizeof(val)); };
+	void write_hash(uint64_t val) { write_raw(&val, sizeof(val)); };
+	void write_string(const std::string& val);
+
+	bool good() const { return _os.good(); };
+
+private:
+	void write_raw(const void* data, std::size_t size)
+		{ _os.write((const char*) data, size); };
+
+	std::ostream& _os;
+};
+
+class Snapshot_reader
+{
+public:
+	Snapshot_reader(std::istream& is) : _is(is) {};
+
+	// all return false once the input is exhausted or corrupt
+	bool read_int(int& val) { return read_raw(&val, sizeof(val)); };
+	bool read_double(double& val) { return read_raw(&val, sizeof(val)); };
+	bool read_hash(uint64_t& val) { return read_raw(&val, sizeof(val)); };
+	bool read_string(std::string& val);
+
+	// the animation block declared with the given name, null if there
+	// is none
+	std::shared_ptr<Animation_block> find_animation_block(const std::string& name) const;
+
+private:
+	bool read_raw(void* data, std::size_t size)
+		{ _is.read((char*) data, size); return _is.good(); };
+
+	std::istream& _is;
+};
+
+class Snapshot
+{
+public:
+	static const char MAGIC[8];
+	static const int FORMAT_VERSION = 2;
+
+	// FNV-1a of the bytes of the file, 0 if it can't be read
+	static uint64_t hash_file(const std::string& filename);
+	static uint64_t hash(const char* bytes, std::size_t size);
+
+	// both return false and set error if something went wrong
+	static bool save(const std::string& filename, uint64_t source_hash,
+			std::string& error);
+	static bool restore(const std::string& filename, uint64_t source_hash,
+			std::string& error);
+};
+
+#endif
@@ -0,0 +1,494 @@
+#include "software_renderer.h"
+#include "stroke_font.h"
+#include "gpl_assert.h"
+#include "interpreter_context.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+/* static */ Software_renderer *Software_renderer::instance()
+{
+  return &Interpreter_context::current()->get_software_renderer();
+}
+
+Software_renderer::Software_renderer()
+{
+  m_enabled = false;
+  m_width = 0;
+  m_height = 0;
+  m_tile_columns = 0;
+  m_tile_rows = 0;
+  set_clear_color(0, 0, 0);
+  set_color(1, 1, 1);
+  set_view(0, 0, 1);
+  m_frame = 0;
+  m_busy_workers = 0;
+  m_next_tile = 0;
+  m_pipelined = false;
+  m_snapshot_pending = false;
+  m_stopping = false;
+  resize(1, 1);
+}
+
+Software_renderer::~Software_renderer()
+{
+  finish();
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+    lock_guard<mutex> pipeline_lock(m_pipeline_mutex);
+    m_stopping = true;
+  }
+  m_frame_started.notify_all();
+  m_pipeline_changed.notify_all();
+
+  for (unsigned int i = 0; i < m_threads.size(); i++)
+    m_threads[i].join();
+  if (m_render_thread.joinable())
+    m_render_thread.join();
+}
+
+static unsigned char to_byte(double value)
+{
+  if (value <= 0)
+    return 0;
+  if (value >= 1)
+    return 255;
+  return (unsigned char) (value * 255 + 0.5);
+}
+
+void Software_renderer::resize(int width, int height)
+{
+  assert(width > 0 && height > 0);
+  finish();
+  m_width = width;
+  m_height = height;
+  m_pixels.assign(width * height * 3, 0);
+
+  m_tile_columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+  m_tile_rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+  m_tile_primitives.assign(m_tile_columns * m_tile_rows, vector<int>());
+}
+
+void Software_renderer::set_clear_color(double red, double green, double blue)
+{
+  m_clear_color[0] = to_byte(red);
+  m_clear_color[1] = to_byte(green);
+  m_clear_color[2] = to_byte(blue);
+}
+
+void Software_renderer::set_color(double red, double green, double blue)
+{
+  m_color[0] = to_byte(red);
+  m_color[1] = to_byte(green);
+  m_color[2] = to_byte(blue);
+}
+
+void Software_renderer::set_view(double camera_x, double camera_y, double zoom)
+{
+  m_camera_x = camera_x;
+  m_camera_y = camera_y;
+  m_zoom = zoom;
+}
+
+void Software_renderer::begin_frame()
+{
+  m_primitives.clear();
+}
+
+bool Software_renderer::add(Primitive &primitive,
+                            double left, double bottom,
+                            double right, double top)
+{
+  primitive.m_left = max(0, (int) floor(left));
+  primitive.m_bottom = max(0, (int) floor(bottom));
+  primitive.m_right = min(m_width, (int) ceil(right) + 1);
+  primitive.m_top = min(m_height, (int) ceil(top) + 1);
+  if (primitive.m_left >= primitive.m_right
+      || primitive.m_bottom >= primitive.m_top)
+    return false;
+
+  for (int i = 0; i < 3; i++)
+    primitive.m_color[i] = m_color[i];
+  m_primitives.push_back(primitive);
+  return true;
+}
+
+void Software_renderer::add_polygon(int count, const double *xs, const double *ys)
+{
+  assert(count == 3 || count == 4);
+
+  Primitive p;
+  p.m_kind = Primitive::POLYGON;
+  p.m_count = count;
+  for (int i = 0; i < count; i++)
+  {
+    p.m_xs[i] = to_pixel_x(xs[i]);
+    p.m_ys[i] = to_pixel_y(ys[i]);
+  }
+  add(p, *min_element(p.m_xs, p.m_xs + count),
+         *min_element(p.m_ys, p.m_ys + count),
+         *max_element(p.m_xs, p.m_xs + count),
+         *max_element(p.m_ys, p.m_ys + count));
+}
+
+void Software_renderer::add_disk(double center_x, double center_y, double radius)
+{
+  Primitive p;
+  p.m_kind = Primitive::DISK;
+  p.m_count = 1;
+  p.m_xs[0] = to_pixel_x(center_x);
+  p.m_ys[0] = to_pixel_y(center_y);
+  p.m_radius = radius * m_zoom;
+  add(p, p.m_xs[0] - p.m_radius, p.m_ys[0] - p.m_radius,
+         p.m_xs[0] + p.m_radius, p.m_ys[0] + p.m_radius);
+}
+
+void Software_renderer::add_line(double x0, double y0, double x1, double y1)
+{
+  Primitive p;
+  p.m_kind = Primitive::LINE;
+  p.m_count = 2;
+  p.m_xs[0] = to_pixel_x(x0);
+  p.m_ys[0] = to_pixel_y(y0);
+  p.m_xs[1] = to_pixel_x(x1);
+  p.m_ys[1] = to_pixel_y(y1);
+  add(p, min(p.m_xs[0], p.m_xs[1]), min(p.m_ys[0], p.m_ys[1]),
+         max(p.m_xs[0], p.m_xs[1]), max(p.m_ys[0], p.m_ys[1]));
+}
+
+void Software_renderer::add_image(const unsigned char *data, int data_width,
+                                  int src_x, int src_y, int width, int height,
+                                  double x, double y)
+{
+  Primitive p;
+  p.m_kind = Primitive::IMAGE;
+  p.m_count = 1;
+  p.m_xs[0] = to_pixel_x(x);
+  p.m_ys[0] = to_pixel_y(y);
+  p.m_data = data;
+  p.m_data_width = data_width;
+  p.m_src_x = src_x;
+  p.m_src_y = src_y;
+  p.m_width = width;
+  p.m_height = height;
+  p.m_scale = m_zoom;
+  add(p, p.m_xs[0], p.m_ys[0],
+         p.m_xs[0] + width * m_zoom, p.m_ys[0] + height * m_zoom);
+}
+
+void Software_renderer::add_character(char c, double x, double y, double size)
+{
+  double cell = Stroke_font::cell() * size;
+  const char *strokes = Stroke_font::strokes(c);
+
+  // each point is two digits, a '|' ends the polyline
+  bool have_point = false;
+  double last_x = 0;
+  double last_y = 0;
+  for (const char *s = strokes; *s; )
+  {
+    if (*s == '|')
+    {
+      have_point = false;
+      s++;
+      continue;
+    }
+    assert(s[1]);
+    double point_x = x + (s[0] - '0') * cell;
+    double point_y = y + (s[1] - '0') * cell;
+    if (have_point)
+      add_line(last_x, last_y, point_x, point_y);
+    last_x = point_x;
+    last_y = point_y;
+    have_point = true;
+    s += 2;
+  }
+}
+
+void Software_renderer::end_frame()
+{
+  // the snapshot can't be replaced while it is being drawn
+  finish();
+  m_snapshot.swap(m_primitives);
+
+  if (!m_pipelined)
+  {
+    draw_snapshot();
+    return;
+  }
+
+  // the render thread lives as long as the renderer
+  if (!m_render_thread.joinable())
+    m_render_thread = thread(&Software_renderer::render_loop, this);
+
+  {
+    lock_guard<mutex> lock(m_pipeline_mutex);
+    m_snapshot_pending = true;
+  }
+  m_pipeline_changed.notify_all();
+}
+
+void Software_renderer::finish()
+{
+  unique_lock<mutex> lock(m_pipeline_mutex);
+  m_pipeline_changed.wait(lock, [this] {return !m_snapshot_pending;});
+}
+
+void Software_renderer::render_loop()
+{
+  while (true)
+  {
+    {
+      unique_lock<mutex> lock(m_pipeline_mutex);
+      m_pipeline_changed.wait(lock,
+                              [this] {return m_snapshot_pending || m_stopping;});
+      if (m_stopping)
+        return;
+    }
+
+    draw_snapshot();
+
+    {
+      lock_guard<mutex> lock(m_pipeline_mutex);
+      m_snapshot_pending = false;
+    }
+    m_pipeline_changed.notify_all();
+  }
+}
+
+void Software_renderer::draw_snapshot()
+{
+  // sort the primitives into the tiles they touch
+  for (unsigned int tile = 0; tile < m_tile_primitives.size(); tile++)
+    m_tile_primitives[tile].clear();
+
+  for (unsigned int i = 0; i < m_snapshot.size(); i++)
+  {
+    const Primitive &p = m_snapshot[i];
+    int last_column = (p.m_right - 1) / TILE_SIZE;
+    int last_row = (p.m_top - 1) / TILE_SIZE;
+    for (int row = p.m_bottom / TILE_SIZE; row <= last_row; row++)
+      for (int column = p.m_left / TILE_SIZE; column <= last_column; column++)
+        m_tile_primitives[row * m_tile_columns + column].push_back(i);
+  }
+
+  if (m_threads.empty())
+    start_threads();
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_next_tile = 0;
+    m_busy_workers = (int) m_threads.size();
+    m_frame++;
+  }
+  m_frame_started.notify_all();
+
+  // this thread draws tiles too (the render thread, if pipelined)
+  draw_tiles();
+
+  unique_lock<mutex> lock(m_mutex);
+  m_frame_done.wait(lock, [this] {return m_busy_workers == 0;});
+}
+
+void Software_renderer::start_threads()
+{
+  // one thread per core, counting the one calling end_frame()
+  int count = (int) thread::hardware_concurrency() - 1;
+  count = min(count, m_tile_columns * m_tile_rows - 1);
+  // the threads live as long as the renderer
+  for (int i = 0; i < count; i++)
+    m_threads.push_back(thread(&Software_renderer::worker, this));
+}
+
+void Software_renderer::worker()
+{
+  unsigned long last_frame = 0;
+  while (true)
+  {
+    {
+      unique_lock<mutex> lock(m_mutex);
+      m_frame_started.wait(lock,
+                           [&] {return m_frame != last_frame || m_stopping;});
+      if (m_stopping)
+        return;
+      last_frame = m_frame;
+    }
+
+    draw_tiles();
+
+    lock_guard<mutex> lock(m_mutex);
+    if (--m_busy_workers == 0)
+      m_frame_done.notify_one();
+  }
+}
+
+void Software_renderer::draw_tiles()
+{
+  int tile_count = m_tile_columns * m_tile_rows;
+  int tile;
+  while ((tile = m_next_tile++) < tile_count)
+    draw_tile(tile);
+}
+
+void Software_renderer::draw_tile(int tile)
+{
+  int left = (tile % m_tile_columns) * TILE_SIZE;
+  int bottom = (tile / m_tile_columns) * TILE_SIZE;
+  int right = min(left + TILE_SIZE, m_width);
+  int top = min(bottom + TILE_SIZE, m_height);
+
+  for (int y = bottom; y < top; y++)
+  {
+    unsigned char *pixel = &m_pixels[(y * m_width + left) * 3];
+    for (int x = left; x < right; x++, pixel += 3)
+    {
+      pixel[0] = m_clear_color[0];
+      pixel[1] = m_clear_color[1];
+      pixel[2] = m_clear_color[2];
+    }
+  }
+
+  const vector<int> &primitives = m_tile_primitives[tile];
+  for (unsigned int i = 0; i < primitives.size(); i++)
+  {
+    const Primitive &p = m_snapshot[primitives[i]];
+
+    // the part of the primitive in this tile
+    int l = max(left, p.m_left);
+    int b = max(bottom, p.m_bottom);
+    int r = min(right, p.m_right);
+    int t = min(top, p.m_top);
+
+    switch (p.m_kind)
+    {
+      case Primitive::POLYGON: draw_polygon(p, l, b, r, t); break;
+      case Primitive::DISK: draw_disk(p, l, b, r, t); break;
+      case Primitive::LINE: draw_line(p, l, b, r, t); break;
+      case Primitive::IMAGE: draw_image(p, l, b, r, t); break;
+    }
+  }
+}
+
+void Software_renderer::draw_polygon(const Primitive &p, int left, int bottom,
+                                     int right, int top)
+{
+  for (int y = bottom; y < top; y++)
+  {
+    double center_y = y + 0.5;
+    unsigned char *pixel = &m_pixels[(y * m_width + left) * 3];
+    for (int x = left; x < right; x++, pixel += 3)
+    {
+      double center_x = x + 0.5;
+
+      // inside a convex polygon: on the same side of every edge
+      // (either winding)
+      bool positive = false;
+      bool negative = false;
+      for (int i = 0; i < p.m_count; i++)
+      {
+        int j = (i + 1) % p.m_count;
+        double cross = (p.m_xs[j] - p.m_xs[i]) * (center_y - p.m_ys[i])
+                       - (p.m_ys[j] - p.m_ys[i]) * (center_x - p.m_xs[i]);
+        if (cross > 0) positive = true;
+        if (cross < 0) negative = true;
+      }
+      if (positive && negative)
+        continue;
+
+      pixel[0] = p.m_color[0];
+      pixel[1] = p.m_color[1];
+      pixel[2] = p.m_color[2];
+    }
+  }
+}
+
+void Software_renderer::draw_disk(const Primitive &p, int left, int bottom,
+                                  int right, int top)
+{
+  double radius_squared = p.m_radius * p.m_radius;
+  for (int y = bottom; y < top; y++)
+  {
+    double dy = y + 0.5 - p.m_ys[0];
+    unsigned char *pixel = &m_pixels[(y * m_width + left) * 3];
+    for (int x = left; x < right; x++, pixel += 3)
+    {
+      double dx = x + 0.5 - p.m_xs[0];
+      if (dx * dx + dy * dy > radius_squared)
+        continue;
+
+      pixel[0] = p.m_color[0];
+      pixel[1] = p.m_color[1];
+      pixel[2] = p.m_color[2];
+    }
+  }
+}
+
+void Software_renderer::draw_line(const Primitive &p, int left, int bottom,
+                                  int right, int top)
+{
+  // step one pixel at a time along the longer axis
+  double dx = p.m_xs[1] - p.m_xs[0];
+  double dy = p.m_ys[1] - p.m_ys[0];
+  int steps = (int) ceil(max(fabs(dx), fabs(dy)));
+  if (steps < 1)
+    steps = 1;
+
+  for (int i = 0; i <= steps; i++)
+  {
+    int x = (int) floor(p.m_xs[0] + dx * i / steps);
+    int y = (int) floor(p.m_ys[0] + dy * i / steps);
+    if (x < left || x >= right || y < bottom || y >= top)
+      continue;
+
+    unsigned char *pixel = &m_pixels[(y * m_width + x) * 3];
+    pixel[0] = p.m_color[0];
+    pixel[1] = p.m_color[1];
+    pixel[2] = p.m_color[2];
+  }
+}
+
+void Software_renderer::draw_image(const Primitive &p, int left, int bottom,
+                                   int right, int top)
+{
+  for (int y = bottom; y < top; y++)
+  {
+    int row = (int) floor((y + 0.5 - p.m_ys[0]) / p.m_scale);
+    if (row < 0 || row >= p.m_height)
+      continue;
+
+    const unsigned char *source
+      = p.m_data + ((p.m_src_y + row) * p.m_data_width + p.m_src_x) * 4;
+    unsigned char *pixel = &m_pixels[(y * m_width + left) * 3];
+    for (int x = left; x < right; x++, pixel += 3)
+    {
+      int column = (int) floor((x + 0.5 - p.m_xs[0]) / p.m_scale);
+      if (column < 0 || column >= p.m_width)
+        continue;
+
+      // BGRA, the transparent pixels have an alpha of 0
+      const unsigned char *texel = source + column * 4;
+      if (texel[3] == 0)
+        continue;
+
+      pixel[0] = texel[2];
+      pixel[1] = texel[1];
+      pixel[2] = texel[0];
+    }
+  }
+}
+
+void Software_renderer::dump_pixels(const char *filename)
+{
+  assert(filename);
+  finish();
+
+  FILE *file = fopen(filename, "w");
+  assert(file);
+
+  // top row first
+  for (int y = m_height - 1; y >= 0; y--)
+    fwrite(&m_pixels[y * m_width * 3], 1, m_width * 3, file);
+  fclose(file);
+}
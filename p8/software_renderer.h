@@ -0,0 +1,218 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+/****
+
+  Software_renderer draws the game objects without OpenGL
+  (gpl -backend software), for machines without a display or a GPU.
+
+  The objects are drawn into an RGB framebuffer in memory that is the
+  size of the window (row 0 is the bottom row, the same as OpenGL):
+
+    begin_frame()      forget last frame's shapes
+    add_...()          each object adds its shapes, in world coordinates
+                       (Game_object::draw_software())
+    end_frame()        clear the framebuffer and draw the shapes
+
+  The shapes are transformed to pixels with the camera (set_view()) as
+  they are added.  end_frame() splits the framebuffer into tiles of
+  TILE_SIZE x TILE_SIZE pixels, makes a list of the shapes that touch
+  each tile, and draws the tiles in parallel on a pool of threads.
+  Shapes are drawn in the order they were added (drawing order), so a
+  tile never needs anything from another tile.
+
+  The shapes are those of the OpenGL drawing:
+
+    polygon     a convex polygon of 3 or 4 vertices (Rectangle, Triangle)
+    disk        (Circle) -- exact, no tessellation
+    image       BGRA pixels, alpha 0 is transparent (Pixmap, Tilemap)
+    line        one pixel wide (the strokes of a Textbox's characters,
+                see stroke_font.h)
+
+  A pixel belongs to a shape if its center is inside of it.
+
+  Pipelined mode (gpl -backend software -pipeline)
+
+  The shapes of a frame are a complete, immutable record of what the
+  frame looks like (positions and sizes in pixels, colors, drawing
+  order).  end_frame() swaps them into a second list (the snapshot) and,
+  in pipelined mode, returns right away: a render thread draws the
+  snapshot while the interpreter animates the next frame and adds its
+  shapes to the first list.  A frame then takes about
+  max(animate, draw) instead of animate + draw.  end_frame() waits if
+  the previous snapshot is still being drawn, so the picture is never
+  more than one frame behind.  Call finish() before reading the
+  framebuffer.
+
+****/
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class Software_renderer
+{
+  public:
+    // the software renderer of the current Interpreter_context
+    static Software_renderer *instance();
+    ~Software_renderer();
+
+    static const int TILE_SIZE = 64;
+
+    void set_enabled(bool enabled) {m_enabled = enabled;}
+    bool enabled() const {return m_enabled;}
+
+    void set_pipelined(bool pipelined) {m_pipelined = pipelined;}
+    bool pipelined() const {return m_pipelined;}
+
+    void resize(int width, int height);
+    int width() const {return m_width;}
+    int height() const {return m_height;}
+
+    void set_clear_color(double red, double green, double blue);
+
+    // the world point (camera_x, camera_y) is the lower left corner,
+    // one world unit is zoom pixels
+    void set_view(double camera_x, double camera_y, double zoom);
+
+    void begin_frame();
+
+    // the color of the shapes added after this
+    void set_color(double red, double green, double blue);
+
+    // a convex polygon of 3 or 4 vertices
+    void add_polygon(int count, const double *xs, const double *ys);
+    void add_disk(double center_x, double center_y, double radius);
+    void add_line(double x0, double y0, double x1, double y1);
+
+    // the width x height pixels of data (an image data_width pixels wide,
+    // BGRA, bottom row first) starting at (src_x, src_y), with the lower
+    // left corner at (x, y).  The data must not change until end_frame()
+    void add_image(const unsigned char *data, int data_width,
+                   int src_x, int src_y, int width, int height,
+                   double x, double y);
+
+    // a character of the stroke font with its origin at (x, y)
+    // (the same as glutStrokeCharacter() scaled by size)
+    void add_character(char c, double x, double y, double size);
+
+    void end_frame();
+
+    // waits until the last frame has been drawn (pipelined mode)
+    void finish();
+
+    // RGB, 3 bytes per pixel, bottom row first (see finish())
+    const unsigned char *pixels() const {return &m_pixels[0];}
+
+    // the same format as Window::dump_pixels(): RGB, top row first
+    void dump_pixels(const char *filename);
+
+  private:
+    Software_renderer();
+
+    struct Primitive
+    {
+      enum Kind {POLYGON, DISK, LINE, IMAGE};
+      Kind m_kind;
+      unsigned char m_color[3];
+
+      // the pixels that might be drawn, [left, right) x [bottom, top)
+      int m_left, m_bottom, m_right, m_top;
+
+      // POLYGON (m_count vertices), LINE (2 vertices), IMAGE (1: the
+      // lower left corner), in pixels
+      int m_count;
+      double m_xs[4];
+      double m_ys[4];
+
+      // DISK, in pixels
+      double m_radius;
+
+      // IMAGE
+      const unsigned char *m_data;
+      int m_data_width;
+      int m_src_x, m_src_y;
+      int m_width, m_height;
+      double m_scale;   // pixels per image pixel
+    };
+
+    // converts world to pixel coordinates
+    double to_pixel_x(double x) const {return (x - m_camera_x) * m_zoom;}
+    double to_pixel_y(double y) const {return (y - m_camera_y) * m_zoom;}
+
+    // clips the bounding box to the framebuffer, returns false (and
+    // does not add the primitive) if nothing is left
+    bool add(Primitive &primitive,
+             double left, double bottom, double right, double top);
+
+    void draw_snapshot();
+    void render_loop();
+
+    void start_threads();
+    void worker();
+    void draw_tiles();
+    void draw_tile(int tile);
+
+    void draw_polygon(const Primitive &p, int left, int bottom,
+                      int right, int top);
+    void draw_disk(const Primitive &p, int left, int bottom,
+                   int right, int top);
+    void draw_line(const Primitive &p, int left, int bottom,
+                   int right, int top);
+    void draw_image(const Primitive &p, int left, int bottom,
+                    int right, int top);
+
+    bool m_enabled;
+    int m_width;
+    int m_height;
+    std::vector<unsigned char> m_pixels;
+    unsigned char m_clear_color[3];
+    unsigned char m_color[3];
+
+    double m_camera_x;
+    double m_camera_y;
+    double m_zoom;
+
+    // the frame being added to, and the frame being drawn
+    std::vector<Primitive> m_primitives;
+    std::vector<Primitive> m_snapshot;
+
+    // the primitives of the snapshot that touch each tile, in drawing order
+    int m_tile_columns;
+    int m_tile_rows;
+    std::vector<std::vector<int> > m_tile_primitives;
+
+    // the thread pool: end_frame() bumps m_frame and wakes the workers,
+    // every thread (end_frame() too) takes tiles from m_next_tile until
+    // they are gone
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_frame_started;
+    std::condition_variable m_frame_done;
+    unsigned long m_frame;
+    int m_busy_workers;
+    std::atomic<int> m_next_tile;
+
+    // pipelined mode: end_frame() sets m_snapshot_pending, the render
+    // thread draws the snapshot and clears it
+    bool m_pipelined;
+    std::thread m_render_thread;
+    std::mutex m_pipeline_mutex;
+    std::condition_variable m_pipeline_changed;
+    bool m_snapshot_pending;
+
+    // the threads wait for work until the renderer is destroyed
+    bool m_stopping;
+
+    // one per Interpreter_context
+    friend class Interpreter_context;
+
+    // disable default copy constructor and default assignment
+    // done as a precaution, they should never be called
+    Software_renderer(const Software_renderer &);
+    const Software_renderer &operator=(const Software_renderer &);
+};
+
+#endif // #ifndef SOFTWARE_RENDERER_H
@@ -0,0 +1,85 @@
+#include "stroke_font.h"
+#include <cctype>
+using namespace std;
+
+// the polylines of the printable characters from ' ' to '_'
+// (the lower case letters are drawn as capitals)
+static const char *glyphs[] =
+{
+  "",                           // ' '
+  "2226|2021",                  // '!'
+  "1615|3635",                  // '"'
+  "1016|3036|0242|0444",        // '#'
+  "460603434000|2026",          // '$'
+  "0046|0516|3041",             // '%'
+  "",                           // '&'
+  "2625",                       // '''
+  "36242230",                   // '('
+  "16242210",                   // ')'
+  "1135|1531|0343",             // '*'
+  "1333|2224",                  // '+'
+  "2110",                       // ','
+  "1333",                       // '-'
+  "2021",                       // '.'
+  "0046",                       // '/'
+  "0040460600|0046",            // '0'
+  "152620|1030",                // '1'
+  "05163645440040",             // '2'
+  "06464000|1343",              // '3'
+  "30360242",                   // '4'
+  "4606043443413000",           // '5'
+  "460600404303",               // '6'
+  "064610",                     // '7'
+  "0040460600|0343",            // '8'
+  "430306464000",               // '9'
+  "2021|2425",                  // ':'
+  "2110|2425",                  // ';'
+  "450341",                     // '<'
+  "0242|0444",                  // '='
+  "054301",                     // '>'
+  "05163645442322|2021",        // '?'
+  "",                           // '@'
+  "002640|1333",                // 'A'
+  "00063645443303|3342413000",  // 'B'
+  "46060040",                   // 'C'
+  "00062644422000",             // 'D'
+  "46060040|0333",              // 'E'
+  "460600|0333",                // 'F'
+  "45460600404323",             // 'G'
+  "0006|4046|0343",             // 'H'
+  "1636|2620|1030",             // 'I'
+  "46400002",                   // 'J'
+  "0006|4602|1340",             // 'K'
+  "060040",                     // 'L'
+  "0006244640",                 // 'M'
+  "00064046",                   // 'N'
+  "0040460600",                 // 'O'
+  "0006464303",                 // 'P'
+  "0040460600|2240",            // 'Q'
+  "0006464303|1340",            // 'R'
+  "460603434000",               // 'S'
+  "0646|2620",                  // 'T'
+  "06004046",                   // 'U'
+  "062046",                     // 'V'
+  "0610233046",                 // 'W'
+  "0046|0640",                  // 'X'
+  "0623|4623|2320",             // 'Y'
+  "06460040",                   // 'Z'
+  "36161030",                   // '['
+  "0640",                       // backslash
+  "16363010",                   // ']'
+  "",                           // '^'
+  "0040"                        // '_'
+};
+
+static_assert(sizeof(glyphs) / sizeof(glyphs[0]) == '_' - ' ' + 1,
+              "one glyph per character from ' ' to '_'");
+
+/* static */ const char *Stroke_font::strokes(char c)
+{
+  if (c >= 'a' && c <= 'z')
+    c = toupper(c);
+  if (c < ' ' || c > '_')
+    return "";
+  return glyphs[c - ' '];
+}
@@ -0,0 +1,37 @@
+#ifndef STROKE_FONT_H
+#define STROKE_FONT_H
+
+/****
+
+  Stroke_font is a small line font for drawing a Textbox without GLUT
+  (see software_renderer.h).  It is measured in the same units as
+  GLUT_STROKE_ROMAN: capitals are about HEIGHT units high, so
+  "size = 0.1" gives characters about 10 pixels high with either backend.
+
+  Each character is a few polylines on a grid GRID_WIDTH x GRID_HEIGHT
+  cells, every character is ADVANCE cells wide (the font is monospaced).
+  Lower case letters are drawn as capitals, characters that are not in
+  the font are drawn as blanks.
+
+****/
+
+class Stroke_font
+{
+  public:
+    static const int HEIGHT = 100;
+    static const int GRID_WIDTH = 4;
+    static const int GRID_HEIGHT = 6;
+    static const int ADVANCE = 5;
+
+    // font units per grid cell
+    static double cell() {return (double) HEIGHT / GRID_HEIGHT;}
+
+    // the width of c, in font units (like glutStrokeWidth())
+    static double width(char c) {return ADVANCE * cell();}
+
+    // the polylines of c: pairs of digits (x, y) are points on the grid,
+    // '|' starts a new polyline.  Never 0 ("" for a blank)
+    static const char *strokes(char c);
+};
+
+#endif // #ifndef STROKE_FONT_H
@@ -8,6 +8,9 @@
 #include "parser.h"
 #include "gpl_exception.h"
 #include "indent.h"
+#include "runtime_metrics.h"
+#include "snapshot.h"
+#include "program_cache.h"
 
 Symbol::Symbol(const std::string& name, const int& val)
 	: IVariable(name, INT)
@@ -470,6 +473,7 @@ Gpl_type ReferenceExpression::get_type() const
 
 std::shared_ptr<IValue> ReferenceExpression::eval() const
 {
+	Runtime_metrics::count_eval();
 	std::shared_ptr<IValue> pVal = std::dynamic_pointer_cast<IValue>(_pRef);
 	if(!pVal) throw undefined_error();
 
@@ -477,3 +481,34 @@ std::shared_ptr<IValue> ReferenceExpression::eval() const
 	return pVal;
 }
 
+void ReferenceExpression::get_variables(VariableSet& vars) const
+{
+	vars.insert(get_storage_name());
+}
+
+std::string ReferenceExpression::get_storage_name() const
+{
+	return storage_name(_pRef);
+}
+
+void ReferenceExpression::write(Snapshot_writer& out) const
+{
+	if(!std::dynamic_pointer_cast<Symbol>(_pRef))
+		throw std::logic_error("ReferenceExpression::write - Not a Symbol");
+
+	out.write_int(Program_cache::REFERENCE_EXPRESSION);
+	out.write_string(_pRef->get_name());
+}
+
+//========================================================================
+
+std::string storage_name(const std::shared_ptr<IValue>& pVal)
+{
+	std::shared_ptr<MemberReference> pMember = std::dynamic_pointer_cast<MemberReference>(pVal);
+	if(pMember) return "." + pMember->get_member_name();
+
+	std::shared_ptr<IVariable> pVar = std::dynamic_pointer_cast<IVariable>(pVal);
+	if(pVar) return pVar->get_name();
+
+	return "";
+}
@@ -43,6 +43,9 @@ public:
 
 	virtual std::ostream& print(std::ostream& os) const;
 
+	// where an int or double symbol keeps its value (see jit.h)
+	void* get_address() const { return _pvar->get_address(); };
+
 private:
 	bool _bInitialized;
 	std::unique_ptr<GPLVariant> _pvar;
@@ -118,8 +121,16 @@ public:
 	virtual ~ReferenceExpression() {};
 	Gpl_type get_type() const;
 	std::shared_ptr<IValue> eval() const;
+	void write(Snapshot_writer& out) const;
+
+	const std::shared_ptr<IVariable>& get_variable() const { return _pRef; };
+	void get_variables(VariableSet& vars) const;
+	std::string get_storage_name() const;
 private:
 	std::shared_ptr<IVariable> _pRef;
 };
 
+// Returns the storage name (see VariableSet) of a Symbol or MemberReference
+std::string storage_name(const std::shared_ptr<IValue>& pVal);
+
 #endif
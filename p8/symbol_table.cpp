@@ -1,11 +1,12 @@
 #include "symbol_table.h"
 #include "parser.h"
-
-Symbol_table* Symbol_table::_pTable;
+#include "snapshot.h"
+#include "animation_block.h"
+#include "interpreter_context.h"
+#include <cassert>
 
 Symbol_table::Symbol_table()
 {
-	if(!_pTable) _pTable = this;
 }
 
 Symbol_table::~Symbol_table()
@@ -15,8 +16,7 @@ Symbol_table::~Symbol_table()
 
 Symbol_table* Symbol_table::instance()
 {
-	if(!_pTable) _pTable = new Symbol_table();
-	return _pTable;
+	return &Interpreter_context::current()->get_symbol_table();
 }
 
 std::shared_ptr<Symbol> Symbol_table::find_symbol
@@ -37,7 +37,17 @@ bool Symbol_table::insert_symbol(std::shared_ptr<Symbol> pSymbol)
 
 	std::pair<SymbolMap::iterator, bool> result;
 	result = _symbols.insert(std::make_pair(pSymbol->get_name(), pSymbol));
-	return result.second;
+	if(!result.second) return false;
+
+	// an object's random numbers depend on its name, not on how many
+	// objects were created before it (see random_stream.h)
+	std::shared_ptr<Game_object> pObj;
+	if(pSymbol->get_type() == GAME_OBJECT
+		&& pSymbol->get_game_object(pObj) != CONVERSION_ERROR && pObj)
+	{
+		pObj->random_stream() = Random_stream(pSymbol->get_name());
+	}
+	return true;
 }
 
 void Symbol_table::print(std::ostream& out) const
@@ -93,3 +103,140 @@ bool Symbol_table::set(std::string name, int val)
 	ConversionStatus result = pSymbol->set_int(val);
 	return (result != CONVERSION_ERROR);
 }
+
+void Symbol_table::write_snapshot(Snapshot_writer& out) const
+{
+	out.write_int((int) _symbols.size());
+	for(SymbolMap::const_iterator it = _symbols.cbegin(); it != _symbols.cend(); it++)
+	{
+		const std::shared_ptr<Symbol>& pCur = it->second;
+		Gpl_type type = pCur->get_type();
+		out.write_string(pCur->get_name());
+		out.write_int(type);
+
+		switch(type)
+		{
+			case INT:
+			{
+				int val = 0;
+				pCur->get_int(val);
+				out.write_int(val);
+				break;
+			}
+			case DOUBLE:
+			{
+				double val = 0;
+				pCur->get_double(val);
+				out.write_double(val);
+				break;
+			}
+			case STRING:
+			{
+				std::string val;
+				pCur->get_string(val);
+				out.write_string(val);
+				break;
+			}
+			case ANIMATION_BLOCK:
+			{
+				// the code is in the program, only the name is checked
+				std::shared_ptr<Animation_block> pAnim;
+				pCur->get_animation_block(pAnim);
+				out.write_string(pAnim? pAnim->name() : "");
+				break;
+			}
+			case GAME_OBJECT:
+			{
+				std::shared_ptr<Game_object> pObj;
+				pCur->get_game_object(pObj);
+				assert(pObj);
+				pObj->write_snapshot(out);
+				// not in Game_object::write_snapshot(), which the program
+				// cache uses: a cached program starts from the run's seed
+				pObj->random_stream().write_snapshot(out);
+				break;
+			}
+		}
+	}
+}
+
+bool Symbol_table::read_snapshot(Snapshot_reader& in, std::string& error)
+{
+	int count;
+	if(!in.read_int(count))
+	{
+		error = "the snapshot is truncated";
+		return false;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		std::string name;
+		int type;
+		if(!in.read_string(name) || !in.read_int(type))
+		{
+			error = "the snapshot is truncated";
+			return false;
+		}
+
+		std::shared_ptr<Symbol> pSymbol = find_symbol(name);
+		if(!pSymbol || pSymbol->get_type() != type)
+		{
+			error = "the program has no " + gpl_type_to_string((Gpl_type) type)
+				+ " " + name;
+			return false;
+		}
+
+		bool bRead = false;
+		switch(type)
+		{
+			case INT:
+			{
+				int val;
+				bRead = in.read_int(val);
+				if(bRead) pSymbol->set_int(val);
+				break;
+			}
+			case DOUBLE:
+			{
+				double val;
+				bRead = in.read_double(val);
+				if(bRead) pSymbol->set_double(val);
+				break;
+			}
+			case STRING:
+			{
+				std::string val;
+				bRead = in.read_string(val);
+				if(bRead) pSymbol->set_string(val);
+				break;
+			}
+			case ANIMATION_BLOCK:
+			{
+				std::string val;
+				bRead = in.read_string(val);
+				break;
+			}
+			case GAME_OBJECT:
+			{
+				std::shared_ptr<Game_object> pObj;
+				pSymbol->get_game_object(pObj);
+				assert(pObj);
+				if(!pObj->read_snapshot(in, error))
+				{
+					error = name + ": " + error;
+					return false;
+				}
+				bRead = pObj->random_stream().read_snapshot(in);
+				break;
+			}
+		}
+
+		if(!bRead)
+		{
+			error = "the snapshot is truncated";
+			return false;
+		}
+	}
+	return true;
+}
@@ -6,11 +6,16 @@
 #include "value.h"
 #include "symbol.h"
 
+class Snapshot_writer;
+class Snapshot_reader;
+
 class Symbol_table
 {
 public:
 	typedef std::map<std::string, std::shared_ptr<Symbol>> SymbolMap;
 	virtual ~Symbol_table();
+
+	// the symbol table of the current Interpreter_context
 	static Symbol_table* instance();
 
 	// returns null if not found
@@ -25,12 +30,21 @@ public:
 	bool set(std::string name, int val);
 
 	void print(std::ostream&) const;
+
+	const SymbolMap& get_symbols() const { return _symbols; };
+
+	// every symbol and its value (see snapshot.h)
+	void write_snapshot(Snapshot_writer& out) const;
+	// returns false and sets error if the snapshot does not fit the symbols
+	bool read_snapshot(Snapshot_reader& in, std::string& error);
 protected:
 	Symbol_table();
 
 private:
-	static Symbol_table* _pTable;
 	SymbolMap _symbols;
+
+	// one per Interpreter_context
+	friend class Interpreter_context;
 };
 
 #endif
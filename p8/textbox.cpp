@@ -1,5 +1,7 @@
 #include "textbox.h"
 #include "gpl_assert.h"
+#include "software_renderer.h"
+#include "stroke_font.h"
 using namespace std;
 
 std::shared_ptr<Game_object> Textbox::Create()
@@ -16,12 +18,18 @@ Textbox::Textbox() :  Game_object(/* red = */ 0.0,
     m_text = "";
     m_size = 0.1;
     m_space = 10;
-    register_member_variable("text", &m_text); 
-    register_member_variable("size", &m_size); 
-    register_member_variable("space", &m_space); 
     m_object_type_name = "Textbox";
-    m_h = (int) (100 * m_size) + 1;
-    m_w = m_space;
+    if (begin_member_schema(m_object_type_name))
+    {
+      register_member_variable("text", &m_text); 
+      register_member_variable("size", &m_size); 
+      register_member_variable("space", &m_space); 
+    }
+    h() = (int) (100 * m_size) + 1;
+    w() = m_space;
+
+    // the real width is only known once the text has been drawn
+    never_cull();
 }
 
 void
@@ -32,12 +40,12 @@ Textbox::build_display_list()
   glNewList(m_display_list, GL_COMPILE);
   glMatrixMode(GL_MODELVIEW);
   glColor3f(m_red, m_green, m_blue);
-  double cur_x = m_x;
+  double cur_x = 0;
 
   for(unsigned int i = 0; i < m_text.length(); i++)
   {
     glPushMatrix();
-    glTranslated(cur_x, m_y, 0);
+    glTranslated(cur_x, 0, 0);
     glScaled(m_size, m_size, 1);
     glutStrokeCharacter(GLUT_STROKE_ROMAN, m_text[i]);
     glPopMatrix();
@@ -47,6 +55,25 @@ Textbox::build_display_list()
 
 
   // update our height & width in case our size has changed
-  m_h = (int) (100 * m_size) + 1;
-  m_w = (int) cur_x - m_x;
+  h() = (int) (100 * m_size) + 1;
+  w() = (int) cur_x;
+}
+
+// the same layout as build_display_list(), with the stroke font of the
+// software renderer instead of GLUT's
+/* virtual */ void Textbox::draw_software(Software_renderer &renderer,
+                                         int left, int bottom,
+                                         int right, int top)
+{
+  renderer.set_color(m_red, m_green, m_blue);
+  double cur_x = 0;
+
+  for(unsigned int i = 0; i < m_text.length(); i++)
+  {
+    renderer.add_character(m_text[i], x() + cur_x, y(), m_size);
+    cur_x += (Stroke_font::width(m_text[i]) + m_space) * m_size;
+  }
+
+  h() = (int) (100 * m_size) + 1;
+  w() = (int) cur_x;
 }
@@ -25,6 +25,8 @@ class Textbox : public Game_object
   private:
 	Textbox();
     virtual void build_display_list();
+    virtual void draw_software(Software_renderer &renderer,
+                               int left, int bottom, int right, int top);
 
     std::string m_text;
     double m_size;
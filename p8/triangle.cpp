@@ -1,5 +1,8 @@
 #include "triangle.h"
 #include "gpl_assert.h"
+#include "geometry_cache.h"
+#include "batch_renderer.h"
+#include "software_renderer.h"
 using namespace std;
 
 #ifdef __APPLE__
@@ -25,34 +28,46 @@ Triangle::Triangle(): Game_object(/* red = */ 0.0,
     m_size = 10;
     m_rotation = 0;
     m_skew = 1.0;
-    register_member_variable("size", &m_size);
-    register_member_variable("rotation", &m_rotation);
-    register_member_variable("skew", &m_skew);
     m_object_type_name = "Triangle";
 
-    // width and height are derived --> user cannot change them
-    Status status;
-    status = mark_member_variable_as_derived("w");
-    assert(status == OK);
-    status = mark_member_variable_as_derived("h");
-    assert(status == OK);
+    if (begin_member_schema(m_object_type_name))
+    {
+      register_member_variable("size", &m_size);
+      register_member_variable("rotation", &m_rotation);
+      register_member_variable("skew", &m_skew);
+
+      // width and height are derived --> user cannot change them
+      Status status;
+      status = mark_member_variable_as_derived("w");
+      assert(status == OK);
+      status = mark_member_variable_as_derived("h");
+      assert(status == OK);
+    }
+
+    // the scene culls by w and h, so they must be right before the
+    // object is first drawn
+    update_size();
 }
 
 void Triangle::updated(string name)
 {
   m_display_list_dirty = true;
+  if (name == "size" || name == "skew")
+    update_size();
 }
 
 /* virtual */ void Triangle::build_display_list()
 {
   assert(m_display_list);
 
-  double midpoint_x = m_x + m_size/2.0;
-  double top_point_y = 1.118 * m_size * m_skew + m_y;
+  double midpoint_x = m_size/2.0;
+  double top_point_y = 1.118 * m_size * m_skew;
 
   // assume size or skew changed:  recalculate the height and width
-  m_w = m_size;
-  m_h = (int) top_point_y - m_y;
+  update_size();
+
+  // must be fetched before glNewList(), the cache may have to compile it
+  GLuint triangle = Geometry_cache::triangle();
 
   glNewList(m_display_list, GL_COMPILE);
   glMatrixMode(GL_MODELVIEW);
@@ -60,17 +75,58 @@ void Triangle::updated(string name)
   if (m_rotation != 0)
   {
     double center_x = midpoint_x;
-    double center_y = m_y + ((top_point_y - m_y) * .5);
+    double center_y = top_point_y * .5;
     glTranslated(center_x, center_y, 0);
     glRotated(m_rotation, 0, 0, 1);
     glTranslated(-center_x, -center_y, 0);
   }
   glColor3f(m_red, m_green, m_blue);
-  glBegin(GL_TRIANGLES);
-    glVertex2i(m_x, m_y);
-    glVertex2i(m_x + m_size, m_y);
-    glVertex2i((int) midpoint_x, (int) top_point_y);
-  glEnd();
+  glScaled(m_size, top_point_y, 1);
+  glCallList(triangle);
   glPopMatrix();
   glEndList();
 }
+
+/* virtual */ void Triangle::get_collision_shape(Collision_shape &shape) const
+{
+  // the same vertices and rotation as build_display_list()
+  double midpoint_x = x() + m_size/2.0;
+  double top_point_y = 1.118 * m_size * m_skew + y();
+
+  double xs[3] = {(double) x(), (double) x() + m_size, midpoint_x};
+  double ys[3] = {(double) y(), (double) y(), top_point_y};
+  shape.set_polygon(3, xs, ys);
+  shape.rotate(m_rotation, midpoint_x, y() + ((top_point_y - y()) * .5));
+}
+
+void Triangle::update_size()
+{
+  w() = m_size;
+  h() = (int) (1.118 * m_size * m_skew);
+}
+
+/* virtual */ bool Triangle::append_to_batch(Batch_renderer &batch)
+{
+  update_size();
+
+  // the outline is the rotated triangle, in world coordinates
+  Collision_shape outline;
+  get_collision_shape(outline);
+
+  batch.set_color(m_red, m_green, m_blue);
+  batch.add_polygon(outline.m_count, outline.m_xs, outline.m_ys);
+  return true;
+}
+
+/* virtual */ void Triangle::draw_software(Software_renderer &renderer,
+                                          int left, int bottom,
+                                          int right, int top)
+{
+  update_size();
+
+  Collision_shape outline;
+  get_collision_shape(outline);
+
+  renderer.set_color(m_red, m_green, m_blue);
+  renderer.add_polygon(outline.m_count, outline.m_xs, outline.m_ys);
+}
@@ -26,6 +26,13 @@ class Triangle : public Game_object
 
     virtual void updated(std::string name);
     virtual void build_display_list();
+    virtual void get_collision_shape(Collision_shape &shape) const;
+    virtual bool append_to_batch(Batch_renderer &batch);
+    virtual void draw_software(Software_renderer &renderer,
+                               int left, int bottom, int right, int top);
+
+    // w and h are derived from size and skew
+    void update_size();
 
 };
 
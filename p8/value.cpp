@@ -3,6 +3,7 @@
 #include "parser.h"
 #include "game_object.h"
 #include "animation_block.h"
+#include "runtime_metrics.h"
 
 IValue::IValue()
 {}
@@ -20,6 +21,17 @@ IValue::~IValue()
 
 }
 
+void* IValue::operator new(std::size_t size)
+{
+	Runtime_metrics::count_allocation();
+	return ::operator new(size);
+}
+
+void IValue::operator delete(void* p)
+{
+	::operator delete(p);
+}
+
 void IValue::set_type(Gpl_type type)
 {
 	_type = type;
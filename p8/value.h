@@ -1,6 +1,7 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <cstddef>
 #include <memory>
 #include "gpl_type.h"
 
@@ -23,6 +24,11 @@ class IValue
 public:
 	virtual ~IValue();
 
+	// every value the interpreter allocates (the results of eval() among
+	// them) is counted in Runtime_metrics
+	static void* operator new(std::size_t size);
+	static void operator delete(void* p);
+
 	virtual Gpl_type get_type() const;
 	virtual bool is_constant() const;
 
@@ -1,8 +1,13 @@
 #include "window.h"
 #include "symbol_table.h"
 #include "game_object.h"
+#include "geometry_cache.h"
+#include "software_renderer.h"
 #include "event_manager.h"
+#include "frame_scheduler.h"
+#include "runtime_metrics.h"
 #include "gpl_assert.h"
+#include "interpreter_context.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <signal.h>
@@ -18,25 +23,39 @@
 #include <GL/glut.h>
 #endif
 
-extern Window *window;
-
-extern void user_quit_program();
-
-int clock_tick;
+// the window of the current Interpreter_context
+static Window *current_window()
+{
+  return Interpreter_context::current()->get_window();
+}
 
-static Symbol_table *symbol_table = Symbol_table::instance();
-static Event_manager *event_manager = Event_manager::instance();
+/* static */ Window::Backend Window::m_backend = Window::GLUT;
 
 void draw_all_game_objects()
 {
-  glClear(GL_COLOR_BUFFER_BIT);
-  Game_object::draw_all_game_objects();
-  glutSwapBuffers();
+  Window *window = current_window();
+  Software_renderer *software_renderer = Software_renderer::instance();
+  Metrics_timer timer(&Runtime_metrics::add_draw_time);
+  bool software = Window::backend() == Window::SOFTWARE;
+  if (software)
+    software_renderer->begin_frame();
+  else glClear(GL_COLOR_BUFFER_BIT);
+
+  int left, bottom, right, top;
+  window->apply_camera();
+  window->get_view(left, bottom, right, top);
+  Geometry_cache::set_pixel_scale(window->camera_zoom());
+  Game_object::draw_all_game_objects(left, bottom, right, top);
+
+  if (software)
+    software_renderer->end_frame();
+  else glutSwapBuffers();
 }
 
 // if the window is resized, must redraw
 void window_reshape_callback(int width, int height)
 {
+  Window *window = current_window();
   window->set_width(width);
   window->set_height(height);
   draw_all_game_objects();
@@ -51,29 +70,43 @@ void window_visibility_callback(int state)
 
 void draw_callback()
 {
+  Window *window = current_window();
   // only redraw the game objects if one of them has changed
   // Note: if any field of any game object has changed since the last
   // time the screen was drawn, graphics_out_of_date_with_last_rendering()
   // will return true
-  if (Game_object::graphics_out_of_date_with_last_rendering())
+  // moving the camera also requires a redraw
+  bool camera_moved = window->update_camera();
+  if (Game_object::graphics_out_of_date_with_last_rendering() || camera_moved)
   {
     draw_all_game_objects();
   }
 }
 
+void animate_callback()
+{
+  Metrics_timer timer(&Runtime_metrics::add_animate_time);
+  Game_object::animate_all_game_objects();
+}
+
 void timer_callback(int value)
 {
   // cout << "timer_callback()" << endl;
 
-  Game_object::animate_all_game_objects();
-  draw_callback();
+  // the scheduler decides how many animation steps to run and whether
+  // to draw, and how long to wait so the next tick lands on its deadline
+  int delay = Frame_scheduler::instance()->tick(animate_callback, draw_callback);
+
+  // events handled since the last tick are counted in this frame
+  Runtime_metrics::instance()->end_frame();
 
   // glut timer functions must be re-registered each time
-  glutTimerFunc(clock_tick, timer_callback, 0);
+  glutTimerFunc(delay, timer_callback, 0);
 }
 
 void keyboard_callback(unsigned char key, int x, int y)
 {
+  Event_manager *event_manager = Event_manager::instance();
   switch (key)
   {
     case ' ' : event_manager->execute_handlers(Window::SPACE);
@@ -107,13 +140,13 @@ void keyboard_callback(unsigned char key, int x, int y)
          break;
     case 'Q' :
     case 'q' :
-         user_quit_program();
-         exit(0);
+         Interpreter_context::current()->quit();
   }
 }
 
 void special_callback(int key, int x, int y)
 {
+  Event_manager *event_manager = Event_manager::instance();
   switch (key)
   {
     case GLUT_KEY_F1:
@@ -135,6 +168,9 @@ void special_callback(int key, int x, int y)
 }
 void mouse_callback(int button, int state, int x, int y)
 {
+  Window *window = current_window();
+  Symbol_table *symbol_table = Symbol_table::instance();
+  Event_manager *event_manager = Event_manager::instance();
   assert(window != NULL);
   symbol_table->set("mouse_x", x);
   // GLUT origin is top left, gpl origin is bottom right
@@ -158,35 +194,41 @@ void mouse_callback(int button, int state, int x, int y)
 
 void motion_callback(int x, int y)
 {
+  Window *window = current_window();
+  Symbol_table *symbol_table = Symbol_table::instance();
   assert(window != NULL);
   symbol_table->set("mouse_x", x);
   // GLUT origin is top left, gpl origin is bottom right
   symbol_table->set("mouse_y", window->height() - y); 
-  event_manager->execute_handlers(Window::MOUSE_DRAG);
+  Event_manager::instance()->execute_handlers(Window::MOUSE_DRAG);
 }
 
 void passive_motion_callback(int x, int y)
 {
+  Window *window = current_window();
+  Symbol_table *symbol_table = Symbol_table::instance();
   assert(window != NULL);
   symbol_table->set("mouse_x", x);
   // GLUT origin is top left, gpl origin is bottom right
   symbol_table->set("mouse_y", window->height() - y); 
-  event_manager->execute_handlers(Window::MOUSE_MOVE);
+  Event_manager::instance()->execute_handlers(Window::MOUSE_MOVE);
 }
 
 void read_keypresses_from_standard_input_callback()
 {
+  Event_manager *event_manager = Event_manager::instance();
+  std::istream &in = Interpreter_context::current()->in();
   while (true)
   {
     // skip whitespace (except actual spaces, they are legal input)
-    while (isspace(std::cin.peek()) && std::cin.peek() != ' ')
-      std::cin.ignore();
+    while (isspace(in.peek()) && in.peek() != ' ')
+      in.ignore();
 
     char keypress;
-    std::cin.get(keypress);
+    in.get(keypress);
 
     // if there was a problem (such as reaching EOF) stop
-    if (!std::cin.good())
+    if (!in.good())
       break;
 
     switch(keypress)
@@ -214,7 +256,19 @@ void read_keypresses_from_standard_input_callback()
 
   // only call this function the first time we are idle
   // it is assumed that all the commands will have been read by now
-  glutIdleFunc(0);
+  if (Window::backend() == Window::GLUT)
+    glutIdleFunc(0);
+}
+
+/* static */ bool Window::string_to_backend(const std::string &str,
+                                           Backend &backend)
+{
+  if (str == "glut")
+    backend = GLUT;
+  else if (str == "software")
+    backend = SOFTWARE;
+  else return false;
+  return true;
 }
 
 Window::Window(int x, int y, int w, int h, std::string title, int speed,
@@ -222,12 +276,17 @@ Window::Window(int x, int y, int w, int h, std::string title, int speed,
                bool read_keypresses_from_standard_input /* = false */
               )
 {
+  Software_renderer *software_renderer = Software_renderer::instance();
   m_x = x;
   m_y = y;
   m_w = w;
   m_h = h;
+  m_camera_x = 0;
+  m_camera_y = 0;
+  m_camera_zoom = 1.0;
   m_title = title;
   m_read_keypresses_from_standard_input = read_keypresses_from_standard_input;
+  m_frame_limit = 0;
 
   if (speed > 100)
     speed = 100;
@@ -240,8 +299,22 @@ Window::Window(int x, int y, int w, int h, std::string title, int speed,
 
   // special case, low speeds are really slow for debugging
   if (speed <= 10)
-    clock_tick = (11 - speed) * 1000;
-  else clock_tick = ((103 - speed) * (103 - speed))/10;
+    m_clock_tick = (11 - speed) * 1000;
+  else m_clock_tick = ((103 - speed) * (103 - speed))/10;
+
+  // the scheduler holds every tick to this period
+  Frame_scheduler::instance()->set_period(m_clock_tick);
+
+  // without a window the framebuffer stands in for it
+  if (m_backend == SOFTWARE)
+  {
+    software_renderer->resize(m_w, m_h);
+    software_renderer->set_clear_color(red, green, blue);
+    software_renderer->set_enabled(true);
+    update_camera();
+    apply_camera();
+    return;
+  }
 
   // glut can be controlled by command line arguments pass to glutInit().
   // In order to simplify argument parsing in gpl.cpp, command line
@@ -270,7 +343,7 @@ Window::Window(int x, int y, int w, int h, std::string title, int speed,
   glutVisibilityFunc(window_visibility_callback);
 
   glutDisplayFunc(draw_callback);
-  glutTimerFunc(clock_tick, timer_callback, 0);
+  glutTimerFunc(m_clock_tick, timer_callback, 0);
   glutKeyboardFunc(keyboard_callback);
   glutSpecialFunc(special_callback);
 
@@ -278,12 +351,61 @@ Window::Window(int x, int y, int w, int h, std::string title, int speed,
   glutMotionFunc(motion_callback);
   glutPassiveMotionFunc(passive_motion_callback);
 
+  update_camera();
+  apply_camera();
+  glClearColor (red, green, blue, 0.0);
+}
+
+bool Window::update_camera()
+{
+  Symbol_table *symbol_table = Symbol_table::instance();
+  int camera_x = m_camera_x;
+  int camera_y = m_camera_y;
+  double camera_zoom = m_camera_zoom;
+
+  // if there are symbols camera_x, camera_y, camera_zoom, use them
+  symbol_table->get("camera_x", camera_x);
+  symbol_table->get("camera_y", camera_y);
+  symbol_table->get("camera_zoom", camera_zoom);
+
+  // a zoom of 0 (or less) makes no sense, ignore it
+  if (camera_zoom <= 0)
+    camera_zoom = 1.0;
+
+  if (camera_x == m_camera_x && camera_y == m_camera_y
+      && camera_zoom == m_camera_zoom)
+    return false;
+
+  m_camera_x = camera_x;
+  m_camera_y = camera_y;
+  m_camera_zoom = camera_zoom;
+  return true;
+}
+
+void Window::apply_camera()
+{
+  if (m_backend == SOFTWARE)
+  {
+    Software_renderer::instance()->set_view(m_camera_x, m_camera_y, m_camera_zoom);
+    return;
+  }
+
+  // the whole window, even after it has been resized
   glViewport(0, 0, m_w, m_h);
 
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
-  gluOrtho2D(0, m_w, 0, m_h);
-  glClearColor (red, green, blue, 0.0);
+  gluOrtho2D(m_camera_x, m_camera_x + m_w / m_camera_zoom,
+             m_camera_y, m_camera_y + m_h / m_camera_zoom);
+  glMatrixMode(GL_MODELVIEW);
+}
+
+void Window::get_view(int &left, int &bottom, int &right, int &top)
+{
+  left = m_camera_x;
+  bottom = m_camera_y;
+  right = m_camera_x + (int) (m_w / m_camera_zoom + 0.5);
+  top = m_camera_y + (int) (m_h / m_camera_zoom + 0.5);
 }
 
 void Window::set_width(int width)
@@ -291,7 +413,7 @@ void Window::set_width(int width)
   m_w = width;
 
   // if there is a symbol window_width, update it
-  symbol_table->set("window_width", width);
+  Symbol_table::instance()->set("window_width", width);
 }
 
 void Window::set_height(int height)
@@ -299,7 +421,7 @@ void Window::set_height(int height)
   m_h = height;
 
   // if there is a symbol window_height, update it
-  symbol_table->set("window_height", height);
+  Symbol_table::instance()->set("window_height", height);
 }
 
 // dump the current front openGL color buffer to 
@@ -308,6 +430,12 @@ void Window::dump_pixels(const char *dumpwindow_filename)
 {
   assert(dumpwindow_filename);
 
+  if (m_backend == SOFTWARE)
+  {
+    Software_renderer::instance()->dump_pixels(dumpwindow_filename);
+    return;
+  }
+
   // Allocate new byte array, bail if that doesn't happen
   char* pixels = new char[m_w * m_h * 3];
   assert(pixels);
@@ -332,10 +460,46 @@ void Window::dump_pixels(const char *dumpwindow_filename)
 
 void Window::initialize()
 {
-  event_manager->execute_handlers(Window::INITIALIZE);
+  Event_manager::instance()->execute_handlers(Window::INITIALIZE);
 }
 
 void Window::main_loop()
 {
+  // the first deadline is measured from here, not from when the
+  // window was created (initialization can take a while)
+  Frame_scheduler::instance()->start();
+
+  if (m_backend == SOFTWARE)
+  {
+    software_main_loop();
+    return;
+  }
   glutMainLoop();
 }
+
+void Window::set_frame_limit(int frames)
+{
+  m_frame_limit = frames;
+  Frame_scheduler::instance()->set_fixed_step(frames > 0);
+}
+
+// what glutMainLoop() does for the SOFTWARE backend: draw once, handle the
+// keypresses from standard input, then run the clock forever (until the
+// program exits) or for m_frame_limit frames
+void Window::software_main_loop()
+{
+  draw_all_game_objects();
+
+  if (m_read_keypresses_from_standard_input)
+    read_keypresses_from_standard_input_callback();
+
+  for (int frames = 0; !m_frame_limit || frames < m_frame_limit; frames++)
+  {
+    int delay = Frame_scheduler::instance()->tick(animate_callback, draw_callback);
+    Runtime_metrics::instance()->end_frame();
+    if (delay > 0)
+      usleep(delay * 1000);
+  }
+
+  Interpreter_context::current()->quit();
+}
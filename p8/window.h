@@ -17,6 +17,32 @@ It distributes events handed to it by the windowing system by calling
 
     event_manager->execute_handlers(Event_manager::SPACE);
 
+The camera
+
+ The window shows the part of the world that starts at (camera_x, camera_y)
+ (lower left corner) and is window_width/camera_zoom wide and
+ window_height/camera_zoom high.  If the program declares any of
+
+    int camera_x, int camera_y, double camera_zoom
+
+ they are read before each frame is drawn; moving the camera only changes
+ the projection, not the objects.  Objects entirely outside of the view
+ are not drawn.  mouse_x and mouse_y stay in window coordinates.
+
+Backends
+
+ The window is drawn by one of two backends, picked before the window
+ is created (gpl -backend glut|software):
+
+    GLUT       an OpenGL window (the default)
+    SOFTWARE   no window at all: the objects are drawn into a framebuffer
+               in memory by Software_renderer (see software_renderer.h),
+               for machines without a display.  The animation runs on
+               the same clock; keypresses can only come from -stdin, and
+               -dump_pixels writes the framebuffer.  With -pipeline a
+               frame is drawn on another thread while the next one is
+               animated.
+
 How to use class Window
 
  If you provide an class Event_manager which is a singleton and has the member
@@ -64,28 +90,62 @@ class Window
         NUMBER_OF_KEYS = 24 // UPDATE to one more than last one if adding a key!!!
        };
 
+    enum Backend {
+        GLUT,
+        SOFTWARE
+       };
+
+    static void set_backend(Backend backend) {m_backend = backend;}
+    static Backend backend() {return m_backend;}
+    static bool string_to_backend(const std::string &str, Backend &backend);
+
     Window(int x, int y, int w, int h, std::string title, int speed,
            double red, double green, double blue,
            bool read_keypresses_from_standard_input = false);
 
     void initialize();
     void main_loop();
+
+    // with a limit the SOFTWARE backend runs that many frames with a
+    // fixed step (see frame_scheduler.h) and then quits as the q key
+    // does (gpl -frames); 0 runs until the program ends
+    void set_frame_limit(int frames);
+
     int width() {return m_w;}
     int height() {return m_h;}
+    double camera_zoom() {return m_camera_zoom;}
     void set_width(int width);
     void set_height(int height);
 
+    // reads camera_x, camera_y and camera_zoom
+    // returns true if the view changed since the last call
+    bool update_camera();
+
+    // sets up the projection for the current view
+    void apply_camera();
+
+    // the part of the world that is in the window
+    void get_view(int &left, int &bottom, int &right, int &top);
+
     void dump_pixels(const char *dumpwindow_filename);
 
   private:
     void initialize(int argc, char **argv);
+    void software_main_loop();
 
     int m_x;
     int m_y;
     int m_w;
     int m_h;
+    int m_camera_x;
+    int m_camera_y;
+    double m_camera_zoom;
     std::string m_title;
     bool m_read_keypresses_from_standard_input;
+    int m_clock_tick;
+    int m_frame_limit;
+
+    static Backend m_backend;
 
     // disable default copy constructor and default assignment
     // done as a precaution, they should never be called